@@ -182,7 +182,9 @@ make DESTDIR=%{buildroot} install
 %{_libdir}/ugr/libugrgeoplugin_geoip.so
 %{_libdir}/ugr/libugrgeoplugin_mmdb.so
 %{_libdir}/ugr/libugrnoloopplugin.so
+%{_libdir}/ugr/libugrperfrankplugin.so
 %{_libdir}/ugr/libugrauthplugin_python*.so
+%{_libexecdir}/ugr/ugrauthpy_worker*
 %config(noreplace) %{_sysconfdir}/ugr/ugr.conf
 %config(noreplace) %{_sysconfdir}/ugr/conf.d/*
 %if %systemd
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   ExtCacheBackend.hh
+ * @brief  The storage behind the external, shared cache
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef EXTCACHEBACKEND_HH
+#define EXTCACHEBACKEND_HH
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+#include <boost/function.hpp>
+
+
+/// Invoked by mget for each key that was found, with the index of the key in the request.
+/// The value is valid only during the call
+typedef boost::function<void (int idx, const char *val, size_t len)> ExtCacheMgetCallback;
+
+/// The interface of the storage behind ExtCacheHandler. ExtCacheHandler decides
+/// the keys and the encoding of the values, a backend just stores and retrieves them.
+/// All the functions return 0 on success, like the rest of UGR
+class ExtCacheBackend {
+public:
+
+    virtual ~ExtCacheBackend() {};
+
+    /// Set up the backend, reading the config
+    virtual int Init() = 0;
+
+    /// Called periodically, e.g. for housekeeping or to log statistics
+    virtual void Tick(time_t timenow) {};
+
+    /// The name of the backend, for the logs
+    virtual const char *name() = 0;
+
+    /// The biggest value that can be stored, 0 if there is no known limit
+    virtual size_t maxValueSize() { return 0; }
+
+    /// Fetch one value. On success the value is a malloc'ed buffer that the caller frees
+    virtual int get(const std::string &key, char **val, size_t &len) = 0;
+
+    /// Fetch many values at once, invoking cb for each one that is found
+    virtual int mget(const std::vector<std::string> &keys, ExtCacheMgetCallback cb) = 0;
+
+    /// Store a value, replacing any previous one
+    virtual int set(const std::string &key, const char *val, size_t len, time_t expirationtime) = 0;
+
+    /// Remove a value
+    virtual int del(const std::string &key) = 0;
+
+    /// Atomically increment a counter, creating it with the value initial if it does not exist
+    virtual int incr(const std::string &key, uint64_t initial, time_t expirationtime, uint64_t &newval) = 0;
+};
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   ExtCacheBackend_memcached.cc
+ * @brief  External cache backend that talks to a memcached cluster
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "ExtCacheBackend_memcached.hh"
+#include "UgrConfig.hh"
+#include "SimpleDebug.hh"
+
+#include <map>
+#include <string.h>
+#include <unistd.h>
+
+
+/// Milliseconds from a monotonic clock
+static long long extcachepool_nowms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Threads are given their preferred slot round robin, the first time they ask
+static __thread int extcachepool_threadidx = -1;
+static std::atomic<int> extcachepool_nextthreadidx(0);
+
+
+
+ExtCacheMemcachedPool::ExtCacheMemcachedPool(ExtCacheBackendMemcached *o, bool issync):
+    owner(o), sync(issync), slots(0), nslots(0), nconns(0), waitms(0),
+    backoffminms(100), backoffmaxms(30000), nfailures(0), backoffuntil(0),
+    ngets(0), nreuses(0), ncreates(0), ndestroys(0), nwaits(0), ntimeouts(0), nbypasses(0) {
+
+    poolname = sync ? "sync" : "async";
+}
+
+ExtCacheMemcachedPool::~ExtCacheMemcachedPool() {
+    clear();
+    delete[] slots;
+}
+
+void ExtCacheMemcachedPool::Init(int poolsize, int prewarm, int wms, int bminms, int bmaxms) {
+    const char *fname = "ExtCacheMemcachedPool::Init";
+
+    clear();
+    delete[] slots;
+
+    nslots = (poolsize > 0) ? poolsize : 1;
+    slots = new std::atomic<memcached_st *>[nslots];
+    for (int i = 0; i < nslots; i++) slots[i].store(0);
+
+    nconns.store(0);
+    nfailures.store(0);
+    backoffuntil.store(0);
+    waitms = wms;
+    backoffminms = bminms;
+    backoffmaxms = bmaxms;
+
+    // Open some connections now, so that the first requests don't pay for that
+    if (prewarm > nslots) prewarm = nslots;
+    for (int i = 0; i < prewarm; i++) {
+        memcached_st *c = owner->createconn(sync);
+        if (!c) break;
+
+        // Connecting is lazy, ask something to actually do it
+        memcached_version(c);
+
+        nconns++;
+        ncreates++;
+        slots[i].store(c);
+    }
+
+    Info(UgrLogger::Lvl1, fname, "Pool '" << poolname << "' size: " << nslots << " prewarmed: " << nconns.load() <<
+            " waitms: " << waitms);
+}
+
+int ExtCacheMemcachedPool::affineslot() {
+    if (extcachepool_threadidx < 0)
+        extcachepool_threadidx = extcachepool_nextthreadidx++ & 0x7fffffff;
+
+    return extcachepool_threadidx % nslots;
+}
+
+memcached_st *ExtCacheMemcachedPool::tryget() {
+    int first = affineslot();
+
+    for (int i = 0; i < nslots; i++) {
+        int idx = (first + i) % nslots;
+
+        // Cheap check before the exchange, that dirties the cache line
+        if (!slots[idx].load(std::memory_order_relaxed)) continue;
+
+        memcached_st *c = slots[idx].exchange(0);
+        if (c) return c;
+    }
+
+    return 0;
+}
+
+memcached_st *ExtCacheMemcachedPool::get() {
+    const char *fname = "ExtCacheMemcachedPool::get";
+
+    if (!slots) return 0;
+    ngets++;
+
+    // The servers were not answering recently, don't make the client wait for them
+    if (extcachepool_nowms() < backoffuntil.load()) {
+        nbypasses++;
+        return 0;
+    }
+
+    memcached_st *c = tryget();
+    if (c) {
+        nreuses++;
+        return c;
+    }
+
+    long long deadline = extcachepool_nowms() + waitms;
+    bool waited = false;
+    int sleepus = 50;
+
+    while (true) {
+        // Can we create a new one?
+        int n = nconns.load();
+        while (n < nslots) {
+            if (nconns.compare_exchange_weak(n, n + 1)) {
+                c = owner->createconn(sync);
+                if (!c) {
+                    nconns--;
+                    failure();
+                    return 0;
+                }
+
+                ncreates++;
+                return c;
+            }
+        }
+
+        // The pool is exhausted, wait for a connection to come back
+        if (!waited) {
+            nwaits++;
+            waited = true;
+        }
+
+        c = tryget();
+        if (c) {
+            nreuses++;
+            return c;
+        }
+
+        if (extcachepool_nowms() >= deadline) {
+            ntimeouts++;
+            Info(UgrLogger::Lvl3, fname, "Timeout waiting for a connection. Pool '" << poolname << "' size: " << nslots);
+            return 0;
+        }
+
+        usleep(sleepus);
+        if (sleepus < 1000) sleepus *= 2;
+    }
+
+    return 0;
+}
+
+void ExtCacheMemcachedPool::failure() {
+    const char *fname = "ExtCacheMemcachedPool::failure";
+
+    int nf = ++nfailures;
+    long long b = backoffminms;
+    for (int i = 1; (i < nf) && (b < backoffmaxms); i++) b *= 2;
+    if (b > backoffmaxms) b = backoffmaxms;
+
+    backoffuntil.store(extcachepool_nowms() + b);
+
+    Info(UgrLogger::Lvl1, fname, "Memcached connection failure. Pool '" << poolname << "' consecutive failures: " << nf <<
+            " backing off for " << b << "ms");
+}
+
+void ExtCacheMemcachedPool::release(memcached_st *c, bool healthy) {
+    if (!c) return;
+
+    if (!healthy) {
+        memcached_free(c);
+        nconns--;
+        ndestroys++;
+        failure();
+        return;
+    }
+
+    if (nfailures.load(std::memory_order_relaxed))
+        nfailures.store(0);
+
+    int first = affineslot();
+    for (int i = 0; i < nslots; i++) {
+        int idx = (first + i) % nslots;
+        memcached_st *expected = 0;
+
+        if (slots[idx].compare_exchange_strong(expected, c))
+            return;
+    }
+
+    // Can't happen as long as we don't create more than nslots connections
+    memcached_free(c);
+    nconns--;
+    ndestroys++;
+}
+
+void ExtCacheMemcachedPool::clear() {
+    for (int i = 0; i < nslots; i++) {
+        memcached_st *c = slots[i].exchange(0);
+        if (c) {
+            memcached_free(c);
+            nconns--;
+            ndestroys++;
+        }
+    }
+}
+
+void ExtCacheMemcachedPool::logStats() {
+    const char *fname = "ExtCacheMemcachedPool::logStats";
+
+    Info(UgrLogger::Lvl1, fname, "Pool '" << poolname << "' size: " << nslots << " conns: " << nconns.load() <<
+            " gets: " << ngets.load() << " reuses: " << nreuses.load() << " creates: " << ncreates.load() <<
+            " destroys: " << ndestroys.load() << " waits: " << nwaits.load() << " timeouts: " << ntimeouts.load() <<
+            " bypasses: " << nbypasses.load() << " failures: " << nfailures.load());
+}
+
+
+
+
+
+ExtCacheBackendMemcached::ExtCacheBackendMemcached():
+    pool(this, false), syncpool(this, true), laststats(0), statsinterval(300) {
+}
+
+ExtCacheBackendMemcached::~ExtCacheBackendMemcached() {
+}
+
+int ExtCacheBackendMemcached::Init() {
+    int waitms = UgrCFG->GetLong("extcache.memcached.poolwaitms", 100);
+    int bmin = UgrCFG->GetLong("extcache.memcached.backoffminms", 100);
+    int bmax = UgrCFG->GetLong("extcache.memcached.backoffmaxms", 30000);
+
+    pool.Init(UgrCFG->GetLong("extcache.memcached.poolsize", 64),
+            UgrCFG->GetLong("extcache.memcached.poolprewarm", 4),
+            waitms, bmin, bmax);
+
+    // Only used for counters, e.g. the monitoring info
+    syncpool.Init(UgrCFG->GetLong("extcache.memcached.syncpoolsize", 4), 0, waitms, bmin, bmax);
+
+    statsinterval = UgrCFG->GetLong("extcache.memcached.poolstatsinterval", 300);
+    laststats = time(0);
+
+    return 0;
+}
+
+void ExtCacheBackendMemcached::Tick(time_t timenow) {
+    if ((statsinterval > 0) && (timenow - laststats >= statsinterval)) {
+        pool.logStats();
+        syncpool.logStats();
+        laststats = timenow;
+    }
+}
+
+bool ExtCacheBackendMemcached::isConnError(memcached_return r) {
+    switch (r) {
+        case MEMCACHED_CONNECTION_FAILURE:
+        case MEMCACHED_CONNECTION_SOCKET_CREATE_FAILURE:
+        case MEMCACHED_HOST_LOOKUP_FAILURE:
+        case MEMCACHED_WRITE_FAILURE:
+        case MEMCACHED_READ_FAILURE:
+        case MEMCACHED_UNKNOWN_READ_FAILURE:
+        case MEMCACHED_ERRNO:
+        case MEMCACHED_TIMEOUT:
+        case MEMCACHED_SERVER_MARKED_DEAD:
+        case MEMCACHED_NO_SERVERS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+
+int ExtCacheBackendMemcached::get(const std::string &key, char **val, size_t &len) {
+    const char *fname = "ExtCacheBackendMemcached::get";
+    memcached_st *conn = pool.get();
+    if (!conn) return 1;
+
+    memcached_return err;
+    uint32_t flags;
+
+    len = 0;
+    *val = memcached_get(conn, key.c_str(), key.length(),
+            &len, &flags, &err);
+
+    Info(UgrLogger::Lvl3, fname, "Memcached get: Key='" << key << "' flags:" << flags << " Res: " << memcached_strerror(conn, err));
+
+    pool.release(conn, !isConnError(err));
+
+    if (err != MEMCACHED_SUCCESS) {
+        if (*val) free(*val);
+        *val = 0;
+        return 1;
+    }
+
+    if (!*val) {
+        Error(fname, "Memcached retured a null value. Key=" << key);
+        return 1;
+    }
+
+    return 0;
+}
+
+int ExtCacheBackendMemcached::mget(const std::vector<std::string> &keys, ExtCacheMgetCallback cb) {
+    const char *fname = "ExtCacheBackendMemcached::mget";
+
+    if (keys.empty()) return 0;
+
+    memcached_st *conn = pool.get();
+    if (!conn) return 1;
+
+    std::vector<const char *> k;
+    std::vector<size_t> kl;
+    std::map<std::string, int> idxbykey;
+
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        k.push_back(keys[i].c_str());
+        kl.push_back(keys[i].length());
+        idxbykey[keys[i]] = i;
+    }
+
+    memcached_return err = memcached_mget(conn, &k[0], &kl[0], k.size());
+
+    Info(UgrLogger::Lvl3, fname, "Memcached mget: Key='" << keys[0] << "' nkeys: " << keys.size() <<
+            " Res: " << memcached_strerror(conn, err));
+
+    if (err != MEMCACHED_SUCCESS) {
+        pool.release(conn, !isConnError(err));
+        return 1;
+    }
+
+    memcached_result_st *res = memcached_result_create(conn, NULL);
+    if (!res) {
+        Error(fname, "Cannot allocate a memcached result. Key=" << keys[0]);
+        // The pending results would confuse the next user of this connection
+        pool.release(conn, false);
+        return 1;
+    }
+
+    // Drain all the results, otherwise the connection cannot be reused
+    while (memcached_fetch_result(conn, res, &err)) {
+        std::map<std::string, int>::iterator it =
+            idxbykey.find(std::string(memcached_result_key_value(res), memcached_result_key_length(res)));
+
+        if (it != idxbykey.end())
+            cb(it->second, memcached_result_value(res), memcached_result_length(res));
+    }
+
+    memcached_result_free(res);
+    pool.release(conn, !isConnError(err));
+
+    return 0;
+}
+
+int ExtCacheBackendMemcached::set(const std::string &key, const char *val, size_t len, time_t expirationtime) {
+    const char *fname = "ExtCacheBackendMemcached::set";
+    memcached_st *conn = pool.get();
+    if (!conn) return 1;
+
+    Info(UgrLogger::Lvl3, fname, "memcached_set " <<
+            " key:" << key << " len:" << len);
+
+    memcached_return r = memcached_set(conn,
+            key.c_str(), key.length(),
+            val, len,
+            expirationtime, (uint32_t) 0);
+
+    Info(UgrLogger::Lvl4, fname, "memcached_set " << "r:" << r <<
+            " key:" << key << " len:" << len);
+
+    if (r != MEMCACHED_SUCCESS) {
+        Error(fname, "Cannot write to memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
+                "' Key=" << key <<
+                " Valuelen:" << len);
+
+        pool.release(conn, !isConnError(r));
+
+        return 1;
+    }
+
+    pool.release(conn, true);
+    return 0;
+}
+
+int ExtCacheBackendMemcached::del(const std::string &key) {
+    memcached_st *conn = pool.get();
+    if (!conn) return 1;
+
+    memcached_return r = memcached_delete(conn, key.c_str(), key.length(), 0);
+
+    pool.release(conn, !isConnError(r));
+    return (r != MEMCACHED_SUCCESS);
+}
+
+int ExtCacheBackendMemcached::incr(const std::string &key, uint64_t initial, time_t expirationtime, uint64_t &newval) {
+    const char *fname = "ExtCacheBackendMemcached::incr";
+
+    // We need the reply here, hence a sync connection
+    memcached_st *conn = syncpool.get();
+    if (!conn) return 1;
+
+    Info(UgrLogger::Lvl3, fname, "memcached_increment " <<
+            " key:" << key);
+
+    memcached_return r = memcached_increment_with_initial(conn, key.c_str(), key.length(),
+            1, initial, expirationtime, &newval);
+
+    if (r != MEMCACHED_SUCCESS) {
+        Error(fname, "Cannot increment counter in memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
+                "' Key= " << key);
+
+        syncpool.release(conn, !isConnError(r));
+
+        return 1;
+    }
+
+    syncpool.release(conn, true);
+    return 0;
+}
+
+
+
+
+
+
+/// Create and configure a new memcached instance
+memcached_st* ExtCacheBackendMemcached::createconn(bool sync) {
+    const char *fname = "ExtCacheBackendMemcached::createconn";
+    memcached_st *res = 0;
+    int r;
+
+    Info(UgrLogger::Lvl1, fname, "Creating NEW memcached instance... sync: " << sync);
+
+    // Passing NULL means dynamically allocating space
+    res = memcached_create(NULL);
+
+    if (res) {
+        Info(UgrLogger::Lvl1, fname, "Configuring memcached...");
+
+        // Configure the memcached behaviour
+        Info(UgrLogger::Lvl3, fname, "Setting memcached protocol...");
+        if (UgrCFG->GetBool("extcache.memcached.useBinaryProtocol", true)) {
+            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
+            if (r != MEMCACHED_SUCCESS) {
+                Error(fname, "Cannot set memcached protocol to binary. retval=" << r);
+            }
+        } else {
+            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 0);
+            if (r != MEMCACHED_SUCCESS) {
+                Error(fname, "Cannot set memcached protocol to ascii. retval=" << r);
+            }
+        }
+
+        Info(UgrLogger::Lvl3, fname, "Setting memcached distribution...");
+        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_DISTRIBUTION, MEMCACHED_DISTRIBUTION_CONSISTENT);
+        if (r != MEMCACHED_SUCCESS) {
+            Error(fname, "Cannot set memcached behavior to consistent. retval=" << r);
+        }
+
+        Info(UgrLogger::Lvl3, fname, "Setting memcached noblock...");
+        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
+        if (r != MEMCACHED_SUCCESS) {
+            Error(fname, "Cannot set memcached behavior to async. retval=" << r);
+        }
+
+        Info(UgrLogger::Lvl3, fname, "Setting memcached TCP_NODELAY...");
+        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
+        if (r != MEMCACHED_SUCCESS) {
+            Error(fname, "Cannot set memcached TCP_NODELAY. retval=" << r);
+        }
+
+        // Not setting this makes the connection SYNC
+        if (!sync) {
+            Info(UgrLogger::Lvl3, fname, "Setting memcached NOREPLY...");
+            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NOREPLY, 1);
+            if (r != MEMCACHED_SUCCESS) {
+                Error(fname, "Cannot set memcached NOREPLY. retval=" << r);
+            }
+        }
+
+        // Add memcached TCP hosts, take them from the config
+        int i = 0;
+        char buf[1024];
+        char server[1024];
+        do {
+
+            UgrCFG->ArrayGetString("extcache.memcached.server", buf, i++);
+
+            if (!buf[0]) break;
+
+
+
+            // split host and port
+            char* host = 0;
+            unsigned int port = 0;
+
+
+            strcpy(server, buf);
+
+            char* token;
+            token = strtok(server, ":/?");
+            if (token != NULL) {
+                host = token;
+            }
+            token = strtok(NULL, ":/?");
+            if (token != NULL) {
+                port = atoi(token);
+            }
+
+            Info(UgrLogger::Lvl3, fname, "Adding memcached server '" << buf << "'" << host << ":" << port);
+
+            r = memcached_server_add(res, host, port);
+            if (r != MEMCACHED_SUCCESS) {
+                Error(fname, "Cannot add server '" << host << "' retval=" << r);
+            }
+
+        } while (buf[0]);
+
+    } else
+        Error(fname, "Cannot create memcached instance");
+
+    return res;
+}
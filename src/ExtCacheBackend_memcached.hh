@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   ExtCacheBackend_memcached.hh
+ * @brief  External cache backend that talks to a memcached cluster
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef EXTCACHEBACKEND_MEMCACHED_HH
+#define EXTCACHEBACKEND_MEMCACHED_HH
+
+#include "Config.h"
+#include "ExtCacheBackend.hh"
+
+#include <libmemcached/memcached.h>
+#include <boost/thread.hpp>
+
+#ifdef HAVE_ATOMIC
+#include <atomic>
+#endif
+
+#ifdef HAVE_CSTDATOMIC
+#include <cstdatomic>
+#endif
+
+
+class ExtCacheBackendMemcached;
+
+/// A bounded pool of memcached connections, with no locks.
+/// The idle connections sit in a fixed array of slots. A thread looks first into
+/// the slot it is affine to, so it tends to reuse the same connection, then into the others.
+/// At most poolsize connections exist. When all are busy, a thread waits for one
+/// up to a timeout, then goes on without the cache.
+/// A connection that fails is destroyed, and the pool backs off exponentially
+/// before creating a new one. Meanwhile the cache is bypassed.
+class ExtCacheMemcachedPool {
+private:
+    ExtCacheBackendMemcached *owner;
+    bool sync;
+    const char *poolname;
+
+    std::atomic<memcached_st *> *slots;
+    int nslots;
+
+    /// How many connections exist, idle or busy
+    std::atomic<int> nconns;
+
+    /// How long to wait for a connection when the pool is exhausted
+    int waitms;
+
+    /// Reconnection backoff
+    int backoffminms, backoffmaxms;
+    std::atomic<int> nfailures;
+    std::atomic<long long> backoffuntil;
+
+    // Metrics
+    std::atomic<long long> ngets, nreuses, ncreates, ndestroys, nwaits, ntimeouts, nbypasses;
+
+    /// The slot where the calling thread looks first
+    int affineslot();
+
+    /// Try to take an idle connection
+    memcached_st *tryget();
+
+    /// Note that a connection could not be created or failed
+    void failure();
+
+public:
+    ExtCacheMemcachedPool(ExtCacheBackendMemcached *o, bool issync);
+    ~ExtCacheMemcachedPool();
+
+    /// Size the pool and open the first prewarm connections
+    void Init(int poolsize, int prewarm, int waitms, int backoffminms, int backoffmaxms);
+
+    /// Get a connection, NULL if none could be had in time
+    memcached_st *get();
+
+    /// Give back a connection. One that had errors is destroyed
+    void release(memcached_st *c, bool healthy);
+
+    /// Destroy all the idle connections
+    void clear();
+
+    /// Log the metrics of the pool
+    void logStats();
+};
+
+
+/// The memcached backend, shared by all the UGR instances that point
+/// to the same memcached servers
+class ExtCacheBackendMemcached: public ExtCacheBackend {
+private:
+    friend class ExtCacheMemcachedPool;
+
+    /// The connections for async operations, which don't wait for replies,
+    /// and for the sync ones
+    ExtCacheMemcachedPool pool, syncpool;
+
+    /// The last time the pool metrics were logged
+    time_t laststats;
+    int statsinterval;
+
+    /// Create and configure a new memcached instance
+    memcached_st* createconn(bool sync);
+
+    /// Tells if an error means that the connection is not usable anymore
+    static bool isConnError(memcached_return r);
+
+public:
+
+    ExtCacheBackendMemcached();
+
+    virtual ~ExtCacheBackendMemcached();
+
+    virtual int Init();
+
+    virtual void Tick(time_t timenow);
+
+    virtual const char *name() { return "memcached"; }
+
+    virtual int get(const std::string &key, char **val, size_t &len);
+    virtual int mget(const std::vector<std::string> &keys, ExtCacheMgetCallback cb);
+    virtual int set(const std::string &key, const char *val, size_t len, time_t expirationtime);
+    virtual int del(const std::string &key);
+    virtual int incr(const std::string &key, uint64_t initial, time_t expirationtime, uint64_t &newval);
+};
+
+#endif
@@ -0,0 +1,550 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   ExtCacheBackend_shm.cc
+ * @brief  External cache backend living in a shared memory segment
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "ExtCacheBackend_shm.hh"
+#include "UgrConfig.hh"
+#include "SimpleDebug.hh"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define EXTCACHESHM_MAGIC      0x5567724361636865ULL
+#define EXTCACHESHM_MAGIC_INIT 0x5567724361636800ULL
+#define EXTCACHESHM_VERSION    3
+
+/// A writer that holds a slot for longer than this (ms) is considered dead.
+/// A write is a copy of a few KB, hence only a process that has been stopped or
+/// swapped out for this long can lose its slot while it's alive
+#define EXTCACHESHM_CLAIMTIMEOUT 10000
+
+/// Sits at the beginning of the segment, describes its geometry
+struct ExtCacheShmHeader {
+    volatile uint64_t magic;
+    uint64_t version;
+    uint64_t nslots;
+    uint64_t slotsize;
+    char pad[32];
+};
+
+/// One entry of the table, followed by the key and then by the value
+struct ExtCacheShmSlot {
+    /// Even when the slot is stable, odd while a writer is modifying it
+    volatile uint64_t seq;
+    /// Of the other fields, the key and the value. A writer whose claim was stolen
+    /// may still be copying into the slot, so the readers cannot trust seq alone
+    uint64_t csum;
+
+    uint64_t keyhash;
+    /// Absolute expiration time, 0 means that the slot is free
+    int64_t expiry;
+    uint32_t keylen;
+    uint32_t vallen;
+    char pad[24];
+
+    char *data() { return (char *)(this + 1); }
+};
+
+
+/// Expiration times follow the memcached convention: 0 is never,
+/// up to 30 days is relative to now, otherwise it's a unix time
+static int64_t extcacheshm_expiry(time_t expirationtime) {
+    if (expirationtime == 0) return 0x7fffffffffffffffLL;
+    if (expirationtime <= 2592000) return time(0) + expirationtime;
+    return expirationtime;
+}
+
+/// FNV-1a, stable across processes and builds
+static uint64_t extcacheshm_hash(const std::string &key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.length(); i++) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t extcacheshm_fnv(uint64_t h, const void *p, size_t len) {
+    const unsigned char *c = (const unsigned char *)p;
+    for (size_t i = 0; i < len; i++) {
+        h ^= c[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/// The checksum of the content of a slot, key and value being contiguous
+static uint64_t extcacheshm_csum(uint64_t keyhash, int64_t expiry, uint32_t keylen, uint32_t vallen,
+                                 const char *key, const char *val) {
+    uint64_t h = 14695981039346656037ULL;
+    h = extcacheshm_fnv(h, &keyhash, sizeof(keyhash));
+    h = extcacheshm_fnv(h, &expiry, sizeof(expiry));
+    h = extcacheshm_fnv(h, &keylen, sizeof(keylen));
+    h = extcacheshm_fnv(h, &vallen, sizeof(vallen));
+    h = extcacheshm_fnv(h, key, keylen);
+    return extcacheshm_fnv(h, val, vallen);
+}
+
+
+
+ExtCacheBackendShm::ExtCacheBackendShm() {
+    base = 0;
+    hdr = 0;
+    mapsize = 0;
+    nslots = 0;
+    slotsize = 0;
+    maxprobe = 8;
+}
+
+ExtCacheBackendShm::~ExtCacheBackendShm() {
+    // The segment stays there for the other processes, we just unmap it
+    if (base) munmap(base, mapsize);
+}
+
+int ExtCacheBackendShm::Init() {
+    const char *fname = "ExtCacheBackendShm::Init";
+
+    shmname = UgrCFG->GetString("extcache.shm.name", (char *)"/ugrcache");
+    if ((shmname.length() < 2) || (shmname[0] != '/')) {
+        Error(fname, "extcache.shm.name must start with a slash. Using '/ugrcache' instead of '" << shmname << "'");
+        shmname = "/ugrcache";
+    }
+
+    nslots = UgrCFG->GetLong("extcache.shm.nslots", 16384);
+    if (nslots < 1024) {
+        Error(fname, "extcache.shm.nslots cannot be smaller than 1024. Setting to 16384 instead of " << nslots);
+        nslots = 16384;
+    }
+
+    slotsize = UgrCFG->GetLong("extcache.shm.slotsize", 4096);
+    if (slotsize < 1024) {
+        Error(fname, "extcache.shm.slotsize cannot be smaller than 1024. Setting to 4096 instead of " << slotsize);
+        slotsize = 4096;
+    }
+    // Keep the slots aligned to the cache lines
+    slotsize = (slotsize + 63) & ~63UL;
+
+    maxprobe = UgrCFG->GetLong("extcache.shm.maxprobe", 8);
+    if (maxprobe < 1) maxprobe = 1;
+
+    int fd = shm_open(shmname.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        Error(fname, "Cannot open shared memory segment '" << shmname << "' errno: " << errno);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        Error(fname, "Cannot stat shared memory segment '" << shmname << "' errno: " << errno);
+        close(fd);
+        return 1;
+    }
+
+    if (st.st_size > 0) {
+        // Someone else created it already, its geometry wins over our config
+        ExtCacheShmHeader *h = (ExtCacheShmHeader *)mmap(0, sizeof(ExtCacheShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (h == MAP_FAILED) {
+            Error(fname, "Cannot map shared memory segment '" << shmname << "' errno: " << errno);
+            close(fd);
+            return 1;
+        }
+
+        for (int i = 0; (h->magic != EXTCACHESHM_MAGIC) && (i < 1000); i++) usleep(1000);
+
+        if ((h->magic == EXTCACHESHM_MAGIC) && (h->version == EXTCACHESHM_VERSION)) {
+            if ((h->nslots != nslots) || (h->slotsize != slotsize))
+                Info(UgrLogger::Lvl1, fname, "Shared memory segment '" << shmname << "' exists with nslots: " << h->nslots <<
+                        " slotsize: " << h->slotsize << ", using these values");
+            nslots = h->nslots;
+            slotsize = h->slotsize;
+        }
+        munmap(h, sizeof(ExtCacheShmHeader));
+    }
+
+    mapsize = sizeof(ExtCacheShmHeader) + nslots * slotsize;
+
+    if ((size_t)st.st_size < mapsize) {
+        if (ftruncate(fd, mapsize)) {
+            Error(fname, "Cannot resize shared memory segment '" << shmname << "' to " << mapsize << " errno: " << errno);
+            close(fd);
+            return 1;
+        }
+    }
+
+    base = mmap(0, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        Error(fname, "Cannot map shared memory segment '" << shmname << "' size: " << mapsize << " errno: " << errno);
+        base = 0;
+        return 1;
+    }
+
+    hdr = (ExtCacheShmHeader *)base;
+
+    // The first process that gets here initializes the header
+    if (__sync_bool_compare_and_swap(&hdr->magic, 0, EXTCACHESHM_MAGIC_INIT)) {
+        hdr->version = EXTCACHESHM_VERSION;
+        hdr->nslots = nslots;
+        hdr->slotsize = slotsize;
+        __sync_synchronize();
+        hdr->magic = EXTCACHESHM_MAGIC;
+    } else {
+        for (int i = 0; (hdr->magic != EXTCACHESHM_MAGIC) && (i < 1000); i++) usleep(1000);
+    }
+
+    if ((hdr->magic != EXTCACHESHM_MAGIC) || (hdr->version != EXTCACHESHM_VERSION) ||
+            (hdr->nslots != nslots) || (hdr->slotsize != slotsize)) {
+        Error(fname, "Shared memory segment '" << shmname << "' is not usable. Remove it and restart. version: " <<
+                hdr->version << " nslots: " << hdr->nslots << " slotsize: " << hdr->slotsize);
+        munmap(base, mapsize);
+        base = 0;
+        hdr = 0;
+        return 1;
+    }
+
+    Info(UgrLogger::Lvl1, fname, "Shared memory cache '" << shmname << "' ready. nslots: " << nslots <<
+            " slotsize: " << slotsize);
+
+    return 0;
+}
+
+ExtCacheShmSlot *ExtCacheBackendShm::getslot(unsigned long idx) {
+    return (ExtCacheShmSlot *)((char *)base + sizeof(ExtCacheShmHeader) + (idx % nslots) * slotsize);
+}
+
+size_t ExtCacheBackendShm::slotcapacity() {
+    return slotsize - sizeof(ExtCacheShmSlot);
+}
+
+size_t ExtCacheBackendShm::maxValueSize() {
+    // Leave some room for the key
+    return slotcapacity() - 512;
+}
+
+/// The low 24 bits of a sequence count the writes, the high 40 bits are the time of the
+/// last claim, in ms of the monotonic clock, that all the processes of the host share.
+/// Having both in one word, claiming and stealing a slot are a single CAS
+#define EXTCACHESHM_SEQBITS 24
+#define EXTCACHESHM_SEQMASK ((1ULL << EXTCACHESHM_SEQBITS) - 1)
+#define EXTCACHESHM_MSMASK  ((1ULL << (64 - EXTCACHESHM_SEQBITS)) - 1)
+
+static uint64_t extcacheshm_nowms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) & EXTCACHESHM_MSMASK;
+}
+
+static uint64_t extcacheshm_nextseq(uint64_t cur, uint64_t incr, uint64_t nowms) {
+    return (nowms << EXTCACHESHM_SEQBITS) | ((cur + incr) & EXTCACHESHM_SEQMASK);
+}
+
+int ExtCacheBackendShm::claim(ExtCacheShmSlot *s, uint64_t &seq) {
+    uint64_t cur = s->seq;
+    uint64_t nowms = extcacheshm_nowms();
+
+    if (cur & 1) {
+        // Someone is writing. If it's been too long, it's a dead process and we take over
+        uint64_t elapsed = (nowms - (cur >> EXTCACHESHM_SEQBITS)) & EXTCACHESHM_MSMASK;
+        if (elapsed <= EXTCACHESHM_CLAIMTIMEOUT) return 1;
+        seq = extcacheshm_nextseq(cur, 2, nowms);
+    } else
+        seq = extcacheshm_nextseq(cur, 1, nowms);
+
+    if (!__sync_bool_compare_and_swap(&s->seq, cur, seq)) return 1;
+
+    return 0;
+}
+
+void ExtCacheBackendShm::release(ExtCacheShmSlot *s, uint64_t seq) {
+    const char *fname = "ExtCacheBackendShm::release";
+
+    __sync_synchronize();
+    if (__sync_bool_compare_and_swap(&s->seq, seq, (seq & ~EXTCACHESHM_SEQMASK) | ((seq + 1) & EXTCACHESHM_SEQMASK)))
+        return;
+
+    // Our claim was stolen while we were stalled, and what we wrote may have landed
+    // over the value of the thief. The readers would refuse it anyway, as it does not
+    // match its checksum, but the slot is emptied to not keep it around
+    Error(fname, "A slot was taken over while being written, invalidating it");
+
+    for (int retry = 0; retry < 100; retry++) {
+        uint64_t seq2;
+        if (!claim(s, seq2)) {
+            s->expiry = 0;
+            s->keylen = 0;
+            s->keyhash = 0;
+            __sync_synchronize();
+            __sync_bool_compare_and_swap(&s->seq, seq2, (seq2 & ~EXTCACHESHM_SEQMASK) | ((seq2 + 1) & EXTCACHESHM_SEQMASK));
+            return;
+        }
+        sched_yield();
+    }
+
+    // Someone else has been writing it all the time, rewriting all of it
+}
+
+ExtCacheShmSlot *ExtCacheBackendShm::claimForWrite(const std::string &key, uint64_t h, uint64_t &seq, bool &found) {
+    time_t now = time(0);
+    ExtCacheShmSlot *match = 0, *freeslot = 0, *firstexp = 0;
+
+    // Look at the whole probe sequence. The slot with our key is the best candidate,
+    // then a free one, then the one that expires first
+    for (int p = 0; p < maxprobe; p++) {
+        ExtCacheShmSlot *s = getslot(h + p);
+        int64_t exp = s->expiry;
+
+        if ((exp != 0) && (exp >= now) && (s->keyhash == h) && (s->keylen == key.length()) &&
+                !memcmp(s->data(), key.c_str(), key.length())) {
+            match = s;
+            break;
+        }
+
+        if ((exp == 0) || (exp < now)) {
+            if (!freeslot) freeslot = s;
+        } else if (!firstexp || (exp < firstexp->expiry)) {
+            firstexp = s;
+        }
+    }
+
+    ExtCacheShmSlot *s = match ? match : (freeslot ? freeslot : firstexp);
+    if (!s || claim(s, seq)) return 0;
+
+    // Things may have changed before our claim, check again if the key is there
+    found = ((s->expiry != 0) && (s->expiry >= now) && (s->keyhash == h) && (s->keylen == key.length()) &&
+            !memcmp(s->data(), key.c_str(), key.length()));
+
+    return s;
+}
+
+int ExtCacheBackendShm::read(const std::string &key, uint64_t h, char **val, size_t &len) {
+    time_t now = time(0);
+
+    for (int p = 0; p < maxprobe; p++) {
+        ExtCacheShmSlot *s = getslot(h + p);
+
+        for (int retry = 0; retry < 8; retry++) {
+            uint64_t seq1 = s->seq;
+            if (seq1 & 1) {
+                sched_yield();
+                continue;
+            }
+            __sync_synchronize();
+
+            if ((s->keyhash != h) || (s->keylen != key.length()) || (s->expiry == 0))
+                break;
+
+            uint32_t vl = s->vallen;
+            int64_t exp = s->expiry;
+            uint64_t csum = s->csum;
+            if (key.length() + vl > slotcapacity()) {
+                // Torn read
+                continue;
+            }
+
+            if (memcmp(s->data(), key.c_str(), key.length()))
+                break;
+
+            // Key and value are copied together, to check them against the checksum
+            size_t kl = key.length();
+            char *buf = (char *)malloc(kl + vl + 1);
+            if (!buf) return 1;
+            memcpy(buf, s->data(), kl + vl);
+
+            __sync_synchronize();
+            if (s->seq != seq1) {
+                free(buf);
+                continue;
+            }
+
+            // A stalled writer that lost its claim can be copying into the slot with
+            // an even seq. What it leaves is a mix that only the checksum can tell
+            if ((memcmp(buf, key.c_str(), kl)) ||
+                    (extcacheshm_csum(h, exp, kl, vl, buf, buf + kl) != csum)) {
+                free(buf);
+                sched_yield();
+                continue;
+            }
+
+            memmove(buf, buf + kl, vl);
+            buf[vl] = '\0';
+
+            if (exp < now) {
+                free(buf);
+                return 1;
+            }
+
+            *val = buf;
+            len = vl;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int ExtCacheBackendShm::get(const std::string &key, char **val, size_t &len) {
+    const char *fname = "ExtCacheBackendShm::get";
+    if (!base) return 1;
+
+    *val = 0;
+    len = 0;
+    int r = read(key, extcacheshm_hash(key), val, len);
+
+    Info(UgrLogger::Lvl3, fname, "Shm get: Key='" << key << "' Res: " << r << " len: " << len);
+
+    return r;
+}
+
+int ExtCacheBackendShm::mget(const std::vector<std::string> &keys, ExtCacheMgetCallback cb) {
+    if (!base) return 1;
+
+    // A memory lookup has no roundtrip to save
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        char *val = 0;
+        size_t len = 0;
+
+        if (!read(keys[i], extcacheshm_hash(keys[i]), &val, len)) {
+            cb(i, val, len);
+            free(val);
+        }
+    }
+
+    return 0;
+}
+
+int ExtCacheBackendShm::set(const std::string &key, const char *val, size_t len, time_t expirationtime) {
+    const char *fname = "ExtCacheBackendShm::set";
+    if (!base) return 1;
+
+    if (key.length() + len > slotcapacity()) {
+        Info(UgrLogger::Lvl3, fname, "Value too big for a slot. Key='" << key << "' len: " << len);
+        return 1;
+    }
+
+    uint64_t h = extcacheshm_hash(key);
+    uint64_t seq;
+    bool found = false;
+
+    ExtCacheShmSlot *s = claimForWrite(key, h, seq, found);
+    if (!s) {
+        // Another writer is busy there. This is a cache, we can lose a write
+        Info(UgrLogger::Lvl3, fname, "No slot available. Key='" << key << "'");
+        return 1;
+    }
+
+    int64_t exp = extcacheshm_expiry(expirationtime);
+    s->keyhash = h;
+    s->keylen = key.length();
+    s->vallen = len;
+    memcpy(s->data(), key.c_str(), key.length());
+    memcpy(s->data() + key.length(), val, len);
+    s->expiry = exp;
+    s->csum = extcacheshm_csum(h, exp, key.length(), len, key.c_str(), val);
+
+    release(s, seq);
+
+    Info(UgrLogger::Lvl4, fname, "Shm set: Key='" << key << "' len: " << len);
+    return 0;
+}
+
+int ExtCacheBackendShm::del(const std::string &key) {
+    if (!base) return 1;
+
+    uint64_t h = extcacheshm_hash(key);
+    time_t now = time(0);
+
+    for (int p = 0; p < maxprobe; p++) {
+        ExtCacheShmSlot *s = getslot(h + p);
+
+        if ((s->keyhash != h) || (s->keylen != key.length()) || (s->expiry == 0))
+            continue;
+
+        uint64_t seq;
+        if (claim(s, seq)) return 1;
+
+        if ((s->keyhash == h) && (s->keylen == key.length()) && !memcmp(s->data(), key.c_str(), key.length())) {
+            bool expired = (s->expiry < now);
+            s->expiry = 0;
+            s->keylen = 0;
+            s->keyhash = 0;
+            release(s, seq);
+            return expired;
+        }
+
+        release(s, seq);
+    }
+
+    return 1;
+}
+
+int ExtCacheBackendShm::incr(const std::string &key, uint64_t initial, time_t expirationtime, uint64_t &newval) {
+    const char *fname = "ExtCacheBackendShm::incr";
+    if (!base) return 1;
+
+    uint64_t h = extcacheshm_hash(key);
+
+    // Unlike a set, an increment cannot be lost. Wait a bit for the other writers
+    for (int retry = 0; retry < 1000; retry++) {
+        uint64_t seq;
+        bool found = false;
+
+        ExtCacheShmSlot *s = claimForWrite(key, h, seq, found);
+        if (!s) {
+            sched_yield();
+            continue;
+        }
+
+        // A counter that does not match its checksum is like an evicted one, the
+        // callers know how to deal with a counter that starts over
+        uint32_t oldvl = s->vallen;
+        if (found && (key.length() + oldvl <= slotcapacity()) &&
+                (extcacheshm_csum(h, s->expiry, key.length(), oldvl, s->data(), s->data() + key.length()) == s->csum)) {
+            char buf[32];
+            size_t vl = oldvl;
+            if (vl > sizeof(buf) - 1) vl = sizeof(buf) - 1;
+            memcpy(buf, s->data() + key.length(), vl);
+            buf[vl] = '\0';
+            newval = strtoull(buf, 0, 10) + 1;
+        } else
+            newval = initial;
+
+        char buf[32];
+        int vl = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)newval);
+        int64_t exp = extcacheshm_expiry(expirationtime);
+
+        s->keyhash = h;
+        s->keylen = key.length();
+        s->vallen = vl;
+        memcpy(s->data(), key.c_str(), key.length());
+        memcpy(s->data() + key.length(), buf, vl);
+        s->expiry = exp;
+        s->csum = extcacheshm_csum(h, exp, key.length(), vl, key.c_str(), buf);
+
+        release(s, seq);
+        return 0;
+    }
+
+    Error(fname, "Cannot increment counter, the slot is always busy. Key='" << key << "'");
+    return 1;
+}
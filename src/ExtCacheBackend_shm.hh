@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   ExtCacheBackend_shm.hh
+ * @brief  External cache backend living in a shared memory segment
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef EXTCACHEBACKEND_SHM_HH
+#define EXTCACHEBACKEND_SHM_HH
+
+#include "ExtCacheBackend.hh"
+
+
+struct ExtCacheShmHeader;
+struct ExtCacheShmSlot;
+
+/// A hash table in a POSIX shared memory segment, shared by all the UGR
+/// processes of the same host. It replaces the network hop to memcached
+/// with a memory lookup, e.g. for single node deployments or for tests.
+///
+/// The table is made of fixed size slots, addressed by open addressing
+/// with a short linear probe. There are no locks: every slot has a sequence
+/// number that is odd while a writer is modifying it. Writers claim a slot
+/// with a CAS on the sequence, readers copy the value out and retry if the
+/// sequence changed meanwhile. A writer that stalls for too long loses its
+/// claim, and may go on writing after the next writer released the slot,
+/// hence every slot also has a checksum that the readers verify.
+/// A full probe sequence evicts the entry that expires first.
+class ExtCacheBackendShm: public ExtCacheBackend {
+private:
+
+    /// The name of the shared memory segment, as in shm_open
+    std::string shmname;
+
+    void *base;
+    size_t mapsize;
+    ExtCacheShmHeader *hdr;
+
+    unsigned long nslots;
+    unsigned long slotsize;
+    /// How many slots a key can be looked for in
+    int maxprobe;
+
+    ExtCacheShmSlot *getslot(unsigned long idx);
+    /// The space for key+value in a slot
+    size_t slotcapacity();
+
+    /// Take exclusive ownership of a slot, returning the sequence to release it with
+    int claim(ExtCacheShmSlot *s, uint64_t &seq);
+    /// If the claim was taken over meanwhile, the slot is emptied
+    void release(ExtCacheShmSlot *s, uint64_t seq);
+
+    /// Find the slot that holds a key, or the best one to overwrite. The slot is claimed
+    ExtCacheShmSlot *claimForWrite(const std::string &key, uint64_t h, uint64_t &seq, bool &found);
+
+    /// Find and copy out a value, if present and not expired
+    int read(const std::string &key, uint64_t h, char **val, size_t &len);
+
+public:
+
+    ExtCacheBackendShm();
+
+    virtual ~ExtCacheBackendShm();
+
+    virtual int Init();
+
+    virtual const char *name() { return "shm"; }
+
+    virtual size_t maxValueSize();
+
+    virtual int get(const std::string &key, char **val, size_t &len);
+    virtual int mget(const std::vector<std::string> &keys, ExtCacheMgetCallback cb);
+    virtual int set(const std::string &key, const char *val, size_t len, time_t expirationtime);
+    virtual int del(const std::string &key);
+    virtual int incr(const std::string &key, uint64_t initial, time_t expirationtime, uint64_t &newval);
+};
+
+#endif
@@ -20,467 +20,664 @@
 
 
 #include "ExtCacheHandler.hh"
+#include "ExtCacheBackend_memcached.hh"
+#include "ExtCacheBackend_shm.hh"
 #include "LocationInfoHandler.hh"
 #include "LocationPlugin.hh"
 
-#include <libmemcached/memcached.h>
-#include <queue>
+#include "UgrMemcached.pb.h"
 
-void ExtCacheHandler::Init() {
-    maxttl = UgrCFG->GetLong("extcache.memcached.ttl", 600);
-    if (maxttl <= 0) {
-      Error("ExtCacheHandler::Init", "extcache.memcached.ttl cannot be smaller than 1 second. Setting to 600 secs instead of " << maxttl);
-      maxttl = 600;
-    }
-    
-    while (!conns.empty()) conns.pop();
-    while (!syncconns.empty()) syncconns.pop();
-}
-
-std::string ExtCacheHandler::makekey(UgrFileInfo *fi) {
-    if (fi->name.length() > 0)
-        return fi->name;
+#include <unistd.h>
+#include <stdlib.h>
 
-    return "/";
-}
+using namespace ugrmemcached;
 
-std::string ExtCacheHandler::makekey_subitems(UgrFileInfo *fi) {
-    return "items_" + fi->name;
-}
 
+/// Collects the values of an mget, indexed like the keys
+struct ExtCacheMgetCollector {
+    std::vector<std::string> *vals;
+    std::vector<bool> *found;
 
+    void operator()(int idx, const char *val, size_t len) {
+        (*vals)[idx].assign(val, len);
+        (*found)[idx] = true;
+    }
+};
 
-std::string ExtCacheHandler::makekey_endpointstatus(std::string endpointname) {
-    return "endpoint_" + endpointname;
-}
+/// Collects the chunks of a list of subitems, to merge them once they are all there
+struct ExtCacheChunkCollector {
+    std::vector<std::string> *chunks;
+    std::vector<bool> *got;
+    int *ngot;
 
+    void operator()(int idx, const char *val, size_t len) {
+        if ((*got)[idx]) return;
+        (*got)[idx] = true;
+        (*ngot)++;
 
+        (*chunks)[idx].assign(val, len);
+    }
+};
 
+/// Merges each chunk of a list of subitems into the item as soon as it arrives,
+/// waking up whoever is waiting on it
+struct ExtCacheChunkMerger {
+    UgrFileInfo *fi;
+    std::vector<bool> *got;
+    int *ngot;
 
-int ExtCacheHandler::getFileInfo(UgrFileInfo *fi) {
-    const char *fname = "ExtCacheHandler::getFileInfo";
-    memcached_st *conn = getconn();
-    if (!conn) return 0;
+    void operator()(int idx, const char *val, size_t len) {
+        if ((*got)[idx]) return;
+        (*got)[idx] = true;
 
-    size_t value_len = 0;
-    memcached_return err;
-    uint32_t flags;
-    std::string k;
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        // A chunk that does not decode is like a missing one
+        if (fi->decodeSubitemsChunk(val, len)) return;
+        (*ngot)++;
+        fi->signalSomeUpdate();
+    }
+};
 
-    k = makekey(fi);
 
-    char *strnfo = memcached_get(conn, k.c_str(), k.length(),
-            &value_len, &flags, &err);
 
-    Info(UgrLogger::Lvl3, fname, "Memcached get: Key='" << k << "' flags:" << flags << " Res: " << memcached_strerror(conn, err));
+ExtCacheHandler::~ExtCacheHandler() {
+    delete backend;
+}
 
-    releaseconn(conn);
+void ExtCacheHandler::Init() {
+    const char *fname = "ExtCacheHandler::Init";
 
-    if (err != MEMCACHED_SUCCESS) {
-        return 1;
+    maxttl = UgrCFG->GetLong("extcache.memcached.ttl", 600);
+    if (maxttl <= 0) {
+      Error(fname, "extcache.memcached.ttl cannot be smaller than 1 second. Setting to 600 secs instead of " << maxttl);
+      maxttl = 600;
     }
 
-    if (!strnfo) {
-        Error(fname, "Memcached retured a null value. Key=" << fi->name);
-        return 1;
+    maxvaluesize = UgrCFG->GetLong("extcache.memcached.maxvaluesize", 1000000);
+    if (maxvaluesize < 4096) {
+      Error(fname, "extcache.memcached.maxvaluesize cannot be smaller than 4096 bytes. Setting to 1000000 instead of " << maxvaluesize);
+      maxvaluesize = 1000000;
     }
+    chunkgen = 0;
 
+    // The parts of the namespace that the admins may want to invalidate at once
+    genrefreshinterval = UgrCFG->GetLong("extcache.generations.refresh", 10);
+    lastgenrefresh = 0;
     {
-        boost::lock_guard<UgrFileInfo > l(*fi);
-        fi->decode(strnfo, value_len);
+        boost::unique_lock<boost::shared_mutex> l(nsmtx);
+        namespaces.clear();
+
+        int i = 0;
+        do {
+            char buf[1024];
+            UgrCFG->ArrayGetString("extcache.genprefix", buf, i);
+            if (!buf[0]) break;
+
+            ExtCacheNamespace ns;
+            std::string pfx = buf;
+            UgrFileInfo::trimpath(pfx);
+            ns.genkey = "ugrgen_pfx_" + pfx;
+            ns.prefixes.push_back(pfx);
+            ns.plugin = false;
+            ns.generation = 0;
+            namespaces.push_back(ns);
+
+            Info(UgrLogger::Lvl1, fname, "Invalidable prefix: '" << pfx << "'");
+            ++i;
+        } while (1);
     }
-    free(strnfo);
 
-    return 0;
-};
+    delete backend;
+    backend = 0;
 
-int ExtCacheHandler::getSubitems(UgrFileInfo *fi) {
-    const char *fname = "ExtCacheHandler::getSubitems";
-    memcached_st *conn = getconn();
-    if (!conn) return 0;
+    std::string b = UgrCFG->GetString("extcache.backend", (char *)"memcached");
+    if (b == "shm")
+        backend = new ExtCacheBackendShm();
+    else {
+        if (b != "memcached")
+            Error(fname, "Unknown extcache.backend '" << b << "'. Using memcached.");
+        backend = new ExtCacheBackendMemcached();
+    }
 
-    size_t value_len = 0;
-    memcached_return err;
-    uint32_t flags;
-    std::string k;
+    if (backend->Init()) {
+        Error(fname, "Cannot initialize the " << backend->name() << " external cache. Running without it.");
+        delete backend;
+        backend = 0;
+        return;
+    }
 
-    k = makekey_subitems(fi);
+    // A backend may not be able to hold values as big as we would like
+    if ((backend->maxValueSize() > 0) && (backend->maxValueSize() < maxvaluesize))
+        maxvaluesize = backend->maxValueSize();
 
-    char *strnfo = memcached_get(conn, k.c_str(), k.length(),
-            &value_len, &flags, &err);
+    Info(UgrLogger::Lvl1, fname, "External cache backend: " << backend->name() << " maxvaluesize: " << maxvaluesize);
+}
 
-    Info(UgrLogger::Lvl3, fname, "Memcached get: Key='" << k << "' flags:" << flags << " Res: " << memcached_strerror(conn, err));
+void ExtCacheHandler::tick(time_t timenow) {
+    if (!backend) return;
 
-    releaseconn(conn);
+    backend->Tick(timenow);
 
-    if (err != MEMCACHED_SUCCESS) {
-        return 1;
+    // Another instance may have invalidated something
+    if ((genrefreshinterval > 0) && (timenow - lastgenrefresh >= genrefreshinterval)) {
+        lastgenrefresh = timenow;
+        refreshGenerations();
     }
+}
 
-    if (!strnfo) {
-        Error(fname, "Memcached retured a null value. Key=" << fi->name);
-        return 1;
-    }
 
-    {
-        boost::lock_guard<UgrFileInfo > l(*fi);
-        fi->decodeSubitems((void *) strnfo, value_len);
-    }
-    free(strnfo);
 
-    return 0;
-};
 
-int ExtCacheHandler::putFileInfo(UgrFileInfo *fi) {
-    const char *fname = "ExtCacheHandler::putFileInfo";
 
+void ExtCacheHandler::registerPluginNamespace(const std::string &pluginname, const std::vector<std::string> &prefixes) {
+    const char *fname = "ExtCacheHandler::registerPluginNamespace";
 
-    std::string s, s1, k;
-    time_t expirationtime = time(0) + maxttl;
+    ExtCacheNamespace ns;
+    ns.genkey = "ugrgen_plugin_" + pluginname;
+    ns.prefixes = prefixes;
+    ns.plugin = true;
+    ns.generation = 0;
 
-    {
-        boost::lock_guard<UgrFileInfo > l(*fi);
-        if (!fi->dirty) return 0;
-        fi->dirty = false;
-        if (fi->getStatStatus() != UgrFileInfo::Ok) return 0;
-        fi->encodeToString(s);
-    }
+    boost::unique_lock<boost::shared_mutex> l(nsmtx);
+    for (unsigned int i = 0; i < namespaces.size(); i++)
+        if (namespaces[i].genkey == ns.genkey) {
+            namespaces[i] = ns;
+            return;
+        }
 
+    namespaces.push_back(ns);
+    Info(UgrLogger::Lvl3, fname, "Plugin '" << pluginname << "' serves " << prefixes.size() << " prefixes");
+}
 
-    memcached_st *conn = getconn();
-    if (!conn) return 0;
+bool ExtCacheHandler::nsCovers(const ExtCacheNamespace &ns, const std::string &lfn) {
+    if (ns.prefixes.empty()) return true;
 
-    k = makekey(fi);
+    for (std::vector<std::string>::const_iterator it = ns.prefixes.begin(); it != ns.prefixes.end(); ++it) {
+        const std::string &pfx = *it;
 
-    if (s.length() > 0) {
+        if (ns.plugin) {
+            // A plugin gets the queries that start with its prefix, like in doNameXlation
+            if (lfn.compare(0, pfx.size(), pfx) == 0) return true;
 
-        Info(UgrLogger::Lvl3, fname, "memcached_set " <<
-                " key:" << k << " len:" << s.length());
+            // ... and adds its prefix to the listings of the parent dirs, like in doParentQueryCheck
+            if ((pfx.size() > lfn.size()) && (pfx.compare(0, lfn.size(), lfn) == 0) &&
+                    ((lfn.size() <= 1) || (pfx[lfn.size()] == '/')))
+                return true;
+        }
+        else {
+            // A configured prefix is a whole subtree
+            if ((lfn.compare(0, pfx.size(), pfx) == 0) &&
+                    ((lfn.size() == pfx.size()) || (lfn[pfx.size()] == '/') || (pfx == "/")))
+                return true;
+        }
+    }
 
-        memcached_return r = memcached_set(conn,
-                k.c_str(), k.length(),
-                s.c_str(), s.length() + 1,
-                expirationtime, (uint32_t) 0);
+    return false;
+}
 
-        Info(UgrLogger::Lvl4, fname, "memcached_set " << "r:" << r <<
-                " key:" << k << " len:" << s.length());
+std::string ExtCacheHandler::genstamp(const std::string &lfn) {
+    // FNV-1a of the keys and values of the generations that apply
+    unsigned long long h = 14695981039346656037ULL;
+    bool stamped = false;
 
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot write fileinfo to memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
-                    "' Key= " << k <<
-                    " Valuelen: " << s.length());
+    {
+        boost::shared_lock<boost::shared_mutex> l(nsmtx);
 
-            releaseconn(conn);
+        for (std::vector<ExtCacheNamespace>::const_iterator it = namespaces.begin(); it != namespaces.end(); ++it) {
+            // Nothing changes in the keys until a generation is bumped
+            if (!it->generation || !nsCovers(*it, lfn)) continue;
 
-            return 1;
+            for (size_t i = 0; i < it->genkey.size(); i++) {
+                h ^= (unsigned char)it->genkey[i];
+                h *= 1099511628211ULL;
+            }
+            for (int i = 0; i < 8; i++) {
+                h ^= (it->generation >> (i * 8)) & 0xff;
+                h *= 1099511628211ULL;
+            }
+            stamped = true;
         }
+    }
+
+    if (!stamped) return "";
+
+    char buf[32];
+    sprintf(buf, "g%llx:", h);
+    return buf;
+}
 
-        releaseconn(conn);
+int ExtCacheHandler::refreshGenerations() {
+    const char *fname = "ExtCacheHandler::refreshGenerations";
+    if (!backend) return 1;
 
+    std::vector<std::string> keys;
+    {
+        boost::shared_lock<boost::shared_mutex> l(nsmtx);
+        for (unsigned int i = 0; i < namespaces.size(); i++)
+            keys.push_back(namespaces[i].genkey);
     }
 
-    return 0;
-};
+    if (keys.empty()) return 0;
 
-int ExtCacheHandler::putSubitems(UgrFileInfo *fi) {
-    const char *fname = "ExtCacheHandler::putSubitems";
+    std::vector<std::string> vals(keys.size());
+    std::vector<bool> found(keys.size(), false);
 
+    ExtCacheMgetCollector coll;
+    coll.vals = &vals;
+    coll.found = &found;
 
-    std::string s, k;
-    time_t expirationtime = time(0) + maxttl;
+    if (backend->mget(keys, coll))
+        return 1;
 
+    // Generations never go back. If a counter was evicted from the cache, we write back
+    // the last value we knew, otherwise the entries that it invalidated would come back
+    std::vector<std::pair<std::string, unsigned long long> > reseed;
     {
-        boost::lock_guard<UgrFileInfo > l(*fi);
-        if (!fi->dirtyitems) return 0;
-        fi->dirtyitems = false;
+        boost::unique_lock<boost::shared_mutex> l(nsmtx);
 
-        if (fi->unixflags & S_IFDIR) {
-            if (fi->getItemsStatus() != UgrFileInfo::Ok) return 0;
-        } else {
-            if (fi->getLocationStatus() != UgrFileInfo::Ok) return 0;
-        }
+        for (unsigned int i = 0; (i < keys.size()) && (i < namespaces.size()); i++) {
+            ExtCacheNamespace &ns = namespaces[i];
+            if (ns.genkey != keys[i]) continue;
 
-        fi->encodeSubitemsToString(s);
+            unsigned long long g = found[i] ? strtoull(vals[i].c_str(), 0, 10) : 0;
+
+            if (g > ns.generation) {
+                Info(UgrLogger::Lvl1, fname, "Generation of '" << ns.genkey << "' is now " << g);
+                ns.generation = g;
+            }
+            else if (g < ns.generation)
+                reseed.push_back(std::make_pair(ns.genkey, ns.generation));
+        }
     }
 
-    if (s.length() > 0) {
-        k = makekey_subitems(fi);
+    for (unsigned int i = 0; i < reseed.size(); i++) {
+        char buf[32];
+        sprintf(buf, "%llu", reseed[i].second);
 
-        memcached_st *conn = getconn();
-        if (!conn) return 0;
+        Info(UgrLogger::Lvl1, fname, "Restoring lost generation of '" << reseed[i].first << "' to " << buf);
 
-        Info(UgrLogger::Lvl3, fname, "memcached_set " <<
-                " key:" << k << " len:" << s.length());
+        // No trailing zero here, the value must stay a valid counter
+        backend->set(reseed[i].first, buf, strlen(buf), 0);
+    }
 
-        memcached_return r = memcached_set(conn,
-                k.c_str(), k.length(),
-                s.c_str(), s.length() + 1,
-                expirationtime, (uint32_t) 0);
+    return 0;
+}
 
-        Info(UgrLogger::Lvl4, fname, "memcached_set " << "r:" << r <<
-                " key:" << k << " len:" << s.length());
+int ExtCacheHandler::bumpGeneration(const std::string &genkey) {
+    const char *fname = "ExtCacheHandler::bumpGeneration";
+    if (!backend) return 1;
 
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot write subitems to memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
-                    "' Key=" << k <<
-                    " Valuelen:" << s.length());
+    uint64_t newval = 0;
+    if (backend->incr(genkey, 1, 0, newval)) {
+        Error(fname, "Cannot bump generation. Key=" << genkey);
+        return 1;
+    }
 
-            releaseconn(conn);
+    bool reseed = false;
+    {
+        boost::unique_lock<boost::shared_mutex> l(nsmtx);
 
-            return 1;
-        }
+        for (unsigned int i = 0; i < namespaces.size(); i++) {
+            if (namespaces[i].genkey != genkey) continue;
+
+            // The counter had been evicted and was recreated
+            if (newval <= namespaces[i].generation) {
+                newval = namespaces[i].generation + 1;
+                reseed = true;
+            }
 
-        releaseconn(conn);
+            namespaces[i].generation = newval;
+        }
+    }
 
+    if (reseed) {
+        char buf[32];
+        sprintf(buf, "%llu", (unsigned long long)newval);
+        backend->set(genkey, buf, strlen(buf), 0);
     }
 
+    Info(UgrLogger::Lvl1, fname, "Bumped generation of '" << genkey << "' to " << newval);
     return 0;
-};
+}
+
+int ExtCacheHandler::bumpPrefixGeneration(std::string pfx) {
+    const char *fname = "ExtCacheHandler::bumpPrefixGeneration";
 
-/// Getting the Memcached connection, async version
-memcached_st* ExtCacheHandler::getconn() {
-    const char *fname = "ExtCacheHandler::getconn";
-    memcached_st *res = 0;
-    int r;
+    UgrFileInfo::trimpath(pfx);
+    std::string genkey = "ugrgen_pfx_" + pfx;
 
+    bool known = false;
     {
-        boost::lock_guard<boost::mutex> l(connsmtx);
-        if (!conns.empty()) {
-            res = conns.front();
-            conns.pop();
-            if (res) return res;
-        }
+        boost::shared_lock<boost::shared_mutex> l(nsmtx);
+        for (unsigned int i = 0; i < namespaces.size(); i++)
+            if (namespaces[i].genkey == genkey) known = true;
     }
 
+    // Only the prefixes that are mixed into the keys can be invalidated
+    if (!known) {
+        Error(fname, "Prefix '" << pfx << "' is not listed in extcache.genprefix");
+        return 1;
+    }
 
-    Info(UgrLogger::Lvl1, fname, "Creating NEW memcached instance...");
+    return bumpGeneration(genkey);
+}
 
-    // Passing NULL means dynamically allocating space
-    res = memcached_create(NULL);
+int ExtCacheHandler::bumpPluginGeneration(const std::string &pluginname) {
+    const char *fname = "ExtCacheHandler::bumpPluginGeneration";
+    std::string genkey = "ugrgen_plugin_" + pluginname;
 
-    if (res) {
-        Info(UgrLogger::Lvl1, fname, "Configuring memcached...");
+    bool known = false;
+    {
+        boost::shared_lock<boost::shared_mutex> l(nsmtx);
+        for (unsigned int i = 0; i < namespaces.size(); i++)
+            if (namespaces[i].genkey == genkey) known = true;
+    }
 
-        // Configure the memcached behaviour
-        Info(UgrLogger::Lvl3, fname, "Setting memcached protocol...");
-        if (UgrCFG->GetBool("extcache.memcached.useBinaryProtocol", true)) {
-            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot set memcached protocol to binary. retval=" << r);
-            }
-        } else {
-            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 0);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot set memcached protocol to ascii. retval=" << r);
-            }
-        }
+    if (!known) {
+        Error(fname, "Unknown plugin '" << pluginname << "'");
+        return 1;
+    }
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached distribution...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_DISTRIBUTION, MEMCACHED_DISTRIBUTION_CONSISTENT);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached behavior to consistent. retval=" << r);
-        }
+    return bumpGeneration(genkey);
+}
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached noblock...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached behavior to async. retval=" << r);
-        }
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached TCP_NODELAY...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached TCP_NODELAY. retval=" << r);
-        }
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached NOREPLY...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NOREPLY, 1);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached NOREPLY. retval=" << r);
-        }
 
-        // Add memcached TCP hosts, take them from the config
-        int i = 0;
-        char buf[1024];
-        char server[1024];
-        do {
 
-            UgrCFG->ArrayGetString("extcache.memcached.server", buf, i++);
 
-            if (!buf[0]) break;
+std::string ExtCacheHandler::makekey(UgrFileInfo *fi) {
+    if (fi->name.length() > 0)
+        return genstamp(fi->name) + fi->name;
 
+    return genstamp(fi->name) + "/";
+}
 
+std::string ExtCacheHandler::makekey_subitems(UgrFileInfo *fi) {
+    return genstamp(fi->name) + "items_" + fi->name;
+}
 
-            // split host and port
-            char* host = 0;
-            unsigned int port = 0;
+std::string ExtCacheHandler::makekey_subitemsmanifest(UgrFileInfo *fi) {
+    return genstamp(fi->name) + "itemsmf_" + fi->name;
+}
 
+std::string ExtCacheHandler::makekey_subitemschunk(UgrFileInfo *fi, long long generation, int idx) {
+    // The chunks are reached only through their manifest, that is already stamped
+    char buf[64];
+    sprintf(buf, "itemsck_%llx_%d_", generation, idx);
+    return buf + fi->name;
+}
 
-            strcpy(server, buf);
 
-            char* token;
-            token = strtok(server, ":/?");
-            if (token != NULL) {
-                host = token;
-            }
-            token = strtok(NULL, ":/?");
-            if (token != NULL) {
-                port = atoi(token);
-            }
 
-            Info(UgrLogger::Lvl3, fname, "Adding memcached server '" << buf << "'" << host << ":" << port);
+std::string ExtCacheHandler::makekey_endpointstatus(std::string endpointname) {
+    return "endpoint_" + endpointname;
+}
+
 
-            r = memcached_server_add(res, host, port);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot add server '" << host << "' retval=" << r);
-            }
 
-        } while (buf[0]);
 
-    } else
-        Error(fname, "Cannot create memcached instance");
+int ExtCacheHandler::getFileInfo(UgrFileInfo *fi) {
+    const char *fname = "ExtCacheHandler::getFileInfo";
+    if (!backend) return 1;
+
+    size_t value_len = 0;
+    char *strnfo = 0;
+    std::string k;
+
+    k = makekey(fi);
 
+    if (backend->get(k, &strnfo, value_len))
+        return 1;
 
+    if (!strnfo) {
+        Error(fname, "The cache retured a null value. Key=" << fi->name);
+        return 1;
+    }
 
+    {
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        fi->decode(strnfo, value_len);
+    }
+    free(strnfo);
 
+    return 0;
+};
 
+int ExtCacheHandler::getSubitems(UgrFileInfo *fi, bool partialok) {
+    if (!backend) return 1;
 
+    // In one roundtrip we look for both the plain list and the manifest of a chunked one
+    std::vector<std::string> keys, vals(2);
+    std::vector<bool> found(2, false);
 
+    keys.push_back(makekey_subitems(fi));
+    keys.push_back(makekey_subitemsmanifest(fi));
 
-    return res;
-}
-/// Releasing the Memcached connection
+    ExtCacheMgetCollector coll;
+    coll.vals = &vals;
+    coll.found = &found;
 
-void ExtCacheHandler::releaseconn(memcached_st *c) {
+    if (backend->mget(keys, coll))
+        return 1;
 
-    boost::lock_guard<boost::mutex> l(connsmtx);
-    if (c) conns.push(c);
-}
+    // A plain value is always preferred. When a list grows too big, the plain value is
+    // deleted, while a list that shrank may leave behind a manifest until it expires
+    if (found[0]) {
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        return fi->decodeSubitems((void *) vals[0].c_str(), vals[0].length());
+    }
 
-/// Releasing the sync Memcached connection
-void ExtCacheHandler::releasesyncconn(memcached_st *c) {
+    if (found[1])
+        return getSubitemsChunked(fi, vals[1].c_str(), vals[1].length(), partialok);
 
-    boost::lock_guard<boost::mutex> l(connsmtx);
-    if (c) syncconns.push(c);
-}
+    return 1;
+};
 
+int ExtCacheHandler::getSubitemsChunked(UgrFileInfo *fi, const char *manifest, size_t manifestlen, bool partialok) {
+    const char *fname = "ExtCacheHandler::getSubitemsChunked";
+    SerialUgrChunkManifest mf;
 
+    // Values are stored including their trailing zero
+    if ((manifestlen < 1) || !mf.ParseFromArray(manifest, manifestlen - 1) || (mf.nchunks() <= 0)) {
+        Error(fname, "Cannot decode the manifest of a chunked list. Key=" << fi->name);
+        return 1;
+    }
 
+    std::vector<std::string> keys;
+    for (int i = 0; i < mf.nchunks(); i++)
+        keys.push_back(makekey_subitemschunk(fi, mf.generation(), i));
 
+    Info(UgrLogger::Lvl3, fname, "Fetching chunked list. Key='" << fi->name << "' nchunks: " << mf.nchunks() <<
+            " nitems: " << mf.nitems());
 
+    std::vector<bool> got(mf.nchunks(), false);
+    int ngot = 0;
 
-/// Getting the Memcached connection, SYNC version
-memcached_st* ExtCacheHandler::getsyncconn() {
-    const char *fname = "ExtCacheHandler::getsyncconn";
-    memcached_st *res = 0;
-    int r;
+    if (partialok) {
+        // Streaming: the listing grows while the chunks arrive, but it is complete
+        // only if all of them arrived and decoded fine
+        ExtCacheChunkMerger merger;
+        merger.fi = fi;
+        merger.got = &got;
+        merger.ngot = &ngot;
 
-    {
-        boost::lock_guard<boost::mutex> l(connsmtx);
-        if (!syncconns.empty()) {
-            res = syncconns.front();
-            syncconns.pop();
-            if (res) return res;
+        if (backend->mget(keys, merger) || (ngot < mf.nchunks())) {
+            Info(UgrLogger::Lvl2, fname, "Incomplete chunked list, keeping it as partial. Key='" << fi->name <<
+                    "' nchunks: " << mf.nchunks() << " merged: " << ngot);
+            return 1;
         }
+
+        boost::lock_guard<UgrFileInfo > l(*fi);
+
+        if (fi->unixflags & S_IFDIR)
+            fi->status_items = UgrFileInfo::Ok;
+        else
+            fi->status_locations = UgrFileInfo::Ok;
+
+        fi->dirtyitems = false;
+        return 0;
     }
 
+    std::vector<std::string> chunks(mf.nchunks());
 
-    Info(UgrLogger::Lvl1, fname, "Creating NEW memcached instance...");
+    ExtCacheChunkCollector coll;
+    coll.chunks = &chunks;
+    coll.got = &got;
+    coll.ngot = &ngot;
 
-    // Passing NULL means dynamically allocating space
-    res = memcached_create(NULL);
+    if (backend->mget(keys, coll) || (ngot < mf.nchunks())) {
+        // Some chunk was evicted, or belongs to another generation. A truncated listing would be
+        // wrong, so this is a cache miss and the item is left as it is
+        Info(UgrLogger::Lvl2, fname, "Incomplete chunked list, ignoring it. Key='" << fi->name <<
+                "' nchunks: " << mf.nchunks() << " found: " << ngot);
+        return 1;
+    }
 
-    if (res) {
-        Info(UgrLogger::Lvl1, fname, "Configuring memcached...");
+    // The chunks are pieces of the same repeated field, glued together they decode as one list.
+    // This way a chunk that does not decode leaves the item as it is, like a missing one
+    std::string all;
+    size_t totlen = 0;
+    for (int i = 0; i < mf.nchunks(); i++)
+        totlen += chunks[i].length();
+    all.reserve(totlen);
 
-        // Configure the memcached behaviour
-        Info(UgrLogger::Lvl3, fname, "Setting memcached protocol...");
-        if (UgrCFG->GetBool("extcache.memcached.useBinaryProtocol", true)) {
-            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot set memcached protocol to binary. retval=" << r);
-            }
-        } else {
-            r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 0);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot set memcached protocol to ascii. retval=" << r);
-            }
-        }
+    // Values are stored including their trailing zero, that here must go
+    for (int i = 0; i < mf.nchunks(); i++)
+        if (chunks[i].length() > 0) all.append(chunks[i], 0, chunks[i].length() - 1);
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached distribution...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_DISTRIBUTION, MEMCACHED_DISTRIBUTION_CONSISTENT);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached behavior to consistent. retval=" << r);
-        }
+    boost::lock_guard<UgrFileInfo > l(*fi);
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached noblock...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached behavior to async. retval=" << r);
-        }
+    if (fi->decodeSubitems((void *) all.c_str(), all.length())) {
+        Error(fname, "Cannot decode a chunked list, ignoring it. Key=" << fi->name << " nchunks: " << mf.nchunks());
+        return 1;
+    }
+
+    return 0;
+}
+
+int ExtCacheHandler::putFileInfo(UgrFileInfo *fi) {
+    const char *fname = "ExtCacheHandler::putFileInfo";
+    if (!backend) return 0;
 
-        Info(UgrLogger::Lvl3, fname, "Setting memcached TCP_NODELAY...");
-        r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot set memcached TCP_NODELAY. retval=" << r);
+    std::string s, k;
+    time_t expirationtime = time(0) + maxttl;
+
+    {
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        if (!fi->dirty) return 0;
+        fi->dirty = false;
+        if (fi->getStatStatus() != UgrFileInfo::Ok) return 0;
+        fi->encodeToString(s);
+    }
+
+    k = makekey(fi);
+
+    if (s.length() > 0) {
+        if (backend->set(k, s.c_str(), s.length() + 1, expirationtime)) {
+            Error(fname, "Cannot write fileinfo to the cache. Key=" << k <<
+                    " Valuelen: " << s.length());
+
+            return 1;
         }
+    }
 
-        // Commenting this out makes the connection SYNC
-        //Info(UgrLogger::Lvl3, fname, "Setting memcached NOREPLY...");
-        //r = memcached_behavior_set(res, MEMCACHED_BEHAVIOR_NOREPLY, 1);
-        //if (r != MEMCACHED_SUCCESS) {
-        //    Error(fname, "Cannot set memcached NOREPLY. retval=" << r);
-        //}
+    return 0;
+};
 
-        // Add memcached TCP hosts, take them from the config
-        int i = 0;
-        char buf[1024];
-        char server[1024];
-        do {
+int ExtCacheHandler::putSubitems(UgrFileInfo *fi) {
+    const char *fname = "ExtCacheHandler::putSubitems";
+    if (!backend) return 0;
 
-            UgrCFG->ArrayGetString("extcache.memcached.server", buf, i++);
+    std::string s, k;
+    std::vector<std::string> chunks;
+    time_t expirationtime = time(0) + maxttl;
 
-            if (!buf[0]) break;
+    {
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        if (!fi->dirtyitems) return 0;
+        fi->dirtyitems = false;
 
+        if (fi->unixflags & S_IFDIR) {
+            if (fi->getItemsStatus() != UgrFileInfo::Ok) return 0;
+        } else {
+            if (fi->getLocationStatus() != UgrFileInfo::Ok) return 0;
+        }
 
+        fi->encodeSubitemsToString(s);
 
-            // split host and port
-            char* host = 0;
-            unsigned int port = 0;
+        // Too big for one value, split it
+        if (s.length() >= maxvaluesize) {
+            s.clear();
+            fi->encodeSubitemsToChunks(chunks, maxvaluesize - 1);
+        }
+    }
 
+    if (chunks.size() > 0)
+        return putSubitemsChunked(fi, chunks, expirationtime);
 
-            strcpy(server, buf);
+    if (s.length() > 0) {
+        k = makekey_subitems(fi);
 
-            char* token;
-            token = strtok(server, ":/?");
-            if (token != NULL) {
-                host = token;
-            }
-            token = strtok(NULL, ":/?");
-            if (token != NULL) {
-                port = atoi(token);
-            }
+        if (backend->set(k, s.c_str(), s.length() + 1, expirationtime)) {
+            Error(fname, "Cannot write subitems to the cache. Key=" << k <<
+                    " Valuelen:" << s.length());
 
-            Info(UgrLogger::Lvl3, fname, "Adding memcached server '" << buf << "'" << host << ":" << port);
+            return 1;
+        }
+    }
 
-            r = memcached_server_add(res, host, port);
-            if (r != MEMCACHED_SUCCESS) {
-                Error(fname, "Cannot add server '" << host << "' retval=" << r);
-            }
+    return 0;
+};
+
+int ExtCacheHandler::putSubitemsChunked(UgrFileInfo *fi, std::vector<std::string> &chunks, time_t expirationtime) {
+    const char *fname = "ExtCacheHandler::putSubitemsChunked";
 
-        } while (buf[0]);
+    SerialUgrChunkManifest mf;
+    long long nitems = 0;
+    {
+        boost::lock_guard<UgrFileInfo > l(*fi);
+        nitems = (fi->unixflags & S_IFDIR) ? fi->subdirs.size() : fi->replicas.size();
+    }
 
-    } else
-        Error(fname, "Cannot create memcached instance");
+    // A new generation for every write. Readers never mix chunks written by different writers,
+    // as the manifest is written only after all its chunks
+    long long generation;
+    {
+        boost::lock_guard<boost::mutex> l(chunkgenmtx);
+        generation = ((long long)time(0) << 32) | ((long long)(getpid() & 0xffff) << 16) | (++chunkgen & 0xffff);
+    }
 
+    mf.set_nchunks(chunks.size());
+    mf.set_nitems(nitems);
+    mf.set_generation(generation);
+    std::string smf = mf.SerializeAsString();
 
+    Info(UgrLogger::Lvl3, fname, "Writing chunked list. Key='" << fi->name << "' nchunks: " << chunks.size() <<
+            " nitems: " << nitems);
 
+    // With memcached these sets are pipelined, as the connection does not wait for replies
+    for (unsigned int i = 0; i < chunks.size(); i++) {
+        std::string k = makekey_subitemschunk(fi, generation, i);
 
+        if (backend->set(k, chunks[i].c_str(), chunks[i].length() + 1, expirationtime)) {
+            Error(fname, "Cannot write subitems chunk to the cache. Key=" << k <<
+                    " Valuelen:" << chunks[i].length());
 
+            return 1;
+        }
+    }
 
+    std::string k = makekey_subitemsmanifest(fi);
+    if (backend->set(k, smf.c_str(), smf.length() + 1, expirationtime)) {
+        Error(fname, "Cannot write subitems manifest to the cache. Key=" << k);
+        return 1;
+    }
 
+    // A plain value would shadow the manifest
+    backend->del(makekey_subitems(fi));
 
-    return res;
+    return 0;
 }
 
 
@@ -490,29 +687,19 @@ memcached_st* ExtCacheHandler::getsyncconn() {
 
 int ExtCacheHandler::getEndpointStatus(PluginEndpointStatus *st, std::string endpointname) {
     const char *fname = "ExtCacheHandler::getEndpointStatus";
-    memcached_st *conn = getconn();
-    if (!conn) return 0;
+    if (!backend) return 1;
 
     size_t value_len = 0;
-    memcached_return err;
-    uint32_t flags;
+    char *strnfo = 0;
     std::string k;
 
     k = makekey_endpointstatus(endpointname);
 
-    char *strnfo = memcached_get(conn, k.c_str(), k.length(),
-            &value_len, &flags, &err);
-
-    Info(UgrLogger::Lvl3, fname, "Memcached get: Key='" << k << "' flags:" << flags << " Res: " << memcached_strerror(conn, err));
-
-    releaseconn(conn);
-
-    if (err != MEMCACHED_SUCCESS) {
+    if (backend->get(k, &strnfo, value_len))
         return 1;
-    }
 
     if (!strnfo) {
-        Error(fname, "Memcached retured a null value. Key=" << k);
+        Error(fname, "The cache retured a null value. Key=" << k);
         return 1;
     }
 
@@ -525,47 +712,63 @@ int ExtCacheHandler::getEndpointStatus(PluginEndpointStatus *st, std::string end
 
 int ExtCacheHandler::putEndpointStatus(PluginEndpointStatus *st, std::string endpointname) {
     const char *fname = "ExtCacheHandler::putEndpointStatus";
+    if (!backend) return 0;
 
-
-    std::string s, s1, k;
+    std::string s, k;
     time_t expirationtime = time(0) + maxttl;
 
-    
-        
-        st->encodeToString(s);
-    
-
-
-    memcached_st *conn = getconn();
-    if (!conn) return 0;
+    st->encodeToString(s);
 
     k = makekey_endpointstatus(endpointname);
 
     if (s.length() > 0) {
+        if (backend->set(k, s.c_str(), s.length() + 1, expirationtime)) {
+            Error(fname, "Cannot write endpointstatus to the cache. Key= " << k <<
+                    " Valuelen: " << s.length());
 
-        Info(UgrLogger::Lvl3, fname, "memcached_set " <<
-                " key:" << k << " len:" << s.length());
+            return 1;
+        }
+    }
 
-        memcached_return r = memcached_set(conn,
-                k.c_str(), k.length(),
-                s.c_str(), s.length() + 1,
-                expirationtime, (uint32_t) 0);
+    return 0;
+}
 
-        Info(UgrLogger::Lvl4, fname, "memcached_set " << "r:" << r <<
-                " key:" << k << " len:" << s.length());
 
-        if (r != MEMCACHED_SUCCESS) {
-            Error(fname, "Cannot write endpointstatus to memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
-                    "' Key= " << k <<
-                    " Valuelen: " << s.length());
+int ExtCacheHandler::getTransferRow(const std::string &site, std::string &row) {
+    const char *fname = "ExtCacheHandler::getTransferRow";
+    if (!backend) return 1;
 
-            releaseconn(conn);
+    size_t value_len = 0;
+    char *strnfo = 0;
+    std::string k = "Ugrxfer_" + site;
 
-            return 1;
-        }
+    if (backend->get(k, &strnfo, value_len))
+        return 1;
 
-        releaseconn(conn);
+    if (!strnfo) {
+        Error(fname, "The cache retured a null value. Key=" << k);
+        return 1;
+    }
+
+    // The terminator was stored too
+    row.assign(strnfo, value_len ? value_len-1 : 0);
+    free(strnfo);
+
+    return 0;
+}
+
+int ExtCacheHandler::putTransferRow(const std::string &site, const std::string &row) {
+    const char *fname = "ExtCacheHandler::putTransferRow";
+    if (!backend) return 0;
 
+    // What we learn about a site stays useful much longer than the cached items
+    time_t expirationtime = time(0) + 86400;
+    std::string k = "Ugrxfer_" + site;
+
+    if (backend->set(k, row.c_str(), row.length() + 1, expirationtime)) {
+        Error(fname, "Cannot write the transfer matrix row to the cache. Key= " << k <<
+                " Valuelen: " << row.length());
+        return 1;
     }
 
     return 0;
@@ -574,30 +777,19 @@ int ExtCacheHandler::putEndpointStatus(PluginEndpointStatus *st, std::string end
 
 int ExtCacheHandler::putMoninfo(std::string val) {
   const char *fname = "ExtCacheHandler::putMoninfo";
+  if (!backend) return 0;
   
   time_t expirationtime = time(0) + 86400 * 30;
   
-  memcached_st *conn = getsyncconn();
-  if (!conn) return 0;
-  
   if (val.length() > 0) {
     std::string k = "Ugrpluginstats_idx";
     uint64_t newval = 0;
     
-    Info(UgrLogger::Lvl3, fname, "memcached_increment " <<
-      " key:" << k);
-    
     // First get a new value of the counter Ugrpluginstats_idx
-    memcached_return r1 = memcached_increment_with_initial(conn, k.c_str(), k.length(),
-                                                    1, 0, expirationtime, &newval);
-        
-    if (r1 != MEMCACHED_SUCCESS) {
-      Error(fname, "Cannot increment monitoring index to memcached. retval=" << r1 << " '" << memcached_strerror(conn, r1) <<
-      "' Key= " << k <<
+    if (backend->incr(k, 0, expirationtime, newval)) {
+      Error(fname, "Cannot increment monitoring index. Key= " << k <<
       " Valuelen: " << val.length());
       
-      releasesyncconn(conn);
-      
       return 1;
     }
     
@@ -606,30 +798,13 @@ int ExtCacheHandler::putMoninfo(std::string val) {
     k = "Ugrpluginstats_";
     k = k + buf;
     
-    
-    Info(UgrLogger::Lvl3, fname, "memcached_set " <<
-    " key:" << k << " len:" << val.length());
-    
-    memcached_return r = memcached_set(conn,
-                                       k.c_str(), k.length(),
-                                       val.c_str(), val.length() + 1,
-                                       expirationtime, (uint32_t) 0);
-    
-    Info(UgrLogger::Lvl4, fname, "memcached_increment " << "r:" << r <<
-    " key:" << k << " len:" << val.length());
-    
-    if (r != MEMCACHED_SUCCESS) {
-      Error(fname, "Cannot write endpointstatus to memcached. retval=" << r << " '" << memcached_strerror(conn, r) <<
-      "' Key= " << k <<
+    if (backend->set(k, val.c_str(), val.length() + 1, expirationtime)) {
+      Error(fname, "Cannot write monitoring info. Key= " << k <<
       " Valuelen: " << val.length());
       
-      releasesyncconn(conn);
-      
       return 1;
     }
     
-    releasesyncconn(conn);
-    
   }
   
   return 0;
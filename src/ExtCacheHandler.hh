@@ -23,10 +23,11 @@
 
 #include "Config.h"
 #include "LocationInfo.hh"
+#include "ExtCacheBackend.hh"
 
-#include <libmemcached/memcached.h>
 #include <string>
-#include <queue>
+#include <vector>
+#include <boost/thread/shared_mutex.hpp>
 
 
 
@@ -37,39 +38,73 @@
 
 class PluginEndpointStatus;
 
+/// A part of the namespace whose cached entries can be invalidated all at once.
+/// Its generation is stored in the external cache and is mixed into the keys
+/// of all the entries it covers, so bumping it makes them unreachable
+struct ExtCacheNamespace {
+    /// The key that holds the generation, e.g. ugrgen_pfx_/atlas/data
+    std::string genkey;
+    /// The prefixes that are covered. None means everything
+    std::vector<std::string> prefixes;
+    /// True if this is the contribution of a plugin. Then the prefixes are matched
+    /// the way the plugins match their xlatepfx, and the parent dirs are covered too
+    bool plugin;
+    /// The last known generation. 0 if it was never bumped
+    unsigned long long generation;
+};
+
 class ExtCacheHandler {
 private:
 
+    /// Where the values are actually stored, memcached by default
+    ExtCacheBackend *backend;
 
-    /// This is our simple but effective pool of connections to memcached
-    /// If a connection is not available, a new one is created and it is then added to the pool
-    std::queue<memcached_st *> conns, syncconns;
-    boost::mutex connsmtx;
-
-    /// Getting the Memcached connection, for async operations
-    memcached_st* getconn();
-    /// Releasing the Memcached connection
-    void releaseconn(memcached_st *c);
-
-    /// Getting the Memcached connection, for SYNC operations
-    memcached_st* getsyncconn();
-    /// Releasing the Memcached connection
-    void releasesyncconn(memcached_st *c);
-    
     /// The max ttl for an item in the cache
     int maxttl;
 
+    /// The max size of a value that we try to store. Lists of subitems
+    /// that are bigger than this are split into chunks
+    size_t maxvaluesize;
+
+    /// Makes unique the keys of the chunks written by this instance
+    unsigned int chunkgen;
+    boost::mutex chunkgenmtx;
+
+    /// The namespaces that can be invalidated, and when their generations were last fetched
+    std::vector<ExtCacheNamespace> namespaces;
+    boost::shared_mutex nsmtx;
+    time_t lastgenrefresh;
+    int genrefreshinterval;
+
+    /// Tells if a namespace covers an lfn
+    static bool nsCovers(const ExtCacheNamespace &ns, const std::string &lfn);
+    /// The generation stamp to prepend to the keys of an lfn, empty if nothing was ever bumped
+    std::string genstamp(const std::string &lfn);
+    /// Bump the generation stored in a key
+    int bumpGeneration(const std::string &genkey);
+
     std::string makekey(UgrFileInfo *fi);
     std::string makekey_subitems(UgrFileInfo *fi);
+    std::string makekey_subitemsmanifest(UgrFileInfo *fi);
+    std::string makekey_subitemschunk(UgrFileInfo *fi, long long generation, int idx);
     
     std::string makekey_endpointstatus(std::string endpointname);
+
+    /// Store a huge list of subitems as a manifest plus N chunks
+    int putSubitemsChunked(UgrFileInfo *fi, std::vector<std::string> &chunks, time_t expirationtime);
+    /// Fetch all the chunks described by a manifest. With partialok each chunk is merged into fi
+    /// as soon as it arrives, otherwise they are merged only if they are all there and decode fine.
+    /// Either way the listing is complete only if all the chunks made it, otherwise it's a cache miss
+    int getSubitemsChunked(UgrFileInfo *fi, const char *manifest, size_t manifestlen, bool partialok);
 public:
 
 
 
     // Cache in/out
     int getFileInfo(UgrFileInfo *fi);
-    int getSubitems(UgrFileInfo *fi);
+    /// With partialok, a chunked list that is incomplete is left merged in fi, for
+    /// a reader that can use a partial listing while the rest comes from the plugins
+    int getSubitems(UgrFileInfo *fi, bool partialok = false);
     int putFileInfo(UgrFileInfo *fi);
     int putSubitems(UgrFileInfo *fi);
     
@@ -77,22 +112,37 @@ public:
     int putEndpointStatus(PluginEndpointStatus *st, std::string endpointname);
 
     int putMoninfo(std::string val);
+
+    /// The row of the transfer matrix of a client site, as shared among the instances
+    int getTransferRow(const std::string &site, std::string &row);
+    int putTransferRow(const std::string &site, const std::string &row);
+
+    /// Declare the prefixes served by a plugin, so that its contribution can be invalidated.
+    /// An empty list means that the plugin may contribute to any lfn
+    void registerPluginNamespace(const std::string &pluginname, const std::vector<std::string> &prefixes);
+
+    /// Fetch the current generations from the cache
+    int refreshGenerations();
+
+    /// Invalidate, in all the instances that share the cache, all the entries below
+    /// a prefix listed in extcache.genprefix
+    int bumpPrefixGeneration(std::string pfx);
+    /// Invalidate, in all the instances that share the cache, all the entries
+    /// a plugin may have contributed to
+    int bumpPluginGeneration(const std::string &pluginname);
     
-    ExtCacheHandler() {};
+    ExtCacheHandler(): backend(0), lastgenrefresh(0), genrefreshinterval(10) {};
 
+    /// Set up the backend that is selected by extcache.backend
     void Init();
+
+    /// True if there is a backend, i.e. an external cache to look into
+    bool isOn() const { return (backend != 0); }
+
+    /// Periodic housekeeping
+    void tick(time_t timenow);
     
-    ~ExtCacheHandler() {
-        while (!conns.empty()) {
-            memcached_free(conns.front());
-            conns.pop();
-        }
-        
-        while (!syncconns.empty()) {
-            memcached_free(syncconns.front());
-            syncconns.pop();
-        }
-    }
+    ~ExtCacheHandler();
 
 
 
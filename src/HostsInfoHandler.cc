@@ -0,0 +1,240 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+
+/** @file   HostsInfoHandler.cc
+ * @brief  Handler of information about hosts and endpoints
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "HostsInfoHandler.hh"
+#include "UgrMetrics.hh"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+
+static UgrMetricCounter *metric_xferevictlru = UgrMetrics::get()->counter("ugr_xfermatrix_evictions", "Client sites removed from the transfer matrix", "reason=\"lru\"");
+static UgrMetricCounter *metric_xferevictdirty = UgrMetrics::get()->counter("ugr_xfermatrix_evictions", "Client sites removed from the transfer matrix", "reason=\"dirty\"");
+
+/// How many sites are looked at to find one to forget
+#define XFER_EVICT_SAMPLES 16
+
+
+std::string HostsInfoHandler::clientSite(const std::string &ip) {
+  unsigned char a[16];
+  char buf[64];
+
+  if (inet_pton(AF_INET, ip.c_str(), a) == 1) {
+    snprintf(buf, sizeof(buf), "%d.%d.%d.0/24", a[0], a[1], a[2]);
+    return buf;
+  }
+
+  if (inet_pton(AF_INET6, ip.c_str(), a) == 1) {
+    // A client may come as an IPv4 address mapped into IPv6
+    static const unsigned char v4mapped[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+    if (!memcmp(a, v4mapped, 12)) {
+      snprintf(buf, sizeof(buf), "%d.%d.%d.0/24", a[12], a[13], a[14]);
+      return buf;
+    }
+
+    snprintf(buf, sizeof(buf), "%x:%x:%x::/48", (a[0] << 8) | a[1], (a[2] << 8) | a[3], (a[4] << 8) | a[5]);
+    return buf;
+  }
+
+  return "";
+}
+
+
+void HostsInfoHandler::setXferParams(size_t maxsites, float memory, int maxidle) {
+  boost::unique_lock<boost::shared_mutex> l(*this);
+  xfermaxsites = maxsites;
+  xfermemory = (memory >= 1) ? memory : 1;
+  xfermaxidle = (maxidle > 0) ? maxidle : 1;
+}
+
+
+bool HostsInfoHandler::evictXferSite() {
+  if (xfersites.empty()) return false;
+
+  // An approximated LRU, like the one of memcached: look at a few sites, starting from
+  // a different bucket each time, and forget the one that was used least recently.
+  // The ones with local samples only if there is nothing else, their samples are lost
+  std::unordered_map<std::string, XferSite>::iterator victim = xfersites.end();
+  size_t nbuckets = xfersites.bucket_count();
+  int nsamples = 0;
+
+  for (size_t i = 0; (i < nbuckets) && (nsamples < XFER_EVICT_SAMPLES); i++) {
+    size_t b = (xferevictbucket + i) % nbuckets;
+    for (std::unordered_map<std::string, XferSite>::local_iterator lit = xfersites.begin(b);
+         lit != xfersites.end(b); ++lit) {
+      nsamples++;
+
+      if (victim != xfersites.end()) {
+        if (lit->second.dirty && !victim->second.dirty) continue;
+        if ((lit->second.dirty == victim->second.dirty) &&
+            (lit->second.lastused.load(std::memory_order_relaxed) >= victim->second.lastused.load(std::memory_order_relaxed)))
+          continue;
+      }
+      victim = xfersites.find(lit->first);
+    }
+    xferevictbucket = b + 1;
+  }
+
+  if (victim == xfersites.end()) return false;
+
+  if (victim->second.dirty) metric_xferevictdirty->inc();
+  else metric_xferevictlru->inc();
+
+  xfersites.erase(victim);
+  return true;
+}
+
+
+void HostsInfoHandler::noteTransfer(const std::string &site, int pluginID, long long bytes, int duration_ms, bool ok) {
+  if (site.empty() || (pluginID < 0)) return;
+
+  boost::unique_lock<boost::shared_mutex> l(*this);
+
+  if ((xfersites.size() >= xfermaxsites) && !xfersites.count(site)) {
+    if (!evictXferSite()) {
+      metric_xferevictdirty->inc();
+      return;
+    }
+  }
+
+  XferSite &xs = xfersites[site];
+  xs.lastused.store(time(0), std::memory_order_relaxed);
+  HostsXferStats &s = xs.row[pluginID];
+
+  // A running mean that forgets the samples older than xfermemory
+  if (s.weight < xfermemory) s.weight += 1;
+  s.errrate += ((ok ? 0.0 : 1.0) - s.errrate) / s.weight;
+  s.lsamples++;
+  if (!ok) s.lerrs++;
+
+  if (ok && (bytes > 0) && (duration_ms > 0)) {
+    float r = bytes * 1000.0 / duration_ms;
+    if (s.rate < 0) s.rate = r;
+    else s.rate += (r - s.rate) / s.weight;
+
+    s.lratesum += r;
+    s.lrates++;
+  }
+
+  xs.dirty = true;
+}
+
+
+void HostsInfoHandler::getXferRow(const std::string &site, HostsXferRow &row) {
+  row.clear();
+  if (site.empty()) return;
+
+  time_t timenow = time(0);
+
+  {
+    // This is called at every locate, the lookup must not serialize them
+    boost::shared_lock<boost::shared_mutex> l(*this);
+    std::unordered_map<std::string, XferSite>::iterator it = xfersites.find(site);
+
+    if (it != xfersites.end()) {
+      it->second.wanted.store(true, std::memory_order_relaxed);
+      it->second.lastused.store(timenow, std::memory_order_relaxed);
+      row = it->second.row;
+      return;
+    }
+  }
+
+  // Nothing yet. Maybe the other instances know something, the next sync will tell
+  boost::unique_lock<boost::shared_mutex> l(*this);
+  if ((xfersites.size() >= xfermaxsites) && !xfersites.count(site)) return;
+
+  XferSite &xs = xfersites[site];
+  xs.wanted.store(true, std::memory_order_relaxed);
+  xs.lastused.store(timenow, std::memory_order_relaxed);
+  row = xs.row;
+}
+
+
+void HostsInfoHandler::getXferSitesToSync(std::vector<std::string> &sites) {
+  sites.clear();
+
+  time_t timenow = time(0);
+
+  boost::unique_lock<boost::shared_mutex> l(*this);
+  for (std::unordered_map<std::string, XferSite>::iterator it = xfersites.begin(); it != xfersites.end(); ) {
+    XferSite &xs = it->second;
+    bool wanted = xs.wanted.exchange(false, std::memory_order_relaxed);
+
+    // A site that the other instances knew nothing about at the last sync, and that
+    // nobody asked for since then, would cost a get at every sync for nothing.
+    // The same for the sites that nobody asked for in a while
+    if (!xs.dirty && !wanted &&
+        (xs.row.empty() || (timenow - xs.lastused.load(std::memory_order_relaxed) > xfermaxidle))) {
+      it = xfersites.erase(it);
+      continue;
+    }
+
+    if (xs.dirty || wanted) sites.push_back(it->first);
+    ++it;
+  }
+}
+
+
+bool HostsInfoHandler::mergeXferRow(const std::string &site, const HostsXferRow &remote, HostsXferRow &merged) {
+  boost::unique_lock<boost::shared_mutex> l(*this);
+
+  merged = remote;
+
+  // Evicted since the list of the sites to sync was made. It stays out,
+  // it will come back if somebody asks for it
+  std::unordered_map<std::string, XferSite>::iterator it = xfersites.find(site);
+  if (it == xfersites.end()) return false;
+
+  XferSite &xs = it->second;
+  bool haslocal = false;
+
+  for (HostsXferRow::iterator i = xs.row.begin(); i != xs.row.end(); ++i) {
+    HostsXferStats &loc = i->second;
+    HostsXferRow::iterator r = merged.find(i->first);
+
+    if (r == merged.end()) {
+      // Nobody else knows about this one, our values are all there is
+      HostsXferStats &m = merged[i->first];
+      m.rate = loc.rate;
+      m.errrate = loc.errrate;
+      m.weight = loc.weight;
+      haslocal |= (loc.lsamples > 0);
+      continue;
+    }
+
+    if (!loc.lsamples) continue;
+    haslocal = true;
+
+    // The remote values weigh as the samples they are made of, the old ones fade away
+    HostsXferStats &m = r->second;
+    float w = std::min(m.weight, std::max(xfermemory - loc.lsamples, (float)0));
+
+    m.errrate = (m.errrate * w + loc.lerrs) / (w + loc.lsamples);
+    if (loc.lrates) {
+      if (m.rate < 0) m.rate = loc.lratesum / loc.lrates;
+      else m.rate = (m.rate * w + loc.lratesum) / (w + loc.lrates);
+    }
+    m.weight = std::min(w + loc.lsamples, xfermemory);
+  }
+
+  xs.row = merged;
+  xs.dirty = false;
+
+  return haslocal;
+}
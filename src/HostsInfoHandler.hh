@@ -24,14 +24,165 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unordered_map>
+#include <atomic>
 #include <boost/thread.hpp>
 
 
-/// A repository of information about hosts or sites.
-class HostsInfoHandler: public boost::shared_mutex {
+/// How the transfers between a client site and an endpoint went
+struct HostsXferStats {
+  /// Throughput in bytes per second, negative if unknown
+  float rate;
+  /// Fraction of the transfers that failed
+  float errrate;
+  /// How many samples the values above are made of, up to the memory of the matrix
+  float weight;
+
+  /// What was reported here since the last sync with the other instances
+  double lratesum;
+  int lrates, lerrs, lsamples;
+
+  HostsXferStats(): rate(-1), errrate(0), weight(0), lratesum(0), lrates(0), lerrs(0), lsamples(0) {}
+};
+
+/// The endpoints seen by a client site, by pluginID
+typedef std::map<int, HostsXferStats> HostsXferRow;
 
 
-   void tick(time_t timenow) {};
+/// A repository of information about hosts or sites.
+/// It knows how busy the endpoints are, as the number of
+/// redirections that we recently sent to each of them. The count decays
+/// exponentially with time, halving every halflife seconds.
+/// The loads are lock-free, the lock is for the rest.
+/// It also keeps the matrix of the transfers reported between client
+/// sites and endpoints. The rows are merged with the ones of the other
+/// instances through the external cache, see UgrConnector::syncTransferMatrix
+class HostsInfoHandler: public boost::shared_mutex {
+private:
+
+    /// Max number of endpoints whose load is tracked. The pluginIDs are small integers
+    static const int maxendpoints = 4096;
+
+    /// The load of an endpoint, indexed by pluginID. It is read at every locate, hence
+    /// no lock: each word packs the decayed count (a float, low 32 bits) and
+    /// the time it was last updated (high 32 bits), and is updated with a CAS
+    std::atomic<uint64_t> loads[maxendpoints];
+
+    std::atomic<int> halflife;
+
+    static uint64_t packLoad(float redirects, time_t t) {
+      uint32_t r;
+      memcpy(&r, &redirects, sizeof(r));
+      return ((uint64_t)(uint32_t)t << 32) | r;
+    }
+
+    static float loadRedirects(uint64_t v) {
+      uint32_t r = (uint32_t)v;
+      float f;
+      memcpy(&f, &r, sizeof(f));
+      return f;
+    }
+
+    static time_t loadTime(uint64_t v) {
+      return (time_t)(v >> 32);
+    }
+
+    struct XferSite {
+      HostsXferRow row;
+      /// Has local samples that the other instances have not seen yet
+      bool dirty;
+      /// Has been looked at since the last sync. Set also under the shared lock
+      std::atomic<bool> wanted;
+      /// When it was last looked at. Set also under the shared lock
+      std::atomic<time_t> lastused;
+
+      XferSite(): dirty(false), wanted(false), lastused(0) {}
+    };
+
+    /// Indexed by client site
+    std::unordered_map<std::string, XferSite> xfersites;
+
+    /// Max number of client sites to keep
+    size_t xfermaxsites;
+    /// Max weight of the past in the averages, in samples
+    float xfermemory;
+    /// Sites with no local samples that nobody looked at for this long are forgotten
+    int xfermaxidle;
+    /// Where the next look for a site to forget starts from
+    size_t xferevictbucket;
+
+    /// Forget one site to make room for another, the least recently used among a few.
+    /// To be called with the unique lock held
+    /// @return false if there was nothing to forget
+    bool evictXferSite();
+
+    /// The count of an endpoint, as it is at the given time
+    float decayed(uint64_t v, time_t timenow) const {
+      float r = loadRedirects(v);
+      time_t t = loadTime(v);
+      if ((timenow <= t) || (r <= 0)) return r;
+      return r * pow(0.5, (double)(timenow - t) / halflife.load(std::memory_order_relaxed));
+    }
+
+public:
+
+    HostsInfoHandler(): halflife(10), xfermaxsites(10000), xfermemory(50), xfermaxidle(600), xferevictbucket(0) {
+      for (int i = 0; i < maxendpoints; i++) loads[i].store(0, std::memory_order_relaxed);
+    }
+
+    void setHalflife(int secs) {
+      halflife.store((secs > 0) ? secs : 1, std::memory_order_relaxed);
+    }
+
+    /// A client has been sent to an endpoint
+    void noteRedirect(int pluginID) {
+      if ((pluginID < 0) || (pluginID >= maxendpoints)) return;
+
+      time_t timenow = time(0);
+      std::atomic<uint64_t> &e = loads[pluginID];
+      uint64_t v = e.load(std::memory_order_relaxed);
+
+      // On failure v gets what the others wrote, so the decay is redone on that
+      while (!e.compare_exchange_weak(v, packLoad(decayed(v, timenow) + 1, timenow),
+                                      std::memory_order_relaxed));
+    }
+
+    /// How many clients have been sent to an endpoint recently
+    float getLoad(int pluginID) {
+      if ((pluginID < 0) || (pluginID >= maxendpoints)) return 0;
+
+      return decayed(loads[pluginID].load(std::memory_order_relaxed), time(0));
+    }
+
+    /// The site of a client, i.e. its /24 or /48 subnet. Empty if the address is not numeric
+    static std::string clientSite(const std::string &ip);
+
+    void setXferParams(size_t maxsites, float memory, int maxidle);
+
+    /// A transfer between a client site and an endpoint has ended
+    void noteTransfer(const std::string &site, int pluginID, long long bytes, int duration_ms, bool ok);
+
+    /// Get what we know about the endpoints as seen from a client site.
+    /// The site is marked for a refresh from the other instances
+    void getXferRow(const std::string &site, HostsXferRow &row);
+
+    /// The sites that have to be synced with the other instances.
+    /// The idle ones, and the ones that nobody had anything about, are forgotten here
+    void getXferSitesToSync(std::vector<std::string> &sites);
+
+    /// Merge the local samples of a site into its row as it was found in the external cache.
+    /// The result becomes our row and is also returned, to be written back
+    /// @return true if there were local samples, i.e. the row has to be written back.
+    ///         false also if the site was evicted in the meantime, it is not added back
+    bool mergeXferRow(const std::string &site, const HostsXferRow &remote, HostsXferRow &merged);
+
+    /// The loads decay when they are read, nothing to do here
+    void tick(time_t timenow) {};
 
 
 };
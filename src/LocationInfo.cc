@@ -19,13 +19,57 @@
 #include "UgrConnector.hh"
 #include "LocationInfo.hh"
 #include "UgrMemcached.pb.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <iomanip>
+#include <string.h>
 #include "UgrConfig.hh"
 
 using namespace boost;
 using namespace std;
 using namespace ugrmemcached;
 
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+
+// The lists of subitems are decoded by walking the protobuf wire format,
+// taking the strings directly from the buffer that came from the cache.
+// This avoids building a full message with a string per field, only to copy
+// everything again into the sets. The format is the one of SerialUgrSubdirs
+// and SerialUgrReplicas
+
+#define UGR_TAG_LEN(n) WireFormatLite::MakeTag(n, WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+#define UGR_TAG_FIXED32(n) WireFormatLite::MakeTag(n, WireFormatLite::WIRETYPE_FIXED32)
+#define UGR_TAG_VARINT(n) WireFormatLite::MakeTag(n, WireFormatLite::WIRETYPE_VARINT)
+
+/// Get a view of a length delimited field, without copying it
+static bool readView(CodedInputStream &in, const char *&p, int &len) {
+    uint32_t l;
+    const void *data;
+    int avail;
+
+    if (!in.ReadVarint32(&l)) return false;
+
+    len = l;
+    if (!l) {
+        p = "";
+        return true;
+    }
+
+    if (!in.GetDirectBufferPointer(&data, &avail) || (avail < (int)l)) return false;
+    p = (const char *)data;
+
+    return in.Skip(l);
+}
+
+static bool readFloat(CodedInputStream &in, float &f) {
+    uint32_t v;
+    if (!in.ReadLittleEndian32(&v)) return false;
+    memcpy(&f, &v, sizeof(f));
+    return true;
+}
+
 
 
 UgrFileInfo::UgrFileInfo(UgrConnector & c, std::string &lfn) : context(c){
@@ -216,7 +260,18 @@ int UgrFileInfo::encodeToString(std::string &str) {
 int UgrFileInfo::decode(void *data, int sz) {
     if (!sz) return 1;
 
+#if GOOGLE_PROTOBUF_VERSION >= 3014000
+    // All the allocations of the message fit in a block on the stack
+    char arenablock[1024];
+    google::protobuf::ArenaOptions opts;
+    opts.initial_block = arenablock;
+    opts.initial_block_size = sizeof(arenablock);
+    google::protobuf::Arena arena(opts);
+
+    SerialUgrfileInfo &sufi = *google::protobuf::Arena::CreateMessage<SerialUgrfileInfo>(&arena);
+#else
     SerialUgrfileInfo sufi;
+#endif
 
     sufi.ParseFromArray(data, sz);
 
@@ -288,56 +343,191 @@ int UgrFileInfo::encodeSubitemsToString(std::string &str) {
 
 /// We will like to be able to encode this info to a string, e.g. for external caching purposes
 
-int UgrFileInfo::decodeSubitems(void *data, int sz) {
-    if (!sz) return 1;
+int UgrFileInfo::encodeSubitemsToChunks(std::vector<std::string> &chunks, size_t maxchunksize) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+    chunks.clear();
 
+    // A conservative estimation of the protobuf overhead per item,
+    // we don't want to count the bytes exactly
+    const size_t itemoverhead = 32;
+    size_t cursz = 0;
 
     if (unixflags & S_IFDIR) {
-        // List of subdirs
         SerialUgrSubdirs dirlist;
-        SerialUgrSubdir dir;
 
-        dirlist.ParseFromArray(data, sz);
-        //list.PrintDebugString();
+        for (std::set<UgrFileItem, UgrFileItemComp>::iterator it = subdirs.begin();
+                it != subdirs.end();
+                it++) {
+
+            size_t itemsz = it->name.size() + itemoverhead;
+            if ((cursz > 0) && (cursz + itemsz > maxchunksize)) {
+                chunks.push_back(dirlist.SerializeAsString());
+                dirlist.Clear();
+                cursz = 0;
+            }
 
-        for (int i = 0; i < dirlist.subdirs_size(); i++) {
-            UgrFileItem itr;
+            dirlist.add_subdirs()->set_name(it->name);
+            cursz += itemsz;
+        }
+
+        if (dirlist.subdirs_size() > 0)
+            chunks.push_back(dirlist.SerializeAsString());
+
+    } else {
+        SerialUgrReplicas replist;
+        SerialUgrReplica* pnt;
+
+        for (std::set<UgrFileItem_replica, UgrFileItemComp>::iterator it = replicas.begin();
+                it != replicas.end();
+                it++) {
+
+            size_t itemsz = it->name.size() + it->location.size() + itemoverhead;
+            if ((cursz > 0) && (cursz + itemsz > maxchunksize)) {
+                chunks.push_back(replist.SerializeAsString());
+                replist.Clear();
+                cursz = 0;
+            }
 
-            dir = dirlist.subdirs(i);
-            itr.name = dir.name();
-            subdirs.insert(itr);
+            pnt = replist.add_replicas();
+
+            pnt->set_name(it->name);
 
+            pnt->set_latitude(it->latitude);
+            pnt->set_location(it->location);
+            pnt->set_longitude(it->longitude);
+            pnt->set_pluginid(it->pluginID);
+            cursz += itemsz;
+        }
+
+        if (replist.replicas_size() > 0)
+            chunks.push_back(replist.SerializeAsString());
+    }
+
+    return (chunks.size() > 0);
+}
+
+/// We will like to be able to encode this info to a string, e.g. for external caching purposes
+
+int UgrFileInfo::decodeSubitemsChunk(const void *data, int sz) {
+    const char *fname = "UgrFileInfo::decodeSubitemsChunk";
+    if (sz <= 0) return 1;
+
+    CodedInputStream in((const google::protobuf::uint8 *)data, sz);
+    uint32_t tag, itemtag, msglen;
+    const char *p;
+    int len;
+    bool ok = true;
+
+    // The items are merged only if the whole buffer decodes fine, a truncated or
+    // corrupted value must not leave half a listing behind
+    std::vector<UgrFileItem> dirs;
+    std::vector<UgrFileItem_replica> reps;
+
+    if (unixflags & S_IFDIR) {
+        // List of subdirs
+
+        while (ok && ((tag = in.ReadTag()) != 0)) {
+            if (tag != UGR_TAG_LEN(1)) {
+                ok = WireFormatLite::SkipField(&in, tag);
+                continue;
+            }
+
+            // An item longer than what is left was cut, as the limit would not be applied
+            if (!(ok = in.ReadVarint32(&msglen) && (msglen <= (uint32_t)in.BytesUntilLimit()))) break;
+            CodedInputStream::Limit lim = in.PushLimit(msglen);
+
+            UgrFileItem itr;
+            while (ok && ((itemtag = in.ReadTag()) != 0)) {
+                if (itemtag == UGR_TAG_LEN(1)) {
+                    if ((ok = readView(in, p, len))) itr.name.assign(p, len);
+                } else
+                    ok = WireFormatLite::SkipField(&in, itemtag);
+            }
+
+            // An item that does not end exactly at its length was truncated
+            ok = ok && (in.BytesUntilLimit() == 0);
+            in.PopLimit(lim);
+            if (ok) dirs.push_back(std::move(itr));
         }
-        status_items = Ok;
 
     } else {
         // List of replicas
-        SerialUgrReplicas replist;
-        SerialUgrReplica rep;
-        
-        replist.ParseFromArray(data, sz);
-        //list.PrintDebugString();
 
-        for (int i = 0; i < replist.replicas_size(); i++) {
-            UgrFileItem_replica itr;
+        while (ok && ((tag = in.ReadTag()) != 0)) {
+            if (tag != UGR_TAG_LEN(1)) {
+                ok = WireFormatLite::SkipField(&in, tag);
+                continue;
+            }
 
+            if (!(ok = in.ReadVarint32(&msglen) && (msglen <= (uint32_t)in.BytesUntilLimit()))) break;
+            CodedInputStream::Limit lim = in.PushLimit(msglen);
 
-            rep = replist.replicas(i);
-            itr.name = rep.name();
-            itr.latitude = rep.latitude();
-            itr.longitude = rep.longitude();
-            itr.location = rep.location();
-            itr.pluginID = rep.pluginid();
-            setPluginID(itr.pluginID, false);
-            replicas.insert(itr);
+            UgrFileItem_replica itr;
+            uint32_t v;
+            while (ok && ((itemtag = in.ReadTag()) != 0)) {
+                switch (itemtag) {
+                    case UGR_TAG_LEN(1):
+                        if ((ok = readView(in, p, len))) itr.name.assign(p, len);
+                        break;
+                    case UGR_TAG_LEN(2):
+                        if ((ok = readView(in, p, len))) itr.location.assign(p, len);
+                        break;
+                    case UGR_TAG_FIXED32(3):
+                        ok = readFloat(in, itr.latitude);
+                        break;
+                    case UGR_TAG_FIXED32(4):
+                        ok = readFloat(in, itr.longitude);
+                        break;
+                    case UGR_TAG_VARINT(5):
+                        if ((ok = in.ReadVarint32(&v))) itr.pluginID = (int32_t)v;
+                        break;
+                    default:
+                        ok = WireFormatLite::SkipField(&in, itemtag);
+                }
+            }
+
+            ok = ok && (in.BytesUntilLimit() == 0);
+            in.PopLimit(lim);
+            if (ok) reps.push_back(std::move(itr));
         }
         
-        status_locations = Ok;
-        
     }
 
+    // A zero tag is the end only if it's the trailing zero that values in the cache carry
+    if (ok) {
+        int pos = in.CurrentPosition();
+        ok = (pos == sz) || ((pos == sz - 1) && !((const char *)data)[sz - 1]);
+    }
+
+    if (!ok) {
+        Info(UgrLogger::Lvl2, fname, "Could not decode the subitems, ignoring them. Name: " << name << " pos: " <<
+                in.CurrentPosition() << " size: " << sz);
+        return 1;
+    }
+
+    // The items were encoded from a sorted set, hence inserting at the end
+    // is the right hint and the inserts take constant time
+    for (size_t i = 0; i < dirs.size(); i++)
+        subdirs.insert(subdirs.end(), std::move(dirs[i]));
 
+    for (size_t i = 0; i < reps.size(); i++) {
+        setPluginID(reps[i].pluginID, false);
+        replicas.insert(replicas.end(), std::move(reps[i]));
+    }
+
+    return 0;
+}
+
+/// We will like to be able to encode this info to a string, e.g. for external caching purposes
+
+int UgrFileInfo::decodeSubitems(void *data, int sz) {
+    if (decodeSubitemsChunk(data, sz)) return 1;
+
+    if (unixflags & S_IFDIR)
+        status_items = Ok;
+    else
+        status_locations = Ok;
 
     dirtyitems = false;
     return 0;
@@ -391,7 +581,8 @@ void UgrFileInfo::takeStat(const struct stat &st) {
     
     status_statinfo = UgrFileInfo::Ok;
 
-    if ((long) st.st_nlink > UgrCFG->GetLong("glb.maxlistitems", 2000)) {
+    static UgrConfigKey<long> maxlistitems("glb.maxlistitems", 2000);
+    if ((long) st.st_nlink > maxlistitems.get()) {
         Info(UgrLogger::Lvl2, fname, "Setting " << name << " as non listable. nlink=" << st.st_nlink);
         subdirs.clear();
         status_items = UgrFileInfo::Error;
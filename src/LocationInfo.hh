@@ -24,6 +24,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <boost/thread.hpp>
 
 #include "SimpleDebug.hh"
@@ -65,9 +66,6 @@ class UgrFileItem {
 public:
 
     UgrFileItem() {}
-    UgrFileItem(const UgrFileItem & origin) :
-        name(origin.name),
-        location(origin.location){}
     
     // The item's name
     std::string name;
@@ -125,7 +123,7 @@ class UgrFileItemComp {
 public:
 	virtual ~UgrFileItemComp(){};
 	
-    virtual bool operator()(UgrFileItem s1, UgrFileItem s2) {
+    virtual bool operator()(const UgrFileItem &s1, const UgrFileItem &s2) const {
         if (s1.name < s2.name)
             return true;
         else
@@ -233,7 +231,8 @@ public:
         //
         // As an addition, we also add the possibility of waiting for less plugins, in order to
         // be a bit fuzzy
-      if (pending_locations > UgrCFG->GetLong("glb.waitlesslocations", 0)) return InProgress;
+      static UgrConfigKey<long> waitlesslocations("glb.waitlesslocations", 0);
+      if (pending_locations > waitlesslocations.get()) return InProgress;
 
         if (status_locations == Ok) return Ok;
         return status_locations;
@@ -383,6 +382,16 @@ public:
     /// We will like to be able to encode this info to a string, e.g. for external caching purposes
     int decodeSubitems(void *data, int sz);
 
+    /// Encode the subitems into a sequence of strings, each one not bigger than maxchunksize
+    /// Each chunk can be decoded on its own with decodeSubitemsChunk
+    int encodeSubitemsToChunks(std::vector<std::string> &chunks, size_t maxchunksize);
+
+    /// Merge the subitems contained in one chunk, or in several chunks glued together.
+    /// Does not change the status of the listing, hence the caller can show a partial
+    /// listing while the other chunks are arriving.
+    /// Returns nonzero and merges nothing if the chunk does not decode entirely
+    int decodeSubitemsChunk(const void *data, int sz);
+
     /// Selects the replica that looks best for the given client. Here we don't make assumptions
     /// on the method that we apply to choose one, since it could be implemented as a plugin
     int getBestReplicaIdx(std::string &clientlocation);
@@ -19,9 +19,19 @@
 
 #include "LocationInfoHandler.hh"
 #include "ExtCacheHandler.hh"
+#include "UgrTrace.hh"
+#include "UgrMetrics.hh"
 
 using namespace boost;
 
+// Hits and misses of the items in memory (L1) and in the external cache (L2)
+static UgrMetricCounter *metric_l1hit = UgrMetrics::get()->counter("ugr_cache_lookups", "Lookups of items in the caches", "level=\"l1\",result=\"hit\"");
+static UgrMetricCounter *metric_l1miss = UgrMetrics::get()->counter("ugr_cache_lookups", "Lookups of items in the caches", "level=\"l1\",result=\"miss\"");
+static UgrMetricCounter *metric_l2hit = UgrMetrics::get()->counter("ugr_cache_lookups", "Lookups of items in the caches", "level=\"l2\",result=\"hit\"");
+static UgrMetricCounter *metric_l2miss = UgrMetrics::get()->counter("ugr_cache_lookups", "Lookups of items in the caches", "level=\"l2\",result=\"miss\"");
+static UgrMetricCounter *metric_evictlru = UgrMetrics::get()->counter("ugr_cache_evictions", "Items removed from memory", "reason=\"lru\"");
+static UgrMetricCounter *metric_evictexpired = UgrMetrics::get()->counter("ugr_cache_evictions", "Items removed from memory", "reason=\"expired\"");
+
 // Get a pointer to a FileInfo, or create a new one
 
 UgrFileInfo *LocationInfoHandler::getFileInfoOrCreateNewOne(UgrConnector& context, std::string &lfn, bool docachelookup, bool docachesubitemslookup) {
@@ -32,12 +42,15 @@ UgrFileInfo *LocationInfoHandler::getFileInfoOrCreateNewOne(UgrConnector& contex
     UgrFileInfo::trimpath(lfn);
 
     {
+        uint64_t t0 = UgrTrace::now();
         boost::lock_guard<LocationInfoHandler> l(*this);
+        UgrTrace::get()->record(UgrTrace::StgHandlerLock, t0);
 
         std::map< std::string, UgrFileInfo *>::iterator p;
 
         p = data.find(lfn);
         if (p == data.end()) {
+            metric_l1miss->inc();
 
             // If we reached the max number of items, delete as much as we can
             while (data.size() > maxitems) {
@@ -77,6 +90,8 @@ UgrFileInfo *LocationInfoHandler::getFileInfoOrCreateNewOne(UgrConnector& contex
             lrudata.insert(lrudataitem(++lrutick, lfn));
 
         } else {
+            metric_l1hit->inc();
+
             // Promote the element to being the most recently used
 
             lrudata.right.erase(lfn);
@@ -115,9 +130,10 @@ UgrFileInfo *LocationInfoHandler::getFileInfoOrCreateNewOne(UgrConnector& contex
 
         if (fi->status_statinfo == UgrFileInfo::Ok) {
 
+            // A partial listing is fine here, on a miss the plugins are asked for the rest
             if ((fi->status_items != UgrFileInfo::Ok) &&
                     (fi->status_locations != UgrFileInfo::Ok))
-                getSubitemsFromCache(fi);
+                getSubitemsFromCache(fi, true);
         }
     }
 
@@ -398,6 +414,7 @@ int LocationInfoHandler::purgeLRUitem() {
     // Delete it, eventually sending it to a 2nd level cache before
     putFileInfoToCache(fi);
     delete fi;
+    metric_evictlru->inc();
 
     return 0;
 }
@@ -469,6 +486,7 @@ void LocationInfoHandler::purgeExpired() {
         dodelete = false;
     }
 
+    metric_evictexpired->inc(d);
     if (d > 0)
         Info(UgrLogger::Lvl1, fname, "purged " << d << " expired items.");
 }
@@ -492,14 +510,22 @@ void LocationInfoHandler::tick() {
 }
 
 int LocationInfoHandler::getFileInfoFromCache(UgrFileInfo *fi) {
-    if (extcache)
-        return extcache->getFileInfo(fi);
+    if (extcache) {
+        UgrTraceScope ts(UgrTrace::StgExtCache);
+        int r = extcache->getFileInfo(fi);
+        if (extcache->isOn()) (r ? metric_l2miss : metric_l2hit)->inc();
+        return r;
+    }
     return 0;
 };
 
-int LocationInfoHandler::getSubitemsFromCache(UgrFileInfo *fi) {
-    if (extcache)
-        return extcache->getSubitems(fi);
+int LocationInfoHandler::getSubitemsFromCache(UgrFileInfo *fi, bool partialok) {
+    if (extcache) {
+        UgrTraceScope ts(UgrTrace::StgExtCache);
+        int r = extcache->getSubitems(fi, partialok);
+        if (extcache->isOn()) (r ? metric_l2miss : metric_l2hit)->inc();
+        return r;
+    }
     return 0;
 };
 
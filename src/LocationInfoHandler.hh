@@ -127,7 +127,7 @@ public:
 		
     // Ext Cache in/out
     int getFileInfoFromCache(UgrFileInfo *fi);
-    int getSubitemsFromCache(UgrFileInfo *fi);
+    int getSubitemsFromCache(UgrFileInfo *fi, bool partialok = false);
     int putFileInfoToCache(UgrFileInfo *fi);
     int putSubitemsToCache(UgrFileInfo *fi);
 
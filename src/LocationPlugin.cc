@@ -37,8 +37,17 @@ void pluginFunc(LocationPlugin *pl, int myidx) {
 
         struct LocationPlugin::worktoken *op = pl->getOp();
 
+        // What this thread does from now on is on behalf of the request of the op,
+        // if any. A check belongs to none, and must not go to the previous op
+        if (op) UgrTrace::setCurrent(op->traceid);
+        if (op && ((op->fi && op->wop) || op->operation))
+            UgrTrace::get()->record(UgrTrace::StgQueue, op->tqueued, pl->getID());
+
         if(op && op->operation){
-            op->operation();
+            {
+              UgrTraceScope ts(UgrTrace::StgPlugin, pl->getID());
+              op->operation();
+            }
             
             delete op;
             continue;
@@ -71,11 +80,18 @@ void pluginFunc(LocationPlugin *pl, int myidx) {
 
             // Finish measuring the time needed
             clock_gettime(CLOCK_MONOTONIC, &t2);
+            UgrTrace::get()->record(UgrTrace::StgPlugin, op->traceid,
+                                    t1.tv_sec * 1000000000ULL + t1.tv_nsec, t2.tv_sec * 1000000000ULL + t2.tv_nsec, pl->getID());
             timespec_sub(&t2, &t1, &diff_time);
             ms = (diff_time.tv_sec)*1000 + (diff_time.tv_nsec) / 1000000L;
             
+            // Let the filters know how this endpoint is performing
+            pl->getConn().applyHooksRequestDone(pl->getID(), ms);
+            pl->metric_opduration->observe((diff_time.tv_sec)*1000000ULL + (diff_time.tv_nsec) / 1000);
+            
             // Just print a warning if the operation took more than the max_latency
             if (ms > pl->availInfo.max_latency_ms) {
+              pl->metric_slowops->inc();
               Info(UgrLogger::Lvl1, pl->get_Name(), "Warning. Operation took " << ms << "ms. This exceeds max_latency: " <<
                 pl->availInfo.max_latency_ms << "ms op:" << op->wop << " item: " << op->fi->name);
             }
@@ -130,6 +146,21 @@ LocationPlugin::LocationPlugin(UgrConnector & c, std::vector<std::string> &parms
     pluglogname = "locplugin.";
     pluglogname += name;
     pluglogmask = UgrLogger::get()->getMask(pluglogname);
+
+    // The metrics of this plugin, labelled with its name
+    {
+      std::string lbl = "plugin=\"" + UgrMetrics::escapeLabel(name) + "\"";
+      UgrMetrics *m = UgrMetrics::get();
+
+      metric_opduration = m->histogram("ugr_plugin_op_duration_seconds", "Duration of the ops of the plugins", lbl);
+      metric_slowops = m->counter("ugr_plugin_slow_ops", "Ops of the plugins that exceeded max_latency", lbl);
+      availInfo.metric_checklatency = m->histogram("ugr_plugin_check_latency_seconds", "Latency of the endpoints, as measured by the checks", lbl);
+      availInfo.metric_checkfailures = m->counter("ugr_plugin_check_failures", "Checks that found the endpoint not online", lbl);
+      metric_gauges.push_back(m->gauge("ugr_plugin_queue_depth", "Ops waiting for a worker of the plugin", lbl,
+                                       std::bind(&LocationPlugin::getQueueDepth, this)));
+      metric_gauges.push_back(m->gauge("ugr_plugin_online", "1 if the plugin is usable", lbl,
+                                       std::bind(&LocationPlugin::isOK, this)));
+    }
     
     
     // Now get from the config any item built as:
@@ -174,6 +205,12 @@ LocationPlugin::LocationPlugin(UgrConnector & c, std::vector<std::string> &parms
     // Very important... the xlatepfx_from vector must be sorted by descending string length
     std::sort(xlatepfx_from.begin(), xlatepfx_from.end(), sortStringsByDescLen);
 
+    // The translations are done by the map. Avoid the double slash in the case the new pfx is a slash
+    for (unsigned int i = 0; i < xlatepfx_from.size(); i++) {
+        if (xlatepfx_from[i].size() > 0)
+            xlatepfx_map.add(xlatepfx_from[i], (xlatepfx_to == "/") ? "" : xlatepfx_to);
+    }
+
     // Now get the content of pfxmultiply
     pfx = "locplugin.";
     pfx += name;
@@ -242,6 +279,11 @@ void LocationPlugin::stop() {
     exiting = true;
     availInfo.state_checking = false;
 
+    // Nobody has to look at this object anymore
+    for (unsigned int i = 0; i < metric_gauges.size(); i++)
+        UgrMetrics::get()->removeGauge(metric_gauges[i]);
+    metric_gauges.clear();
+
     /// Note: this tends to hang due to a known bug in boost
     //for (unsigned int i = 0; i < workers.size(); i++) {
     //        LocPluginLogInfo(UgrLogger::Lvl1, fname, "Interrupting thread: " << i);
@@ -280,7 +322,8 @@ int LocationPlugin::start(ExtCacheHandler *c) {
 }
 
 LocationPlugin::~LocationPlugin() {
-
+    for (unsigned int i = 0; i < metric_gauges.size(); i++)
+        UgrMetrics::get()->removeGauge(metric_gauges[i]);
 }
 
 
@@ -716,9 +759,12 @@ int LocationPlugin::do_List(UgrFileInfo *fi, LocationInfoHandler *handler) {
 bool LocationPlugin::doParentQueryCheck(std::string & from, struct worktoken *wtk, int myidx){
     const char* fname = "LocationPlugin::doParentQueryCheck";
     bool doitemsnotify = false;
-    // Loop through the xlatepfx alternatives
+    // Loop through the xlatepfx alternatives that start with the name
+    std::vector<int> below;
+    xlatepfx_map.below(from, below);
     
-    for( std::vector<std::string>::iterator it = xlatepfx_from.begin(); it < xlatepfx_from.end(); it++){
+    for( std::vector<int>::iterator b = below.begin(); b < below.end(); b++){
+        const std::string *it = &xlatepfx_map.from(*b);
         
         // IF we are querying for a substring of any of the xlatepfx
         //  AND this substring is followed by '/' in the xlatepfx it is substring of
@@ -813,7 +859,6 @@ int LocationPlugin::do_waitList(UgrFileInfo *fi, int tmout) {
 int LocationPlugin::doNameXlation(std::string &from, std::string &to, workOp op, std::string &altpfx) {
     const char *fname = "LocationPlugin::doNameXlation";
     int r = 1;
-    size_t i;
     const size_t nxlations = xlatepfx_from.size();
 
     if(nxlations == 0){ // no translation required
@@ -822,25 +867,19 @@ int LocationPlugin::doNameXlation(std::string &from, std::string &to, workOp op,
     }
     else {
       
-      // Loop on the prefixes that have to be recognized and xlated
-      for (i = 0; i < nxlations; i++) {
-	if ((xlatepfx_from[i].size() > 0) &&
-	  ((from.size() == 0) || (from.compare(0, xlatepfx_from[i].length(), xlatepfx_from[i]) == 0))) {
-	  
-	  if (from.size() == 0)
-	    to = xlatepfx_to;
-	  else {
-            // Avoid the double slash in the case the new pfx ends with slash (or is a slash)
-            if (xlatepfx_to == "/")
-              to = from.substr(xlatepfx_from[i].length());
-            else
-	      to = xlatepfx_to + from.substr(xlatepfx_from[i].length());
-          }
-	  
-	  r = 0;
-	break;
-	
-	  }
+      // The longest of the prefixes that have to be recognized and xlated
+      if (from.size() == 0) {
+        if (xlatepfx_map.size() > 0) {
+          to = xlatepfx_to;
+          r = 0;
+        }
+      }
+      else {
+        int m = xlatepfx_map.match(from);
+        if (m >= 0) {
+          xlatepfx_map.apply(m, from, to);
+          r = 0;
+        }
       }
       
       if (r) to = from;
@@ -912,7 +951,8 @@ const std::string & LocationPlugin::getConfigPrefix(){
     return location_config_prefix;
 }
 
-PluginAvailabilityInfo::PluginAvailabilityInfo(int interval_ms, int latency_ms) {
+PluginAvailabilityInfo::PluginAvailabilityInfo(int interval_ms, int latency_ms):
+  metric_checklatency(0), metric_checkfailures(0) {
     isCheckRunning = false;
     status_dirty = false;
     time_interval_ms = interval_ms;
@@ -973,6 +1013,12 @@ void PluginAvailabilityInfo::setStatus(PluginEndpointStatus &st, bool setdirty,
             status = st;
             if (setdirty) status_dirty = true;
             reject = false;
+
+            // Only the checks made here, not the statuses read from the external cache
+            if (setdirty && metric_checklatency) {
+              metric_checklatency->observe(st.latency_ms * 1000ULL);
+              if (st.state != PLUGIN_ENDPOINT_ONLINE) metric_checkfailures->inc();
+            }
         }
     }
 
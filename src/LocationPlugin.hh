@@ -23,6 +23,9 @@
 #include "SimpleDebug.hh"
 #include "LocationInfoHandler.hh"
 #include "PluginInterface.hh"
+#include "UgrPrefixMap.hh"
+#include "UgrTrace.hh"
+#include "UgrMetrics.hh"
 
 #include <string>
 #include <vector>
@@ -35,27 +38,27 @@ class LocationInfoHandler;
 class UgrConnector;
 
 #define LocPluginLogInfo(lvl, where, what) do {                                											\
-	if (UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(pluglogmask)) 	\
+	if (UGR_LOG_COMPILED(lvl) && UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(pluglogmask)) 	\
 	{    																	\
-		std::ostringstream outs;                                   			\
+		UgrLogLine ugrlogline; std::ostream &outs = ugrlogline.stream();                                   			\
 		outs << "UGR " << pluglogname << " " << where << " " << __func__ << " : " << what;                      			\
-		UgrLogger::get()->log((UgrLogger::Level)lvl, outs.str());    				\
+		UgrLogger::get()->log((UgrLogger::Level)lvl, ugrlogline.data(), ugrlogline.size());    				\
 	}                                                             			\
 }while(0)
 
 #define LocPluginLogInfoThr(lvl, where, what) do {                                											\
-	if (UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(pluglogmask)) 	\
+	if (UGR_LOG_COMPILED(lvl) && UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(pluglogmask)) 	\
 	{    																	\
-		std::ostringstream outs;                                   			\
+		UgrLogLine ugrlogline; std::ostream &outs = ugrlogline.stream();                                   			\
         outs << "UGR " << pluglogname << "[" << getID() << "] " << where << " " << __func__ << " : " << what;                      			\
-		UgrLogger::get()->log((UgrLogger::Level)lvl, outs.str());    				\
+		UgrLogger::get()->log((UgrLogger::Level)lvl, ugrlogline.data(), ugrlogline.size());    				\
 	}                                                             			\
 }while(0)
 
 #define LocPluginLogErr(where, what) do {                                											\
-		std::ostringstream outs;                                   			\
+		UgrLogLine ugrlogline; std::ostream &outs = ugrlogline.stream();                                   			\
         outs << "UGR " << pluglogname << "[" << getID() << "] " << where << " !! " << __func__ << " : " << what;                      			\
-		UgrLogger::get()->log((UgrLogger::Level)0, outs.str());    				\
+		UgrLogger::get()->log((UgrLogger::Level)0, ugrlogline.data(), ugrlogline.size());    				\
 }while(0)
 
 
@@ -141,6 +144,10 @@ public:
         boost::unique_lock< boost::mutex > l(workmutex);
         status_dirty = d;
     }
+
+    /// Where to account the checks made by this instance, if not null
+    UgrMetricHistogram *metric_checklatency;
+    UgrMetricCounter *metric_checkfailures;
 private:
     boost::mutex workmutex;
     bool isCheckRunning;
@@ -207,6 +214,13 @@ public:
        /// alternative execution task
        ///  if operation is valid, execute only operation
        std::function<void (void)> operation;
+
+       /// The request that this op works for, 0 if not traced
+       uint64_t traceid;
+       /// When the op was queued
+       uint64_t tqueued;
+
+       worktoken(): fi(0), wop(wop_Nop), handler(0), traceid(UgrTrace::current()), tqueued(UgrTrace::now()) {}
     };
 
 protected:
@@ -242,6 +256,12 @@ protected:
 
     UgrLogger::bitmask pluglogmask;
     UgrLogger::component pluglogname;
+
+    /// How long the ops take, and how many exceed max_latency
+    UgrMetricHistogram *metric_opduration;
+    UgrMetricCounter *metric_slowops;
+    /// The gauges that read from this object, removed when it stops
+    std::vector<int> metric_gauges;
     
     /// Push into the queue a new op to be performed, relative to an instance of UgrFileInfo
     void pushOp(UgrFileInfo *fi, LocationInfoHandler *handler, workOp wop = wop_Nop, char *newpfx = 0);
@@ -284,6 +304,8 @@ protected:
     // The simple, default global name translation
     std::vector<std::string> xlatepfx_from;
     std::string xlatepfx_to;
+    /// The same, compiled
+    UgrPrefixMap xlatepfx_map;
     
     // The prefix multiplier, to look for files in multiple dirs at once
     std::vector<std::string> pfxmultiply;
@@ -312,6 +334,12 @@ public:
         return availInfo.isOK();
     }
 
+    /// The number of ops waiting for a worker
+    size_t getQueueDepth() {
+        boost::lock_guard< boost::mutex > l(workmutex);
+        return workqueue.size();
+    }
+
     virtual bool canDoChecksum() {
       std::string pfx("locplugin.");
       pfx += name;
@@ -348,6 +376,23 @@ public:
         return name;
     }
 
+    ///
+    /// The prefixes of the lfns this plugin may contribute to. None means any lfn
+    ///
+
+    virtual void getServedPrefixes(std::vector<std::string> &pfxs) {
+        pfxs = xlatepfx_from;
+    }
+
+    ///
+    /// Tells if a replica url points to the endpoint of this plugin.
+    /// Returns the length of the part that matched, the longest match wins. -1 if not ours
+    ///
+
+    virtual int matchReplicaUrl(const std::string &url) {
+        return -1;
+    }
+
 
     // Calls that characterize the behavior of the plugin
     // In general:
@@ -440,6 +485,11 @@ public:
     void do_Check(int myidx);
 
     void appendMonString(std::string &mons);
+
+    /// Gets the last known status of the endpoint
+    void getEndpointStatus(PluginEndpointStatus &st) {
+        availInfo.getStatus(st);
+    }
     
 public:
     static const std::string & getConfigPrefix();
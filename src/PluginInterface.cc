@@ -42,3 +42,11 @@ void FilterPlugin::hookNewReplica(UgrFileItem_replica &replica){
 int FilterPlugin::applyFilterOnReplicaList(UgrReplicaVec&replica, const UgrClientInfo &cli_info){
     return 0;
 }
+
+void FilterPlugin::hookRequestDone(int pluginID, int latency_ms){
+
+}
+
+void FilterPlugin::hookTransferReport(int pluginID, long long bytes, int duration_ms, bool ok){
+
+}
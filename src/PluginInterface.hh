@@ -90,6 +90,15 @@ public:
     virtual int applyFilterOnReplicaList(UgrReplicaVec& replica, const UgrClientInfo & cli_info);
 
 
+    /// Called by the workers of a location plugin after each operation towards its endpoint,
+    /// with the time it took
+    virtual void hookRequestDone(int pluginID, int latency_ms);
+
+
+    /// Called when a client reports the outcome of a transfer from a replica of the given plugin
+    virtual void hookTransferReport(int pluginID, long long bytes, int duration_ms, bool ok);
+
+
 };
 
 #endif // PLUGININTERFACE_HH
@@ -83,21 +83,24 @@ private:
 //    when requesting the logging
 //  what is a string that describes the info to log.
 //
+// The message is formatted into a buffer of the thread, without allocating memory.
+// The levels above UGR_LOG_COMPILE_LEVEL are removed at compile time.
+//
 #define Info(lvl, where, what) do {                                											\
-	if (UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(ugrlogmask)) 	\
+	if (UGR_LOG_COMPILED(lvl) && UgrLogger::get()->getLevel() >= lvl && UgrLogger::get()->isLogged(ugrlogmask)) 	\
 	{    																	\
-		std::ostringstream outs;                                   			\
+		UgrLogLine ugrlogline; std::ostream &outs = ugrlogline.stream();                                   			\
 		outs << ugrlogname << " " << where << " " << __func__ << " : " << what;                      			\
-		UgrLogger::get()->log((UgrLogger::Level)lvl, outs.str());    				\
+		UgrLogger::get()->log((UgrLogger::Level)lvl, ugrlogline.data(), ugrlogline.size());    				\
 	}                                                             			\
 }while(0)
 
 // Error logging
 // These error messages are printed regardless of the current local logging level
 #define Error(where, what) do{                                											\
-		std::ostringstream outs;                                   			\
+		UgrLogLine ugrlogline; std::ostream &outs = ugrlogline.stream();                                   			\
 		outs << ugrlogname << " " << where << " !! " << __func__ << " : " << what;                      			\
-		UgrLogger::get()->log((UgrLogger::Level)0, outs.str());    				\
+		UgrLogger::get()->log((UgrLogger::Level)0, ugrlogline.data(), ugrlogline.size());    				\
 }while(0)
 
 
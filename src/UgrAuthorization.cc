@@ -17,6 +17,8 @@
 
 #include "UgrAuthorization.hh"
 #include <errno.h>
+#include <string.h>
+#include <algorithm>
 
 
 UgrAuthorizationPlugin::UgrAuthorizationPlugin( UgrConnector & c, std::vector<std::string> & parms): PluginInterface(c, parms) {
@@ -28,6 +30,42 @@ UgrAuthorizationPlugin::~UgrAuthorizationPlugin() {};
 
 
 
+void UgrAuthzPrefixTrie::add(const std::string &pfx, const UgrAuthzModes &modes) {
+  int n = 0;
+
+  for (size_t i = 0; i < pfx.size(); i++) {
+    std::map<char, int>::const_iterator it = nodes[n].next.find(pfx[i]);
+    if (it != nodes[n].next.end()) {
+      n = it->second;
+      continue;
+    }
+
+    nodes.push_back(Node());
+    nodes[n].next[pfx[i]] = nodes.size()-1;
+    n = nodes.size()-1;
+  }
+
+  nodes[n].modes |= modes;
+}
+
+
+bool UgrAuthzPrefixTrie::allows(const char *resource, const char mode) const {
+  int n = 0;
+  unsigned char m = (unsigned char)mode;
+
+  for (const char *p = resource; ; p++) {
+    if (nodes[n].modes[m]) return true;
+    if (!*p) return false;
+
+    std::map<char, int>::const_iterator it = nodes[n].next.find(*p);
+    if (it == nodes[n].next.end()) return false;
+    n = it->second;
+  }
+}
+
+
+
+
 // Implement a simple authorization scheme
 // glb.allowusers[] user /path rwl
 // glb.allowgroups[] group /path rwl
@@ -37,256 +75,242 @@ UgrAuthorizationPlugin::~UgrAuthorizationPlugin() {};
 //  w = capability of writing
 //  l = capability of listing
 //  d = capability of deleting
-bool UgrAuthorizationPlugin::isallowed(const char *fname,
-                                       const std::string &clientName,
-                                       const std::string &remoteAddress,
-                                       const std::vector<std::string> &fqans,
-                                       const std::vector< std::pair<std::string, std::string> > &keys,
-                                       const char *reqresource, const char reqmode) {
-  // Simple authorization 
-  // If any of the simple rules matches then we let the request pass
-  int i;
-  bool haddirectives = false;
-  unsigned int l;
-  unsigned int buflen;
-  
-  Info(UgrLogger::Lvl4, fname, "isallowed. res: " << reqresource);
-  
-  // Check usernames
-  i = 0;
-  do {
-    char buf[1024];
-    UgrCFG->ArrayGetString("glb.allowusers", buf, i);
-    if (!buf[0]) break;
-    if ( (buflen = strlen(buf)) < 4) {
-      Error(fname, "UgrAuthorization::isallowed Bad allowusers directive: '" << buf << "'");
-      break;
+//
+// The user or group can be quoted if it contains spaces. The resource is a prefix
+// of the requested one. A group ending with * matches all the groups that start with it,
+// the group "" matches the clients that have no groups
+int UgrAuthzIndex::parseRule(const char *fname, const char *kind, const std::string &directive,
+                             std::string &name, bool &quotedempty, std::string &resource, std::string &modes) {
+  const char *buf = directive.c_str();
+  size_t buflen = directive.size();
+  const char *p1, *p2;
+
+  name.clear();
+  resource.clear();
+  modes.clear();
+  quotedempty = false;
+
+  if (buflen < 4) {
+    Error(fname, "UgrAuthorization::isallowed Bad " << kind << " directive: '" << buf << "'");
+    return 1;
+  }
+
+  // Look for the space that separates the name from the rest
+  if ( !(p1 = strchr(buf, ' ')) ) {
+    Error(fname, "UgrAuthorization::isallowed Invalid " << kind << " directive: '" << buf << "'");
+    return 0;
+  }
+
+  // If the name starts with a double quote, look for a closing double quote instead of a space
+  if (buf[0] == '"') {
+    if ( !(p1 = strchr(buf+1, '"')) ) {
+      Error(fname, "UgrAuthorization::isallowed Mismatched quotes in " << kind << " directive: '" << buf << "'");
+      return 0;
     }
-    
-    haddirectives = true;
-    
-    
-    // Now tokenize the buffer into user, resource, modes ... space separated
-    char user[256], resource[256], modes[256];
-    user[0] = '\0';
-    resource[0] = '\0';
-    modes[0] = '\0';
-    char *p1, *p2;    
-    
-    // Look for the space that separates userDN from permissions
-    if ( (p1=strchr(buf, ' ')) ) {
-      // A space was found
-      
-      // If the name starts with a double quote, look for a closing double quote instead of a space
-      if (buf[0] == '"') {
-        if ( (p1=strchr(buf+1, '"')) ) {
-          // Compute the length of the quoted string. This is the userDN
-          l = (unsigned int)(p1-buf-1);
-          
-          if ( l+2 > buflen ) {
-            Error(fname, "UgrAuthorization::isallowed Bad allowusers directive: '" << buf << "'");
-            break;
-          }
-          
-          strncpy(user, buf+1, l);
-          user[l] = '\0';
-          
-          // p1 is pointing to the closing double quote now
-          // We advance it by one, and it should point to a space. If not then it's an error.
-          if ( *(++p1) != ' ')
-            Error(fname, "UgrAuthorization::isallowed Syntax error in allowusers directive, missing separator space after closing quote: '" << buf << "'");
-          
-        }
-        else {
-          Error(fname, "UgrAuthorization::isallowed Mismatched quotes in allowusers directive: '" << buf << "'");
-        }
-        
-      }
-      else {
-        // If no double quote, then just look for a space
-        l = (unsigned int)(p1-buf);
-        
-        if ( l+2 > buflen ) {
-          Error(fname, "UgrAuthorization::isallowed Bad allowusers directive: '" << buf << "'");
-          break;
-        }
-        
-        strncpy(user, buf, l);
-        user[l] = '\0';
-      }
-      
-      // Here p1 points to the space after the userDN, we look for the next one. No quotes supported in the dir name
-      if ( (p2=strchr(p1+1, ' ')) ) {
-        l = (unsigned int)(p2-p1-1);
-        
-        if ( p2-buf+2 > buflen ) {
-          Error(fname, "UgrAuthorization::isallowed Bad allowusers directive: '" << buf << "'");
-          break;
-        }
-        
-        strncpy(resource, p1+1, l);
-        resource[l] = '\0';
-        
-        strncpy(modes, p2+1, 255);
-      }
+
+    // Compute the length of the quoted string. This is the name
+    size_t l = p1-buf-1;
+    if ( l+2 > buflen ) {
+      Error(fname, "UgrAuthorization::isallowed Bad " << kind << " directive: '" << buf << "'");
+      return 1;
     }
-    
-    if (!user[0] || !resource[0] || !modes[0]) {
-      Error(fname, "UgrAuthorization::isallowed Invalid allowusers directive: '" << buf << "'");
+
+    name.assign(buf+1, l);
+
+    // An empty name between quotes has a special meaning
+    quotedempty = (l == 0);
+
+    // p1 is pointing to the closing double quote now
+    // We advance it by one, and it should point to a space. If not then it's an error.
+    if ( *(++p1) != ' ')
+      Error(fname, "UgrAuthorization::isallowed Syntax error in " << kind << " directive, missing separator space after closing quote: '" << buf << "'");
+  }
+  else {
+    // If no double quote, then just look for a space
+    size_t l = p1-buf;
+    if ( l+2 > buflen ) {
+      Error(fname, "UgrAuthorization::isallowed Bad " << kind << " directive: '" << buf << "'");
+      return 1;
     }
-    
-    Info(UgrLogger::Lvl4, fname, "UgrAuthorization::isallowed Checking user. clientName:'" << clientName << "' user:'" << user <<
-    "' reqresource:'" << reqresource << "' resource:'" << resource << "' reqmode:'" << reqmode << "' modes:" << modes );
-    if ( !clientName.compare(user) && 
-      !strncmp(resource, reqresource, strlen(resource)) &&
-      strchr(modes, reqmode) ) {
-      
-      // This user has been explicitely allowed
-      Info(UgrLogger::Lvl3, fname, "UgrAuthorization::isallowed User allowed. clientName:" << clientName << " resource:" << resource );
-    return true;
-    
-      }
-      
-      ++i;
-  } while (1);
-  
-  // We are here if no matching userallow directives have been found
-  // Check groups
-  i = 0;
-  do {
-    char buf[1024];
-    
-    
-    UgrCFG->ArrayGetString("glb.allowgroups", buf, i);
-    if (!buf[0]) break;  
-    if ( (buflen = strlen(buf)) < 4) {
-      Error(fname, "UgrAuthorization::isallowed Bad allowgroups directive: '" << buf << "'");
-      break;
+
+    name.assign(buf, l);
+  }
+
+  // Here p1 points to the space after the name, we look for the next one. No quotes supported in the dir name
+  if ( *p1 && (p2 = strchr(p1+1, ' ')) ) {
+    if ( (size_t)(p2-buf+2) > buflen ) {
+      Error(fname, "UgrAuthorization::isallowed Bad " << kind << " directive: '" << buf << "'");
+      return 1;
     }
-    
+
+    resource.assign(p1+1, p2-p1-1);
+    modes.assign(p2+1, std::min(strlen(p2+1), (size_t)255));
+  }
+
+  if ((name.empty() && !quotedempty) || resource.empty() || modes.empty()) {
+    Error(fname, "UgrAuthorization::isallowed Invalid " << kind << " directive: '" << buf << "'");
+  }
+
+  return 0;
+}
+
+
+void UgrAuthzIndex::build(const std::vector<std::string> &allowusers, const std::vector<std::string> &allowgroups) {
+  const char *fname = "UgrAuthzIndex::build";
+  std::string name, resource, modes;
+  bool quotedempty;
+
+  for (size_t i = 0; i < allowusers.size(); i++) {
+    if (allowusers[i].empty()) break;
+
+    if (parseRule(fname, "allowusers", allowusers[i], name, quotedempty, resource, modes)) break;
     haddirectives = true;
-    
-    // Now tokenize the buffer into user, resource, modes ... space separated
-    char group[256], resource[256], modes[256];
-    group[0] = '\0';
-    resource[0] = '\0';
-    modes[0] = '\0';
-    char *p1, *p2;
-    bool matchemptygroup = false;
-    
-    if ( (p1=strchr(buf, ' ')) ) {
-      // A space was found
-      
-      // If the name starts with a double quote, look for a closing double quote instead of a space
-      if (buf[0] == '"') {
-        if ( (p1=strchr(buf+1, '"')) ) {
-          // Compute the length of the quoted string. This is the group
-          l = (unsigned int)(p1-buf-1);
-          
-          // An empty group name between quotes has a special meaning
-          if (l == 0)
-            matchemptygroup = true;
-          
-          if ( l+2 > buflen ) {
-            Error(fname, "UgrAuthorization::isallowed Bad allowgroups directive: '" << buf << "'");
-            break;
-          }
-          
-          strncpy(group, buf+1, l);
-          group[l] = '\0';
-          
-          // p1 is pointing to the closing double quote now
-          // We advance it by one, and it should point to a space. If not then it's an error.
-          if ( *(++p1) != ' ')
-            Error(fname, "UgrAuthorization::isallowed Syntax error in allowgroups directive, missing separator space after closing quote: '" << buf << "'");
-          
-        }
-        else {
-          Error(fname, "UgrAuthorization::isallowed Mismatched quotes in allowgroups directive: '" << buf << "'");
-        }
-        
-      }
-      else {
-        // If no double quote, then just look for a space
-        l = (unsigned int)(p1-buf);
-        
-        if ( l+2 > buflen ) {
-          Error(fname, "UgrAuthorization::isallowed Bad allowgroups directive: '" << buf << "'");
-          break;
-        }
-        
-        strncpy(group, buf, l);
-        group[l] = '\0';
-      }
-      
-      // Here p1 points to the space after the group, we look for the next one. No quotes supported in the dir name
-      if ( (p2=strchr(p1+1, ' ')) ) {
-        l = (unsigned int)(p2-p1-1);
-        
-        if ( p2-buf+2 > buflen ) {
-          Error(fname, "UgrAuthorization::isallowed Bad allowgroups directive: '" << buf << "'");
-          break;
-        }
-        
-        strncpy(resource, p1+1, l);
-        resource[l] = '\0';
-        
-        strncpy(modes, p2+1, 255);
-      }
+
+    // Without modes a rule grants nothing
+    if (modes.empty()) continue;
+
+    UgrAuthzModes m;
+    for (size_t j = 0; j < modes.size(); j++) m.set((unsigned char)modes[j]);
+
+    users[name].add(resource, m);
+  }
+
+  for (size_t i = 0; i < allowgroups.size(); i++) {
+    if (allowgroups[i].empty()) break;
+
+    if (parseRule(fname, "allowgroups", allowgroups[i], name, quotedempty, resource, modes)) break;
+    haddirectives = true;
+
+    if (modes.empty()) continue;
+
+    UgrAuthzModes m;
+    for (size_t j = 0; j < modes.size(); j++) m.set((unsigned char)modes[j]);
+
+    if (quotedempty) {
+      emptygroup.add(resource, m);
+      hasemptygroup = true;
     }
-    
-    if (!group[0] && !matchemptygroup) {
-      Error("UgrAuthorization::isallowed", "invalid allowgroups directive, missing group name: '" << buf << "'");
+
+    // If the group name ends with a * then we treat it as a wildcard
+    if (!name.empty() && (name[name.size()-1] == '*')) {
+      std::string pfx = name.substr(0, name.size()-1);
+      size_t k;
+      for (k = 0; k < wildcardgroups.size(); k++)
+        if (wildcardgroups[k].first == pfx) break;
+      if (k == wildcardgroups.size())
+        wildcardgroups.push_back(std::make_pair(pfx, UgrAuthzPrefixTrie()));
+
+      wildcardgroups[k].second.add(resource, m);
     }
-    
-    if (!resource[0] || !modes[0]) {
-      Error("UgrAuthorization::isallowed", "invalid allowgroups directive: '" << buf << "'");
+    else
+      groups[name].add(resource, m);
+  }
+
+  Info(UgrLogger::Lvl2, fname, "Authorization rules. users: " << users.size() << " groups: " << groups.size() <<
+    " wildcard groups: " << wildcardgroups.size());
+}
+
+
+bool UgrAuthzIndex::isallowed(const char *fname, const std::string &clientName, const std::vector<std::string> &fqans,
+                              const char *reqresource, const char reqmode) const {
+
+  std::unordered_map<std::string, UgrAuthzPrefixTrie>::const_iterator it = users.find(clientName);
+  if ((it != users.end()) && it->second.allows(reqresource, reqmode)) {
+    // This user has been explicitely allowed
+    Info(UgrLogger::Lvl3, fname, "UgrAuthorization::isallowed User allowed. clientName:" << clientName << " reqresource:" << reqresource );
+    return true;
+  }
+
+  if (hasemptygroup && !fqans.size() && emptygroup.allows(reqresource, reqmode)) {
+    Info(UgrLogger::Lvl3, "isallowed", "Group rule matched with empty fqans. reqresource:" << reqresource );
+    return true;
+  }
+
+  for (unsigned int j = 0; j < fqans.size(); j++ ) {
+    it = groups.find(fqans[j]);
+    if ((it != groups.end()) && it->second.allows(reqresource, reqmode)) {
+      Info(UgrLogger::Lvl3, "isallowed", "Group allowed. group:" << fqans[j] << " reqresource:" << reqresource );
+      return true;
     }
-    
-    Info(UgrLogger::Lvl4, "isallowed", "Checking group: '" << group << "' reqresource:'" << reqresource << "' resource:'" << resource << "' reqmode:'" << reqmode << "' modes:" << modes );
-    
-    if ( !strncmp(resource, reqresource, strlen(resource)) &&
-      strchr(modes, reqmode) ) {
-      
-      if (matchemptygroup && !fqans.size()) {  
-        Info(UgrLogger::Lvl3, "isallowed", "Group rule matched with empty fqans. group:" << group << " resource:" << resource );
+
+    for (size_t k = 0; k < wildcardgroups.size(); k++) {
+      if (!fqans[j].compare(0, wildcardgroups[k].first.size(), wildcardgroups[k].first) &&
+          wildcardgroups[k].second.allows(reqresource, reqmode)) {
+        Info(UgrLogger::Lvl3, "isallowed", "Group allowed. group:" << wildcardgroups[k].first << "* reqresource:" << reqresource );
         return true;
       }
-      
-      // If the group name ends with a * then we treat it as a wildcard
-      bool iswildcard = (group[0] && group[ strlen(group)-1 ] == '*');
-    
-      for (unsigned int j = 0; j < fqans.size(); j++ ) {
-        Info(UgrLogger::Lvl4, "isallowed", "Checking group. fqan:'" << fqans[j] << "' group:'" << group <<
-        "' reqresource:'" << reqresource << "' resource:'" << resource << "' reqmode:'" << reqmode << "' modes:" << modes );
-        
-        if (iswildcard) {
-          if (!strncmp(fqans[j].c_str(), group, strlen(group)-1)) {  
-            Info(UgrLogger::Lvl3, "isallowed", "Group allowed. group:" << group << " resource:" << resource );
-            return true;
-          }
-        }
-        else {
-          if (!strcmp(fqans[j].c_str(), group)) {  
-            Info(UgrLogger::Lvl3, "isallowed", "Group allowed. group:" << group << " resource:" << resource );
-            return true;
-          }
-        }
-      }
-      
-      }
-      
-      ++i;
-  } while (1);
-  
-  if (haddirectives) {
-    Info(UgrLogger::Lvl3, "isallowed", "Denied." );
-    return false;
+    }
   }
-  
-  Info(UgrLogger::Lvl3, "isallowed", "No auth directives, hence allowed." );
-  return true;
-                                       }
+
+  return false;
+}
+
+
+
+
+std::shared_ptr<const UgrAuthzIndex> UgrAuthorizationPlugin::getRules() {
+  long gen = UgrCFG->GetGeneration();
+
+  std::shared_ptr<const UgrAuthzIndex> r = std::atomic_load(&rules);
+  if (r && (r->generation == gen)) return r;
+
+  // Only one thread rebuilds, the others keep using the old rules meanwhile
+  boost::unique_lock<boost::mutex> l(rulesmtx, boost::try_to_lock);
+  if (!l.owns_lock()) {
+    if (r) return r;
+    l.lock();
+  }
+
+  r = std::atomic_load(&rules);
+  if (r && (r->generation == gen)) return r;
+
+  std::vector<std::string> allowusers, allowgroups;
+  for (int i = 0; ; i++) {
+    char buf[1024];
+    UgrCFG->ArrayGetString("glb.allowusers", buf, i);
+    if (!buf[0]) break;
+    allowusers.push_back(buf);
+  }
+  for (int i = 0; ; i++) {
+    char buf[1024];
+    UgrCFG->ArrayGetString("glb.allowgroups", buf, i);
+    if (!buf[0]) break;
+    allowgroups.push_back(buf);
+  }
+
+  std::shared_ptr<UgrAuthzIndex> idx = std::make_shared<UgrAuthzIndex>();
+  idx->generation = gen;
+  idx->build(allowusers, allowgroups);
+
+  r = idx;
+  std::atomic_store(&rules, r);
+  return r;
+}
+
+
+bool UgrAuthorizationPlugin::isallowed(const char *fname,
+                                       const std::string &clientName,
+                                       const std::string &remoteAddress,
+                                       const std::vector<std::string> &fqans,
+                                       const std::vector< std::pair<std::string, std::string> > &keys,
+                                       const char *reqresource, const char reqmode) {
+  // Simple authorization 
+  // If any of the simple rules matches then we let the request pass
+  Info(UgrLogger::Lvl4, fname, "isallowed. res: " << reqresource);
+
+  std::shared_ptr<const UgrAuthzIndex> r = getRules();
+
+  if (!r->hasDirectives()) {
+    Info(UgrLogger::Lvl3, "isallowed", "No auth directives, hence allowed." );
+    return true;
+  }
+
+  if (r->isallowed(fname, clientName, fqans, reqresource, reqmode))
+    return true;
+
+  Info(UgrLogger::Lvl3, "isallowed", "Denied." );
+  return false;
+}
 
 
 
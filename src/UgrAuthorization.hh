@@ -15,12 +15,93 @@
  */
 
 
+#ifndef UGRAUTHORIZATION_HH
+#define UGRAUTHORIZATION_HH
+
 #include "PluginInterface.hh"
+#include <bitset>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <boost/thread.hpp>
+
+
+/// The modes granted by a rule, one bit per mode character
+typedef std::bitset<256> UgrAuthzModes;
+
+
+/// The resources of the rules of a principal, as a trie of their path prefixes.
+/// A resource is a plain string prefix of the requested one, not necessarily a
+/// whole path component, so the trie goes by character
+class UgrAuthzPrefixTrie {
+private:
+    struct Node {
+        /// Granted to everything below this prefix
+        UgrAuthzModes modes;
+        std::map<char, int> next;
+    };
+
+    /// The root is the empty prefix
+    std::vector<Node> nodes;
+
+public:
+    UgrAuthzPrefixTrie(): nodes(1) {}
+
+    void add(const std::string &pfx, const UgrAuthzModes &modes);
+
+    /// Tells if any prefix of the resource grants the mode
+    bool allows(const char *resource, const char mode) const;
+};
+
 
+/// The glb.allowusers and glb.allowgroups rules, parsed once.
+/// A check is a lookup of the user and of each group, plus a walk of the
+/// trie of their resources
+class UgrAuthzIndex {
+private:
+    std::unordered_map<std::string, UgrAuthzPrefixTrie> users;
+    std::unordered_map<std::string, UgrAuthzPrefixTrie> groups;
+    /// The groups ending with a *, by their prefix
+    std::vector< std::pair<std::string, UgrAuthzPrefixTrie> > wildcardgroups;
+    /// The rules for the group "", that match the clients that have no groups
+    UgrAuthzPrefixTrie emptygroup;
+    bool hasemptygroup;
 
+    bool haddirectives;
+
+    /// Split a directive into name, resource and modes. Complains about the malformed ones
+    /// @return nonzero if the directive is so bad that the ones that follow have to be ignored
+    static int parseRule(const char *fname, const char *kind, const std::string &directive,
+                         std::string &name, bool &quotedempty, std::string &resource, std::string &modes);
+
+public:
+    UgrAuthzIndex(): hasemptygroup(false), haddirectives(false), generation(0) {}
+
+    /// The generation of the config the rules come from
+    long generation;
+
+    /// Parse the directives, in the format of glb.allowusers and glb.allowgroups
+    void build(const std::vector<std::string> &allowusers, const std::vector<std::string> &allowgroups);
+
+    /// With no directives at all, everything is allowed
+    bool hasDirectives() const {
+        return haddirectives;
+    }
+
+    bool isallowed(const char *fname, const std::string &clientName, const std::vector<std::string> &fqans,
+                   const char *reqresource, const char reqmode) const;
+};
 
 
 class UgrAuthorizationPlugin : public PluginInterface {
+private:
+    /// The rules, swapped as a whole when the config changes
+    std::shared_ptr<const UgrAuthzIndex> rules;
+    boost::mutex rulesmtx;
+
+    /// The current rules, rebuilt if the config has changed
+    std::shared_ptr<const UgrAuthzIndex> getRules();
+
 public:
     UgrAuthorizationPlugin( UgrConnector & c, std::vector<std::string> & parms);   
     virtual ~UgrAuthorizationPlugin();
@@ -32,10 +113,14 @@ public:
                            const std::vector<std::string> &fqans,
                            const std::vector< std::pair<std::string, std::string> > &keys,
                            const char *reqresource, const char reqmode);
-};
 
+    /// Forget the decisions that may have been cached about a client, or about
+    /// everybody if clientName is empty. For the plugins that cache them
+    virtual void invalidateDecisions(const std::string &clientName) {};
+};
 
 
 
+#endif
 
 
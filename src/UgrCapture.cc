@@ -0,0 +1,318 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrCapture.cc
+ * @brief  A compact binary log of the requests, to replay them offline
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "UgrCapture.hh"
+#include "UgrLogRing.hh"
+#include "LocationInfo.hh"
+#include "SimpleDebug.hh"
+#include <errno.h>
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include <boost/thread/lock_guard.hpp>
+
+
+static const char capmagic[8] = { 'U', 'G', 'R', 'C', 'A', 'P', '1', '\n' };
+enum { caphdrlen = 8 + 4 + 1 + 1 + 1 + 2 };
+
+static const char *opnames[UgrCapture::OpLast] = { "stat", "locate", "list", "newlocation" };
+
+/// How deep the calling thread is in the requests it serves
+static __thread int capturedepth = 0;
+
+
+// The ring of the calling thread, marked as orphan when the thread exits
+static void orphanRing(UgrLogRing *r) {
+  r->orphan.store(true, std::memory_order_release);
+}
+
+static boost::thread_specific_ptr<UgrLogRing> *myRing() {
+  // Never destroyed, a thread may exit after the process has started exiting
+  static boost::thread_specific_ptr<UgrLogRing> *p = new boost::thread_specific_ptr<UgrLogRing>(orphanRing);
+  return p;
+}
+
+
+UgrCapture *UgrCapture::get() {
+  // Never destroyed, a thread may still be recording while the process exits
+  static UgrCapture *instance = new UgrCapture();
+  return instance;
+}
+
+
+UgrCapture::UgrCapture(): running(false), ringsize(262144), file(0), writer(0), stopping(false), written(0), dropped(0) {
+}
+
+
+const char *UgrCapture::opName(int op) {
+  if ((op < 0) || (op >= OpLast)) return "unknown";
+  return opnames[op];
+}
+
+
+int UgrCapture::start(const std::string &fn, size_t rsz) {
+  const char *fname = "UgrCapture::start";
+
+  boost::lock_guard<boost::mutex> l(mtx);
+  if (writer) return 0;
+
+  FILE *f = fopen(fn.c_str(), "a");
+  if (!f) {
+    Error(fname, "Cannot open capture file '" << fn << "' err:" << errno);
+    return 1;
+  }
+  if ((ftell(f) == 0) && (fwrite(capmagic, sizeof(capmagic), 1, f) != 1)) {
+    Error(fname, "Cannot write capture file '" << fn << "' err:" << errno);
+    fclose(f);
+    return 1;
+  }
+
+  // The rings that already exist keep their size
+  ringsize = rsz;
+  file = f;
+  stopping = false;
+  writer = new boost::thread(&UgrCapture::run, this);
+  running.store(true, std::memory_order_release);
+
+  Info(UgrLogger::Lvl1, fname, "Capturing the requests into " << fn);
+  return 0;
+}
+
+
+void UgrCapture::stop() {
+  const char *fname = "UgrCapture::stop";
+  boost::thread *w;
+
+  {
+    boost::lock_guard<boost::mutex> l(mtx);
+    if (!writer) return;
+    running.store(false, std::memory_order_release);
+    stopping = true;
+    w = writer;
+  }
+
+  w->join();
+
+  // A record may have been pushed while the writer was exiting.
+  // writer is still set, so that nobody can start again meanwhile
+  boost::unique_lock<boost::mutex> l(mtx);
+  drain(l);
+  delete writer;
+  writer = 0;
+  fclose(file);
+  file = 0;
+
+  Info(UgrLogger::Lvl1, fname, "Capture stopped. Records written: " << written.load() << " dropped: " << dropped.load());
+}
+
+
+UgrLogRing *UgrCapture::getRing() {
+  UgrLogRing *r = myRing()->get();
+  if (r) return r;
+
+  r = new UgrLogRing(ringsize);
+  {
+    boost::lock_guard<boost::mutex> l(mtx);
+    rings.push_back(r);
+  }
+  myRing()->reset(r);
+  return r;
+}
+
+
+static inline char *put8(char *p, uint8_t v) { *p = v; return p + 1; }
+static inline char *put16(char *p, uint16_t v) { for (int i = 0; i < 2; i++) *p++ = v >> (8*i); return p; }
+static inline char *put32(char *p, uint32_t v) { for (int i = 0; i < 4; i++) *p++ = v >> (8*i); return p; }
+static inline char *put64(char *p, uint64_t v) { for (int i = 0; i < 8; i++) *p++ = v >> (8*i); return p; }
+
+static inline uint64_t getLE(const unsigned char *p, int n) {
+  uint64_t v = 0;
+  for (int i = 0; i < n; i++) v |= (uint64_t)p[i] << (8*i);
+  return v;
+}
+
+
+void UgrCapture::record(uint64_t tns, uint32_t durus, uint8_t op, uint8_t result, bool hit,
+                        const std::string &client, const std::string &lfn) {
+  if (!isOn()) return;
+
+  size_t iplen = std::min(client.size(), (size_t)255);
+  size_t lfnlen = std::min(lfn.size(), (size_t)65535);
+  size_t len = caphdrlen + iplen + lfnlen;
+
+  char stackbuf[1024];
+  std::vector<char> heapbuf;
+  char *buf = stackbuf;
+  if (len > sizeof(stackbuf)) {
+    heapbuf.resize(len);
+    buf = &heapbuf[0];
+  }
+
+  char *p = buf;
+  p = put64(p, tns);
+  p = put32(p, durus);
+  p = put8(p, op);
+  p = put8(p, result | (hit ? FlagCacheHit : 0));
+  p = put8(p, iplen);
+  p = put16(p, lfnlen);
+  memcpy(p, client.data(), iplen);
+  memcpy(p + iplen, lfn.data(), lfnlen);
+
+  // A record that the ring would cut is as good as lost
+  UgrLogRing *ring = getRing();
+  if ((len > ring->maxRecord()) || !ring->push(buf, len))
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void UgrCapture::drain(boost::unique_lock<boost::mutex> &l) {
+  unsigned long long cnt = 0;
+  FILE *f = file;
+
+  // Only the drainer pops or removes the rings, the others can just add new ones
+  drainrings.swap(rings);
+  l.unlock();
+
+  for (size_t i = 0; i < drainrings.size(); ) {
+    UgrLogRing *r = drainrings[i];
+    bool gone = r->orphan.load(std::memory_order_acquire);
+
+    while (r->pop(drainrec)) {
+      drainout.append(drainrec);
+      cnt++;
+    }
+
+    if (gone) {
+      delete r;
+      drainrings[i] = drainrings.back();
+      drainrings.pop_back();
+    }
+    else i++;
+  }
+
+  if (!drainout.empty() && f) {
+    if (fwrite(drainout.data(), drainout.size(), 1, f) != 1)
+      dropped.fetch_add(cnt, std::memory_order_relaxed);
+    else
+      written.fetch_add(cnt, std::memory_order_relaxed);
+    fflush(f);
+  }
+
+  // The buffers keep their memory for the next time
+  drainout.clear();
+
+  l.lock();
+  rings.insert(rings.end(), drainrings.begin(), drainrings.end());
+  drainrings.clear();
+}
+
+
+void UgrCapture::run() {
+  boost::unique_lock<boost::mutex> l(mtx);
+
+  while (!stopping) {
+    l.unlock();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    l.lock();
+    drain(l);
+  }
+}
+
+
+int UgrCapture::openFile(const std::string &fn, FILE *&f) {
+  char m[sizeof(capmagic)];
+
+  f = fopen(fn.c_str(), "r");
+  if (!f) return -1;
+
+  if ((fread(m, sizeof(m), 1, f) != 1) || memcmp(m, capmagic, sizeof(m))) {
+    fclose(f);
+    f = 0;
+    return -1;
+  }
+  return 0;
+}
+
+
+int UgrCapture::read(FILE *f, Record &r) {
+  unsigned char h[caphdrlen];
+
+  size_t n = fread(h, 1, sizeof(h), f);
+  if (n == 0) return 1;
+  if (n != sizeof(h)) return -1;
+
+  r.tns = getLE(h, 8);
+  r.durus = getLE(h + 8, 4);
+  r.op = h[12];
+  r.result = h[13] & ~FlagCacheHit;
+  r.hit = (h[13] & FlagCacheHit) != 0;
+  size_t iplen = h[14];
+  size_t lfnlen = getLE(h + 15, 2);
+
+  if (r.op >= OpLast) return -1;
+
+  r.client.resize(iplen);
+  r.lfn.resize(lfnlen);
+  if (iplen && (fread(&r.client[0], iplen, 1, f) != 1)) return -1;
+  if (lfnlen && (fread(&r.lfn[0], lfnlen, 1, f) != 1)) return -1;
+
+  return 0;
+}
+
+
+// ------------------------------------------------------------------------------------
+// UgrCaptureScope
+// ------------------------------------------------------------------------------------
+
+static inline uint64_t clockns(clockid_t c) {
+  struct timespec ts;
+  clock_gettime(c, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+UgrCaptureScope::UgrCaptureScope(UgrCapture::Op o, const std::string &l, const UgrClientInfo &c):
+  on(false), hit(true), op(o), res(UgrCapture::ResOk), lfn(&l), client(&c), tns(0), t0(0) {
+
+  if (capturedepth++ || !UgrCapture::get()->isOn()) return;
+
+  on = true;
+  tns = clockns(CLOCK_REALTIME);
+  t0 = clockns(CLOCK_MONOTONIC);
+}
+
+
+UgrCaptureScope::~UgrCaptureScope() {
+  capturedepth--;
+  if (!on) return;
+
+  uint64_t us = (clockns(CLOCK_MONOTONIC) - t0) / 1000;
+  UgrCapture::get()->record(tns, (us > 0xffffffffULL) ? 0xffffffffU : us, op, res, hit, client->ip, *lfn);
+}
+
+
+void UgrCaptureScope::result(int infostatus) {
+  switch (infostatus) {
+    case UgrFileInfo::Ok:
+      res = UgrCapture::ResOk;
+      break;
+    case UgrFileInfo::NotFound:
+      res = UgrCapture::ResNotFound;
+      break;
+    default:
+      res = UgrCapture::ResError;
+      break;
+  }
+}
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrCapture.hh
+ * @brief  A compact binary log of the requests, to replay them offline
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRCAPTURE_HH
+#define UGRCAPTURE_HH
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+
+class UgrLogRing;
+class UgrClientInfo;
+
+
+/// Captures the requests that reach UgrConnector (e.g. from the dmlite frontend)
+/// into a binary file, to reproduce the load offline with ugrreplay.
+/// The threads that serve the requests only copy a few bytes into a ring of their own,
+/// a writer thread appends the content of the rings to the file every 100ms.
+/// If a ring is full the record is dropped, the requests are never slowed down.
+///
+/// The file starts with the 8 bytes "UGRCAP1\n", then the records, in little endian:
+///   8 bytes  arrival time, ns since the epoch
+///   4 bytes  duration, us
+///   1 byte   op
+///   1 byte   result, plus FlagCacheHit if no plugin was asked
+///   1 byte   length of the client address
+///   2 bytes  length of the lfn
+///   the client address, then the lfn
+class UgrCapture {
+public:
+    enum Op { OpStat = 0, OpLocate, OpList, OpNewLocation, OpLast };
+    enum Result { ResOk = 0, ResNotFound, ResError };
+    enum { FlagCacheHit = 0x80 };
+
+    struct Record {
+        uint64_t tns;
+        uint32_t durus;
+        uint8_t op;
+        uint8_t result;
+        bool hit;
+        std::string client;
+        std::string lfn;
+    };
+
+    static UgrCapture *get();
+
+    static const char *opName(int op);
+
+    bool isOn() const { return running.load(std::memory_order_relaxed); }
+
+    /// Start appending to a file
+    /// @param ringsize : the bytes buffered for each thread
+    /// @return 0 if ok
+    int start(const std::string &fn, size_t ringsize);
+    /// Write what is pending and close the file
+    void stop();
+
+    void record(const Record &r) {
+        record(r.tns, r.durus, r.op, r.result, r.hit, r.client, r.lfn);
+    }
+    void record(uint64_t tns, uint32_t durus, uint8_t op, uint8_t result, bool hit,
+                const std::string &client, const std::string &lfn);
+
+    unsigned long long getWritten() const { return written.load(); }
+    unsigned long long getDropped() const { return dropped.load(); }
+
+    /// Open a capture file for reading
+    /// @return 0 if ok
+    static int openFile(const std::string &fn, FILE *&f);
+    /// @return 0 if a record was read, 1 at the end, -1 if the file is corrupted
+    static int read(FILE *f, Record &r);
+
+private:
+    UgrCapture();
+
+    std::atomic<bool> running;
+
+    /// Protects the list of the rings, the file and the writer
+    boost::mutex mtx;
+    std::vector<UgrLogRing *> rings;
+    size_t ringsize;
+    FILE *file;
+    boost::thread *writer;
+    bool stopping;
+
+    std::atomic<unsigned long long> written;
+    std::atomic<unsigned long long> dropped;
+
+    /// Used only by the drainer, they keep their memory across the drains
+    std::vector<UgrLogRing *> drainrings;
+    std::string drainrec, drainout;
+
+    UgrLogRing *getRing();
+    /// Append what is in the rings to the file, and free the rings of the threads that have exited.
+    /// Called with mtx locked, only by the writer or when the writer is not there.
+    /// mtx is released while writing, so that a thread that captures for the first time
+    /// can add its ring without waiting for the disk
+    void drain(boost::unique_lock<boost::mutex> &l);
+    void run();
+};
+
+
+/// Captures the request served in a scope. The requests done while serving
+/// another one (e.g. the stat of a findNewLocation) are not captured
+class UgrCaptureScope {
+public:
+    UgrCaptureScope(UgrCapture::Op op, const std::string &lfn, const UgrClientInfo &client);
+    ~UgrCaptureScope();
+
+    /// The plugins had to be asked
+    void miss() { hit = false; }
+    void result(UgrCapture::Result r) { res = r; }
+    /// The result from the status of an UgrFileInfo
+    void result(int infostatus);
+
+private:
+    bool on;
+    bool hit;
+    UgrCapture::Op op;
+    UgrCapture::Result res;
+    const std::string *lfn;
+    const UgrClientInfo *client;
+    uint64_t tns, t0;
+};
+
+
+#endif
@@ -171,6 +171,7 @@ int UgrConfig::ProcessFile(char *filename) {
                     }
                     Info(UgrLogger::Lvl4, "UgrConfig::ProcessFile", token << "[" << arrdata[token].size() << "] <-" << val);
                 arrdata[token].push_back(val);
+                generation.fetch_add(1, std::memory_order_release);
               }
                   else {
                     if(data.count(token) == 1) {
@@ -178,6 +179,7 @@ int UgrConfig::ProcessFile(char *filename) {
                     }
                     Info(UgrLogger::Lvl4, "UgrConfig::ProcessFile", token << "<-" << val);
                     data[token] = val;
+                    generation.fetch_add(1, std::memory_order_release);
                   }
               }
           }
@@ -193,6 +195,8 @@ int UgrConfig::ProcessFile(char *filename) {
         }
     }
 
+    Publish();
+
   }else {
     Error("UgrConfig::ProcessFile", "Unable to open file " << fn); 
     return -1;
@@ -222,10 +226,14 @@ void UgrConfig::SetLong(const char *name, long val) {
 
   sprintf(buf, "%ld", val);
   data[name] = buf;
+  generation.fetch_add(1, std::memory_order_release);
+  Publish();
 }
 
 void UgrConfig::SetString(const char *name, char *val) {
   data[name] = val;
+  generation.fetch_add(1, std::memory_order_release);
+  Publish();
 }
 
 
@@ -234,13 +242,7 @@ long UgrConfig::GetLong(const char *name, long deflt) {
 }
 
 long UgrConfig::GetLong(const string &name, long deflt){
-    if (data.find(name) == data.end()) {
-        std::string newname;
-        if(!UgrConfig::FindWithWildcard(name, &newname, deflt) )
-            return deflt;
-        return atol( data[newname].c_str() );
-    }        
-    return atol( data[name].c_str() );
+    return GetSnapshot()->GetLong(name, deflt);
 }
 
 bool UgrConfig::GetBool(const char *name, bool deflt) 
@@ -251,22 +253,7 @@ bool UgrConfig::GetBool(const char *name, bool deflt)
 
 bool UgrConfig::GetBool(const string & name, bool deflt) 
 {
-  if (data.find(name) == data.end()){
-      std::string newname;  
-      if(!UgrConfig::FindWithWildcard(name, &newname, deflt) )
-          return deflt;    
-      else {
-          if (!strcasecmp(data[newname].c_str(), "yes")) return true;
-          if (!strcasecmp(data[newname].c_str(), "true")) return true;
-          
-          return false;
-      } 
-  } 
-
-  if (!strcasecmp(data[name].c_str(), "yes")) return true;
-  if (!strcasecmp(data[name].c_str(), "true")) return true;
-  
-  return false;
+  return GetSnapshot()->GetBool(name, deflt);
 }
 
 string UgrConfig::GetString(const char *name, char *deflt) {
@@ -276,25 +263,120 @@ string UgrConfig::GetString(const char *name, char *deflt) {
 
 string UgrConfig::GetString(const string & name, const string & deflt) {
 
-  if (data.find(name) == data.end()) {
-      std::string newname;  
-      if(!UgrConfig::FindWithWildcard(name, &newname, deflt) )
-          return deflt;
-      return data[newname];
-  }
-  return data[name];
+  return GetSnapshot()->GetString(name, deflt);
 }
 
 void UgrConfig::GetString(const char *name, char *val, char *deflt) {
 
   if (!val) return;
-  if (data.find(name) == data.end()) {
+
+  // No wildcards here
+  std::shared_ptr<const UgrConfigSnapshot> s = GetSnapshot();
+  const UgrConfigSnapshot::Value *v = s->find(name, false);
+  if (!v) {
     if (deflt) strcpy(val, deflt);
     else val[0] = 0;
   }
   else
-    strcpy(val, data[name].c_str());
+    strcpy(val, v->s.c_str());
+
+}
+
+
+
+
+//////////////////////////////////////////////
+//
+// Snapshots and handles
+//
+
+
+
+UgrConfigSnapshot::UgrConfigSnapshot(const std::map<std::string, std::string> &data, long gen): generation(gen) {
+  values.reserve(data.size());
+
+  for (std::map<std::string, std::string>::const_iterator i = data.begin(); i != data.end(); ++i) {
+    Value &v = values[i->first];
+    v.s = i->second;
+    v.l = atol(v.s.c_str());
+    v.b = (!strcasecmp(v.s.c_str(), "yes") || !strcasecmp(v.s.c_str(), "true"));
+  }
+}
+
+
+const UgrConfigSnapshot::Value *UgrConfigSnapshot::find(const std::string &name, bool wildcard) const {
+  std::unordered_map<std::string, Value>::const_iterator i = values.find(name);
+  if (i != values.end()) return &i->second;
+
+  // Convert the locplugin ID to *, then search again
+  if (!wildcard || (name.compare(0, 9, "locplugin") != 0)) return 0;
+
+  std::vector<std::string> tkns = tokenize(name, ".");
+  if (tkns.size() < 2) return 0;
+  tkns[1] = "*";
+
+  std::string newname;
+  for (unsigned int t = 0; t < tkns.size(); ++t) {
+    if (t) newname += ".";
+    newname += tkns[t];
+  }
+
+  i = values.find(newname);
+  if (i != values.end()) return &i->second;
+  return 0;
+}
+
+
+void UgrConfig::Publish() {
+  boost::lock_guard<boost::mutex> l(keysmtx);
+
+  std::shared_ptr<const UgrConfigSnapshot> s = std::make_shared<const UgrConfigSnapshot>(data, generation.load(std::memory_order_acquire));
+  std::atomic_store(&snap, s);
+
+  for (unsigned int i = 0; i < keys.size(); i++)
+    keys[i]->refresh(s.get());
+}
+
+
+std::shared_ptr<const UgrConfigSnapshot> UgrConfig::GetSnapshot() {
+  std::shared_ptr<const UgrConfigSnapshot> s = std::atomic_load(&snap);
+  if (s) return s;
+
+  // Nothing loaded yet
+  Publish();
+  return std::atomic_load(&snap);
+}
+
+
+void UgrConfig::RegisterKey(UgrConfigKeyBase *k) {
+  std::shared_ptr<const UgrConfigSnapshot> s = GetSnapshot();
+
+  boost::lock_guard<boost::mutex> l(keysmtx);
+  if (std::find(keys.begin(), keys.end(), k) != keys.end()) return;
+
+  // A newer snapshot may have been published in the meantime
+  s = std::atomic_load(&snap);
+  k->refresh(s.get());
+  keys.push_back(k);
+}
+
+
+void UgrConfig::UnregisterKey(UgrConfigKeyBase *k) {
+  boost::lock_guard<boost::mutex> l(keysmtx);
+  keys.erase(std::remove(keys.begin(), keys.end(), k), keys.end());
+}
+
+
+void UgrConfigKeyBase::doregister() {
+  UgrConfig *c = UgrCFG;
+  c->RegisterKey(this);
+  registered.store(c, std::memory_order_release);
+}
+
 
+UgrConfigKeyBase::~UgrConfigKeyBase() {
+  UgrConfig *c = registered.load();
+  if (c) c->UnregisterKey(this);
 }
 
 void UgrConfig::ArrayGetString(const char *name, char *val, int pos) {
@@ -23,6 +23,11 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
 
 
 /// The macro to be used to access the cfg options
@@ -34,6 +39,67 @@ std::vector<std::string> tokenize(const std::string& str, const std::string& del
 // Utility to get filename entries in a directory
 std::vector<std::string> ReadDirectory(const std::string& path);
 
+class UgrConfig;
+
+/// An immutable, hashed copy of the simple parameters, with the values already parsed.
+/// A new one is published every time the content changes, the ones in use stay valid
+class UgrConfigSnapshot {
+public:
+    struct Value {
+        std::string s;
+        long l;
+        bool b;
+    };
+
+    UgrConfigSnapshot(const std::map<std::string, std::string> &data, long gen);
+
+    /// Find a parameter, trying also the wildcard version of the locplugin ones.
+    /// Returns 0 if not found
+    const Value *find(const std::string &name, bool wildcard = true) const;
+
+    long GetLong(const std::string &name, long deflt) const {
+      const Value *v = find(name);
+      return v ? v->l : deflt;
+    }
+    bool GetBool(const std::string &name, bool deflt) const {
+      const Value *v = find(name);
+      return v ? v->b : deflt;
+    }
+    std::string GetString(const std::string &name, const std::string &deflt) const {
+      const Value *v = find(name);
+      return v ? v->s : deflt;
+    }
+
+    /// The generation of the config this has been taken from
+    long generation;
+
+private:
+    std::unordered_map<std::string, Value> values;
+};
+
+
+/// Common part of the config handles. A handle is looked up once, then it is
+/// refreshed by the config every time a new snapshot is published
+class UgrConfigKeyBase {
+public:
+    UgrConfigKeyBase(const std::string &n): name(n), registered(0) {}
+    virtual ~UgrConfigKeyBase();
+
+    /// Take the value from a new snapshot, or the default if there is none
+    virtual void refresh(const UgrConfigSnapshot *snap) = 0;
+
+    const std::string name;
+
+protected:
+    /// Register with the config the first time the value is needed, so that
+    /// the plugins register with the instance they have been given
+    void doregister();
+
+    /// The config we are registered with
+    std::atomic<UgrConfig *> registered;
+};
+
+
 /// Singleton class that implements a simple config manager
 /// Once initialized with ProcessFile, it will contain all
 /// the config parameters, organized as:
@@ -49,9 +115,22 @@ class UgrConfig {
 protected:
     static UgrConfig *inst;
 
-    UgrConfig() {
+    UgrConfig(): generation(0) {
     };
 
+    /// Bumped whenever the content changes. Read by the request threads without locking
+    std::atomic<long> generation;
+
+    /// The last published snapshot of data
+    std::shared_ptr<const UgrConfigSnapshot> snap;
+
+    /// The handles to refresh when the content changes, and the lock for publishing
+    std::vector<UgrConfigKeyBase *> keys;
+    boost::mutex keysmtx;
+
+    /// Make the current content visible to the getters and to the handles
+    void Publish();
+
     /// Stores the simple parameters
     std::map<std::string, std::string> data;
 
@@ -72,6 +151,19 @@ public:
     /// @param filename Configuration file to parse
     int ProcessFile(char *filename);
 
+    /// Tells if the content has changed, e.g. to rebuild what was computed from it
+    long GetGeneration() {
+        return generation.load(std::memory_order_acquire);
+    }
+
+    /// The current content, that will not change while the caller holds it.
+    /// Never null
+    std::shared_ptr<const UgrConfigSnapshot> GetSnapshot();
+
+    /// Handles get their value from the snapshots
+    void RegisterKey(UgrConfigKeyBase *k);
+    void UnregisterKey(UgrConfigKeyBase *k);
+
     /// Set a value of type long
     /// @param name The name of the parameter
     /// @param val  The value for the parameter
@@ -144,6 +236,38 @@ public:
 };
 
 
+/// A handle to a parameter of type long or bool, to be used in the paths that are hit
+/// at every request. It is resolved once, and then reading it is a single atomic load.
+/// The value follows the config when it is reloaded. Typically a function-local static:
+///
+///   static UgrConfigKey<long> waittimeout("glb.waittimeout", 30);
+///   ... waittimeout.get() ...
+template <typename T>
+class UgrConfigKey : public UgrConfigKeyBase {
+public:
+    UgrConfigKey(const std::string &n, T d): UgrConfigKeyBase(n), deflt(d), val(d) {}
+
+    T get() {
+      if (!registered.load(std::memory_order_acquire)) doregister();
+      return val.load(std::memory_order_relaxed);
+    }
+
+    virtual void refresh(const UgrConfigSnapshot *snap);
+
+private:
+    const T deflt;
+    std::atomic<T> val;
+};
+
+template <>
+inline void UgrConfigKey<long>::refresh(const UgrConfigSnapshot *snap) {
+  val.store(snap ? snap->GetLong(name, deflt) : deflt, std::memory_order_relaxed);
+}
+
+template <>
+inline void UgrConfigKey<bool>::refresh(const UgrConfigSnapshot *snap) {
+  val.store(snap ? snap->GetBool(name, deflt) : deflt, std::memory_order_relaxed);
+}
 
 
 
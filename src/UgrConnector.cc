@@ -26,12 +26,16 @@
 #include "SimpleDebug.hh"
 
 #include <string>
+#include <sstream>
 #include "UgrConnector.hh"
 #include "LocationInfo.hh"
 #include "LocationInfoHandler.hh"
 #include "UgrPluginLoader.hh"
 #include "UgrAuthorization.hh"
 #include "LocationPlugin.hh"
+#include "UgrTrace.hh"
+#include "UgrMetrics.hh"
+#include "UgrCapture.hh"
 #include <dlfcn.h>
 
 
@@ -41,6 +45,22 @@ using namespace boost::filesystem;
 using namespace boost::system;
 
 
+// The parameters that are read at every request
+static UgrConfigKey<long> cfg_waittimeout("glb.waittimeout", 30);
+static UgrConfigKey<bool> cfg_addchildtoparentonstat("glb.addchildtoparentonstat", true);
+static UgrConfigKey<bool> cfg_addchildtoparentonput("glb.addchildtoparentonput", true);
+static UgrConfigKey<bool> cfg_allow_overwrite("glb.allow_overwrite", true);
+static UgrConfigKey<bool> cfg_statsubdirs("glb.statsubdirs", false);
+
+// How long the requests take, by type
+static UgrMetricHistogram *metric_stat = UgrMetrics::get()->histogram("ugr_request_duration_seconds",
+                                                                      "Duration of the requests", "op=\"stat\"");
+static UgrMetricHistogram *metric_locate = UgrMetrics::get()->histogram("ugr_request_duration_seconds",
+                                                                        "Duration of the requests", "op=\"locate\"");
+static UgrMetricHistogram *metric_list = UgrMetrics::get()->histogram("ugr_request_duration_seconds",
+                                                                      "Duration of the requests", "op=\"list\"");
+
+
 bool replicas_is_offline(UgrConnector * c,  const UgrFileItem_replica & r);
 
 // mocking object
@@ -89,6 +109,7 @@ void UgrConnector::tick(int parm) {
 	  if (noffline > 0) {
 	    Info(UgrLogger::Lvl1, fname, " Offline plugins:" << off);
 	  }
+	  UgrTrace::get()->report();
 	  
 	  timesummary = time(0);
 	}
@@ -106,14 +127,24 @@ void UgrConnector::tick(int parm) {
         }
 	Info(UgrLogger::Lvl4, fname, " Plugin mon info:" << statuses);
         
+        hostHandler.tick(timenow);
+        if (timenow - lastxfersync >= (time_t)xfersyncinterval) {
+          syncTransferMatrix();
+          lastxfersync = timenow;
+        }
+
+        extCache.tick(timenow);
         extCache.putMoninfo(statuses);
+
+        UgrTrace::get()->flush();
     }
 
     Info(UgrLogger::Lvl1, fname, "Ticker exiting");
 }
 
 
-UgrConnector::UgrConnector(): ticker(0), ticktime(10), initdone(false) {
+UgrConnector::UgrConnector(): ticker(0), prefixrouting(true), ticktime(10), initdone(false), replicaselection(SelSorted), selcandidates(2),
+  xfersyncinterval(30), lastxfersync(0) {
     const char *fname = "UgrConnector::ctor";
     ugrlogmask = UgrLogger::get()->getMask(ugrlogname);
     Info(UgrLogger::Lvl1, fname, "Ctor " << UGR_VERSION_MAJOR <<"." << UGR_VERSION_MINOR << "." << UGR_VERSION_PATCH);
@@ -142,8 +173,11 @@ UgrConnector::~UgrConnector() {
     ugr_unload_plugin<LocationPlugin>(locPlugins);
     ugr_unload_plugin<FilterPlugin>(filterPlugins);
 
+    UgrMetrics::get()->stopServer();
+    UgrCapture::get()->stop();
+    UgrTrace::get()->flush();
     Info(UgrLogger::Lvl1, fname, "Exiting.");
-
+    UgrLogger::get()->flush();
 }
 
 UgrConfig & UgrConnector::getConfig() const{
@@ -161,6 +195,18 @@ void UgrConnector::applyHooksNewReplica(UgrFileItem_replica & rep){
     }
 }
 
+void UgrConnector::applyHooksRequestDone(int pluginID, int latency_ms){
+    for( auto it = filterPlugins.begin(); it != filterPlugins.end(); ++it){
+        (*it)->hookRequestDone(pluginID, latency_ms);
+    }
+}
+
+void UgrConnector::applyHooksTransferReport(int pluginID, long long bytes, int duration_ms, bool ok){
+    for( auto it = filterPlugins.begin(); it != filterPlugins.end(); ++it){
+        (*it)->hookTransferReport(pluginID, bytes, duration_ms, ok);
+    }
+}
+
 static boost::filesystem::path getPluginDirectory(){
      const char *fname = "UgrConnector::init::getPluginDirectory";
      boost::filesystem::path plugin_dir(getUgrLibPath());
@@ -202,6 +248,23 @@ int UgrConnector::init(char *cfgfile) {
         long debuglevel = UgrCFG->GetLong("glb.debug", 1);
         DebugSetLevel(debuglevel);
         UgrLogger::get()->SetStderrPrint(debug_stderr);
+
+        {
+          std::string logfile = UgrCFG->GetString("glb.log_file", (char *)"");
+          if (!logfile.empty()) UgrLogger::get()->setLogFile(logfile);
+        }
+
+        // Write the log in a thread of its own, the threads that log just leave the messages in a ring
+        if (UgrCFG->GetBool("glb.log_async", false)) {
+          std::string ovf = UgrCFG->GetString("glb.log_async.overflow", (char *)"drop");
+          UgrLogger::OverflowPolicy pol = UgrLogger::OverflowDrop;
+          if (ovf == "block") pol = UgrLogger::OverflowBlock;
+          else if (ovf != "drop")
+            Error(fname, "Unknown glb.log_async.overflow '" << ovf << "'. Using 'drop'");
+
+          UgrLogger::get()->startAsync(UgrCFG->GetLong("glb.log_async.ringsize", 65536), pol);
+          Info(UgrLogger::Lvl1, fname, "Asynchronous logging started. overflow: " << ovf);
+        }
         
         // Now enable the logging of the components that have been explicitely requested
         int i = 0;
@@ -213,12 +276,53 @@ int UgrConnector::init(char *cfgfile) {
           ++i;
         } while (1);
         
+        // Expose the metrics to a scraper, e.g. Prometheus
+        {
+          std::string ml = UgrCFG->GetString("glb.metrics.listen", (char *)"");
+          if (!ml.empty()) UgrMetrics::get()->startServer(ml);
+        }
+
+        // Capture the requests, to replay them offline
+        {
+          std::string cf = UgrCFG->GetString("glb.capture.file", (char *)"");
+          if (!cf.empty()) UgrCapture::get()->start(cf, UgrCFG->GetLong("glb.capture.ringsize", 262144));
+        }
+
+        // Trace some of the requests through the stages where they spend their time
+        UgrTrace::get()->configure(UgrCFG->GetLong("glb.trace.samplerate", 0),
+                                   UgrCFG->GetString("glb.trace.file", (char *)""),
+                                   UgrCFG->GetLong("glb.trace.maxevents", 100000));
+
         // setup plugin directory
         plugin_dir = getPluginDirectory();
 
         // Get the tick pace from the config
         ticktime = UgrCFG->GetLong("glb.tick", 10);
 
+        // How to choose the replica that a client is redirected to
+        {
+          std::string sel = UgrCFG->GetString("glb.replicaselection", (char *)"sorted");
+          if (sel == "p2c") replicaselection = SelP2C;
+          else if (sel == "lfnhash") replicaselection = SelLfnHash;
+          else {
+            if (sel != "sorted")
+              Error(fname, "Unknown glb.replicaselection '" << sel << "'. Using 'sorted'");
+            replicaselection = SelSorted;
+          }
+
+          long n = UgrCFG->GetLong("glb.replicaselection.candidates", 2);
+          selcandidates = (n < 1) ? 1 : n;
+          hostHandler.setHalflife(UgrCFG->GetLong("glb.replicaselection.halflife", 10));
+
+          Info(UgrLogger::Lvl1, fname, "Replica selection: " << sel << " candidates: " << selcandidates);
+        }
+
+        // The matrix of the transfers between client sites and endpoints
+        hostHandler.setXferParams(UgrCFG->GetLong("glb.xfermatrix.maxsites", 10000),
+                                  UgrCFG->GetLong("glb.xfermatrix.memory", 50),
+                                  UgrCFG->GetLong("glb.xfermatrix.maxidle", 600));
+        xfersyncinterval = UgrCFG->GetLong("glb.xfermatrix.syncinterval", 30);
+
         // Mini sanity check on the cache parameters
         if (UgrCFG->GetLong("infohandler.itemttl", 1) > UgrCFG->GetLong("infohandler.itemmaxttl", 1)) {
 					Error(fname, "Fatal misconfiguration: infohandler.itemttl (" << UgrCFG->GetLong("infohandler.itemttl", 1) <<
@@ -273,9 +377,10 @@ int UgrConnector::init(char *cfgfile) {
         }
         
         
-        // Populate vector of prefixes
+        // Populate the map of prefixes
         size_t p1=0, p2=0;
         std::string pfx_str = UgrCFG->GetString("glb.n2n_pfx", (char *) "");
+        std::vector<std::string> n2n_pfx_v;
         // Split on space character and populate vector
         while ( (p2=pfx_str.find_first_of(" ", p1)) != std::string::npos ) {
           n2n_pfx_v.push_back(pfx_str.substr(p1, p2-p1));
@@ -284,14 +389,34 @@ int UgrConnector::init(char *cfgfile) {
         }   
         n2n_pfx_v.push_back(pfx_str.substr(p1));
         UgrFileInfo::trimpath(n2n_pfx_v.back());
-        // Must have the longest paths first
-        sort(n2n_pfx_v.begin(), n2n_pfx_v.end(), std::greater<std::string>());
         
         n2n_newpfx = UgrCFG->GetString("glb.n2n_newpfx", (char *) "");
         UgrFileInfo::trimpath(n2n_newpfx);
+
+        // The longest prefix wins. An empty one means all the paths, and it does something
+        // only if there is a new prefix to put
+        n2n_map.clear();
+        for (unsigned int i = 0; i < n2n_pfx_v.size(); i++) {
+          if ((n2n_pfx_v[i].size() > 0) || (n2n_newpfx.size() > 0))
+            n2n_map.add(n2n_pfx_v[i], n2n_newpfx);
+        }
         Info(UgrLogger::Lvl1, fname, "N2N prefixes: '" << pfx_str << "' newpfx: '" << n2n_newpfx << "'");
 
 
+        // Let the extcache know what each plugin may contribute to, so that it can be invalidated.
+        // The same prefixes tell which plugins a request has to be queued to
+        std::vector< std::vector<std::string> > servedpfxs(locPlugins.size());
+        for (unsigned int i = 0; i < locPlugins.size(); i++) {
+            locPlugins[i]->getServedPrefixes(servedpfxs[i]);
+            extCache.registerPluginNamespace(locPlugins[i]->get_Name(), servedpfxs[i]);
+        }
+        extCache.refreshGenerations();
+
+        prefixrouting = UgrCFG->GetBool("glb.prefixrouting", true);
+        if (prefixrouting)
+            prefixRouter.build(servedpfxs);
+        Info(UgrLogger::Lvl1, fname, "Prefix routing: " << prefixrouting);
+
         Info(UgrLogger::Lvl3, fname, "Starting the plugins.");
         for (unsigned int i = 0; i < locPlugins.size(); i++) {
             if (locPlugins[i]->start(&extCache))
@@ -315,6 +440,126 @@ int UgrConnector::init(char *cfgfile) {
 }
 
 
+int UgrConnector::invalidateCachePrefix(const std::string &pfx) {
+    return extCache.bumpPrefixGeneration(pfx);
+}
+
+int UgrConnector::invalidateCachePlugin(const std::string &pluginname) {
+    return extCache.bumpPluginGeneration(pluginname);
+}
+
+
+void UgrConnector::invalidateAuthorizationCache(const std::string &clientName) {
+    for (unsigned int i = 0; i < authorizationPlugins.size(); i++)
+        authorizationPlugins[i]->invalidateDecisions(clientName);
+}
+
+
+int UgrConnector::getPluginIDFromUrl(const std::string &url) {
+    int best = -1, bestlen = -1;
+
+    for (unsigned int i = 0; i < locPlugins.size(); i++) {
+        int l = locPlugins[i]->matchReplicaUrl(url);
+        if (l > bestlen) {
+            bestlen = l;
+            best = locPlugins[i]->getID();
+        }
+    }
+
+    return best;
+}
+
+
+int UgrConnector::reportTransfer(const UgrClientInfo &client, const std::string &replicaurl, long long bytes, int duration_ms, bool ok) {
+    const char *fname = "UgrConnector::reportTransfer";
+
+    int pluginID = getPluginIDFromUrl(replicaurl);
+    if (pluginID < 0) {
+        Info(UgrLogger::Lvl3, fname, "No endpoint for " << replicaurl);
+        return 1;
+    }
+
+    return reportTransfer(client, pluginID, bytes, duration_ms, ok);
+}
+
+
+int UgrConnector::reportTransfer(const UgrClientInfo &client, int pluginID, long long bytes, int duration_ms, bool ok) {
+    const char *fname = "UgrConnector::reportTransfer";
+
+    if ((pluginID < 0) || (pluginID >= (int)locPlugins.size()))
+        return 1;
+
+    Info(UgrLogger::Lvl4, fname, "client: " << client.ip << " pluginID: " << pluginID << " bytes: " << bytes <<
+        " duration_ms: " << duration_ms << " ok: " << ok);
+
+    hostHandler.noteTransfer(HostsInfoHandler::clientSite(client.ip), pluginID, bytes, duration_ms, ok);
+    applyHooksTransferReport(pluginID, bytes, duration_ms, ok);
+
+    return 0;
+}
+
+
+void UgrConnector::getSiteTransferStats(const UgrClientInfo &client, HostsXferRow &row) {
+    hostHandler.getXferRow(HostsInfoHandler::clientSite(client.ip), row);
+}
+
+
+void UgrConnector::syncTransferMatrix() {
+    const char *fname = "UgrConnector::syncTransferMatrix";
+    std::vector<std::string> sites;
+
+    hostHandler.getXferSitesToSync(sites);
+    if (sites.empty()) return;
+
+    // The pluginIDs depend on the order of the config, the other instances know the endpoints by name
+    std::map<std::string, int> ids;
+    for (unsigned int i = 0; i < locPlugins.size(); i++)
+        ids[locPlugins[i]->get_Name()] = locPlugins[i]->getID();
+
+    for (unsigned int i = 0; i < sites.size(); i++) {
+        std::string s;
+        HostsXferRow remote, merged;
+        std::vector<std::string> foreign;
+
+        // One line per endpoint: name rate errrate weight
+        if (!extCache.getTransferRow(sites[i], s)) {
+            std::istringstream is(s);
+            std::string line;
+            while (std::getline(is, line)) {
+                std::istringstream ls(line);
+                std::string name;
+                HostsXferStats st;
+                if (!(ls >> name >> st.rate >> st.errrate >> st.weight)) continue;
+
+                std::map<std::string, int>::iterator id = ids.find(name);
+                if (id != ids.end()) remote[id->second] = st;
+                else foreign.push_back(line);
+            }
+        }
+
+        if (!hostHandler.mergeXferRow(sites[i], remote, merged)) continue;
+
+        // This read-modify-write is not atomic across the instances: two of them syncing the
+        // same site at the same time both start from the same row, and the samples of the one
+        // that writes first are lost. They are averages anyway, and the next sync recovers
+        // the site from whatever reports come next
+
+        // Write it back, keeping what we know nothing about
+        std::ostringstream os;
+        for (HostsXferRow::iterator it = merged.begin(); it != merged.end(); ++it) {
+            if ((it->first < 0) || (it->first >= (int)locPlugins.size())) continue;
+            os << locPlugins[it->first]->get_Name() << " " << it->second.rate << " " <<
+                it->second.errrate << " " << it->second.weight << "\n";
+        }
+        for (unsigned int j = 0; j < foreign.size(); j++)
+            os << foreign[j] << "\n";
+
+        Info(UgrLogger::Lvl4, fname, "Site: " << sites[i] << " row: " << os.str());
+        extCache.putTransferRow(sites[i], os.str());
+    }
+}
+
+
 bool UgrConnector::canEndpointDoChecksum(int pluginID) {
   const size_t id = static_cast<size_t>(pluginID);
   
@@ -327,6 +572,16 @@ bool UgrConnector::canEndpointDoChecksum(int pluginID) {
   return locPlugins[pluginID]->canDoChecksum();
 }
 
+int UgrConnector::getEndpointStatus(int pluginID, PluginEndpointStatus &st) {
+    const size_t id = static_cast<size_t>(pluginID);
+
+    if ((pluginID < 0) || (id >= locPlugins.size()))
+        return 1;
+
+    locPlugins[id]->getEndpointStatus(st);
+    return 0;
+}
+
 bool UgrConnector::isEndpointOK(int pluginID) {
     const size_t id = static_cast<size_t>(pluginID);
 
@@ -339,21 +594,14 @@ bool UgrConnector::isEndpointOK(int pluginID) {
 }
 
 void UgrConnector::do_n2n(std::string &path) {
-  for (auto p = n2n_pfx_v.begin(); p != n2n_pfx_v.end(); ++p) {
-    
-    if ((p->size() == 0) || (path.find(*p) == 0)) {
-      
-      if ((n2n_newpfx.size() > 0) || (p->size() > 0)) {
-        
-        path = n2n_newpfx + path.substr(p->size());
-        
-        // Avoid double slashes at the beginning. This is well spent CPU time, even if it may hide a bad configuration.
-        if (path.substr(0, 2) == "//")
-          path.erase(0, 1);
-        
-        break;
-      }
-    }
+  int r = n2n_map.match(path);
+
+  if (r >= 0) {
+    n2n_map.applyInPlace(r, path);
+
+    // Avoid double slashes at the beginning. This is well spent CPU time, even if it may hide a bad configuration.
+    if ((path.size() >= 2) && (path[0] == '/') && (path[1] == '/'))
+      path.erase(0, 1);
   }
   
   // Make sure that no spurious queries enter Ugr
@@ -363,13 +611,27 @@ void UgrConnector::do_n2n(std::string &path) {
   
 }
 
+void UgrConnector::routePlugins(const std::string &lfn, std::vector<int> &ids) {
+    if (prefixrouting && (prefixRouter.size() == (int)locPlugins.size())) {
+        prefixRouter.route(lfn, ids);
+        return;
+    }
+
+    ids.resize(locPlugins.size());
+    for (unsigned int i = 0; i < ids.size(); i++) ids[i] = i;
+}
+
 int UgrConnector::do_Stat(UgrFileInfo *fi) {
 
+    std::vector<int> ids;
+    routePlugins(fi->name, ids);
+
     // Ask all the non slave plugins that are online
-    for (unsigned int i = 0; i < locPlugins.size(); i++) {
-        if ( (!locPlugins[i]->isSlave()) && (locPlugins[i]->isOK())
-             && (locPlugins[i]->getFlag(LocationPlugin::Readable))){
-            locPlugins[i]->do_Stat(fi, &locHandler);
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             && (p->getFlag(LocationPlugin::Readable))){
+            p->do_Stat(fi, &locHandler);
         }
     }
 
@@ -382,6 +644,7 @@ int UgrConnector::do_waitStat(UgrFileInfo *fi, int tmout) {
 
     Info(UgrLogger::Lvl3, "UgrConnector::do_waitStat", "Going to wait for " << fi->name);
     {
+        UgrTraceScope ts(UgrTrace::StgWait);
         unique_lock<mutex> lck(*fi);
 
         // If still pending, we wait for the file object to get a notification
@@ -393,6 +656,16 @@ int UgrConnector::do_waitStat(UgrFileInfo *fi, int tmout) {
 }
 
 int UgrConnector::stat(std::string &lfn, const UgrClientInfo &client, UgrFileInfo **nfo) {
+    UgrTrace::get()->begin();
+    UgrTraceScope trs(UgrTrace::StgRequest);
+    // Only the stats of the clients, not the ones done by the other requests
+    UgrMetricTimer mt(metric_stat);
+    UgrCaptureScope cap(UgrCapture::OpStat, lfn, client);
+
+    return do_StatLfn(lfn, nfo, &cap);
+}
+
+int UgrConnector::do_StatLfn(std::string &lfn, UgrFileInfo **nfo, UgrCaptureScope *cap) {
     const char *fname = "UgrConnector::stat";
     std::string l_lfn(lfn);
     UgrFileInfo::trimpath(l_lfn);
@@ -405,12 +678,14 @@ int UgrConnector::stat(std::string &lfn, const UgrClientInfo &client, UgrFileInf
     UgrFileInfo *fi = locHandler.getFileInfoOrCreateNewOne(*this, l_lfn);
     {
         boost::lock_guard<UgrFileInfo > l(*fi);
-        if (fi->getStatStatus() == UgrFileInfo::NoInfo)
+        if (fi->getStatStatus() == UgrFileInfo::NoInfo) {
+            if (cap) cap->miss();
             do_Stat(fi);
+        }
     }
 
     // wait for the search to finish by looking at the pending object
-    do_waitStat(fi, UgrCFG->GetLong("glb.waittimeout", 30));
+    do_waitStat(fi, cfg_waittimeout.get());
 
     bool addtoparent = false;
     
@@ -430,10 +705,11 @@ int UgrConnector::stat(std::string &lfn, const UgrClientInfo &client, UgrFileInf
         
         // Touch the item anyway, it has been referenced
         fi->touch();
-    
+
+        if (cap) cap->result(fi->getStatStatus());
     }
 
-    if ( addtoparent && UgrCFG->GetBool("glb.addchildtoparentonstat", true) )
+    if ( addtoparent && cfg_addchildtoparentonstat.get() )
       this->locHandler.addChildToParentSubitem(*this, l_lfn, false, true);
 
     *nfo = fi;
@@ -453,6 +729,8 @@ static bool predUnAvailableReplica(const UgrFileItem_replica & rep){
 
 UgrCode UgrConnector::remove(const std::string &lfn, const UgrClientInfo &client, UgrReplicaVec &replicas_to_delete){
     const char *fname = "UgrConnector::remove";
+    // Not traced. What is queued from here must not go to the previous request of this thread
+    UgrTrace::setCurrent(0);
     std::string l_lfn(lfn);
     std::shared_ptr<DeleteReplicaHandler> response_handler= std::make_shared<DeleteReplicaHandler>();
 
@@ -462,15 +740,19 @@ UgrCode UgrConnector::remove(const std::string &lfn, const UgrClientInfo &client
     Info(UgrLogger::Lvl2, fname,  "Delete all replicas of " << l_lfn);
 
 
+    std::vector<int> ids;
+    routePlugins(l_lfn, ids);
+
     // Ask all the non slave plugins that are online and writable
-    for (auto it = locPlugins.begin(); it < locPlugins.end(); ++it) {
-        if ( (!(*it)->isSlave()) && ((*it)->isOK())
-             && (*it)->getFlag(LocationPlugin::Writable)){
-            (*it)->async_deleteReplica(l_lfn, response_handler);
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             && p->getFlag(LocationPlugin::Writable)){
+            p->async_deleteReplica(l_lfn, response_handler);
         }
     }
 
-    if(response_handler->wait(UgrCFG->GetLong("glb.waittimeout", 30)) == false){
+    if(response_handler->wait(cfg_waittimeout.get()) == false){
          Info(UgrLogger::Lvl2, fname, "Timeout triggered during deleteAll for " << l_lfn);
     }
 
@@ -507,6 +789,8 @@ UgrCode UgrConnector::remove(const std::string &lfn, const UgrClientInfo &client
 
 UgrCode UgrConnector::removeDir(const std::string &lfn, const UgrClientInfo &client, UgrReplicaVec &replicas_to_delete){
     const char *fname = "UgrConnector::removeDir";
+    // Not traced, see remove()
+    UgrTrace::setCurrent(0);
     std::string l_lfn(lfn);
     std::shared_ptr<DeleteReplicaHandler> response_handler= std::make_shared<DeleteReplicaHandler>();
 
@@ -516,15 +800,19 @@ UgrCode UgrConnector::removeDir(const std::string &lfn, const UgrClientInfo &cli
     Info(UgrLogger::Lvl2, fname,  "Delete all replicas of " << l_lfn);
 
 
+    std::vector<int> ids;
+    routePlugins(l_lfn, ids);
+
     // Ask all the non slave plugins that are online and writable
-    for (auto it = locPlugins.begin(); it < locPlugins.end(); ++it) {
-        if ( (!(*it)->isSlave()) && ((*it)->isOK())
-             && (*it)->getFlag(LocationPlugin::Writable)){
-            (*it)->async_deleteDir(l_lfn, response_handler);
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             && p->getFlag(LocationPlugin::Writable)){
+            p->async_deleteDir(l_lfn, response_handler);
         }
     }
 
-    if(response_handler->wait(UgrCFG->GetLong("glb.waittimeout", 30)) == false){
+    if(response_handler->wait(cfg_waittimeout.get()) == false){
          Info(UgrLogger::Lvl2, fname, "Timeout triggered during async_deleteDir for " << l_lfn);
     }
 
@@ -631,6 +919,8 @@ UgrCode UgrConnector::makeDir(const std::string & lfn, const UgrClientInfo & cli
   // TODO: ugrconnector::mkdir always succeeds and inserts all the non-existing parent dirs into the cache
   // from LCGDM-2373
   const char *fname = "UgrConnector::makeDir";
+  // Not traced, see remove()
+  UgrTrace::setCurrent(0);
   std::string l_lfn(lfn);
   
   UgrFileInfo::trimpath(l_lfn);
@@ -650,7 +940,7 @@ UgrCode UgrConnector::makeDir(const std::string & lfn, const UgrClientInfo & cli
     
     std::string ppath = joinPath(components);
     // Here we can only stat the parent, to guess whether it exists or not
-    stat(ppath, client, &nfo);
+    do_StatLfn(ppath, &nfo, 0);
     {
       boost::lock_guard<UgrFileInfo > l(*nfo);
       
@@ -705,6 +995,11 @@ UgrCode UgrConnector::makeDir(const std::string & lfn, const UgrClientInfo & cli
 
 UgrCode UgrConnector::findNewLocation(const std::string & new_lfn, off64_t filesz, const UgrClientInfo & client, UgrReplicaVec & new_locations){
     const char *fname = "UgrConnector::findNewLocation";
+    // Not traced, see remove()
+    UgrTrace::setCurrent(0);
+    // The plugins are always asked
+    UgrCaptureScope cap(UgrCapture::OpNewLocation, new_lfn, client);
+    cap.miss();
     std::string l_lfn(new_lfn);
     std::shared_ptr<NewLocationHandler> response_handler= std::make_shared<NewLocationHandler>();
 
@@ -717,12 +1012,13 @@ UgrCode UgrConnector::findNewLocation(const std::string & new_lfn, off64_t files
 
     // We need to stat the file to make sure we know nothing about it... sigh
     UgrFileInfo* fi = NULL;
-    stat(l_lfn, client, &fi);
+    do_StatLfn(l_lfn, &fi, 0);
         
     // check if ovewrite
-    if(UgrCFG->GetBool("glb.allow_overwrite", true) == false){
+    if(cfg_allow_overwrite.get() == false){
         
         if(fi && fi->status_items !=  UgrFileInfo::NotFound){
+            cap.result(UgrCapture::ResError);
             return UgrCode(UgrCode::OverwriteNotAllowed, "Ovewrite existing resource is not allowed");
         }
     }
@@ -735,32 +1031,36 @@ UgrCode UgrConnector::findNewLocation(const std::string & new_lfn, off64_t files
     
     // Ask all the non slave plugins that are online
     // Limit the search to one plugin if requested so...
+    std::vector<int> ids;
+    routePlugins(l_lfn, ids);
     
-    for (auto it = locPlugins.begin(); it < locPlugins.end(); ++it) {
-        if ( (!(*it)->isSlave()) && ((*it)->isOK())
-             && (*it)->getFlag(LocationPlugin::Writable)) {
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             && p->getFlag(LocationPlugin::Writable)) {
           
           // If the client requested a search through a specific plugin...
           if (client.s3uploadpluginid >= 0) {
             Info(UgrLogger::Lvl2, fname,  "Find new location for '" << l_lfn << "' restricting to pluginid " << client.s3uploadpluginid);
             
-            if (client.s3uploadpluginid == (*it)->getID())
-              (*it)->async_findNewLocation(l_lfn, response_handler);
+            if (client.s3uploadpluginid == p->getID())
+              p->async_findNewLocation(l_lfn, response_handler);
           }
           else // otherwise do it through all the plugins
-            (*it)->async_findNewLocation(l_lfn, response_handler);
+            p->async_findNewLocation(l_lfn, response_handler);
           
         }
     }
 
 
-    if(response_handler->wait(UgrCFG->GetLong("glb.waittimeout", 30)) == false){
+    if(response_handler->wait(cfg_waittimeout.get()) == false){
          Info(UgrLogger::Lvl2, fname, "Timeout triggered during findNewLocation for " << l_lfn);
     }
 
     new_locations.clear();
     new_locations = response_handler->takeAll();
     Info(UgrLogger::Lvl2, fname, new_locations.size() << " NewLocations found for " << l_lfn);
+    cap.result(new_locations.empty() ? UgrCapture::ResNotFound : UgrCapture::ResOk);
 
 
     // apply hooks now
@@ -771,10 +1071,10 @@ UgrCode UgrConnector::findNewLocation(const std::string & new_lfn, off64_t files
 
     // sort geographically
     if (client.s3uploadpluginid < 0)
-      filterAndSortReplicaList(new_locations, client);
+      filterAndSortReplicaList(new_locations, client, l_lfn);
     
     // attempt to update the subdir set of new entry's parent, should increase dynamicity of listing
-    if ( UgrCFG->GetBool("glb.addchildtoparentonput", true) )
+    if ( cfg_addchildtoparentonput.get() )
       this->locHandler.addChildToParentSubitem(*this, l_lfn, true, true);
     
     Info(UgrLogger::Lvl2, fname, new_locations.size() << " new locations found");
@@ -797,7 +1097,7 @@ UgrCode UgrConnector::mkDirMinusPonSiteFN(const std::string & sitefn) {
       }
   }
   
-  if(response_handler->wait(UgrCFG->GetLong("glb.waittimeout", 30)) == false){
+  if(response_handler->wait(cfg_waittimeout.get()) == false){
     Error(fname, "Timeout creating remote parent directories for " << sitefn );
   }
   
@@ -831,6 +1131,7 @@ void filter_offline_replica(UgrConnector & c, UgrReplicaVec & replicas){
 
 
 int UgrConnector::filterAndSortReplicaList(UgrReplicaVec & replicas, const UgrClientInfo & cli_info){
+    UgrTraceScope ts(UgrTrace::StgFilter);
 
     // applys all filters with cli_info
     for(std::vector<FilterPlugin*>::iterator it = filterPlugins.begin(); it != filterPlugins.end(); ++it){
@@ -843,6 +1144,87 @@ int UgrConnector::filterAndSortReplicaList(UgrReplicaVec & replicas, const UgrCl
 }
 
 
+int UgrConnector::filterAndSortReplicaList(UgrReplicaVec & replicas, const UgrClientInfo & cli_info, const std::string & lfn){
+
+    filterAndSortReplicaList(replicas, cli_info);
+    selectReplica(replicas, lfn);
+
+    return 0;
+}
+
+
+/// Rendezvous hashing of a file on an endpoint, FNV-1a
+static unsigned long long lfnhash_weight(const std::string &lfn, int pluginID) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (size_t i = 0; i < lfn.size(); i++) {
+    h ^= (unsigned char)lfn[i];
+    h *= 1099511628211ULL;
+  }
+  for (int i = 0; i < 4; i++) {
+    h ^= (unsigned char)(pluginID >> (i*8));
+    h *= 1099511628211ULL;
+  }
+  // A final mix, the plain FNV does not spread the last bytes enough
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+
+void UgrConnector::selectReplica(UgrReplicaVec & replicas, const std::string & lfn){
+    const char *fname = "UgrConnector::selectReplica";
+
+    if (replicas.empty()) return;
+
+    size_t ncand = std::min((size_t)selcandidates, replicas.size());
+    size_t best = 0;
+
+    switch (replicaselection) {
+      case SelP2C: {
+        // The filters have put the best replicas first. Among them, take the least busy one
+        float bestload = hostHandler.getLoad(replicas[0].pluginID);
+        for (size_t i = 1; i < ncand; i++) {
+          float ld = hostHandler.getLoad(replicas[i].pluginID);
+          if (ld < bestload) {
+            bestload = ld;
+            best = i;
+          }
+        }
+        break;
+      }
+
+      case SelLfnHash: {
+        // Without a name there is nothing to be affine to
+        if (lfn.empty()) break;
+
+        // The same file goes to the same endpoint for as long as it is among the candidates
+        unsigned long long bestw = lfnhash_weight(lfn, replicas[0].pluginID);
+        for (size_t i = 1; i < ncand; i++) {
+          unsigned long long w = lfnhash_weight(lfn, replicas[i].pluginID);
+          if (w > bestw) {
+            bestw = w;
+            best = i;
+          }
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    if (best > 0) {
+      Info(UgrLogger::Lvl3, fname, "Selected replica " << best << " pluginID: " << replicas[best].pluginID << " " << replicas[best].name);
+      // Keep the order of the others, they are the fallbacks
+      std::rotate(replicas.begin(), replicas.begin() + best, replicas.begin() + best + 1);
+    }
+
+    if (replicaselection != SelSorted)
+      hostHandler.noteRedirect(replicas[0].pluginID);
+}
+
+
 
 
 void UgrConnector::statSubdirs(UgrFileInfo *fi) {
@@ -881,11 +1263,15 @@ void UgrConnector::statSubdirs(UgrFileInfo *fi) {
 
 int UgrConnector::do_Locate(UgrFileInfo *fi) {
 
+    std::vector<int> ids;
+    routePlugins(fi->name, ids);
+
     // Ask all the non slave plugins that are online
-    for (unsigned int i = 0; i < locPlugins.size(); i++) {
-        if ( (!locPlugins[i]->isSlave()) && (locPlugins[i]->isOK())
-             &&  (locPlugins[i]->getFlag(LocationPlugin::Readable))){
-            locPlugins[i]->do_Locate(fi, &locHandler);
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             &&  (p->getFlag(LocationPlugin::Readable))){
+            p->do_Locate(fi, &locHandler);
         }
     }
 
@@ -898,6 +1284,7 @@ int UgrConnector::do_waitLocate(UgrFileInfo *fi, int tmout) {
 
     Info(UgrLogger::Lvl3, "UgrConnector::do_waitLocate", "Going to wait for " << fi->name);
     {
+        UgrTraceScope ts(UgrTrace::StgWait);
         unique_lock<mutex> lck(*fi);
 
         // If still pending, we wait for the file object to get a notification
@@ -937,6 +1324,11 @@ int UgrConnector::do_checkreplica(UgrFileInfo *fi, std::string rep) {
 
 int UgrConnector::locate(std::string &lfn, const UgrClientInfo &client, UgrFileInfo **nfo) {
   
+    UgrTrace::get()->begin();
+    UgrTraceScope trs(UgrTrace::StgRequest);
+    UgrMetricTimer mt(metric_locate);
+    UgrCaptureScope cap(UgrCapture::OpLocate, lfn, client);
+
     UgrFileInfo::trimpath(lfn);
     
     std::string l_lfn(lfn);
@@ -950,12 +1342,14 @@ int UgrConnector::locate(std::string &lfn, const UgrClientInfo &client, UgrFileI
 
     {
         boost::lock_guard<UgrFileInfo > l(*fi);
-        if (fi->getLocationStatus() == UgrFileInfo::NoInfo)
+        if (fi->getLocationStatus() == UgrFileInfo::NoInfo) {
+            cap.miss();
             do_Locate(fi);
+        }
     }
 
     // wait for the search to finish by looking at the pending object
-    do_waitLocate(fi, UgrCFG->GetLong("glb.waittimeout", 30));
+    do_waitLocate(fi, cfg_waittimeout.get());
 
 
     // If the status is noinfo, we can mark it as not found
@@ -964,6 +1358,8 @@ int UgrConnector::locate(std::string &lfn, const UgrClientInfo &client, UgrFileI
         if (fi->getLocationStatus() == UgrFileInfo::NoInfo)
             fi->status_locations = UgrFileInfo::NotFound;
         else fi->status_locations = UgrFileInfo::Ok;
+
+        cap.result(fi->getLocationStatus());
     }
 
     *nfo = fi;
@@ -983,11 +1379,15 @@ int UgrConnector::locate(std::string &lfn, const UgrClientInfo &client, UgrFileI
 int UgrConnector::do_List(UgrFileInfo *fi) {
 
 
+    std::vector<int> ids;
+    routePlugins(fi->name, ids);
+
     // Ask all the non slave plugins that are online
-    for (unsigned int i = 0; i < locPlugins.size(); i++) {
-        if ( (!locPlugins[i]->isSlave()) && (locPlugins[i]->isOK())
-             && (locPlugins[i]->getFlag(LocationPlugin::Listable))){
-            locPlugins[i]->do_List(fi, &locHandler);
+    for (unsigned int k = 0; k < ids.size(); k++) {
+        LocationPlugin *p = locPlugins[ids[k]];
+        if ( (!p->isSlave()) && (p->isOK())
+             && (p->getFlag(LocationPlugin::Listable))){
+            p->do_List(fi, &locHandler);
         }
     }
 
@@ -1001,6 +1401,7 @@ int UgrConnector::do_waitList(UgrFileInfo *fi, int tmout) {
 
     Info(UgrLogger::Lvl3, "UgrConnector::do_waitList", "Going to wait for " << fi->name);
     {
+        UgrTraceScope ts(UgrTrace::StgWait);
         unique_lock<mutex> lck(*fi);
 
         // If still pending, we wait for the file object to get a notification
@@ -1014,6 +1415,11 @@ int UgrConnector::do_waitList(UgrFileInfo *fi, int tmout) {
 
 int UgrConnector::list(std::string &lfn, const UgrClientInfo &client, UgrFileInfo **nfo, int nitemswait) {
 
+    UgrTrace::get()->begin();
+    UgrTraceScope trs(UgrTrace::StgRequest);
+    UgrMetricTimer mt(metric_list);
+    UgrCaptureScope cap(UgrCapture::OpList, lfn, client);
+
     UgrFileInfo::trimpath(lfn);
     
     std::string l_lfn(lfn);
@@ -1027,12 +1433,14 @@ int UgrConnector::list(std::string &lfn, const UgrClientInfo &client, UgrFileInf
 
     {
         boost::lock_guard<UgrFileInfo > l(*fi);
-        if (fi->getItemsStatus() == UgrFileInfo::NoInfo)
+        if (fi->getItemsStatus() == UgrFileInfo::NoInfo) {
+            cap.miss();
             do_List(fi);
+        }
     }
 
     // wait for the search to finish by looking at the pending object
-    do_waitList(fi, UgrCFG->GetLong("glb.waittimeout", 30));
+    do_waitList(fi, cfg_waittimeout.get());
 
 
 
@@ -1044,10 +1452,12 @@ int UgrConnector::list(std::string &lfn, const UgrClientInfo &client, UgrFileInf
         else
             if (fi->status_items != UgrFileInfo::Error)
             fi->status_items = UgrFileInfo::Ok;
+
+        cap.result(fi->getItemsStatus());
     }
 
     // Stat all the childs in parallel, eventually
-    if (UgrCFG->GetBool("glb.statsubdirs", false))
+    if (cfg_statsubdirs.get())
         statSubdirs(fi);
 
     *nfo = fi;
@@ -33,10 +33,13 @@
 #include "HostsInfoHandler.hh"
 #include "LocationPlugin.hh"
 #include "ExtCacheHandler.hh"
+#include "UgrPrefixRouter.hh"
+#include "UgrPrefixMap.hh"
 
 
 class UgrAuthorization;
 class UgrAuthorizationPlugin;
+class UgrCaptureScope;
 
 /// return the path of the UgrConnector shared library
 const std::string & getUgrLibPath();
@@ -85,18 +88,29 @@ protected:
     ExtCacheHandler extCache;
     
     /// Info needed for a simple implementation of n2n functionalities
-    /// Prefix to substitute and new prefix
+    /// Prefixes to substitute with the new prefix
     std::string n2n_newpfx;
-    std::vector<std::string> n2n_pfx_v;
+    UgrPrefixMap n2n_map;
     
     void do_n2n(std::string &path);
 
+    /// The prefixes served by the location plugins, to queue a request
+    /// only to the ones that may have something to say about it
+    UgrPrefixRouter prefixRouter;
+    bool prefixrouting;
+
+    /// The location plugins that may serve an lfn, in ascending order of ID
+    void routePlugins(const std::string &lfn, std::vector<int> &ids);
+
     /// Start the async stat process
     /// In practice, trigger all the location plugins, possibly together,
     /// so they act concurrently
     int do_Stat(UgrFileInfo *fi);
     /// Waits max a number of seconds for a stat process to be complete
     int do_waitStat(UgrFileInfo *fi, int tmout = 30);
+    /// The body of stat(), also for the requests that need to stat something on their own.
+    /// It does not begin a trace, the caller may give the capture to fill
+    int do_StatLfn(std::string &lfn, UgrFileInfo **nfo, UgrCaptureScope *cap);
 
     /// Start the async location process
     /// In practice, trigger all the location plugins, possibly together,
@@ -123,6 +137,25 @@ protected:
 
     unsigned int ticktime;
     bool initdone;
+
+    /// How the replica to redirect to is chosen among the best ones
+    enum ReplicaSelection {
+      /// The first one after the filters
+      SelSorted = 0,
+      /// The least loaded between the best two
+      SelP2C,
+      /// The best candidates are hashed together with the lfn, so a file always goes to the same endpoint
+      SelLfnHash
+    };
+    ReplicaSelection replicaselection;
+    unsigned int selcandidates;
+
+    /// Every how many seconds the transfer matrix is synced with the other instances
+    unsigned int xfersyncinterval;
+    time_t lastxfersync;
+
+    /// Bring to the front the replica that the client will be sent to, and account for it
+    void selectReplica(UgrReplicaVec & replicas, const std::string & lfn);
 public:
 
     UgrConnector();
@@ -144,6 +177,41 @@ public:
     // Tells us if the endpoint is able to calculate a checksum if a client
     // is redirected to it
     bool canEndpointDoChecksum(int pluginID);
+
+    // Gets the last known status of the endpoint represented by the given pluginID
+    // Returns nonzero if there is no such plugin
+    int getEndpointStatus(int pluginID, PluginEndpointStatus &st);
+
+    /// Invalidates in the external cache, for all the instances that share it,
+    /// the entries below a prefix listed in extcache.genprefix
+    int invalidateCachePrefix(const std::string &pfx);
+
+    /// Invalidates in the external cache, for all the instances that share it,
+    /// the entries that the given location plugin may have contributed to
+    int invalidateCachePlugin(const std::string &pluginname);
+
+    /// Makes the authorization plugins that cache their decisions forget the ones about
+    /// a client, or all of them if clientName is empty
+    void invalidateAuthorizationCache(const std::string &clientName);
+
+    /// Finds the location plugin whose endpoint a replica url belongs to.
+    /// Returns the pluginID, or -1
+    int getPluginIDFromUrl(const std::string &url);
+
+    /// Feedback about a client that has been redirected to a replica. E.g. from a frontend
+    /// that sees the end of the transfers, or a tool that tails the logs of the storage.
+    /// The outcome goes to the filter plugins and to the transfer matrix, that
+    /// tells how the endpoints perform for the site of the client
+    /// Returns nonzero if the url does not belong to any endpoint
+    int reportTransfer(const UgrClientInfo &client, const std::string &replicaurl, long long bytes, int duration_ms, bool ok);
+    int reportTransfer(const UgrClientInfo &client, int pluginID, long long bytes, int duration_ms, bool ok);
+
+    /// What the transfer matrix knows about the endpoints, as seen from the site of a client
+    void getSiteTransferStats(const UgrClientInfo &client, HostsXferRow &row);
+
+    /// Merge the transfer matrix with the one shared by the other instances through the
+    /// external cache. This happens periodically, call it to do it now
+    void syncTransferMatrix();
     
     /// Returns a pointer to the item with the list of the locations of the given lfn (ls).
     /// This could be a list of replicas
@@ -257,11 +325,18 @@ public:
     /// replicas Status (Default: Checker)
     int filterAndSortReplicaList(UgrReplicaVec & replica, const UgrClientInfo & cli_info);
 
+    /// Same as above, for a list whose first replica is where the client is going to be sent.
+    /// If glb.replicaselection says so, the first replica is chosen among the best ones
+    /// to spread the load, and accounted as a redirection
+    int filterAndSortReplicaList(UgrReplicaVec & replica, const UgrClientInfo & cli_info, const std::string & lfn);
+
 
 
     //
     // internal usage only
     void applyHooksNewReplica(UgrFileItem_replica & rep);
+    void applyHooksRequestDone(int pluginID, int latency_ms);
+    void applyHooksTransferReport(int pluginID, long long bytes, int duration_ms, bool ok);
     
 protected:
     // non copyable
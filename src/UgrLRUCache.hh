@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrLRUCache.hh
+ * @brief  A small, thread safe, bounded cache with LRU eviction and expiration
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRLRUCACHE_HH
+#define UGRLRUCACHE_HH
+
+#include <list>
+#include <unordered_map>
+#include <time.h>
+#include <boost/thread.hpp>
+
+
+/// A map that keeps at most maxsize entries, evicting the least recently used ones.
+/// Entries can also expire after a ttl. All the functions are thread safe
+template <typename K, typename V, typename H = std::hash<K> >
+class UgrLRUCache {
+private:
+
+    struct Entry {
+        K key;
+        V val;
+        /// 0 means that the entry never expires
+        time_t expiry;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    /// The entries, the most recently used first
+    EntryList lru;
+    std::unordered_map<K, typename EntryList::iterator, H> idx;
+
+    size_t maxsize;
+    int ttl;
+
+    long long nhits, nmisses;
+
+    boost::mutex mtx;
+
+    void eraseEntry(typename EntryList::iterator e) {
+        idx.erase(e->key);
+        lru.erase(e);
+    }
+
+public:
+
+    /// @param maxsize the max number of entries
+    /// @param ttl the default lifetime of an entry in seconds, 0 for no expiration
+    UgrLRUCache(size_t maxsize = 1000, int ttl = 0): maxsize(maxsize), ttl(ttl), nhits(0), nmisses(0) {}
+
+    void setLimits(size_t newmaxsize, int newttl) {
+        boost::lock_guard<boost::mutex> l(mtx);
+        maxsize = newmaxsize;
+        ttl = newttl;
+
+        while (lru.size() > maxsize)
+            eraseEntry(--lru.end());
+    }
+
+    /// Look up a value, refreshing its position in the lru
+    /// @return true if a valid value was found
+    bool get(const K &key, V &val) {
+        boost::lock_guard<boost::mutex> l(mtx);
+
+        typename std::unordered_map<K, typename EntryList::iterator, H>::iterator i = idx.find(key);
+        if (i == idx.end()) {
+            nmisses++;
+            return false;
+        }
+
+        typename EntryList::iterator e = i->second;
+        if (e->expiry && (e->expiry <= time(0))) {
+            eraseEntry(e);
+            nmisses++;
+            return false;
+        }
+
+        lru.splice(lru.begin(), lru, e);
+        val = e->val;
+        nhits++;
+        return true;
+    }
+
+    /// Insert or replace a value
+    /// @param entryttl the lifetime of this entry, if different from the default one
+    void put(const K &key, const V &val, int entryttl = -1) {
+        if (entryttl < 0) entryttl = ttl;
+        time_t expiry = entryttl ? time(0) + entryttl : 0;
+
+        boost::lock_guard<boost::mutex> l(mtx);
+        if (!maxsize) return;
+
+        typename std::unordered_map<K, typename EntryList::iterator, H>::iterator i = idx.find(key);
+        if (i != idx.end()) {
+            i->second->val = val;
+            i->second->expiry = expiry;
+            lru.splice(lru.begin(), lru, i->second);
+            return;
+        }
+
+        if (lru.size() >= maxsize)
+            eraseEntry(--lru.end());
+
+        Entry e;
+        e.key = key;
+        e.val = val;
+        e.expiry = expiry;
+        lru.push_front(e);
+        idx[key] = lru.begin();
+    }
+
+    void erase(const K &key) {
+        boost::lock_guard<boost::mutex> l(mtx);
+
+        typename std::unordered_map<K, typename EntryList::iterator, H>::iterator i = idx.find(key);
+        if (i != idx.end())
+            eraseEntry(i->second);
+    }
+
+    /// Erase all the entries for which pred(key, val) is true
+    template <typename P>
+    void eraseIf(P pred) {
+        boost::lock_guard<boost::mutex> l(mtx);
+
+        for (typename EntryList::iterator e = lru.begin(); e != lru.end(); ) {
+            typename EntryList::iterator cur = e++;
+            if (pred(cur->key, cur->val))
+                eraseEntry(cur);
+        }
+    }
+
+    void clear() {
+        boost::lock_guard<boost::mutex> l(mtx);
+        idx.clear();
+        lru.clear();
+    }
+
+    size_t size() {
+        boost::lock_guard<boost::mutex> l(mtx);
+        return lru.size();
+    }
+
+    void getStats(long long &hits, long long &misses) {
+        boost::lock_guard<boost::mutex> l(mtx);
+        hits = nhits;
+        misses = nmisses;
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrLogRing.hh
+ * @brief  Lock-free ring where a thread leaves its log messages for the writer thread
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRLOGRING_HH
+#define UGRLOGRING_HH
+
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+
+/// A ring of bytes with a single producer and a single consumer, that never lock.
+/// A record is its length followed by its bytes, and may wrap around the end
+class UgrLogRing {
+public:
+    /// @param sz the size in bytes, rounded up to a power of two
+    UgrLogRing(size_t sz): orphan(false), head(0), tail(0) {
+      size_t n = 1024;
+      while (n < sz) n <<= 1;
+      buf.resize(n);
+      mask = n - 1;
+    }
+
+    /// The longest record that fits
+    size_t maxRecord() const {
+      return buf.size() / 2;
+    }
+
+    /// Producer side. Returns false if there is no room. A record that is too long is cut
+    bool push(const char *p, uint32_t len) {
+      if (len > maxRecord()) len = maxRecord();
+
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t t = tail.load(std::memory_order_acquire);
+      if (buf.size() - (h - t) < len + sizeof(len)) return false;
+
+      put(h, (const char *)&len, sizeof(len));
+      put(h + sizeof(len), p, len);
+
+      head.store(h + sizeof(len) + len, std::memory_order_release);
+      return true;
+    }
+
+    /// Consumer side. Returns false if there is nothing
+    bool pop(std::string &out) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t h = head.load(std::memory_order_acquire);
+      if (h == t) return false;
+
+      uint32_t len;
+      get(t, (char *)&len, sizeof(len));
+      out.resize(len);
+      if (len) get(t + sizeof(len), &out[0], len);
+
+      tail.store(t + sizeof(len) + len, std::memory_order_release);
+      return true;
+    }
+
+    /// How full, from 0 to 1. Approximate if not called by the consumer
+    float fill() const {
+      return (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed)) / (float)buf.size();
+    }
+
+    bool empty() const {
+      return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    /// Set when the producer thread has exited, the consumer frees the ring once it's empty
+    std::atomic<bool> orphan;
+
+private:
+    std::vector<char> buf;
+    size_t mask;
+
+    /// Bytes ever written and read. Only the producer writes head, only the consumer writes tail
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    void put(size_t pos, const char *p, size_t len) {
+      size_t o = pos & mask;
+      size_t first = std::min(len, buf.size() - o);
+      memcpy(&buf[o], p, first);
+      if (first < len) memcpy(&buf[0], p + first, len - first);
+    }
+
+    void get(size_t pos, char *p, size_t len) const {
+      size_t o = pos & mask;
+      size_t first = std::min(len, buf.size() - o);
+      memcpy(p, &buf[o], first);
+      if (first < len) memcpy(p + first, &buf[0], len - first);
+    }
+};
+
+
+#endif
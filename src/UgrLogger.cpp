@@ -16,12 +16,16 @@
 
 
 #include "UgrLogger.hh"
+#include "UgrLogRing.hh"
 #include <stdlib.h>
+#include <stdio.h>
 #include <iostream>
+#include <boost/thread.hpp>
 #include <boost/iterator/iterator_concepts.hpp>
 #include <cxxabi.h>
 #include <execinfo.h>
 #include <string.h>
+#include <errno.h>
 
 UgrLogger *UgrLogger::instance = 0;
 UgrLogger::bitmask UgrLogger::unregistered = ~0;
@@ -154,7 +158,240 @@ int UgrLogger::getStackTrace(std::string &s)
 
 
 
-UgrLogger::UgrLogger() : stderr_log(true), level(Lvl0), size(0)
+/// The writer thread and its rings. Once created it's never destroyed, as the threads
+/// that have logged keep a pointer to their ring until they exit
+class UgrLogAsync {
+public:
+    UgrLogAsync(): ringsize(65536), policy(UgrLogger::OverflowDrop), running(false),
+      stopping(false), writer(0), flushreq(0), flushed(0), dropped(0), written(0), reporteddrops(0),
+      myring(orphanRing), logfile(0) {}
+
+    /// The settings of the rings that will be created
+    size_t ringsize;
+    UgrLogger::OverflowPolicy policy;
+
+    /// The producers look at this without locking
+    std::atomic<bool> running;
+
+    bool stopping;
+    boost::thread *writer;
+
+    /// Protects the list of the rings, the flags and the counters of the flushes
+    boost::mutex mtx;
+    /// The writer waits here for something to do
+    boost::condition_variable wakeup;
+    /// Who flushes waits here
+    boost::condition_variable done;
+    unsigned long long flushreq, flushed;
+
+    std::vector<UgrLogRing *> rings;
+
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> written;
+    unsigned long long reporteddrops;
+
+    /// The ring of the calling thread. Marked as orphan when the thread exits
+    boost::thread_specific_ptr<UgrLogRing> myring;
+
+    /// The log file, if any, with its own lock as it's written also by the threads when not async.
+    /// Atomic, as they look at it before taking the lock
+    boost::mutex filemtx;
+    std::atomic<FILE *> logfile;
+
+    static void orphanRing(UgrLogRing *r) {
+      r->orphan.store(true, std::memory_order_release);
+    }
+
+    UgrLogRing *getRing() {
+      UgrLogRing *r = myring.get();
+      if (r) return r;
+
+      r = new UgrLogRing(ringsize);
+      {
+        boost::lock_guard<boost::mutex> l(mtx);
+        rings.push_back(r);
+      }
+      myring.reset(r);
+      return r;
+    }
+
+    /// @return false if the writer has been stopped in the meantime, the caller has to write the message
+    bool push(UgrLogger::Level lvl, const char *msg, size_t len) {
+      UgrLogRing *r = getRing();
+
+      if (r->push(msg, len)) {
+        // No need to wake up the writer for every message, it looks anyway every few ms
+        if (r->fill() > 0.5) wakeup.notify_one();
+        return true;
+      }
+
+      if ((lvl > UgrLogger::Lvl0) && (policy == UgrLogger::OverflowDrop)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      // Wait for the writer to make room
+      do {
+        if (!running.load(std::memory_order_acquire)) return false;
+        wakeup.notify_one();
+        boost::this_thread::sleep(boost::posix_time::microseconds(200));
+      } while (!r->push(msg, len));
+
+      return true;
+    }
+
+    /// Write some lines to stderr and/or the log file
+    void write(const std::string &lines, bool tostderr) {
+      if (lines.empty()) return;
+
+      if (tostderr) {
+        fwrite(lines.data(), 1, lines.size(), stderr);
+        fflush(stderr);
+      }
+
+      boost::lock_guard<boost::mutex> l(filemtx);
+      FILE *f = logfile.load(std::memory_order_relaxed);
+      if (f) {
+        fwrite(lines.data(), 1, lines.size(), f);
+        fflush(f);
+      }
+    }
+
+    /// Write all that is in the rings and free the rings of the threads that have exited
+    /// Called with mtx locked, only by the writer or when the writer is not there.
+    /// mtx is released while writing, so that a thread that logs for the first time
+    /// can add its ring without waiting for the disk
+    void drain(boost::unique_lock<boost::mutex> &l, bool tostderr) {
+      std::string msg, lines;
+      unsigned long long cnt = 0;
+      std::vector<UgrLogRing *> mine;
+
+      // Only the drainer pops or removes the rings, the others can just add new ones
+      mine.swap(rings);
+      l.unlock();
+
+      for (size_t i = 0; i < mine.size(); ) {
+        UgrLogRing *r = mine[i];
+        bool gone = r->orphan.load(std::memory_order_acquire);
+
+        while (r->pop(msg)) {
+          syslog(LOG_INFO, "%s", msg.c_str());
+          lines.append(msg);
+          lines.push_back('\n');
+          cnt++;
+        }
+
+        if (gone) {
+          delete r;
+          mine[i] = mine.back();
+          mine.pop_back();
+        }
+        else i++;
+      }
+
+      unsigned long long d = dropped.load(std::memory_order_relaxed);
+      if (d != reporteddrops) {
+        std::ostringstream outs;
+        outs << "UgrLogger::drain : " << d - reporteddrops << " messages were dropped, as the logging was too fast. Total: " << d;
+        syslog(LOG_INFO, "%s", outs.str().c_str());
+        lines.append(outs.str());
+        lines.push_back('\n');
+        reporteddrops = d;
+      }
+
+      written.fetch_add(cnt, std::memory_order_relaxed);
+      write(lines, tostderr);
+
+      l.lock();
+      rings.insert(rings.end(), mine.begin(), mine.end());
+    }
+
+    void run(const UgrLogger *lg) {
+      boost::unique_lock<boost::mutex> l(mtx);
+
+      while (!stopping) {
+        wakeup.timed_wait(l, boost::posix_time::milliseconds(10));
+
+        unsigned long long req = flushreq;
+        drain(l, lg->stderr_log);
+        flushed = req;
+        done.notify_all();
+      }
+
+      drain(l, lg->stderr_log);
+      flushed = flushreq;
+      done.notify_all();
+    }
+};
+
+
+
+/// The lines of a thread where the messages are formatted
+struct UgrLogSlots {
+    enum { nslots = 4 };
+
+    UgrLogLine::Slot slots[nslots];
+    /// How many are in use
+    int depth;
+
+    UgrLogSlots(): depth(0) {}
+};
+
+// The pointer is the fast way to get them, the thread_specific_ptr frees them
+// when the thread exits. It is never destroyed, as one may log while exiting
+static __thread UgrLogSlots *logslots = 0;
+
+// A message logged later in the exit of the thread (e.g. by another cleanup)
+// gets new slots, instead of the freed ones
+static void freeLogSlots(UgrLogSlots *s)
+{
+    if (logslots == s) logslots = 0;
+    delete s;
+}
+
+static boost::thread_specific_ptr<UgrLogSlots> *logSlotsOwner()
+{
+    static boost::thread_specific_ptr<UgrLogSlots> *o = new boost::thread_specific_ptr<UgrLogSlots>(freeLogSlots);
+    return o;
+}
+
+UgrLogLine::UgrLogLine()
+{
+    UgrLogSlots *s = logslots;
+    if (!s) {
+      s = new UgrLogSlots();
+      logSlotsOwner()->reset(s);
+      logslots = s;
+    }
+
+    if (s->depth < UgrLogSlots::nslots) {
+      slot = &s->slots[s->depth++];
+      owned = false;
+    }
+    else {
+      slot = new Slot();
+      owned = true;
+    }
+
+    // Forget what the previous message did to the stream
+    slot->buf.reset();
+    std::ostream &os = slot->os;
+    os.clear();
+    os.flags(std::ios_base::dec | std::ios_base::skipws);
+    os.width(0);
+    os.precision(6);
+    os.fill(' ');
+}
+
+UgrLogLine::~UgrLogLine()
+{
+    if (owned) delete slot;
+    else logslots->depth--;
+}
+
+
+
+UgrLogger::UgrLogger() : stderr_log(true), level(Lvl0), size(0), async(0)
 {
     mask = 0;
     registerComponent("unregistered");
@@ -173,13 +410,119 @@ UgrLogger::~UgrLogger()
     closelog();
 }
 
-void UgrLogger::log(Level lvl, const std::string & msg) const
+void UgrLogger::log(Level lvl, const char *msg, size_t len) const
 {
-    syslog(LOG_INFO, "%s", msg.c_str());
+    if (async && async->running.load(std::memory_order_acquire) && async->push(lvl, msg, len))
+        return;
+
+    syslog(LOG_INFO, "%.*s", (int)len, msg);
 
     if(stderr_log){
-        std::cerr << msg << std::endl;
+        std::cerr.write(msg, len) << std::endl;
     }
+
+    if (async && async->logfile.load(std::memory_order_relaxed)) {
+        boost::lock_guard<boost::mutex> l(async->filemtx);
+        FILE *f = async->logfile.load(std::memory_order_relaxed);
+        if (f) fprintf(f, "%.*s\n", (int)len, msg);
+    }
+}
+
+int UgrLogger::setLogFile(const std::string &fn)
+{
+    if (!async) async = new UgrLogAsync();
+
+    FILE *f = 0;
+    if (!fn.empty()) {
+      f = fopen(fn.c_str(), "a");
+      if (!f) {
+        std::ostringstream outs;
+        outs << "UgrLogger::setLogFile" << " !! " << "Cannot open log file '" << fn << "' err:" << errno;
+        log(Lvl0, outs.str());
+        return 1;
+      }
+    }
+
+    boost::lock_guard<boost::mutex> l(async->filemtx);
+    FILE *old = async->logfile.exchange(f);
+    if (old) fclose(old);
+    return 0;
+}
+
+// Write what is still pending when the process exits normally
+static void flushAtExit()
+{
+    UgrLogger::get()->flush();
+}
+
+void UgrLogger::startAsync(size_t ringsize, OverflowPolicy pol)
+{
+    if (!async) async = new UgrLogAsync();
+
+    boost::lock_guard<boost::mutex> l(async->mtx);
+    if (async->writer) return;
+
+    // The rings that already exist keep their size
+    async->ringsize = ringsize;
+    async->policy = pol;
+    async->stopping = false;
+    async->writer = new boost::thread(&UgrLogAsync::run, async, this);
+    async->running.store(true, std::memory_order_release);
+
+    static bool atexitdone = false;
+    if (!atexitdone) {
+      atexit(flushAtExit);
+      atexitdone = true;
+    }
+}
+
+void UgrLogger::stopAsync()
+{
+    if (!async) return;
+
+    boost::thread *w;
+    {
+      boost::lock_guard<boost::mutex> l(async->mtx);
+      if (!async->writer) return;
+
+      // From now on the messages are written directly, the writer takes care of the ones
+      // that are already in the rings
+      async->running.store(false, std::memory_order_release);
+      async->stopping = true;
+      w = async->writer;
+      async->writer = 0;
+    }
+
+    async->wakeup.notify_one();
+    w->join();
+    delete w;
+
+    // A message may have been pushed while the writer was exiting
+    boost::unique_lock<boost::mutex> l(async->mtx);
+    async->drain(l, stderr_log);
+}
+
+void UgrLogger::flush()
+{
+    if (!async) return;
+
+    boost::unique_lock<boost::mutex> l(async->mtx);
+    if (!async->writer) return;
+
+    unsigned long long req = ++async->flushreq;
+    async->wakeup.notify_one();
+    while (async->writer && (async->flushed < req))
+      async->done.wait(l);
+}
+
+unsigned long long UgrLogger::getDropped() const
+{
+    return async ? async->dropped.load() : 0;
+}
+
+unsigned long long UgrLogger::getWritten() const
+{
+    return async ? async->written.load() : 0;
 }
 
 void UgrLogger::registerComponent(component const &  comp)
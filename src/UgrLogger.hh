@@ -17,12 +17,27 @@
 #include <syslog.h>
 
 #include <sstream>
+#include <ostream>
+#include <streambuf>
 #include <string>
+#include <string.h>
 
 #include <map>
 #include <vector>
 
 
+/// The messages of a level above this one are not even compiled in, e.g.
+/// -DUGR_LOG_COMPILE_LEVEL=2 removes the cost of the checks for the levels 3 and 4
+#ifndef UGR_LOG_COMPILE_LEVEL
+#define UGR_LOG_COMPILE_LEVEL 4
+#endif
+#define UGR_LOG_COMPILED(lvl) ((lvl) <= UGR_LOG_COMPILE_LEVEL)
+
+/// The longest message, a longer one is cut
+#define UGR_LOG_LINEMAX 4096
+
+class UgrLogAsync;
+
 /**
  * A UgrLogger class
  */
@@ -49,6 +64,13 @@ public:
         Lvl4=4
     };
 
+    /// What to do with a message when the ring of its thread is full
+    enum OverflowPolicy
+    {
+        OverflowDrop=0,   // Count it and forget it
+        OverflowBlock     // Wait for the writer to make room
+    };
+
     /// Destructor
     ~UgrLogger();
 
@@ -75,6 +97,34 @@ public:
         stderr_log = debug_stderr;
     }
     
+    /// Also write the messages to a file, opened in append mode
+    /// @param fn : the file name, empty to stop writing to a file
+    /// @return 0 if ok
+    int setLogFile(const std::string &fn);
+
+    /**
+     * Hand the messages to a thread that writes them, so that who logs does not
+     * wait for syslog or the terminal. Every thread that logs gets its own ring,
+     * that it fills without locking. The messages of level 0, that include the errors,
+     * always wait for room in the ring, the others follow the given policy.
+     *
+     * @param ringsize : the size in bytes of the ring of each thread
+     * @param pol : what to do with a message when the ring is full
+     */
+    void startAsync(size_t ringsize, OverflowPolicy pol);
+
+    /// Write what is pending and go back to writing the messages in the thread that logs them
+    void stopAsync();
+
+    /// Wait until the messages logged so far have been written
+    void flush();
+
+    /// @return the number of messages lost because a ring was full
+    unsigned long long getDropped() const;
+
+    /// @return the number of messages written by the writer thread
+    unsigned long long getWritten() const;
+
     /// @return true if the given component is being logged, false otherwise
     bool isLogged(bitmask m) const
     {
@@ -100,7 +150,12 @@ public:
      * @param component : bitmask assignet to the given component
      * @param msg : the message to be logged
      */
-    void log(Level lvl, std::string const & msg) const;
+    void log(Level lvl, std::string const & msg) const {
+        log(lvl, msg.data(), msg.size());
+    }
+
+    /// Same, with a message that is not zero terminated
+    void log(Level lvl, const char *msg, size_t len) const;
 
     /**
      * @param if true all unregistered components will be logged,
@@ -148,10 +203,68 @@ private:
     bitmask mask;
     /// component name to bitmask mapping
     std::map<component, bitmask> mapping;
+    /// the writer thread and the rings, created the first time it's started
+    UgrLogAsync *async;
     
     static UgrLogger *instance;
 
+    friend class UgrLogAsync;
+
+
+};
 
+
+
+/// A stream that writes into a fixed buffer, cutting what does not fit
+class UgrLogBuf: public std::streambuf {
+public:
+    UgrLogBuf() { reset(); }
+
+    void reset() { setp(buf, buf + sizeof(buf)); }
+    const char *data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+
+protected:
+    virtual std::streamsize xsputn(const char *s, std::streamsize n) {
+        std::streamsize c = epptr() - pptr();
+        if (n < c) c = n;
+        memcpy(pptr(), s, c);
+        pbump(c);
+        return n;
+    }
+
+    virtual int_type overflow(int_type c) {
+        return traits_type::not_eof(c);
+    }
+
+private:
+    char buf[UGR_LOG_LINEMAX];
+};
+
+
+/// The line where a log message is formatted. The streams are kept by each thread and reused,
+/// so that formatting a message does not allocate memory.
+/// More than one can be in use at the same time, e.g. when the formatting of a message logs
+/// something else
+class UgrLogLine {
+public:
+    UgrLogLine();
+    ~UgrLogLine();
+
+    std::ostream &stream() { return slot->os; }
+    const char *data() const { return slot->buf.data(); }
+    size_t size() const { return slot->buf.size(); }
+
+    struct Slot {
+        UgrLogBuf buf;
+        std::ostream os;
+
+        Slot(): os(&buf) {}
+    };
+
+private:
+    Slot *slot;
+    bool owned;
 };
 
 
@@ -0,0 +1,439 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrMetrics.cc
+ * @brief  Counters and latency histograms, exposed in the OpenMetrics text format
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "UgrMetrics.hh"
+#include "UgrTrace.hh"
+#include "SimpleDebug.hh"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <boost/thread/lock_guard.hpp>
+
+
+static std::atomic<int> metricsnextshard(0);
+static __thread int metricsshard = -1;
+
+int ugrMetricsShard() {
+  if (metricsshard < 0)
+    metricsshard = metricsnextshard.fetch_add(1, std::memory_order_relaxed) % UGR_METRICS_NSHARDS;
+  return metricsshard;
+}
+
+
+UgrMetricHistogram::UgrMetricHistogram() {
+  for (int i = 0; i < UGR_METRICS_NSHARDS; i++) {
+    for (int j = 0; j < nbuckets; j++) shards[i].buckets[j] = 0;
+    shards[i].sum = 0;
+  }
+}
+
+
+void UgrMetricHistogram::snapshot(std::vector<unsigned long long> &counts, unsigned long long &sumus) const {
+  counts.assign(nbuckets, 0);
+  sumus = 0;
+
+  for (int i = 0; i < UGR_METRICS_NSHARDS; i++) {
+    for (int j = 0; j < nbuckets; j++)
+      counts[j] += shards[i].buckets[j].load(std::memory_order_relaxed);
+    sumus += shards[i].sum.load(std::memory_order_relaxed);
+  }
+}
+
+
+UgrMetricTimer::UgrMetricTimer(UgrMetricHistogram *h): hist(h), t0(UgrTrace::now()) {}
+
+UgrMetricTimer::~UgrMetricTimer() {
+  if (hist) hist->observe((UgrTrace::now() - t0) / 1000);
+}
+
+
+UgrMetrics *UgrMetrics::get() {
+  // Never destroyed, the metrics may be updated while the process exits
+  static UgrMetrics *instance = new UgrMetrics();
+  return instance;
+}
+
+
+UgrMetrics::UgrMetrics(): lastgauge(0), listenfd(-1), server(0), stopping(false) {}
+
+
+UgrMetrics::Family &UgrMetrics::family(const std::string &name, const std::string &help, Type t) {
+  std::map<std::string, Family>::iterator it = families.find(name);
+  if (it != families.end()) return it->second;
+
+  Family &f = families[name];
+  f.type = t;
+  f.help = help;
+  return f;
+}
+
+
+UgrMetricCounter *UgrMetrics::counter(const std::string &name, const std::string &help, const std::string &labels) {
+  boost::lock_guard<boost::mutex> l(mtx);
+
+  Family &f = family(name, help, TCounter);
+  UgrMetricCounter *&c = f.counters[labels];
+  if (!c) c = new UgrMetricCounter();
+  return c;
+}
+
+
+UgrMetricHistogram *UgrMetrics::histogram(const std::string &name, const std::string &help, const std::string &labels) {
+  boost::lock_guard<boost::mutex> l(mtx);
+
+  Family &f = family(name, help, THistogram);
+  UgrMetricHistogram *&h = f.histograms[labels];
+  if (!h) h = new UgrMetricHistogram();
+  return h;
+}
+
+
+int UgrMetrics::gauge(const std::string &name, const std::string &help, const std::string &labels, std::function<double (void)> fn) {
+  boost::lock_guard<boost::mutex> l(mtx);
+
+  Family &f = family(name, help, TGauge);
+  int id = ++lastgauge;
+  f.gauges[id] = std::make_pair(labels, fn);
+  return id;
+}
+
+
+void UgrMetrics::removeGauge(int id) {
+  boost::lock_guard<boost::mutex> l(mtx);
+
+  for (std::map<std::string, Family>::iterator it = families.begin(); it != families.end(); ++it)
+    it->second.gauges.erase(id);
+}
+
+
+std::string UgrMetrics::escapeLabel(const std::string &s) {
+  std::string r;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '\\') r += "\\\\";
+    else if (s[i] == '"') r += "\\\"";
+    else if (s[i] == '\n') r += "\\n";
+    else r += s[i];
+  }
+  return r;
+}
+
+
+// The buckets that are exposed, the internal ones are too many for a scraper.
+// Powers of two of us, from 16us to 67s. Both the histograms count below 2^k us in
+// them, i.e. up to 2^k - 1 us, that is the le that they get
+#define METRICS_LE_FIRST 4
+#define METRICS_LE_LAST 26
+
+static void appendSample(std::string &out, const std::string &name, const char *suffix,
+                         const std::string &labels, const char *extralabel, double v) {
+  char buf[64];
+
+  out += name;
+  out += suffix;
+  if (!labels.empty() || extralabel) {
+    out += '{';
+    out += labels;
+    if (extralabel) {
+      if (!labels.empty()) out += ',';
+      out += extralabel;
+    }
+    out += '}';
+  }
+
+  snprintf(buf, sizeof(buf), " %.15g\n", v);
+  out += buf;
+}
+
+// A histogram given as cumulative counts at the exposed bounds
+static void appendHistogram(std::string &out, const std::string &name, const std::string &labels,
+                            const std::vector<unsigned long long> &cumul, unsigned long long count, unsigned long long sumus) {
+  char le[32];
+
+  for (size_t i = 0; i < cumul.size(); i++) {
+    // With all the digits, a bound rounded up would claim values that are not counted
+    snprintf(le, sizeof(le), "le=\"%.6f\"", (double)((1ULL << (METRICS_LE_FIRST + i)) - 1) / 1e6);
+    appendSample(out, name, "_bucket", labels, le, cumul[i]);
+  }
+  appendSample(out, name, "_bucket", labels, "le=\"+Inf\"", count);
+  appendSample(out, name, "_count", labels, 0, count);
+  appendSample(out, name, "_sum", labels, 0, sumus / 1e6);
+}
+
+
+void UgrMetrics::render(std::string &out) {
+  std::vector<unsigned long long> counts;
+  std::vector<unsigned long long> cumul;
+  unsigned long long sumus;
+
+  {
+    boost::lock_guard<boost::mutex> l(mtx);
+
+    for (std::map<std::string, Family>::iterator it = families.begin(); it != families.end(); ++it) {
+      const std::string &name = it->first;
+      Family &f = it->second;
+
+      out += "# TYPE " + name + ((f.type == TCounter) ? " counter\n" : (f.type == THistogram) ? " histogram\n" : " gauge\n");
+      out += "# HELP " + name + " " + f.help + "\n";
+
+      for (std::map<std::string, UgrMetricCounter *>::iterator c = f.counters.begin(); c != f.counters.end(); ++c)
+        appendSample(out, name, "_total", c->first, 0, c->second->value());
+
+      for (std::map<std::string, UgrMetricHistogram *>::iterator h = f.histograms.begin(); h != f.histograms.end(); ++h) {
+        h->second->snapshot(counts, sumus);
+
+        unsigned long long n = 0;
+        int b = 0;
+        cumul.clear();
+        for (int k = METRICS_LE_FIRST; k <= METRICS_LE_LAST; k++) {
+          while ((b < UgrMetricHistogram::nbuckets) && (UgrMetricHistogram::bucketEnd(b) <= (1ULL << k)))
+            n += counts[b++];
+          cumul.push_back(n);
+        }
+        while (b < UgrMetricHistogram::nbuckets) n += counts[b++];
+
+        appendHistogram(out, name, h->first, cumul, n, sumus);
+      }
+
+      for (std::map<int, std::pair<std::string, std::function<double (void)> > >::iterator g = f.gauges.begin(); g != f.gauges.end(); ++g)
+        appendSample(out, name, "", g->second.first, 0, g->second.second());
+    }
+  }
+
+  // The stages of the requests, from the histograms of the tracer. Its bucket i is below 2^i us
+  std::string name = "ugr_stage_duration_seconds";
+  out += "# TYPE " + name + " histogram\n";
+  out += "# HELP " + name + " Time spent by the requests in each stage\n";
+  for (int s = 0; s < UgrTrace::StgLast; s++) {
+    UgrTrace::Histogram h;
+    UgrTrace::get()->getHistogram((UgrTrace::Stage)s, h);
+
+    unsigned long long n = 0;
+    cumul.clear();
+    for (int i = 0; i < UgrTrace::nbuckets; i++) {
+      n += h.buckets[i];
+      // Its last bucket takes also the longer ones
+      if ((i >= METRICS_LE_FIRST) && (i <= METRICS_LE_LAST) && (i < UgrTrace::nbuckets-1)) cumul.push_back(n);
+    }
+
+    appendHistogram(out, name, std::string("stage=\"") + UgrTrace::stageName((UgrTrace::Stage)s) + "\"", cumul, n, h.sumus);
+  }
+
+  out += "# EOF\n";
+}
+
+
+int UgrMetrics::startServer(const std::string &listen) {
+  const char *fname = "UgrMetrics::startServer";
+
+  if (server) return 0;
+
+  int fd = -1;
+  if (listen.compare(0, 5, "unix:") == 0) {
+    struct sockaddr_un sa;
+    std::string path = listen.substr(5);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (path.empty() || (path.size() >= sizeof(sa.sun_path))) {
+      Error(fname, "Bad unix socket path '" << path << "'");
+      return 1;
+    }
+    strcpy(sa.sun_path, path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    unlink(path.c_str());
+    if ((fd < 0) || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || ::listen(fd, 16)) {
+      Error(fname, "Cannot listen on '" << path << "' err:" << errno);
+      if (fd >= 0) close(fd);
+      return 1;
+    }
+    unixpath = path;
+  }
+  else {
+    size_t p = listen.rfind(':');
+    if (p == std::string::npos) {
+      Error(fname, "Bad address '" << listen << "', expected host:port or unix:/path");
+      return 1;
+    }
+    std::string host = listen.substr(0, p);
+    std::string port = listen.substr(p+1);
+    if ((host.size() > 1) && (host[0] == '[')) host = host.substr(1, host.size()-2);
+
+    struct addrinfo hints, *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int r = getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(), &hints, &res);
+    if (r || !res) {
+      Error(fname, "Cannot resolve '" << listen << "' err:" << gai_strerror(r));
+      return 1;
+    }
+
+    fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    int one = 1;
+    if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((fd < 0) || bind(fd, res->ai_addr, res->ai_addrlen) || ::listen(fd, 16)) {
+      Error(fname, "Cannot listen on '" << listen << "' err:" << errno);
+      if (fd >= 0) close(fd);
+      freeaddrinfo(res);
+      return 1;
+    }
+    freeaddrinfo(res);
+  }
+
+  listenfd = fd;
+  stopping = false;
+  server = new boost::thread(&UgrMetrics::serve, this);
+
+  Info(UgrLogger::Lvl1, fname, "Serving the metrics on " << listen);
+  return 0;
+}
+
+
+void UgrMetrics::stopServer() {
+  if (!server) return;
+
+  stopping = true;
+  server->join();
+  delete server;
+  server = 0;
+
+  close(listenfd);
+  listenfd = -1;
+  if (!unixpath.empty()) unlink(unixpath.c_str());
+  unixpath.clear();
+}
+
+
+/// A client of the metrics server, served as its data comes
+struct UgrMetricsConn {
+  int fd;
+  std::string in, out;
+  size_t off;
+  /// A client that is too slow is dropped
+  uint64_t deadline;
+};
+
+/// At most this many clients at a time, each one has this long (ms) to be served
+#define UGRMETRICS_MAXCONNS 64
+#define UGRMETRICS_CONNTIMEOUT 5000
+
+static uint64_t metrics_nowms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+// All the clients are served by one thread, with non blocking sockets,
+// so that a client that is idle or slow does not delay the others
+void UgrMetrics::serve() {
+  std::vector<UgrMetricsConn> conns;
+  std::vector<struct pollfd> pfds;
+  char buf[4096];
+
+  while (!stopping) {
+    uint64_t now = metrics_nowms();
+    int timeout = 500;
+
+    pfds.resize(conns.size() + 1);
+    pfds[0].fd = listenfd;
+    pfds[0].events = (conns.size() < UGRMETRICS_MAXCONNS) ? POLLIN : 0;
+    pfds[0].revents = 0;
+    for (size_t i = 0; i < conns.size(); i++) {
+      pfds[i+1].fd = conns[i].fd;
+      pfds[i+1].events = conns[i].out.empty() ? POLLIN : POLLOUT;
+      pfds[i+1].revents = 0;
+      if (conns[i].deadline <= now) timeout = 0;
+      else if ((int)(conns[i].deadline - now) < timeout) timeout = conns[i].deadline - now;
+    }
+
+    if (poll(&pfds[0], pfds.size(), timeout) < 0) continue;
+    now = metrics_nowms();
+
+    for (size_t i = conns.size(); i > 0; i--) {
+      UgrMetricsConn &c = conns[i-1];
+      short ev = pfds[i].revents;
+      bool done = (c.deadline <= now) || (ev & (POLLERR | POLLNVAL));
+
+      if (!done && c.out.empty() && (ev & (POLLIN | POLLHUP))) {
+        // Read the headers
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR))) continue;
+        if (n <= 0) done = true;
+        else {
+          c.in.append(buf, n);
+          if (c.in.find("\r\n\r\n") != std::string::npos) respond(c.in, c.out);
+          else if (c.in.size() > 16384) done = true;
+        }
+      }
+      else if (!done && !c.out.empty() && (ev & (POLLOUT | POLLHUP))) {
+        ssize_t n = send(c.fd, c.out.data() + c.off, c.out.size() - c.off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR))) continue;
+        if (n <= 0) done = true;
+        else if ((c.off += n) >= c.out.size()) done = true;
+      }
+
+      if (done) {
+        close(c.fd);
+        conns[i-1] = conns.back();
+        conns.pop_back();
+      }
+    }
+
+    if (pfds[0].revents & POLLIN) {
+      while (conns.size() < UGRMETRICS_MAXCONNS) {
+        int fd = accept4(listenfd, 0, 0, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) break;
+
+        UgrMetricsConn c;
+        c.fd = fd;
+        c.off = 0;
+        c.deadline = now + UGRMETRICS_CONNTIMEOUT;
+        conns.push_back(c);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < conns.size(); i++) close(conns[i].fd);
+}
+
+
+// One request per connection, with no keepalive. Enough for a scraper
+void UgrMetrics::respond(const std::string &req, std::string &out) {
+  std::string body;
+  char buf[128];
+
+  if ((req.compare(0, 13, "GET /metrics ") == 0) || (req.compare(0, 6, "GET / ") == 0)) {
+    render(body);
+    out = "HTTP/1.0 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n";
+  }
+  else {
+    body = "Not found\n";
+    out = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+  }
+
+  snprintf(buf, sizeof(buf), "Content-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long)body.size());
+  out += buf;
+  out += body;
+}
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrMetrics.hh
+ * @brief  Counters and latency histograms, exposed in the OpenMetrics text format
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRMETRICS_HH
+#define UGRMETRICS_HH
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+
+/// The slots of the counters are split among the threads, so that the threads that
+/// update the same counter do not fight for the same cache line
+#define UGR_METRICS_NSHARDS 8
+
+/// The shard of the calling thread
+int ugrMetricsShard();
+
+
+/// A counter that only goes up
+class UgrMetricCounter {
+public:
+    UgrMetricCounter() {
+      for (int i = 0; i < UGR_METRICS_NSHARDS; i++) shards[i].v = 0;
+    }
+
+    void inc(unsigned long long n = 1) {
+      shards[ugrMetricsShard()].v.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    unsigned long long value() const {
+      unsigned long long t = 0;
+      for (int i = 0; i < UGR_METRICS_NSHARDS; i++) t += shards[i].v.load(std::memory_order_relaxed);
+      return t;
+    }
+
+private:
+    struct Shard {
+      std::atomic<unsigned long long> v;
+      char pad[64 - sizeof(std::atomic<unsigned long long>)];
+    };
+    Shard shards[UGR_METRICS_NSHARDS];
+};
+
+
+/// A histogram of durations in us. Four buckets per power of two, as in the HDR
+/// histograms, hence the error on a quantile is at most 25%, from 1us to many hours
+class UgrMetricHistogram {
+public:
+    enum { nbuckets = 4 + 34*4 };
+
+    UgrMetricHistogram();
+
+    void observe(unsigned long long us) {
+      Shard &s = shards[ugrMetricsShard()];
+      s.buckets[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+      s.sum.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    /// The counts of all the buckets, and the sum of the values
+    void snapshot(std::vector<unsigned long long> &counts, unsigned long long &sumus) const;
+
+    /// The bucket of a value
+    static int bucket(unsigned long long us) {
+      if (us < 4) return us;
+      int o = 63 - __builtin_clzll(us);
+      int b = 4 + (o-2)*4 + ((us >> (o-2)) & 3);
+      return (b < nbuckets) ? b : nbuckets-1;
+    }
+
+    /// The lowest value that does not fit in a bucket
+    static unsigned long long bucketEnd(int b) {
+      if (b < 4) return b+1;
+      int o = (b-4)/4 + 2;
+      return (unsigned long long)(5 + (b-4)%4) << (o-2);
+    }
+
+private:
+    struct Shard {
+      std::atomic<unsigned long long> buckets[nbuckets];
+      std::atomic<unsigned long long> sum;
+    };
+    Shard shards[UGR_METRICS_NSHARDS];
+};
+
+
+/// Measures a scope into a histogram
+class UgrMetricTimer {
+public:
+    UgrMetricTimer(UgrMetricHistogram *h);
+    ~UgrMetricTimer();
+
+private:
+    UgrMetricHistogram *hist;
+    uint64_t t0;
+};
+
+
+/// The registry of all the metrics of the process. The metrics are created once
+/// and never destroyed, whoever updates them keeps a pointer.
+/// The gauges are computed when the metrics are read, by a function given by who owns the value.
+/// The metrics can be read through a small HTTP server, on a TCP port or a unix socket
+class UgrMetrics {
+public:
+    static UgrMetrics *get();
+
+    /// Get or create a metric. The labels are like plugin="name", already escaped
+    UgrMetricCounter *counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    UgrMetricHistogram *histogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /// Add a gauge, whose value is given by f
+    /// @return the ID to remove it, e.g. before the owner of the value is destroyed
+    int gauge(const std::string &name, const std::string &help, const std::string &labels, std::function<double (void)> f);
+    void removeGauge(int id);
+
+    /// A label value, with the chars that need it escaped
+    static std::string escapeLabel(const std::string &s);
+
+    /// All the metrics in the OpenMetrics text format, including the latencies of the stages of UgrTrace
+    void render(std::string &out);
+
+    /// Serve the metrics over HTTP
+    /// @param listen : host:port, or unix:/path for a unix socket
+    /// @return 0 if ok
+    int startServer(const std::string &listen);
+    void stopServer();
+
+private:
+    UgrMetrics();
+
+    enum Type { TCounter, THistogram, TGauge };
+
+    struct Family {
+      Type type;
+      std::string help;
+      /// By labels
+      std::map<std::string, UgrMetricCounter *> counters;
+      std::map<std::string, UgrMetricHistogram *> histograms;
+      /// By ID
+      std::map<int, std::pair<std::string, std::function<double (void)> > > gauges;
+    };
+
+    /// Protects the families, not the values
+    boost::mutex mtx;
+    std::map<std::string, Family> families;
+    int lastgauge;
+
+    Family &family(const std::string &name, const std::string &help, Type t);
+
+    int listenfd;
+    std::string unixpath;
+    boost::thread *server;
+    std::atomic<bool> stopping;
+
+    void serve();
+    /// The reply to a request, given its headers
+    void respond(const std::string &req, std::string &out);
+};
+
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrPrefixMap.cc
+ * @brief  Longest prefix match and substitution, for the name translations
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "UgrPrefixMap.hh"
+#include <algorithm>
+
+
+void UgrPrefixMap::clear() {
+  rules.clear();
+  nodes.clear();
+
+  // The root, its label is empty
+  nodes.push_back(Node());
+}
+
+
+int UgrPrefixMap::child(int n, unsigned char c) const {
+  const std::vector<int> &ch = nodes[n].children;
+
+  // Few children per node, usually
+  size_t lo = 0, hi = ch.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    unsigned char m = nodes[ch[mid]].label[0];
+
+    if (m == c) return ch[mid];
+    if (m < c) lo = mid+1;
+    else hi = mid;
+  }
+
+  return -1;
+}
+
+
+int UgrPrefixMap::add(const std::string &from, const std::string &to) {
+  int n = 0;
+  size_t pos = 0;
+
+  while (pos < from.size()) {
+    unsigned char c = from[pos];
+    int ch = child(n, c);
+
+    if (ch < 0) {
+      // Nothing starts like this, a new leaf with the rest of the prefix
+      Node leaf;
+      leaf.label = from.substr(pos);
+      int l = nodes.size();
+      nodes.push_back(leaf);
+
+      std::vector<int> &v = nodes[n].children;
+      std::vector<int>::iterator it = v.begin();
+      while ((it != v.end()) && ((unsigned char)nodes[*it].label[0] < c)) ++it;
+      v.insert(it, l);
+
+      n = l;
+      pos = from.size();
+      break;
+    }
+
+    // How much of the label is shared
+    const std::string &lab = nodes[ch].label;
+    size_t k = 0;
+    while ((k < lab.size()) && (pos + k < from.size()) && (lab[k] == from[pos + k])) k++;
+
+    if (k < lab.size()) {
+      // Split the edge, the first part goes into a new node
+      Node mid;
+      mid.label = lab.substr(0, k);
+      mid.children.push_back(ch);
+      int m = nodes.size();
+      nodes.push_back(mid);
+
+      nodes[ch].label.erase(0, k);
+
+      std::vector<int> &v = nodes[n].children;
+      for (size_t i = 0; i < v.size(); i++)
+        if (v[i] == ch) v[i] = m;
+
+      ch = m;
+    }
+
+    n = ch;
+    pos += k;
+  }
+
+  if (nodes[n].rule >= 0) return nodes[n].rule;
+
+  Rule r;
+  r.from = from;
+  r.to = to;
+  rules.push_back(r);
+
+  nodes[n].rule = rules.size() - 1;
+  return nodes[n].rule;
+}
+
+
+int UgrPrefixMap::match(const char *path, size_t len) const {
+  int n = 0;
+  int best = nodes[0].rule;
+  size_t pos = 0;
+
+  while (pos < len) {
+    n = child(n, path[pos]);
+    if (n < 0) break;
+
+    const std::string &lab = nodes[n].label;
+    if ((len - pos < lab.size()) || memcmp(lab.data(), path + pos, lab.size())) break;
+
+    pos += lab.size();
+    if (nodes[n].rule >= 0) best = nodes[n].rule;
+  }
+
+  return best;
+}
+
+
+void UgrPrefixMap::below(const char *path, size_t len, std::vector<int> &out) const {
+  out.clear();
+
+  int n = 0;
+  size_t pos = 0;
+
+  while (pos < len) {
+    n = child(n, path[pos]);
+    if (n < 0) return;
+
+    const std::string &lab = nodes[n].label;
+    size_t k = std::min(lab.size(), len - pos);
+    if (memcmp(lab.data(), path + pos, k)) return;
+
+    // The path ends in the middle of the label, everything below is longer than it
+    pos += k;
+  }
+
+  // All the rules in the subtree
+  std::vector<int> todo(1, n);
+  while (!todo.empty()) {
+    const Node &nd = nodes[todo.back()];
+    todo.pop_back();
+
+    if (nd.rule >= 0) out.push_back(nd.rule);
+    todo.insert(todo.end(), nd.children.begin(), nd.children.end());
+  }
+}
+
+
+size_t UgrPrefixMap::apply(int rule, const char *path, size_t len, char *buf, size_t bufsz, const char *lead) const {
+  const Rule &r = rules[rule];
+  size_t tot = 0;
+
+  const char *parts[3];
+  size_t lens[3];
+  parts[0] = lead ? lead : "";
+  lens[0] = lead ? strlen(lead) : 0;
+  parts[1] = r.to.data();
+  lens[1] = r.to.size();
+  parts[2] = path + r.from.size();
+  lens[2] = len - r.from.size();
+
+  for (int i = 0; i < 3; i++) {
+    if (bufsz && (tot < bufsz - 1)) {
+      size_t c = std::min(lens[i], bufsz - 1 - tot);
+      memcpy(buf + tot, parts[i], c);
+    }
+    tot += lens[i];
+  }
+
+  if (bufsz) buf[std::min(tot, bufsz - 1)] = '\0';
+  return tot;
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrPrefixMap.hh
+ * @brief  Longest prefix match and substitution, for the name translations
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRPREFIXMAP_HH
+#define UGRPREFIXMAP_HH
+
+#include <string>
+#include <vector>
+#include <string.h>
+
+
+/// A set of rules that substitute a prefix of a path with another one, e.g.
+/// /myfed/atlas -> /dpm/cern.ch/home/atlas
+/// The prefixes are kept in a radix trie, so that finding the rule of a path is
+/// a walk along the path, whatever the number of the rules.
+/// The longest prefix that matches wins. An empty prefix matches any path.
+/// The translated path is written into a buffer given by the caller.
+///
+/// Built once, then it can be used by any number of threads
+class UgrPrefixMap {
+public:
+    UgrPrefixMap() { clear(); }
+
+    void clear();
+
+    /// Add a rule. A prefix that is already there keeps the first rule
+    /// @return the index of the rule
+    int add(const std::string &from, const std::string &to);
+
+    /// The rule with the longest prefix of a path. -1 if none
+    int match(const char *path, size_t len) const;
+    int match(const std::string &path) const {
+        return match(path.c_str(), path.size());
+    }
+
+    /// The rules whose prefix starts with the given path, i.e. the path is the same
+    /// as the prefix or one of its parents. In no particular order
+    void below(const char *path, size_t len, std::vector<int> &rules) const;
+    void below(const std::string &path, std::vector<int> &rules) const {
+        below(path.c_str(), path.size(), rules);
+    }
+
+    /// Translate a path that matches a rule: lead + to + what follows the prefix in the path.
+    /// Like snprintf, at most bufsz-1 chars are written, followed by a zero.
+    /// @return the length of the whole translation
+    size_t apply(int rule, const char *path, size_t len, char *buf, size_t bufsz, const char *lead = 0) const;
+
+    /// Same, into a string. Its memory is reused if large enough
+    void apply(int rule, const std::string &path, std::string &out) const {
+        const Rule &r = rules[rule];
+        out.assign(r.to);
+        out.append(path, r.from.size(), std::string::npos);
+    }
+
+    /// Same, replacing the prefix in place
+    void applyInPlace(int rule, std::string &path) const {
+        const Rule &r = rules[rule];
+        path.replace(0, r.from.size(), r.to);
+    }
+
+    const std::string &from(int rule) const { return rules[rule].from; }
+    const std::string &to(int rule) const { return rules[rule].to; }
+
+    /// The number of rules
+    int size() const { return rules.size(); }
+
+private:
+    struct Rule {
+        std::string from, to;
+    };
+
+    struct Node {
+        /// The chars that lead here from the parent
+        std::string label;
+        /// The rule whose prefix ends here, -1 if none
+        int rule;
+        /// Sorted by the first char of their label
+        std::vector<int> children;
+
+        Node(): rule(-1) {}
+    };
+
+    std::vector<Rule> rules;
+    std::vector<Node> nodes;
+
+    /// The child of a node whose label starts with c, -1 if none
+    int child(int n, unsigned char c) const;
+};
+
+
+#endif
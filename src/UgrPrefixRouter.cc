@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrPrefixRouter.cc
+ * @brief  Tells which location plugins may have something to say about an lfn
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "UgrPrefixRouter.hh"
+#include <algorithm>
+
+
+struct ugrrouter_charless {
+  bool operator()(const std::pair<unsigned char, int> &a, unsigned char c) const { return a.first < c; }
+};
+
+
+int UgrPrefixRouter::child(int n, unsigned char c) const {
+  const std::vector< std::pair<unsigned char, int> > &v = nodes[n].next;
+  std::vector< std::pair<unsigned char, int> >::const_iterator it = std::lower_bound(v.begin(), v.end(), c, ugrrouter_charless());
+
+  if ((it == v.end()) || (it->first != c)) return -1;
+  return it->second;
+}
+
+
+int UgrPrefixRouter::addchild(int n, unsigned char c) {
+  int r = child(n, c);
+  if (r >= 0) return r;
+
+  r = nodes.size();
+  nodes.push_back(Node());
+
+  std::vector< std::pair<unsigned char, int> > &v = nodes[n].next;
+  v.insert(std::lower_bound(v.begin(), v.end(), c, ugrrouter_charless()), std::make_pair(c, r));
+  return r;
+}
+
+
+static void ugrrouter_addplugin(std::vector<int> &v, int id) {
+  // The plugins are added in order, a plugin with more prefixes may come again
+  if (v.empty() || (v.back() != id)) v.push_back(id);
+}
+
+
+void UgrPrefixRouter::build(const std::vector< std::vector<std::string> > &prefixes) {
+  nodes.clear();
+  catchall.clear();
+  nodes.push_back(Node());
+  nplugins = prefixes.size();
+
+  for (int id = 0; id < nplugins; id++) {
+    const std::vector<std::string> &pfxs = prefixes[id];
+
+    if (pfxs.empty()) {
+      catchall.push_back(id);
+      continue;
+    }
+
+    for (unsigned int i = 0; i < pfxs.size(); i++) {
+      const std::string &p = pfxs[i];
+
+      // Don't try to be smarter than the plugin with a prefix that matches anything
+      if (p.empty()) {
+        ugrrouter_addplugin(catchall, id);
+        continue;
+      }
+
+      int n = 0;
+      for (size_t k = 0; k < p.size(); k++) {
+        // The lfn so far is a parent dir of the prefix if the prefix continues with a slash.
+        // Any lfn made of one char is the root
+        if ((k == 1) || ((k > 0) && (p[k] == '/')))
+          ugrrouter_addplugin(nodes[n].parentof, id);
+
+        n = addchild(n, p[k]);
+      }
+
+      ugrrouter_addplugin(nodes[n].terminal, id);
+    }
+  }
+
+  for (unsigned int n = 0; n < nodes.size(); n++) {
+    std::sort(nodes[n].parentof.begin(), nodes[n].parentof.end());
+    nodes[n].parentof.erase(std::unique(nodes[n].parentof.begin(), nodes[n].parentof.end()), nodes[n].parentof.end());
+  }
+  std::sort(catchall.begin(), catchall.end());
+  catchall.erase(std::unique(catchall.begin(), catchall.end()), catchall.end());
+}
+
+
+void UgrPrefixRouter::route(const std::string &lfn, std::vector<int> &plugins) const {
+  plugins.clear();
+
+  // An empty lfn matches every prefix
+  if (lfn.empty() || nodes.empty()) {
+    for (int i = 0; i < nplugins; i++) plugins.push_back(i);
+    return;
+  }
+
+  plugins = catchall;
+
+  int n = 0;
+  size_t k = 0;
+  for (; k < lfn.size(); k++) {
+    n = child(n, lfn[k]);
+    if (n < 0) break;
+
+    plugins.insert(plugins.end(), nodes[n].terminal.begin(), nodes[n].terminal.end());
+  }
+
+  // The whole lfn is in the trie, it may be the parent of some prefixes
+  if (n >= 0)
+    plugins.insert(plugins.end(), nodes[n].parentof.begin(), nodes[n].parentof.end());
+
+  std::sort(plugins.begin(), plugins.end());
+  plugins.erase(std::unique(plugins.begin(), plugins.end()), plugins.end());
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrPrefixRouter.hh
+ * @brief  Tells which location plugins may have something to say about an lfn
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRPREFIXROUTER_HH
+#define UGRPREFIXROUTER_HH
+
+#include <string>
+#include <vector>
+
+
+/// An index of the prefixes served by the plugins, so that a request is queued only
+/// to the plugins that would not discard it.
+/// A plugin is selected for an lfn if
+/// - it serves no prefix in particular, or
+/// - one of its prefixes is a prefix of the lfn, as in LocationPlugin::doNameXlation, or
+/// - the lfn is a parent dir of one of its prefixes, as in LocationPlugin::doParentQueryCheck
+///
+/// The result may contain more plugins than needed, never less. It is built once,
+/// then it can be used by any number of threads
+class UgrPrefixRouter {
+public:
+    UgrPrefixRouter(): nplugins(0) {}
+
+    /// Build the index
+    /// @param prefixes the prefixes served by each plugin, indexed by pluginID. None means any lfn
+    void build(const std::vector< std::vector<std::string> > &prefixes);
+
+    /// The plugins that may serve an lfn, in ascending order
+    void route(const std::string &lfn, std::vector<int> &plugins) const;
+
+    /// The number of plugins the index has been built for
+    int size() const { return nplugins; }
+
+private:
+    struct Node {
+        /// The children, sorted by char
+        std::vector< std::pair<unsigned char, int> > next;
+        /// The plugins that have a prefix ending here
+        std::vector<int> terminal;
+        /// The plugins that have a longer prefix, for which this is a parent dir
+        std::vector<int> parentof;
+    };
+
+    std::vector<Node> nodes;
+
+    /// The plugins that serve everything
+    std::vector<int> catchall;
+
+    int nplugins;
+
+    int child(int n, unsigned char c) const;
+    int addchild(int n, unsigned char c);
+};
+
+
+#endif
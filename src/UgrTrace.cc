@@ -0,0 +1,201 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrTrace.cc
+ * @brief  Where the requests spend their time
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#include "UgrTrace.hh"
+#include "SimpleDebug.hh"
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <boost/thread/lock_guard.hpp>
+
+
+static __thread uint64_t tracecurrent = 0;
+static __thread long tracetid = 0;
+
+static const char *stagenames[UgrTrace::StgLast] = {
+  "request", "handlerlock", "extcache", "queue", "plugin", "wait", "filter"
+};
+
+
+UgrTrace *UgrTrace::get() {
+  // Never destroyed, a thread may still be recording while the process exits
+  static UgrTrace *instance = new UgrTrace();
+  return instance;
+}
+
+
+UgrTrace::UgrTrace(): samplerate(0), nrequests(0), lastid(0), maxevents(100000), droppedevents(0) {
+  for (int k = 0; k < UGR_METRICS_NSHARDS; k++)
+    for (int i = 0; i < StgLast; i++) {
+      shards[k].count[i] = 0;
+      shards[k].sumus[i] = 0;
+      for (int j = 0; j < nbuckets; j++) shards[k].buckets[i][j] = 0;
+    }
+}
+
+
+const char *UgrTrace::stageName(Stage s) {
+  if ((s < 0) || (s >= StgLast)) return "unknown";
+  return stagenames[s];
+}
+
+
+void UgrTrace::configure(long rate, const std::string &fn, size_t maxev) {
+  boost::lock_guard<boost::mutex> l(evmtx);
+
+  filename = fn;
+  maxevents = maxev;
+  // Nobody would read the events
+  if (filename.empty()) rate = 0;
+  samplerate = rate;
+}
+
+
+uint64_t UgrTrace::begin() {
+  long rate = samplerate.load(std::memory_order_relaxed);
+
+  tracecurrent = 0;
+  if ((rate > 0) && (nrequests.fetch_add(1, std::memory_order_relaxed) % rate == 0))
+    tracecurrent = lastid.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  return tracecurrent;
+}
+
+
+uint64_t UgrTrace::current() {
+  return tracecurrent;
+}
+
+
+void UgrTrace::setCurrent(uint64_t id) {
+  tracecurrent = id;
+}
+
+
+void UgrTrace::record(Stage s, uint64_t id, uint64_t t0, uint64_t t1, int pluginid) {
+  unsigned long long us = (t1 > t0) ? (t1 - t0) / 1000 : 0;
+
+  int b = 0;
+  while ((b < nbuckets-1) && (us >= (1ULL << b))) b++;
+
+  Shard &sh = shards[ugrMetricsShard()];
+  sh.count[s].fetch_add(1, std::memory_order_relaxed);
+  sh.sumus[s].fetch_add(us, std::memory_order_relaxed);
+  sh.buckets[s][b].fetch_add(1, std::memory_order_relaxed);
+
+  if (!id) return;
+
+  if (!tracetid) tracetid = syscall(SYS_gettid);
+
+  Event ev;
+  ev.id = id;
+  ev.t0 = t0;
+  ev.t1 = t1;
+  ev.stage = s;
+  ev.pluginid = pluginid;
+  ev.tid = tracetid;
+
+  boost::lock_guard<boost::mutex> l(evmtx);
+  if (events.size() >= maxevents) {
+    droppedevents++;
+    return;
+  }
+  events.push_back(ev);
+}
+
+
+void UgrTrace::flush() {
+  const char *fname = "UgrTrace::flush";
+  std::vector<Event> evs;
+  std::string fn;
+
+  {
+    boost::lock_guard<boost::mutex> l(evmtx);
+    evs.swap(events);
+    fn = filename;
+  }
+
+  if (evs.empty() || fn.empty()) return;
+
+  FILE *f = fopen(fn.c_str(), "a");
+  if (!f) {
+    Error(fname, "Cannot open trace file '" << fn << "' err:" << errno);
+    return;
+  }
+
+  // The trace viewer accepts an array without the closing bracket,
+  // hence we can keep appending to it
+  if (ftell(f) == 0) fputs("[\n", f);
+
+  int pid = getpid();
+  for (size_t i = 0; i < evs.size(); i++) {
+    const Event &e = evs[i];
+    fprintf(f, "{\"name\":\"%s\",\"cat\":\"ugr\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,"
+      "\"args\":{\"req\":%llu,\"plugin\":%d}},\n",
+      stagenames[e.stage], e.t0 / 1000.0, (e.t1 - e.t0) / 1000.0, pid, e.tid,
+      (unsigned long long)e.id, e.pluginid);
+  }
+
+  fclose(f);
+  Info(UgrLogger::Lvl4, fname, "Written " << evs.size() << " events to " << fn);
+}
+
+
+void UgrTrace::getHistogram(Stage s, Histogram &h) const {
+  h.count = 0;
+  h.sumus = 0;
+  for (int i = 0; i < nbuckets; i++) h.buckets[i] = 0;
+
+  for (int k = 0; k < UGR_METRICS_NSHARDS; k++) {
+    const Shard &sh = shards[k];
+    h.count += sh.count[s].load(std::memory_order_relaxed);
+    h.sumus += sh.sumus[s].load(std::memory_order_relaxed);
+    for (int i = 0; i < nbuckets; i++)
+      h.buckets[i] += sh.buckets[s][i].load(std::memory_order_relaxed);
+  }
+}
+
+
+// The upper bound of the bucket where the given fraction of the samples is reached
+static unsigned long long histPercentile(const UgrTrace::Histogram &h, double frac) {
+  unsigned long long tot = 0;
+  for (int i = 0; i < UgrTrace::nbuckets; i++) tot += h.buckets[i];
+
+  unsigned long long n = 0;
+  for (int i = 0; i < UgrTrace::nbuckets; i++) {
+    n += h.buckets[i];
+    if (n >= tot * frac) return 1ULL << i;
+  }
+
+  return 1ULL << (UgrTrace::nbuckets-1);
+}
+
+
+void UgrTrace::report() {
+  const char *fname = "UgrTrace::report";
+
+  for (int s = 0; s < StgLast; s++) {
+    Histogram h;
+    getHistogram((Stage)s, h);
+    if (!h.count) continue;
+
+    Info(UgrLogger::Lvl1, fname, "Stage " << stagenames[s] << " count:" << h.count << " avg:" << h.sumus / h.count <<
+      "us p50<" << histPercentile(h, 0.5) << "us p99<" << histPercentile(h, 0.99) << "us");
+  }
+
+  if (droppedevents.load())
+    Info(UgrLogger::Lvl1, fname, "Trace events dropped: " << droppedevents.load());
+}
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/** @file   UgrTrace.hh
+ * @brief  Where the requests spend their time
+ * @author agent
+ * @date   Oct 2026
+ */
+
+#ifndef UGRTRACE_HH
+#define UGRTRACE_HH
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include <boost/thread/mutex.hpp>
+#include "UgrMetrics.hh"
+
+
+/// Measures how long the requests stay in each stage, e.g. waiting for the lock of the
+/// LocationInfoHandler or in the queue of a plugin.
+/// The durations of all the requests go into a histogram per stage.
+/// One request every samplerate gets an ID, that follows it from the thread that serves it
+/// to the plugins that work for it. Its stages are kept as events, that are periodically
+/// appended to a file in the format of the Chrome trace viewer (chrome://tracing)
+class UgrTrace {
+public:
+    enum Stage {
+        StgRequest = 0,  // A whole stat, locate or list
+        StgHandlerLock,  // Waiting for the lock of the LocationInfoHandler
+        StgExtCache,     // Getting an item from the external cache
+        StgQueue,        // Waiting in the queue of a plugin
+        StgPlugin,       // A plugin talking to its endpoint
+        StgWait,         // Waiting for the plugins to fill an UgrFileInfo
+        StgFilter,       // The filters sorting the replicas
+        StgLast
+    };
+
+    /// The buckets of the histograms. Bucket i counts the durations below 2^i us,
+    /// that are not in bucket i-1. The last bucket takes all the rest
+    enum { nbuckets = 24 };
+
+    struct Histogram {
+        unsigned long long count;
+        unsigned long long sumus;
+        unsigned long long buckets[nbuckets];
+    };
+
+    static UgrTrace *get();
+
+    static const char *stageName(Stage s);
+
+    /// The monotonic clock, in ns
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    /// @param samplerate : trace one request every samplerate, 0 for none
+    /// @param fn : the file where to append the events
+    /// @param maxevents : the events kept between two writes, the others are dropped
+    void configure(long samplerate, const std::string &fn, size_t maxevents);
+
+    /// Start a request in the calling thread. The ID stays with the thread until
+    /// the next request, so that what the thread does later on behalf of it
+    /// (e.g. filtering the replicas) is accounted to it. The requests that are not
+    /// traced clear it with setCurrent(0)
+    /// @return the ID of the request, 0 if it's not traced
+    uint64_t begin();
+
+    /// The ID of the request the calling thread is working for, 0 if none
+    static uint64_t current();
+    /// Set the request the calling thread is working for, e.g. a plugin worker
+    static void setCurrent(uint64_t id);
+
+    /// Account a stage of the current request, that started at t0 and ends now
+    void record(Stage s, uint64_t t0, int pluginid = -1) {
+        record(s, current(), t0, now(), pluginid);
+    }
+
+    void record(Stage s, uint64_t id, uint64_t t0, uint64_t t1, int pluginid);
+
+    /// Append the pending events to the file
+    void flush();
+
+    /// Log a summary of the histograms
+    void report();
+
+    void getHistogram(Stage s, Histogram &h) const;
+
+    /// The number of events lost since there were too many
+    unsigned long long getDroppedEvents() const { return droppedevents.load(); }
+
+private:
+    UgrTrace();
+
+    struct Event {
+        uint64_t id;
+        uint64_t t0, t1;
+        int stage;
+        int pluginid;
+        long tid;
+    };
+
+    /// The histograms are split among the threads as the metrics are,
+    /// and summed up when they are read
+    struct Shard {
+      std::atomic<unsigned long long> count[StgLast];
+      std::atomic<unsigned long long> sumus[StgLast];
+      std::atomic<unsigned long long> buckets[StgLast][nbuckets];
+      char pad[64];
+    };
+    Shard shards[UGR_METRICS_NSHARDS];
+
+    std::atomic<long> samplerate;
+    std::atomic<unsigned long long> nrequests;
+    std::atomic<uint64_t> lastid;
+
+    /// Protects the events and the file name
+    boost::mutex evmtx;
+    std::vector<Event> events;
+    size_t maxevents;
+    std::string filename;
+    std::atomic<unsigned long long> droppedevents;
+};
+
+
+/// Accounts to a stage of the current request the time spent in a scope
+class UgrTraceScope {
+public:
+    UgrTraceScope(UgrTrace::Stage s, int pluginid = -1): stage(s), plugin(pluginid), t0(UgrTrace::now()) {}
+    ~UgrTraceScope() {
+        UgrTrace::get()->record(stage, t0, plugin);
+    }
+
+private:
+    UgrTrace::Stage stage;
+    int plugin;
+    uint64_t t0;
+};
+
+
+#endif
@@ -9,13 +9,42 @@
 
 
 #include "UgrAuthPlugin_python.hh"
+#include "UgrConnector.hh"
+#include <algorithm>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include "libs/time_utils.h"
 
 
+// Where the workers are installed
+#ifndef UGRAUTHPY_WORKER_DEFAULT
+#define UGRAUTHPY_WORKER_DEFAULT "/usr/libexec/ugr/ugrauthpy_worker"
+#endif
+
+// The max size of a request to a worker
+#define UGRAUTHPY_MAXREQ 65536
+
+
 
 
 bool UgrAuthorizationPlugin_py::python_initdone = false;
+
+
+/// Matches the cached decisions about a client
+struct ugrauthpy_keyprefix {
+  std::string pfx;
+  ugrauthpy_keyprefix(const std::string &p): pfx(p) {}
+  bool operator()(const std::string &k, bool) const {
+    return !k.compare(0, pfx.size(), pfx);
+  }
+};
 static PyThreadState *global_tstate;
 
 
@@ -355,8 +384,28 @@ int UgrAuthorizationPlugin_py::pyxeqfunc2(int &retval, PyObject *pFunc,
 UgrAuthorizationPlugin_py::UgrAuthorizationPlugin_py( UgrConnector & c, std::vector<std::string> & parms) : UgrAuthorizationPlugin(c, parms) {
   
   const char *fname = "UgrAuthorizationPlugin_py::UgrAuthorizationPlugin_py";
+  UgrCFG->Set(&c.getConfig());
+
+  // Take the parms
+  if (parms.size() != 4) {
+    // here we should abort everything
+    throw "Fatal error, wrong number of arguments in UgrAuthorizationPlugin_py"; 
+  }
+
+  info_pyfunc.module = parms[2];
+  info_pyfunc.func = parms[3];
+
+  // With workers, the python function runs in helper processes and there is no interpreter here
+  std::string pfx = "glb.authorizationplugin." + parms[1] + ".";
+  int nworkers = UgrCFG->GetLong(pfx + "workers", 0);
+  workertimeoutms = UgrCFG->GetLong(pfx + "workertimeoutms", 2000);
+  workerpath = UgrCFG->GetString(pfx + "workerpath", UGRAUTHPY_WORKER_DEFAULT);
+  if (nworkers < 0) {
+    Error(fname, "Invalid number of workers: " << nworkers << ", running the function in process");
+    nworkers = 0;
+  }
   
-  {
+  if (!nworkers) {
     
     //
     // Various hacks for initializing python, inspired by
@@ -448,19 +497,32 @@ UgrAuthorizationPlugin_py::UgrAuthorizationPlugin_py( UgrConnector & c, std::vec
     }
   }
   
-  // Take the parms
-  if (parms.size() != 4) {
-    pyterm(info_pyfunc);
-    
-    // here we should abort everything
-    throw "Fatal error, wrong number of arguments in UgrAuthorizationPlugin_py"; 
-  }
-  
-  info_pyfunc.module = parms[2];
-  info_pyfunc.func = parms[3];
-  
   Info(UgrLogger::Lvl1, fname, "Python authorization invokes function: " << info_pyfunc.func << " from module " << info_pyfunc.module);
 
+  // The decisions of the function can be cached, if asked
+  cachettl = UgrCFG->GetLong(pfx + "cachettl", 0);
+  cachenegttl = UgrCFG->GetLong(pfx + "cachenegttl", 0);
+  cacheprefixdepth = UgrCFG->GetLong(pfx + "cacheprefixdepth", 0);
+  decisions.setLimits(UgrCFG->GetLong(pfx + "cachesize", 100000), cachettl);
+  cachegeneration.store(UgrCFG->GetGeneration(), std::memory_order_release);
+
+  Info(UgrLogger::Lvl1, fname, "Decision cache. ttl: " << cachettl << " negttl: " << cachenegttl <<
+    " prefixdepth: " << cacheprefixdepth);
+
+  if (nworkers > 0) {
+    Info(UgrLogger::Lvl1, fname, "Starting " << nworkers << " python workers: " << workerpath);
+
+    workers.resize(nworkers);
+    for (int i = 0; i < nworkers; i++) {
+      if (spawnWorker(workers[i])) {
+        killWorkers();
+        throw "Fatal error, cannot start the python authorization workers";
+      }
+    }
+
+    return;
+  }
+
   if (pyinit(info_pyfunc)) {
     pyterm(info_pyfunc);
     
@@ -472,7 +534,313 @@ UgrAuthorizationPlugin_py::UgrAuthorizationPlugin_py( UgrConnector & c, std::vec
 
 
 UgrAuthorizationPlugin_py::~UgrAuthorizationPlugin_py() {
-  
+  killWorkers();
+}
+
+
+// ------------------------------------------------------------------------------------
+// The pool of worker processes
+// ------------------------------------------------------------------------------------
+
+
+// A request is a packet with the fields separated by zeroes:
+// clientname, remoteaddr, resource, mode, number of fqans, the fqans, then the keys and values
+// The reply is two ints: the result of the invocation and the value returned by the function
+void UgrAuthorizationPlugin_py::encodeRequest(std::string &req, const std::string &clientName, const std::string &remoteAddress,
+                                              const char *resource, const char reqmode,
+                                              const std::vector<std::string> &fqans,
+                                              const std::vector< std::pair<std::string, std::string> > &keys) {
+  char buf[32];
+
+  req = clientName;
+  req += '\0';
+  req += remoteAddress;
+  req += '\0';
+  req += resource;
+  req += '\0';
+  req += reqmode;
+  req += '\0';
+
+  snprintf(buf, sizeof(buf), "%lu", (unsigned long)fqans.size());
+  req += buf;
+  req += '\0';
+  for (unsigned int i = 0; i < fqans.size(); i++) {
+    req += fqans[i];
+    req += '\0';
+  }
+
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    req += keys[i].first;
+    req += '\0';
+    req += keys[i].second;
+    req += '\0';
+  }
+}
+
+
+int UgrAuthorizationPlugin_py::spawnWorker(UgrAuthPyWorker &w) {
+  const char *fname = "UgrAuthorizationPlugin_py::spawnWorker";
+
+  // A module that can't be loaded would make us fork all the time
+  time_t now = time(0);
+  if (now - w.lastspawn < 1) {
+    Error(fname, "Python worker restarting too often, not restarting it now.");
+    return 1;
+  }
+  w.lastspawn = now;
+
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv)) {
+    Error(fname, "Cannot create the socket pair. errno: " << errno);
+    return 1;
+  }
+
+  // Prepare everything before forking, the child only execs
+  std::string a0 = workerpath, a1 = info_pyfunc.module, a2 = info_pyfunc.func;
+  char *argv[] = { (char *)a0.c_str(), (char *)a1.c_str(), (char *)a2.c_str(), 0 };
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    Error(fname, "Cannot fork. errno: " << errno);
+    close(sv[0]);
+    close(sv[1]);
+    return 1;
+  }
+
+  if (!pid) {
+    // The worker talks through its stdin
+    if (sv[1] == 0) fcntl(0, F_SETFD, 0);
+    else dup2(sv[1], 0);
+
+    execv(argv[0], argv);
+    _exit(127);
+  }
+
+  close(sv[1]);
+  w.fd = sv[0];
+  w.pid = pid;
+
+  Info(UgrLogger::Lvl2, fname, "Started python worker. pid: " << pid);
+  return 0;
+}
+
+
+void UgrAuthorizationPlugin_py::killWorker(UgrAuthPyWorker &w) {
+  if (w.fd >= 0) {
+    close(w.fd);
+    w.fd = -1;
+  }
+
+  if (w.pid > 0) {
+    kill(w.pid, SIGKILL);
+    waitpid(w.pid, 0, 0);
+    w.pid = -1;
+  }
+}
+
+
+void UgrAuthorizationPlugin_py::killWorkers() {
+  for (unsigned int i = 0; i < workers.size(); i++)
+    killWorker(workers[i]);
+}
+
+
+int UgrAuthorizationPlugin_py::talkToWorker(UgrAuthPyWorker &w, const std::string &req, int &result, int &retval) {
+  const char *fname = "UgrAuthorizationPlugin_py::talkToWorker";
+
+  if (send(w.fd, req.data(), req.size(), MSG_NOSIGNAL) != (ssize_t)req.size()) {
+    Error(fname, "Cannot send the request to the python worker " << w.pid << ". errno: " << errno);
+    return 1;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = w.fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  int n;
+  do {
+    n = poll(&pfd, 1, workertimeoutms);
+  } while ((n < 0) && (errno == EINTR));
+
+  if (n <= 0) {
+    Error(fname, "The python worker " << w.pid << " did not answer in " << workertimeoutms << "ms. Killing it.");
+    return 1;
+  }
+
+  int32_t reply[2];
+  if (recv(w.fd, reply, sizeof(reply), 0) != sizeof(reply)) {
+    Error(fname, "The python worker " << w.pid << " has died.");
+    return 1;
+  }
+
+  result = reply[0];
+  retval = reply[1];
+  return 0;
+}
+
+
+int UgrAuthorizationPlugin_py::askWorker(int &retval, const std::string &req) {
+  const char *fname = "UgrAuthorizationPlugin_py::askWorker";
+  UgrAuthPyWorker *w = 0;
+
+  if (req.size() > UGRAUTHPY_MAXREQ) {
+    Error(fname, "Request too big for the python workers: " << req.size() << " bytes");
+    return 1;
+  }
+
+  {
+    boost::unique_lock<boost::mutex> l(workersmtx);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(workertimeoutms);
+
+    while (true) {
+      for (unsigned int i = 0; i < workers.size(); i++)
+        if (!workers[i].busy) {
+          w = &workers[i];
+          break;
+        }
+
+      if (w) break;
+
+      if (!workerfree.timed_wait(l, deadline)) {
+        Error(fname, "No python worker available in " << workertimeoutms << "ms");
+        return 1;
+      }
+    }
+
+    w->busy = true;
+  }
+
+  // The worker is ours now. A dead or stuck one is replaced
+  int r = 1;
+  if ((w->fd >= 0) || !spawnWorker(*w)) {
+    if (talkToWorker(*w, req, r, retval)) {
+      killWorker(*w);
+      r = 1;
+    }
+  }
+
+  {
+    boost::lock_guard<boost::mutex> l(workersmtx);
+    w->busy = false;
+  }
+  workerfree.notify_one();
+
+  return r;
+}
+
+
+int UgrAuthorizationPlugin_py::serveWorker(int fd) {
+  const char *fname = "UgrAuthorizationPlugin_py::serveWorker";
+  std::vector<char> buf(UGRAUTHPY_MAXREQ);
+
+  Info(UgrLogger::Lvl1, fname, "Python worker ready.");
+
+  while (true) {
+    ssize_t n = recv(fd, &buf[0], buf.size(), 0);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      Error(fname, "Cannot receive requests. errno: " << errno);
+      return 1;
+    }
+
+    // The redirector has gone away
+    if (!n) return 0;
+
+    std::vector<std::string> f;
+    for (ssize_t i = 0, b = 0; i < n; i++)
+      if (!buf[i]) {
+        f.push_back(std::string(&buf[b], i-b));
+        b = i+1;
+      }
+
+    int32_t reply[2] = {1, 0};
+    size_t nfqans = (f.size() >= 5) ? strtoul(f[4].c_str(), 0, 10) : 0;
+
+    if ((f.size() < 5) || (f[3].size() != 1) || (5 + nfqans > f.size()) || ((f.size() - 5 - nfqans) % 2)) {
+      Error(fname, "Malformed request, " << f.size() << " fields");
+    }
+    else {
+      std::vector<std::string> fqans(f.begin() + 5, f.begin() + 5 + nfqans);
+      std::vector< std::pair<std::string, std::string> > keys;
+      for (size_t i = 5 + nfqans; i + 1 < f.size(); i += 2)
+        keys.push_back(std::make_pair(f[i], f[i+1]));
+
+      PyGILState_STATE gstate;
+      gstate = PyGILState_Ensure();
+
+      int retval = 0;
+      reply[0] = pyxeqfunc2(retval, info_pyfunc.pFunc, f[0], f[1], f[2].c_str(), f[3][0], fqans, keys);
+      reply[1] = retval;
+
+      PyGILState_Release(gstate);
+    }
+
+    if (send(fd, reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+      Error(fname, "Cannot send the reply. errno: " << errno);
+      return 1;
+    }
+  }
+}
+
+
+
+
+std::string UgrAuthorizationPlugin_py::decisionKey(const std::string &clientName, const std::string &remoteAddress,
+                                                   const std::vector<std::string> &fqans,
+                                                   const std::vector< std::pair<std::string, std::string> > &keys,
+                                                   const char *reqresource, const char reqmode) {
+  // The fields are separated by newlines, that can't be in any of them
+  std::string k = clientName;
+  k += '\n';
+  for (unsigned int i = 0; i < fqans.size(); i++) {
+    k += fqans[i];
+    k += '\t';
+  }
+  k += '\n';
+  k += remoteAddress;
+  k += '\n';
+
+  // With a depth, the decision is the same for everything below the first components of the path
+  const char *end = 0;
+  if (cacheprefixdepth > 0) {
+    int n = 0;
+    for (const char *p = reqresource; *p; p++) {
+      if ((*p == '/') && (p != reqresource) && (++n == cacheprefixdepth)) {
+        end = p+1;
+        break;
+      }
+    }
+  }
+  if (end) k.append(reqresource, end-reqresource);
+  else k += reqresource;
+
+  k += '\n';
+  k += reqmode;
+
+  // The keys may carry credentials that the function looks at. They come as C strings,
+  // hence they are separated by a zero. Their order does not matter
+  std::vector< std::pair<std::string, std::string> > sortedkeys(keys);
+  std::sort(sortedkeys.begin(), sortedkeys.end());
+  k += '\n';
+  for (unsigned int i = 0; i < sortedkeys.size(); i++) {
+    k += sortedkeys[i].first;
+    k += '\0';
+    k += sortedkeys[i].second;
+    k += '\0';
+  }
+  return k;
+}
+
+
+void UgrAuthorizationPlugin_py::invalidateDecisions(const std::string &clientName) {
+  if (clientName.empty()) {
+    decisions.clear();
+    return;
+  }
+
+  std::string pfx = clientName + '\n';
+  decisions.eraseIf(ugrauthpy_keyprefix(pfx));
 }
 
 
@@ -483,27 +851,60 @@ bool UgrAuthorizationPlugin_py::isallowed(const char *fname,
                                                   const std::vector<std::pair<std::string, std::string>> &keys,
                                                   const char *reqresource, const char reqmode) {
 
+  std::string k;
+  bool cached;
+
+  if (cachettl || cachenegttl) {
+    // Whatever the function depends on may have changed with the config
+    long gen = UgrCFG->GetGeneration();
+    if (gen != cachegeneration.load(std::memory_order_acquire)) {
+      boost::lock_guard<boost::mutex> l(mtx);
+      if (gen != cachegeneration.load(std::memory_order_relaxed)) {
+        decisions.clear();
+        cachegeneration.store(gen, std::memory_order_release);
+      }
+    }
+
+    k = decisionKey(clientName, remoteAddress, fqans, keys, reqresource, reqmode);
+    if (decisions.get(k, cached)) {
+      Info(UgrLogger::Lvl3, "isallowed", (cached ? "Allowed" : "Denied") << " (cached). clientname: '" << clientName <<
+        "' remoteaddr: '" << remoteAddress << "' mode: " << reqmode );
+      return cached;
+    }
+  }
   
   
-  
-  PyGILState_STATE gstate;
-  gstate = PyGILState_Ensure();
-  
   int retval = 0;
-  int r = pyxeqfunc2(retval, info_pyfunc.pFunc, clientName, remoteAddress, reqresource, reqmode, fqans, keys);
+  int r;
 
-  
-  /* Release the thread. No Python API allowed beyond this point. */
-  PyGILState_Release(gstate);
+  if (workers.size()) {
+    std::string req;
+    encodeRequest(req, clientName, remoteAddress, reqresource, reqmode, fqans, keys);
+    r = askWorker(retval, req);
+  }
+  else {
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+    
+    r = pyxeqfunc2(retval, info_pyfunc.pFunc, clientName, remoteAddress, reqresource, reqmode, fqans, keys);
+
+    
+    /* Release the thread. No Python API allowed beyond this point. */
+    PyGILState_Release(gstate);
+  }
   
   
   // A value of 0 got from a successful execution means allowed
   if (!r && !retval) {
     Info(UgrLogger::Lvl3, "isallowed", "Allowed. clientname: '" << clientName << "' remoteaddr: '" << remoteAddress << "' mode: " << reqmode );
+    if (cachettl) decisions.put(k, true, cachettl);
     return true;
   }
   
   Info(UgrLogger::Lvl3, "isallowed", "Denied. clientname: '" << clientName << "' remoteaddr: '" << remoteAddress << "' mode: " << reqmode );
+
+  // A failure of the function is not a decision
+  if (!r && cachenegttl) decisions.put(k, false, cachenegttl);
   return false;
 
 }
@@ -15,9 +15,11 @@
  */
 
 #include "UgrAuthorization.hh"
+#include "UgrLRUCache.hh"
 class UgrConnector;
 class myPyFuncInfo;
 #include <Python.h>
+#include <atomic>
 
 
 
@@ -30,6 +32,18 @@ public:
 };
 
 
+/// A helper process that runs the python function on behalf of the plugin
+struct UgrAuthPyWorker {
+  pid_t pid;
+  /// Our end of the socket pair, -1 if the worker has to be (re)started
+  int fd;
+  bool busy;
+  time_t lastspawn;
+
+  UgrAuthPyWorker(): pid(-1), fd(-1), busy(false), lastspawn(0) {}
+};
+
+
 class UgrAuthorizationPlugin_py : public UgrAuthorizationPlugin {
 public:
   UgrAuthorizationPlugin_py( UgrConnector & c, std::vector<std::string> & parms);
@@ -43,11 +57,51 @@ public:
                          const std::vector<std::string> &fqans,
                          const std::vector< std::pair<std::string, std::string> > &keys,
                          const char *reqresource, const char reqmode);
+
+  virtual void invalidateDecisions(const std::string &clientName);
+
+  /// The main loop of a worker process: take the requests from the given socket,
+  /// invoke the function and send back the results. Returns when the socket is closed
+  int serveWorker(int fd);
   
 private:
   
   
   boost::mutex mtx;
+
+  /// The decisions of the python function, by client, groups, address, resource and mode
+  UgrLRUCache<std::string, bool> decisions;
+  /// Lifetime of the decisions that allow and of the ones that deny. 0 means not cached
+  int cachettl, cachenegttl;
+  /// How many leading components of the resource path the decisions depend on. 0 means all
+  int cacheprefixdepth;
+  /// The decisions are dropped when the config changes. Read without locking
+  std::atomic<long> cachegeneration;
+
+  /// The helper processes, if the function does not run here
+  std::vector<UgrAuthPyWorker> workers;
+  boost::mutex workersmtx;
+  boost::condition_variable workerfree;
+  int workertimeoutms;
+  std::string workerpath;
+
+  int spawnWorker(UgrAuthPyWorker &w);
+  void killWorker(UgrAuthPyWorker &w);
+  void killWorkers();
+  /// Send a request to a worker and wait for the answer
+  /// @return nonzero if the worker could not be talked to
+  int talkToWorker(UgrAuthPyWorker &w, const std::string &req, int &result, int &retval);
+  /// Invoke the function in a free worker. Same return values as pyxeqfunc2
+  int askWorker(int &retval, const std::string &req);
+  static void encodeRequest(std::string &req, const std::string &clientName, const std::string &remoteAddress,
+                            const char *resource, const char reqmode,
+                            const std::vector<std::string> &fqans,
+                            const std::vector< std::pair<std::string, std::string> > &keys);
+
+  std::string decisionKey(const std::string &clientName, const std::string &remoteAddress,
+                          const std::vector<std::string> &fqans,
+                          const std::vector< std::pair<std::string, std::string> > &keys,
+                          const char *reqresource, const char reqmode);
   
   myPyFuncInfo info_pyfunc;
   static bool python_initdone;
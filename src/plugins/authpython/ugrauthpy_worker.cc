@@ -0,0 +1,53 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ * 
+ */
+
+
+/** @file   ugrauthpy_worker.cc
+ * @brief  Helper process that runs the python authorization function for UgrAuthorizationPlugin_py
+ * @author agent
+ * @date   Oct 2026
+ */
+
+// Started by the plugin when glb.authorizationplugin.<name>.workers is set.
+// It gets the requests from the socket that is its stdin.
+// usage:
+// ugrauthpy_worker <Python module to import> <Python function to invoke>
+
+#include "UgrAuthPlugin_python.hh"
+#include "UgrConnector.hh"
+#include <iostream>
+
+using namespace std;
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <python module> <python function>" << endl;
+        return 1;
+    }
+
+    UgrConnector ugr;
+
+    std::vector<std::string> parms;
+    parms.push_back(argv[0]);
+    parms.push_back("worker");
+    parms.push_back(argv[1]);
+    parms.push_back(argv[2]);
+
+    try {
+        UgrAuthorizationPlugin_py plugin(ugr, parms);
+        return plugin.serveWorker(0);
+    }
+    catch (const char *e) {
+        cerr << argv[0] << ": " << e << endl;
+    }
+
+    return 1;
+}
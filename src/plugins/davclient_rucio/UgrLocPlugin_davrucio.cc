@@ -67,6 +67,10 @@ UgrLocPlugin_davrucio::UgrLocPlugin_davrucio(UgrConnector & c, std::vector<std::
             for (i = 0; i < parms.size() - 1; i++) {
 		UgrFileInfo::trimpath(xlatepfxruciohash_from[i]);
                 Info(UgrLogger::Lvl1, fname, name << " Translating prefixes with Rucio hashing '" << xlatepfxruciohash_from[i] << "' -> '" << xlatepfxruciohash_to << "'");
+
+                // Avoid the double slash in the case the new pfx is a slash
+                if (xlatepfxruciohash_from[i].size() > 0)
+                    xlatepfxruciohash_map.add(xlatepfxruciohash_from[i], (xlatepfxruciohash_to == "/") ? "" : xlatepfxruciohash_to);
             }
         }
     }
@@ -74,6 +78,16 @@ UgrLocPlugin_davrucio::UgrLocPlugin_davrucio(UgrConnector & c, std::vector<std::
     
 }
 
+void UgrLocPlugin_davrucio::getServedPrefixes(std::vector<std::string> &pfxs) {
+    LocationPlugin::getServedPrefixes(pfxs);
+
+    // No xlatepfx means that any name is served anyway
+    if (pfxs.empty()) return;
+
+    pfxs.insert(pfxs.end(), xlatepfxruciohash_from.begin(), xlatepfxruciohash_from.end());
+}
+
+
 /// Perform the sophisticated rucio-friendly name translation
 /// If 'from' matches any of the xlatepfx_ruciohash then
 ///   translate this pfx
@@ -83,29 +97,24 @@ UgrLocPlugin_davrucio::UgrLocPlugin_davrucio(UgrConnector & c, std::vector<std::
 int UgrLocPlugin_davrucio::doNameXlation(std::string &from, std::string &to, workOp op, std::string &altpfx) {
     const char *fname = "LocationPlugin_davrucio::doNameXlation";
     int r = 1;
-    size_t i;
     const size_t xtlate_size = xlatepfxruciohash_from.size();
 
     if(xtlate_size == 0){ // no rucio processing required
       return LocationPlugin::doNameXlation(from, to, op, altpfx);
     }
     else {
-      for (i = 0; i < xtlate_size; i++) {
-	if ((xlatepfxruciohash_from[i].size() > 0) &&
-	  ((from.size() == 0) || (from.compare(0, xlatepfxruciohash_from[i].length(), xlatepfxruciohash_from[i]) == 0))) {
-	  
-	  if (from.size() == 0)
-	    to = xlatepfxruciohash_to;
-	  else {
-	    if (xlatepfxruciohash_to == "/") to = from.substr(xlatepfxruciohash_from[i].length());
-	    else
-	      to = xlatepfxruciohash_to + from.substr(xlatepfxruciohash_from[i].length());
-	  }
-	  
-	  r = 0;
-	break;
-	
-	  }
+      if (from.size() == 0) {
+        if (xlatepfxruciohash_map.size() > 0) {
+          to = xlatepfxruciohash_to;
+          r = 0;
+        }
+      }
+      else {
+        int m = xlatepfxruciohash_map.match(from);
+        if (m >= 0) {
+          xlatepfxruciohash_map.apply(m, from, to);
+          r = 0;
+        }
       }
       
       if (r) to = from;
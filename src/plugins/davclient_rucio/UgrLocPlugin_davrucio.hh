@@ -33,6 +33,8 @@ protected:
     // that, when triggered, ALSO puts the Rucio hashes in the right place
     std::vector<std::string> xlatepfxruciohash_from;
     std::string xlatepfxruciohash_to;
+    /// The same, compiled
+    UgrPrefixMap xlatepfxruciohash_map;
     
     
     /// Applies the plugin-specific name translation
@@ -47,6 +49,9 @@ public:
     UgrLocPlugin_davrucio(UgrConnector & c, std::vector<std::string> & parms);
     virtual ~UgrLocPlugin_davrucio(){}
 
+    /// The rucio prefixes are an alias of the namespace, they are served too
+    virtual void getServedPrefixes(std::vector<std::string> &pfxs);
+
 
 protected:
 
@@ -289,7 +289,7 @@ std::vector<Replica> UgrCatalog::getReplicas(const std::string &path) {
         Info(UgrLogger::Lvl3, "UgrCatalog::getReplicas", "UgrDmlite Client remote address (" << info.ip << ")");
         UgrReplicaVec reps;
         nfo->getReplicaList(reps);
-        getUgrConnector()->filterAndSortReplicaList(reps, info);
+        getUgrConnector()->filterAndSortReplicaList(reps, info, abspath);
 
         for (UgrReplicaVec::iterator i = reps.begin(); i != reps.end(); ++i) {
             // Populate the vector
@@ -45,6 +45,9 @@
 
 #include "UgrGeoPlugin_mmdb.hh"
 #include "netdb.h"
+#include <arpa/inet.h>
+#include <math.h>
+#include <algorithm>
 
 using namespace std;
 
@@ -69,10 +72,34 @@ UgrGeoPlugin_mmdb::UgrGeoPlugin_mmdb(UgrConnector & c, std::vector<std::string>
   Info(UgrLogger::Lvl4, "UgrGeoPlugin_mmdb::UgrGeoPlugin_mmdb", "Fuzz " << ifuzz << " normalized into " << fuzz);
   
   seed = time(0);
+  
+  // The locations of the servers are cached, as replicas come from a few hosts
+  hostcachettl = UgrCFG->GetLong("glb.filterplugin.mmdb.hostcachettl", 3600);
+  hostcachenegttl = UgrCFG->GetLong("glb.filterplugin.mmdb.hostcachenegttl", 60);
+  hostcachemaxsize = UgrCFG->GetLong("glb.filterplugin.mmdb.hostcachemaxsize", 10000);
+  Info(UgrLogger::Lvl1, fname, "Host cache ttl: " << hostcachettl << " negative ttl: " << hostcachenegttl <<
+    " max size: " << hostcachemaxsize);
+  
+  // Clients are located by subnet
+  clientcache.setLimits(UgrCFG->GetLong("glb.filterplugin.mmdb.clientcachesize", 100000),
+                        UgrCFG->GetLong("glb.filterplugin.mmdb.clientcachettl", 3600));
+  
+  // The clients often use only the first few replicas. 0 means sort all of them
+  sorttopk = UgrCFG->GetLong("glb.filterplugin.mmdb.sorttopk", 0);
+  Info(UgrLogger::Lvl1, fname, "Sorting the closest " << sorttopk << " replicas (0 means all)");
+  
+  refresher = 0;
+  if (mmdb_ok && (hostcachettl > 0))
+    refresher = new boost::thread(boost::bind(&UgrGeoPlugin_mmdb::runRefresher, this));
 }
 
 UgrGeoPlugin_mmdb::~UgrGeoPlugin_mmdb(){
-  
+  if (refresher) {
+    refresher->interrupt();
+    refresher->join();
+    delete refresher;
+    refresher = 0;
+  }
 }
 
 // Init the geoIP stuff, try to get the best info that is available
@@ -115,6 +142,13 @@ void UgrGeoPlugin_mmdb::ugrgeorandom_shuffle( UgrReplicaVec::iterator first,
 }
 bool lessthan(const UgrFileItem_replica &i, const UgrFileItem_replica &j) { return (i.tempDistance < j.tempDistance); }
 
+/// True for the replicas whose distance is within the fuzz of a given one
+struct UgrGeoWithinFuzz {
+  float d, fuzz;
+  UgrGeoWithinFuzz(float d, float fuzz): d(d), fuzz(fuzz) {}
+  bool operator()(const UgrFileItem_replica &i) const { return (fabs(i.tempDistance - d) <= fuzz); }
+};
+
 int UgrGeoPlugin_mmdb::applyFilterOnReplicaList(UgrReplicaVec&replica, const UgrClientInfo &cli_info){
   float cli_latitude=0, cli_longitude=0;
   
@@ -122,7 +156,7 @@ int UgrGeoPlugin_mmdb::applyFilterOnReplicaList(UgrReplicaVec&replica, const Ugr
   
   if (replica.size() < 2) return 0;
   
-  getAddrLocation(cli_info.ip, cli_latitude, cli_longitude);
+  getClientLocation(cli_info.ip, cli_latitude, cli_longitude);
   
   // Assign distances to all the objects
   for (UgrReplicaVec::iterator i = replica.begin(); i != replica.end(); i++) {
@@ -141,7 +175,24 @@ int UgrGeoPlugin_mmdb::applyFilterOnReplicaList(UgrReplicaVec&replica, const Ugr
   
   //UgrFileItemGeoComp comp_geo(fuzz);
   
-  std::sort(replica.begin(), replica.end(), lessthan);
+  // Often only the first few replicas matter, then the others don't need to be sorted
+  UgrReplicaVec::iterator sorted_end = replica.end();
+  if ((sorttopk > 0) && (sorttopk < replica.size())) {
+    sorted_end = replica.begin() + sorttopk;
+    std::partial_sort(replica.begin(), sorted_end, replica.end(), lessthan);
+    
+    // The replicas that are within the fuzz of the last sorted one could
+    // have been among the first ones. Bring them in, so that they get shuffled too
+    if (fuzz > 0.0) {
+      float kth = (sorted_end-1)->tempDistance;
+      UgrReplicaVec::iterator tail_end = std::partition(sorted_end, replica.end(),
+                                                        UgrGeoWithinFuzz(kth, fuzz));
+      std::sort(sorted_end, tail_end, lessthan);
+      sorted_end = tail_end;
+    }
+  }
+  else
+    std::sort(replica.begin(), replica.end(), lessthan);
   
   // Shuffle the elements that are within the fuzz value
   if (fuzz > 0.0) {
@@ -149,7 +200,7 @@ int UgrGeoPlugin_mmdb::applyFilterOnReplicaList(UgrReplicaVec&replica, const Ugr
     UgrReplicaVec::iterator b = replica.begin();
     for (UgrReplicaVec::iterator i = replica.begin(); ; i++) {
       
-      if (i == replica.end()) {
+      if (i == sorted_end) {
         ugrgeorandom_shuffle (b, i);
         break;
       }
@@ -200,6 +251,69 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
   Info(UgrLogger::Lvl4, fname, "pos:" << pos << " lastpos: " << lastPos);
   Info(UgrLogger::Lvl4, fname, "Got server: " << srv);
   
+  UgrGeoHostInfo nfo;
+  
+  if (hostcachettl <= 0) {
+    // No cache, look it up every time
+    lookupHost(srv, nfo);
+  }
+  else {
+    bool cached = false, stale = false;
+    time_t now = time(0);
+    
+    {
+      boost::shared_lock<boost::shared_mutex> l(hostcachemtx);
+      std::unordered_map<std::string, UgrGeoHostInfo>::iterator h = hostcache.find(srv);
+      if (h != hostcache.end()) {
+        nfo = h->second;
+        cached = true;
+        stale = (h->second.expiry <= now) && !h->second.refreshing;
+      }
+    }
+    
+    // Expired info is still served, while the refresher thread looks it up again
+    if (stale) {
+      {
+        boost::unique_lock<boost::shared_mutex> l(hostcachemtx);
+        std::unordered_map<std::string, UgrGeoHostInfo>::iterator h = hostcache.find(srv);
+        if ((h == hostcache.end()) || h->second.refreshing)
+          stale = false;
+        else
+          h->second.refreshing = true;
+      }
+      
+      if (stale) {
+        Info(UgrLogger::Lvl3, fname, "Queueing refresh of server: " << srv);
+        boost::lock_guard<boost::mutex> l(refreshmtx);
+        refreshqueue.push_back(srv);
+        refreshcondvar.notify_one();
+      }
+    }
+    
+    // Never seen before, we have to wait for it
+    if (!cached) {
+      lookupHost(srv, nfo);
+      cacheHost(srv, nfo);
+    }
+  }
+  
+  if (!nfo.found) return;
+  
+  it.location = nfo.location;
+  it.latitude = nfo.latitude;
+  it.longitude = nfo.longitude;
+  
+  Info(UgrLogger::Lvl4, fname, "Set geo info: '" << it.name << "' srv: '"<< srv << "' loc: '" <<
+    it.location << "' coords: " << it.latitude << " " << it.longitude);
+}
+
+
+
+void UgrGeoPlugin_mmdb::lookupHost(const std::string &srv, UgrGeoHostInfo &nfo) {
+  const char *fname = "UgrGeoPlugin_mmdb::lookupHost";
+  
+  nfo.found = false;
+  
   // Do the dns lookup to get the ip address of the replica
   struct addrinfo hints;
   hints.ai_family   = AF_UNSPEC;
@@ -236,9 +350,10 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
   }
   
   // The lookup was successful
-  it.location.clear();
-  it.latitude = 0.0;
-  it.longitude = 0.0;
+  nfo.found = true;
+  nfo.location.clear();
+  nfo.latitude = 0.0;
+  nfo.longitude = 0.0;
   // now dig in to the result to get the city name
   MMDB_entry_data_s entry_data;
   
@@ -247,8 +362,8 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
   if ((status == MMDB_SUCCESS) && (entry_data.has_data)) {
     
     if (entry_data.type == MMDB_DATA_TYPE_UTF8_STRING) {
-      it.location.assign( entry_data.utf8_string, entry_data.data_size );
-      Info(UgrLogger::Lvl4, fname, "Got city: " << it.location);
+      nfo.location.assign( entry_data.utf8_string, entry_data.data_size );
+      Info(UgrLogger::Lvl4, fname, "Got city: " << nfo.location);
     }
     else 
       Error(fname, "City lookup did not return a string. Internal error or Geo DB corruption.");
@@ -259,12 +374,12 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
                               "country", "names", "en", NULL);
   if ((status == MMDB_SUCCESS) && (entry_data.has_data)) {
     if (entry_data.type == MMDB_DATA_TYPE_UTF8_STRING) {
-      if (it.location.length() > 0)
-        it.location += ", ";
+      if (nfo.location.length() > 0)
+        nfo.location += ", ";
       std::string l;
       l.assign( entry_data.utf8_string, entry_data.data_size );
-      it.location += l;
-      Info(UgrLogger::Lvl4, fname, "Got country: " << it.location);
+      nfo.location += l;
+      Info(UgrLogger::Lvl4, fname, "Got country: " << nfo.location);
     }
     else 
       Error(fname, "Country lookup did not return a string. Internal error or Geo DB corruption.");
@@ -293,12 +408,12 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
       Error(fname, "Longitude lookup did not return a double. Internal error or Geo DB corruption.");
   }
   
-  Info(UgrLogger::Lvl2, fname, "Set geo info: '" << it.name << "' srv: '"<< srv << "' loc: '" <<
-    it.location << "' coords: " << latitude << " " << longitude);
+  Info(UgrLogger::Lvl2, fname, "Located srv: '"<< srv << "' loc: '" <<
+    nfo.location << "' coords: " << latitude << " " << longitude);
   
   // Convert here into radians so we save a few operations later
-  it.latitude = latitude / 180.0 * M_PI;
-  it.longitude = longitude / 180.0 * M_PI;
+  nfo.latitude = latitude / 180.0 * M_PI;
+  nfo.longitude = longitude / 180.0 * M_PI;
   
   
   return;
@@ -306,6 +421,128 @@ void UgrGeoPlugin_mmdb::setReplicaLocation(UgrFileItem_replica &it) {
 
 
 
+void UgrGeoPlugin_mmdb::cacheHost(const std::string &srv, UgrGeoHostInfo &nfo) {
+  const char *fname = "UgrGeoPlugin_mmdb::cacheHost";
+  time_t now = time(0);
+  
+  boost::unique_lock<boost::shared_mutex> l(hostcachemtx);
+  
+  std::unordered_map<std::string, UgrGeoHostInfo>::iterator h = hostcache.find(srv);
+  
+  if ((h == hostcache.end()) && (hostcache.size() >= hostcachemaxsize)) {
+    // Make space. First drop what expired, and if it's not enough the one that expires first.
+    // New hosts are rare, this scan is not on the path of the requests that hit the cache
+    std::unordered_map<std::string, UgrGeoHostInfo>::iterator firstexp = hostcache.end();
+    for (h = hostcache.begin(); h != hostcache.end(); ) {
+      if ((h->second.expiry <= now) && !h->second.refreshing) {
+        h = hostcache.erase(h);
+        continue;
+      }
+      if (!h->second.refreshing && ((firstexp == hostcache.end()) || (h->second.expiry < firstexp->second.expiry)))
+        firstexp = h;
+      ++h;
+    }
+    
+    if ((hostcache.size() >= hostcachemaxsize) && (firstexp != hostcache.end())) {
+      Info(UgrLogger::Lvl3, fname, "Host cache full, evicting srv: '" << firstexp->first << "'");
+      hostcache.erase(firstexp);
+    }
+    
+    h = hostcache.end();
+  }
+  
+  // A failed refresh does not throw away good info, it's kept a bit longer
+  if (!nfo.found && (h != hostcache.end()) && h->second.found) {
+    Info(UgrLogger::Lvl2, fname, "Refresh failed, keeping the previous location of srv: '" << srv << "'");
+    nfo = h->second;
+    nfo.expiry = now + hostcachenegttl;
+  }
+  else
+    nfo.expiry = now + (nfo.found ? hostcachettl : hostcachenegttl);
+  
+  nfo.refreshing = false;
+  hostcache[srv] = nfo;
+}
+
+
+
+void UgrGeoPlugin_mmdb::runRefresher() {
+  const char *fname = "UgrGeoPlugin_mmdb::runRefresher";
+  Info(UgrLogger::Lvl1, fname, "Starting host refresher.");
+  
+  while (!boost::this_thread::interruption_requested()) {
+    std::string srv;
+    
+    {
+      boost::unique_lock<boost::mutex> l(refreshmtx);
+      // Waiting is an interruption point
+      while (refreshqueue.empty())
+        refreshcondvar.wait(l);
+      
+      srv = refreshqueue.front();
+      refreshqueue.pop_front();
+    }
+    
+    Info(UgrLogger::Lvl3, fname, "Refreshing srv: '" << srv << "'");
+    
+    UgrGeoHostInfo nfo;
+    lookupHost(srv, nfo);
+    cacheHost(srv, nfo);
+  }
+}
+
+
+
+
+
+
+std::string UgrGeoPlugin_mmdb::clientSubnet(const std::string &clientip) {
+  unsigned char a[16];
+  
+  if (inet_pton(AF_INET, clientip.c_str(), a) == 1)
+    return std::string("4") + std::string((char *)a, 3);
+  
+  if (inet_pton(AF_INET6, clientip.c_str(), a) == 1) {
+    // An IPv4 address mapped into IPv6 is the same client
+    static const unsigned char v4mapped[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+    if (!memcmp(a, v4mapped, 12))
+      return std::string("4") + std::string((char *)a + 12, 3);
+    
+    return std::string("6") + std::string((char *)a, 6);
+  }
+  
+  // Not an address, not much we can do
+  return clientip;
+}
+
+
+
+void UgrGeoPlugin_mmdb::getClientLocation(const std::string &clientip, float &ltt, float &lng) {
+  const char *fname = "UgrGeoPlugin_mmdb::getClientLocation";
+  if (!mmdb_ok) return;
+  if (clientip.empty()) return;
+  
+  std::string subnet = clientSubnet(clientip);
+  UgrGeoClientLoc loc;
+  
+  if (clientcache.get(subnet, loc)) {
+    ltt = loc.latitude;
+    lng = loc.longitude;
+    Info(UgrLogger::Lvl4, fname, clientip << " " << ltt << " " << lng << " (cached)");
+    return;
+  }
+  
+  loc.latitude = ltt;
+  loc.longitude = lng;
+  getAddrLocation(clientip, loc.latitude, loc.longitude);
+  clientcache.put(subnet, loc);
+  
+  ltt = loc.latitude;
+  lng = loc.longitude;
+}
+
+
+
 void UgrGeoPlugin_mmdb::getAddrLocation(const std::string &clientip, float &ltt, float &lng) {
   const char *fname = "UgrGeoPlugin_mmdb::getAddrLocation";
   if (!mmdb_ok) return;
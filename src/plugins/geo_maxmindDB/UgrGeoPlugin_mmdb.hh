@@ -19,8 +19,35 @@
 
 #include <UgrConnector.hh>
 #include "../PluginInterface.hh"
+#include "UgrLRUCache.hh"
 #include "maxminddb.h"
 
+#include <unordered_map>
+#include <deque>
+#include <boost/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+
+/// What we know about the location of a server
+struct UgrGeoHostInfo {
+  /// False if the host could not be resolved or located
+  bool found;
+  std::string location;
+  /// In radians
+  float latitude, longitude;
+  /// When this info has to be refreshed
+  time_t expiry;
+  /// A refresh has already been queued
+  bool refreshing;
+
+  UgrGeoHostInfo(): found(false), latitude(0.0), longitude(0.0), expiry(0), refreshing(false) {}
+};
+
+/// Where the clients of a subnet are, in radians
+struct UgrGeoClientLoc {
+  float latitude, longitude;
+};
+
 /** UgrGeoPlugin_mmdb
  * Plugin which parses a replica name and figures out where the server is.
  * This implementation uses the MaxMindDB API, which obsoletes GeoIP
@@ -31,6 +58,26 @@ protected:
     bool mmdb_ok;
     float fuzz;
     unsigned int seed;
+
+    /// Cache of the locations of the servers, by host name
+    std::unordered_map<std::string, UgrGeoHostInfo> hostcache;
+    boost::shared_mutex hostcachemtx;
+    /// Lifetime of a cached location, and of a failed lookup
+    int hostcachettl, hostcachenegttl;
+    /// Max number of hosts in the cache
+    unsigned int hostcachemaxsize;
+
+    /// The hosts whose info expired, to be looked up again by the refresher thread
+    std::deque<std::string> refreshqueue;
+    boost::mutex refreshmtx;
+    boost::condition_variable refreshcondvar;
+    boost::thread *refresher;
+
+    /// Cache of the locations of the clients, by subnet
+    UgrLRUCache<std::string, UgrGeoClientLoc> clientcache;
+
+    /// If nonzero, only this number of closest replicas is sorted
+    unsigned int sorttopk;
 public:
 
   UgrGeoPlugin_mmdb(UgrConnector & c, std::vector<std::string> & parms);
@@ -51,8 +98,23 @@ protected:
     /// Sets, wherever needed the geo information in the replica
     void setReplicaLocation(UgrFileItem_replica &it);
 
+    /// Resolves a server and looks up its location. Slow, as it involves a DNS query
+    void lookupHost(const std::string &srv, UgrGeoHostInfo &nfo);
+
+    /// Stores the result of a lookup into the cache
+    void cacheHost(const std::string &srv, UgrGeoHostInfo &nfo);
+
+    /// Looks up again the hosts whose info expired, so that the workers never wait for the DNS
+    void runRefresher();
+
     /// Gets latitude and longitude of a client
     void getAddrLocation(const std::string &clientip, float &ltt, float &lng);
+
+    /// Gets latitude and longitude of a client, looking first into the cache of the subnets
+    void getClientLocation(const std::string &clientip, float &ltt, float &lng);
+
+    /// The /24 (IPv4) or /48 (IPv6) subnet an address belongs to, as a key
+    static std::string clientSubnet(const std::string &clientip);
 };
 
 
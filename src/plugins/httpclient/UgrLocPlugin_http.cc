@@ -687,6 +687,30 @@ std::string joinUrl(const std::vector<std::string>& components) throw()
 
 
 
+int UgrLocPlugin_http::matchReplicaUrl(const std::string &url) {
+  // The protocol may differ, e.g. davs vs https
+  size_t pos = url.find("://");
+  if (pos == string::npos) return -1;
+
+  std::string baseurl_noproto = base_url_endpoint.getString();
+  size_t bpos = baseurl_noproto.find("://");
+  if (bpos == string::npos) return -1;
+  baseurl_noproto.erase(0, bpos+3);
+
+  if (url.compare(pos+3, baseurl_noproto.length(), baseurl_noproto))
+    return -1;
+
+  // The match must end at a path boundary, host/data is not a prefix of host/data2
+  size_t end = pos + 3 + baseurl_noproto.length();
+  if ((end < url.length()) && (url[end] != '/') &&
+      (baseurl_noproto.empty() || (*baseurl_noproto.rbegin() != '/')))
+    return -1;
+
+  return baseurl_noproto.length();
+}
+
+
+
 int UgrLocPlugin_http::run_mkDirMinusPonSiteFN(const std::string &sitefn, std::shared_ptr<HandlerTraits> handler) {
   const char *fname = "UgrLocPlugin_http::run_mkDirMinusPonSiteFN";
   std::string xname;
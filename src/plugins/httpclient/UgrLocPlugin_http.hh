@@ -76,6 +76,8 @@ public:
 
     virtual int run_mkDirMinusPonSiteFN(const std::string &sitefn, std::shared_ptr<HandlerTraits> handler);
 
+    virtual int matchReplicaUrl(const std::string &url);
+
 protected:
     int flags;
     Davix::Uri base_url_endpoint;
@@ -22,6 +22,7 @@
 
 
 #include "PluginInterface.hh"
+#include "noloop_resolver.hh"
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
@@ -48,6 +49,8 @@ public:
     virtual int applyFilterOnReplicaList(UgrReplicaVec&replica, const UgrClientInfo &cli_info);
 
 private:
+    /// Shared by all the instances of the plugin
+    NoLoopResolver *resolver;
 };
 
 #endif // FILTERNOLOOPPLUGIN_HH
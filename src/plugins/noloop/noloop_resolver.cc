@@ -0,0 +1,259 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+/**
+ * @file   noloop_resolver.cc
+ * @brief  Process-wide DNS resolver with a cache, for the noloop plugin
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+
+#include "noloop_resolver.hh"
+#include <UgrConfig.hh>
+#include <SimpleDebug.hh>
+#include <algorithm>
+
+namespace Asio_ip = boost::asio::ip;
+typedef Asio_ip::udp::resolver Resolver;
+typedef Asio_ip::udp::resolver::query ResolverQuery;
+typedef boost::system::error_code Error_code;
+
+
+NoLoopResolver *NoLoopResolver::instance = 0;
+int NoLoopResolver::refcount = 0;
+boost::mutex NoLoopResolver::instancemtx;
+
+
+NoLoopResolver *NoLoopResolver::acquire() {
+    boost::lock_guard<boost::mutex> l(instancemtx);
+    if (!instance) instance = new NoLoopResolver();
+    refcount++;
+    return instance;
+}
+
+void NoLoopResolver::release() {
+    boost::lock_guard<boost::mutex> l(instancemtx);
+    if (--refcount > 0) return;
+
+    // The last plugin is going away, possibly together with this code
+    delete instance;
+    instance = 0;
+}
+
+
+NoLoopResolver::NoLoopResolver() {
+    const char *fname = "NoLoopResolver::NoLoopResolver";
+
+    ttl = UgrCFG->GetLong("glb.filterplugin.noloop.dnsttl", 300);
+    negttl = UgrCFG->GetLong("glb.filterplugin.noloop.dnsnegttl", 30);
+    timeoutms = UgrCFG->GetLong("glb.filterplugin.noloop.dnstimeoutms", 2000);
+    maxsize = UgrCFG->GetLong("glb.filterplugin.noloop.dnscachesize", 10000);
+    nthreads = UgrCFG->GetLong("glb.filterplugin.noloop.dnsthreads", 4);
+    if (nthreads < 1) nthreads = 1;
+
+    Info(UgrLogger::Lvl1, fname, "ttl: " << ttl << " negttl: " << negttl << " timeoutms: " << timeoutms <<
+         " cachesize: " << maxsize << " threads: " << nthreads);
+
+    for (int i = 0; i < nthreads; i++) {
+        Worker *wk = new Worker();
+
+        // Keeps the io thread alive when there is nothing to resolve
+        wk->work = new boost::asio::io_service::work(wk->ios);
+        wk->iothread = new boost::thread(boost::bind(&boost::asio::io_service::run, &wk->ios));
+        workers.push_back(wk);
+    }
+}
+
+NoLoopResolver::~NoLoopResolver() {
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker *wk = workers[i];
+
+        delete wk->work;
+        wk->work = 0;
+        wk->resolver.cancel();
+        wk->ios.stop();
+
+        if (wk->iothread) {
+            wk->iothread->join();
+            delete wk->iothread;
+            wk->iothread = 0;
+        }
+
+        delete wk;
+    }
+    workers.clear();
+}
+
+
+bool NoLoopResolver::parseAddress(const std::string &s, Asio_ip::address &addr) {
+    Error_code ec;
+    addr = Asio_ip::address::from_string(s, ec);
+    if (ec) return false;
+
+    // A client may come as an IPv4 address mapped into IPv6
+    if (addr.is_v6() && addr.to_v6().is_v4_mapped())
+        addr = addr.to_v6().to_v4();
+
+    return true;
+}
+
+
+void NoLoopResolver::startResolve(const std::string &host, Entry &e) {
+    e.pending = true;
+    e.started = boost::get_system_time();
+
+    // The least busy worker, a name that takes long delays only what is queued behind it
+    Worker *wk = workers[0];
+    for (size_t i = 1; i < workers.size(); i++)
+        if (workers[i]->inflight < wk->inflight) wk = workers[i];
+    wk->inflight++;
+
+    // Only the addresses matter. A numeric port does not depend on /etc/services
+    ResolverQuery q(host, "80", ResolverQuery::address_configured | ResolverQuery::numeric_service);
+    wk->resolver.async_resolve(q, boost::bind(&NoLoopResolver::onResolve, this, wk, host,
+                                              boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+}
+
+
+void NoLoopResolver::onResolve(Worker *wk, const std::string &host, const Error_code &ec, Resolver::iterator iter) {
+    const char *fname = "NoLoopResolver::onResolve";
+    NoLoopAddrList addrs;
+
+    if (ec) {
+        Info(UgrLogger::Lvl3, fname, "Error during resolution of " << host << ": " << ec);
+    }
+    else {
+        Resolver::iterator end;
+        for (; iter != end; ++iter) {
+            Asio_ip::address a = iter->endpoint().address();
+            if (a.is_v6() && a.to_v6().is_v4_mapped())
+                a = a.to_v6().to_v4();
+
+            if (std::find(addrs.begin(), addrs.end(), a) == addrs.end()) {
+                Info(UgrLogger::Lvl3, fname, "Resolution " << host << " to " << a);
+                addrs.push_back(a);
+            }
+        }
+    }
+
+    time_t now = time(0);
+    {
+        boost::lock_guard<boost::mutex> l(mtx);
+        wk->inflight--;
+
+        Entry &e = cache[host];
+        if (e.pending) {
+            long ms = (boost::get_system_time() - e.started).total_milliseconds();
+            if (ms > timeoutms)
+                Info(UgrLogger::Lvl1, fname, "Slow resolution of " << host << ": " << ms << "ms");
+        }
+        e.pending = false;
+
+        if (addrs.size() || !e.valid) {
+            e.addrs.swap(addrs);
+            e.expiry = now + (e.addrs.size() ? ttl : negttl);
+        }
+        else {
+            // A failed refresh keeps the last known addresses for a while
+            e.expiry = now + negttl;
+        }
+        e.valid = true;
+    }
+
+    resolved.notify_all();
+}
+
+
+void NoLoopResolver::makeRoom(time_t now) {
+    const char *fname = "NoLoopResolver::makeRoom";
+
+    // First drop what expired, and if it's not enough the one that expires first.
+    // New names are rare, this scan is not on the path of the requests that hit the cache
+    std::unordered_map<std::string, Entry>::iterator firstexp = cache.end();
+    for (std::unordered_map<std::string, Entry>::iterator it = cache.begin(); it != cache.end(); ) {
+        if (it->second.pending) {
+            ++it;
+            continue;
+        }
+        if (it->second.expiry <= now) {
+            it = cache.erase(it);
+            continue;
+        }
+        if ((firstexp == cache.end()) || (it->second.expiry < firstexp->second.expiry))
+            firstexp = it;
+        ++it;
+    }
+
+    if ((cache.size() >= maxsize) && (firstexp != cache.end())) {
+        Info(UgrLogger::Lvl3, fname, "DNS cache full, evicting " << firstexp->first);
+        cache.erase(firstexp);
+    }
+}
+
+
+void NoLoopResolver::resolve(const std::vector<std::string> &hosts, std::vector<NoLoopAddrList> &addrs) {
+    std::vector<size_t> waiting;
+    time_t now = time(0);
+
+    addrs.clear();
+    addrs.resize(hosts.size());
+
+    boost::unique_lock<boost::mutex> l(mtx);
+
+    for (size_t i = 0; i < hosts.size(); i++) {
+        if (hosts[i].empty()) continue;
+
+        Asio_ip::address a;
+        if (parseAddress(hosts[i], a)) {
+            addrs[i].push_back(a);
+            continue;
+        }
+
+        if ((cache.size() >= maxsize) && !cache.count(hosts[i]))
+            makeRoom(now);
+
+        Entry &e = cache[hosts[i]];
+        if (e.valid) {
+            addrs[i] = e.addrs;
+            if ((e.expiry <= now) && !e.pending)
+                startResolve(hosts[i], e);
+            continue;
+        }
+
+        if (!e.pending)
+            startResolve(hosts[i], e);
+        waiting.push_back(i);
+    }
+
+    // Wait for the names that were never seen before
+    if (waiting.empty()) return;
+
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeoutms);
+
+    for (size_t w = 0; w < waiting.size(); ) {
+        size_t i = waiting[w];
+        Entry &e = cache[hosts[i]];
+
+        if (e.valid) {
+            addrs[i] = e.addrs;
+            w++;
+            continue;
+        }
+
+        // The entry may have been dropped by a cleanup in the meantime
+        if (!e.pending)
+            startResolve(hosts[i], e);
+
+        if (!resolved.timed_wait(l, deadline)) {
+            Info(UgrLogger::Lvl2, "NoLoopResolver::resolve", "Timeout resolving " << hosts[i]);
+            break;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef NOLOOPRESOLVER_HH
+#define NOLOOPRESOLVER_HH
+
+
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+/**
+ * @file   noloop_resolver.hh
+ * @brief  Process-wide DNS resolver with a cache, for the noloop plugin
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <time.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+
+typedef std::vector<boost::asio::ip::address> NoLoopAddrList;
+
+
+/// Resolves host names in a small pool of persistent io threads, caching the results.
+/// There is one instance per process, shared by all the noloop plugins.
+/// Names that are known are answered from memory. Expired names are answered
+/// with the last known addresses while they are resolved again in the background.
+/// Only the names never seen before are waited for, up to a timeout.
+/// Each resolution goes to the least busy thread, so a slow name does not hold up the others
+class NoLoopResolver {
+public:
+
+    /// Get the instance, creating it if needed. Each acquire needs a release
+    static NoLoopResolver *acquire();
+    static void release();
+
+    /// Resolve a set of hosts. An address is returned as it is.
+    /// A host that cannot be resolved in time gets an empty list
+    void resolve(const std::vector<std::string> &hosts, std::vector<NoLoopAddrList> &addrs);
+
+    /// Parse a numeric address, returning false if it's a name
+    static bool parseAddress(const std::string &s, boost::asio::ip::address &addr);
+
+private:
+
+    struct Entry {
+        NoLoopAddrList addrs;
+        time_t expiry;
+        /// A resolution is in progress
+        bool pending;
+        /// The entry has been resolved at least once
+        bool valid;
+        /// When the resolution in progress was started
+        boost::system_time started;
+
+        Entry(): expiry(0), pending(false), valid(false) {}
+    };
+
+    /// An io thread with its resolver. The resolver runs one getaddrinfo at a time
+    struct Worker {
+        boost::asio::io_service ios;
+        boost::asio::io_service::work *work;
+        boost::asio::ip::udp::resolver resolver;
+        boost::thread *iothread;
+        /// Resolutions queued or in progress, protected by mtx
+        int inflight;
+
+        Worker(): work(0), resolver(ios), iothread(0), inflight(0) {}
+    };
+
+    static NoLoopResolver *instance;
+    static int refcount;
+    static boost::mutex instancemtx;
+
+    std::vector<Worker *> workers;
+
+    std::unordered_map<std::string, Entry> cache;
+    boost::mutex mtx;
+    boost::condition_variable resolved;
+
+    /// Lifetime of the resolved names and of the failures
+    int ttl, negttl;
+    /// How long to wait for a name never seen before
+    int timeoutms;
+    /// Max number of names in the cache
+    size_t maxsize;
+    /// How many resolutions can be in progress together
+    int nthreads;
+
+    NoLoopResolver();
+    ~NoLoopResolver();
+
+    /// Make room for a new name in a full cache, dropping the expired ones or else
+    /// the one that expires first. What is in progress stays. Called with mtx held
+    void makeRoom(time_t now);
+
+    /// Start the resolution of a host. Called with mtx held
+    void startResolve(const std::string &host, Entry &e);
+
+    /// Completion of a resolution, in the io thread of the worker
+    void onResolve(Worker *wk, const std::string &host, const boost::system::error_code &ec,
+                   boost::asio::ip::udp::resolver::iterator iter);
+};
+
+#endif // NOLOOPRESOLVER_HH
@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+
+/** @file  UgrPerfRankPlugin.cc
+ * @brief  An UGR filter plugin that sorts the replicas by the performance of their endpoints
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+
+#include "UgrPerfRankPlugin.hh"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+using namespace std;
+
+
+// Replicas come with pluginIDs that are small integers, this is just a sanity limit
+#define PERFRANK_MAXPLUGINS 65536
+
+
+/// Exponentially weighted moving average. A negative average means no samples yet
+static inline void perfrank_ewma(float &avg, float sample, float alpha) {
+  if (avg < 0) avg = sample;
+  else avg += alpha * (sample - avg);
+}
+
+static bool perfrank_lessthan(const UgrFileItem_replica &i, const UgrFileItem_replica &j) { return (i.tempDistance < j.tempDistance); }
+
+
+
+UgrPerfRankPlugin::UgrPerfRankPlugin(UgrConnector & c, std::vector<std::string> & parms)  : FilterPlugin(c, parms){
+  UgrCFG->Set(&c.getConfig());
+
+  const char *fname = "UgrPerfRankPlugin::UgrPerfRankPlugin";
+  Info(UgrLogger::Lvl1, fname, "Creating instance.");
+
+  alpha = UgrCFG->GetLong("glb.filterplugin.perfrank.alphapct", 20) / 100.0;
+  if ((alpha <= 0) || (alpha > 1)) {
+    Error(fname, "glb.filterplugin.perfrank.alphapct must be between 1 and 100. Using 20");
+    alpha = 0.2;
+  }
+
+  distweight = UgrCFG->GetLong("glb.filterplugin.perfrank.distweight", 10);
+  latencyweight = UgrCFG->GetLong("glb.filterplugin.perfrank.latencyweight", 1);
+  errorweight = UgrCFG->GetLong("glb.filterplugin.perfrank.errorweight", 1000);
+  rateweight = UgrCFG->GetLong("glb.filterplugin.perfrank.rateweight", 1);
+  refsize = UgrCFG->GetLong("glb.filterplugin.perfrank.refsize", 100000000);
+  jitter = UgrCFG->GetLong("glb.filterplugin.perfrank.jitter", 5);
+  sitemin = UgrCFG->GetLong("glb.filterplugin.perfrank.sitemin", 3);
+
+  Info(UgrLogger::Lvl1, fname, "alpha: " << alpha << " distweight: " << distweight << " latencyweight: " << latencyweight <<
+    " errorweight: " << errorweight << " rateweight: " << rateweight << " refsize: " << refsize << " jitter: " << jitter <<
+    " sitemin: " << sitemin);
+
+  seed = time(0);
+}
+
+UgrPerfRankPlugin::~UgrPerfRankPlugin(){
+
+}
+
+
+UgrPerfRankStats &UgrPerfRankPlugin::getStats(int pluginID) {
+  if (pluginID >= (int)stats.size())
+    stats.resize(pluginID+1);
+
+  return stats[pluginID];
+}
+
+
+void UgrPerfRankPlugin::pollStatus(int pluginID, UgrPerfRankStats &eff) {
+  PluginEndpointStatus st;
+  if (getConn().getEndpointStatus(pluginID, st)) return;
+  if (!st.lastcheck || (st.lastcheck == eff.lastcheck)) return;
+
+  boost::lock_guard<boost::mutex> l(statsmtx);
+  UgrPerfRankStats &s = getStats(pluginID);
+
+  // A new check, it counts as one sample
+  if (st.lastcheck != s.lastcheck) {
+    s.lastcheck = st.lastcheck;
+    bool online = (st.state == PLUGIN_ENDPOINT_ONLINE);
+
+    s.errrate += alpha * ((online ? 0.0 : 1.0) - s.errrate);
+    if (online && (st.latency_ms > 0))
+      perfrank_ewma(s.checklatency, st.latency_ms, alpha);
+  }
+
+  eff = s;
+}
+
+
+float UgrPerfRankPlugin::cost(const UgrFileItem_replica &r, const UgrPerfRankStats &s, float defaultxfertime) {
+  // The geo plugins leave the square of the distance in radians
+  float km = sqrt(r.tempDistance) * 6371.0;
+  float c = distweight * km / 1000.0;
+
+  // The latency of the real requests is better than the one of the checks
+  if (s.latency >= 0)
+    c += latencyweight * s.latency;
+  else if (s.checklatency >= 0)
+    c += latencyweight * s.checklatency;
+
+  c += errorweight * s.errrate;
+
+  // How long the reference transfer would take, in ms
+  c += rateweight * ((s.rate > 0) ? xfertime(s) : defaultxfertime);
+
+  return c;
+}
+
+
+int UgrPerfRankPlugin::applyFilterOnReplicaList(UgrReplicaVec& replica, const UgrClientInfo & cli_info){
+  const char *fname = "UgrPerfRankPlugin::applyFilterOnReplicaList";
+
+  if (replica.size() < 2) return 0;
+
+  // What the clients of the same site have experienced, it beats the global averages
+  HostsXferRow siterow;
+  getConn().getSiteTransferStats(cli_info, siterow);
+
+  time_t now = time(0);
+  std::vector<UgrPerfRankStats> eff(replica.size());
+  std::vector<bool> poll(replica.size(), false);
+
+  // Only copy what we know under the lock, the rest is done without it
+  {
+    boost::lock_guard<boost::mutex> l(statsmtx);
+
+    for (size_t i = 0; i < replica.size(); i++) {
+      int id = replica[i].pluginID;
+      if ((id < 0) || (id >= PERFRANK_MAXPLUGINS)) continue;
+
+      UgrPerfRankStats &s = getStats(id);
+
+      // The checks are seldom, no need to look more often than this
+      if (s.lastpoll != now) {
+        s.lastpoll = now;
+        poll[i] = true;
+      }
+      eff[i] = s;
+    }
+  }
+
+  for (size_t i = 0; i < replica.size(); i++) {
+    if (!poll[i]) continue;
+    pollStatus(replica[i].pluginID, eff[i]);
+
+    // The other replicas of the same endpoint see the same check
+    for (size_t j = i+1; j < replica.size(); j++)
+      if (replica[j].pluginID == replica[i].pluginID) eff[j] = eff[i];
+  }
+
+  for (size_t i = 0; i < replica.size(); i++) {
+    HostsXferRow::iterator x = siterow.find(replica[i].pluginID);
+    if ((x != siterow.end()) && (x->second.weight >= sitemin)) {
+      if (x->second.rate > 0) eff[i].rate = x->second.rate;
+      eff[i].errrate = x->second.errrate;
+    }
+  }
+
+  // The endpoints with no reported throughput are assumed to be average,
+  // otherwise they would always beat the ones that have been measured
+  float defaultxfertime = 0;
+  int nrates = 0;
+  for (size_t i = 0; i < eff.size(); i++) {
+    if (eff[i].rate > 0) {
+      defaultxfertime += xfertime(eff[i]);
+      nrates++;
+    }
+  }
+  if (nrates) defaultxfertime /= nrates;
+
+  // Endpoints that are about equivalent are picked at random.
+  // The seed is shared by the concurrent locates
+  std::vector<float> jit(replica.size(), 0.0);
+  if (jitter > 0) {
+    boost::lock_guard<boost::mutex> l(seedmtx);
+    for (size_t i = 0; i < replica.size(); i++)
+      jit[i] = jitter * (rand_r(&seed) / (float)RAND_MAX);
+  }
+
+  for (size_t i = 0; i < replica.size(); i++) {
+    const UgrPerfRankStats &s = eff[i];
+    float c = cost(replica[i], s, defaultxfertime) + jit[i];
+
+    replica[i].tempDistance = c;
+
+    Info(UgrLogger::Lvl4, fname, "Cost: " << c << " pluginID: " << replica[i].pluginID << " latency: " << s.latency <<
+      " checklatency: " << s.checklatency << " errrate: " << s.errrate << " rate: " << s.rate << " " << replica[i].name);
+  }
+
+  std::stable_sort(replica.begin(), replica.end(), perfrank_lessthan);
+
+  return 0;
+}
+
+
+void UgrPerfRankPlugin::hookRequestDone(int pluginID, int latency_ms){
+  if ((pluginID < 0) || (pluginID >= PERFRANK_MAXPLUGINS)) return;
+
+  boost::lock_guard<boost::mutex> l(statsmtx);
+  perfrank_ewma(getStats(pluginID).latency, latency_ms, alpha);
+}
+
+
+void UgrPerfRankPlugin::hookTransferReport(int pluginID, long long bytes, int duration_ms, bool ok){
+  const char *fname = "UgrPerfRankPlugin::hookTransferReport";
+  if ((pluginID < 0) || (pluginID >= PERFRANK_MAXPLUGINS)) return;
+
+  Info(UgrLogger::Lvl4, fname, "pluginID: " << pluginID << " bytes: " << bytes << " duration_ms: " << duration_ms << " ok: " << ok);
+
+  boost::lock_guard<boost::mutex> l(statsmtx);
+  UgrPerfRankStats &s = getStats(pluginID);
+
+  s.errrate += alpha * ((ok ? 0.0 : 1.0) - s.errrate);
+
+  // Only the transfers that succeeded tell the throughput
+  if (ok && (bytes > 0) && (duration_ms > 0))
+    perfrank_ewma(s.rate, bytes * 1000.0 / duration_ms, alpha);
+}
+
+
+
+// ------------------------------------------------------------------------------------
+// Plugin-related stuff
+// ------------------------------------------------------------------------------------
+
+
+
+/// The plugin hook function. GetPluginInterfaceClass must be given the name of this function
+/// for the plugin to be loaded
+extern "C" PluginInterface * GetPluginInterface(GetPluginInterfaceArgs) {
+  return (PluginInterface *)new UgrPerfRankPlugin(c, parms);
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+
+
+/** @file  UgrPerfRankPlugin.hh
+ * @brief  An UGR filter plugin that sorts the replicas by the performance of their endpoints
+ * @author agent
+ * @date   Oct 2026
+ */
+#ifndef PERFRANKPLUGIN_HH
+#define PERFRANKPLUGIN_HH
+
+#include <UgrConnector.hh>
+#include "../PluginInterface.hh"
+
+#include <vector>
+#include <boost/thread.hpp>
+
+
+/// What we have learnt about an endpoint. The averages are exponentially weighted
+struct UgrPerfRankStats {
+  /// Latency of the requests made by the location plugin, in ms. Negative if unknown
+  float latency;
+  /// Latency measured by the availability checker, in ms. Negative if unknown
+  float checklatency;
+  /// Fraction of the failed checks and transfers
+  float errrate;
+  /// Throughput reported by the clients, in bytes per second. Negative if unknown
+  float rate;
+  /// The last status check that was taken into account, and when we looked for a new one
+  time_t lastcheck, lastpoll;
+
+  UgrPerfRankStats(): latency(-1), checklatency(-1), errrate(0), rate(-1), lastcheck(0), lastpoll(0) {}
+};
+
+
+/** UgrPerfRankPlugin
+ * Ranks the replicas by a cost that blends the distance from the client, as given by
+ * a geo plugin that runs before this one, and how well their endpoints have been performing:
+ * latency, errors and throughput. The errors and the throughput reported by the clients
+ * of the same site, if enough, replace the global ones.
+ * A small random jitter spreads the load among endpoints that are equivalent.
+ */
+class UgrPerfRankPlugin : public FilterPlugin {
+protected:
+    /// Indexed by pluginID
+    std::vector<UgrPerfRankStats> stats;
+    boost::mutex statsmtx;
+
+    /// The weight of a new sample in the averages
+    float alpha;
+
+    /// Cost of the distance, in ms per 1000 Km
+    float distweight;
+    /// Cost of a ms of latency
+    float latencyweight;
+    /// Cost of an endpoint that always fails, in ms
+    float errorweight;
+    /// Cost of the time needed to transfer refsize bytes at the reported rate
+    float rateweight;
+    float refsize;
+    /// Max random cost added to spread the load, in ms
+    float jitter;
+    /// How many transfers from the site of the client are needed to prefer
+    /// what they tell to the global averages
+    float sitemin;
+
+    unsigned int seed;
+    boost::mutex seedmtx;
+
+    /// Gets the stats of an endpoint, growing the table if needed. Called with statsmtx held
+    UgrPerfRankStats &getStats(int pluginID);
+
+    /// Takes into account the latest status check of an endpoint, if it's new.
+    /// Called without statsmtx held, eff is updated with what we know after that
+    void pollStatus(int pluginID, UgrPerfRankStats &eff);
+
+    /// The time to transfer refsize bytes from an endpoint with a known rate, in ms
+    float xfertime(const UgrPerfRankStats &s) {
+      return (refsize / s.rate) * 1000.0;
+    }
+
+    /// The cost of a replica, lower is better
+    /// @param defaultxfertime the transfer time to assume if the rate of the endpoint is not known
+    float cost(const UgrFileItem_replica &r, const UgrPerfRankStats &s, float defaultxfertime);
+
+public:
+
+    UgrPerfRankPlugin(UgrConnector & c, std::vector<std::string> & parms);
+    virtual ~UgrPerfRankPlugin();
+
+    virtual int applyFilterOnReplicaList(UgrReplicaVec& replica, const UgrClientInfo & cli_info);
+
+    virtual void hookRequestDone(int pluginID, int latency_ms);
+
+    virtual void hookTransferReport(int pluginID, long long bytes, int duration_ms, bool ok);
+};
+
+
+
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ * 
+ */
+
+
+
+/* testinvalidate
+ * invalidate a subtree or the contribution of a plugin in the external cache
+ *
+ */
+
+
+
+#include <iostream>
+#include "../UgrConnector.hh"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+
+int main(int argc, char **argv) {
+
+    if ((argc != 4) || (strcmp(argv[2], "prefix") && strcmp(argv[2], "plugin"))) {
+        cout << "Usage: " << argv[0] << " <cfgfile> prefix|plugin <prefix or plugin name>" << endl;
+        exit(1);
+    }
+
+    UgrConnector ugr;
+
+    cout << "Initializing" << endl;
+    if (ugr.init(argv[1]))
+        return 1;
+
+    string what = argv[3];
+    int r;
+
+    if (!strcmp(argv[2], "prefix"))
+        r = ugr.invalidateCachePrefix(what);
+    else
+        r = ugr.invalidateCachePlugin(what);
+
+    if (r) {
+        cout << "Cannot invalidate " << argv[2] << " '" << what << "'" << endl;
+        return 1;
+    }
+
+    cout << "Invalidated " << argv[2] << " '" << what << "'" << endl;
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ * 
+ */
+
+
+
+/* testxferfeed
+ * feed the outcome of transfers into the transfer matrix, shared through the external cache
+ * Reads from stdin lines like:
+ *   <client ip> <replica url> <bytes> <duration in ms> <http status>
+ * e.g. tail -F access_log | awk '{ ... }' | testxferfeed ugr.conf
+ */
+
+
+
+#include <iostream>
+#include <sstream>
+#include "../UgrConnector.hh"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        cout << "Usage: " << argv[0] << " <cfgfile>  < transfers" << endl;
+        exit(1);
+    }
+
+    UgrConnector ugr;
+
+    cout << "Initializing" << endl;
+    if (ugr.init(argv[1]))
+        return 1;
+
+    string line;
+    long nok = 0, nbad = 0;
+
+    while (getline(cin, line)) {
+        istringstream ls(line);
+        string ip, url;
+        long long bytes;
+        int ms, status;
+
+        if (!(ls >> ip >> url >> bytes >> ms >> status)) {
+            nbad++;
+            continue;
+        }
+
+        bool ok = (status >= 200) && (status < 300);
+        if (ugr.reportTransfer(UgrClientInfo(ip), url, bytes, ms, ok))
+            nbad++;
+        else
+            nok++;
+    }
+
+    // Don't wait for the next tick
+    ugr.syncTransferMatrix();
+
+    cout << "Reported " << nok << " transfers, skipped " << nbad << " lines" << endl;
+    return 0;
+}
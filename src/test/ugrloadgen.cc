@@ -0,0 +1,566 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/* ugrloadgen
+ * Initialize the connector with the given cfgfile and load it from many
+ * threads with a mix of stat, locate, list and findNewLocation, to see how
+ * much a redirector node can take.
+ *
+ * Closed loop (the default): each thread sends its next request as soon as the
+ * previous one is answered.
+ * Open loop (--rate): the requests arrive as a Poisson process, regardless of
+ * how fast they are answered. A request that could not start in time because
+ * its thread was still busy is accounted from when it should have started,
+ * hence the latencies are corrected for the coordinated omission.
+ *
+ * The names are the ones of ugr_mockstorage, <prefix>/dirNNNNN/fileNNNNNNN,
+ * or the ones in a file. Their popularity follows a Zipf distribution.
+ *
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <boost/thread.hpp>
+#include "../UgrConnector.hh"
+
+using namespace std;
+
+
+static uint64_t nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t t) {
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+}
+
+
+// ------------------------------------------------------------------------------------
+// Latency histogram, with the layout of the HDR histograms: 64 sub-buckets
+// per power of two, hence the values are kept with an error below 1.6%
+// ------------------------------------------------------------------------------------
+
+class LatHistogram {
+public:
+    enum { subbits = 7, subcount = 1 << subbits, halfcount = subcount / 2, maxbits = 40,
+           nbuckets = subcount + (maxbits - subbits) * halfcount };
+
+    LatHistogram(): counts(nbuckets, 0), total(0), sum(0), maxv(0) {}
+
+    void record(uint64_t us) {
+        counts[index(us)]++;
+        total++;
+        sum += us;
+        if (us > maxv) maxv = us;
+    }
+
+    void add(const LatHistogram &h) {
+        for (int i = 0; i < nbuckets; i++) counts[i] += h.counts[i];
+        total += h.total;
+        sum += h.sum;
+        maxv = max(maxv, h.maxv);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t maxValue() const { return maxv; }
+    double mean() const { return total ? (double)sum / total : 0; }
+
+    /// The highest value that is equivalent to the one at the given percentile
+    uint64_t percentile(double pct) const {
+        if (!total) return 0;
+        uint64_t want = (uint64_t)ceil(pct / 100.0 * total);
+        if (want < 1) want = 1;
+        uint64_t n = 0;
+        for (int i = 0; i < nbuckets; i++) {
+            n += counts[i];
+            if (n >= want) return min(highest(i), maxv);
+        }
+        return maxv;
+    }
+
+    /// The percentile distribution in the .hgrm format of HdrHistogram, in ms
+    void writeHgrm(ostream &out) const {
+        char buf[256];
+        out << "       Value     Percentile TotalCount 1/(1-Percentile)\n\n";
+
+        uint64_t n = 0;
+        for (int i = 0; i < nbuckets; i++) {
+            if (!counts[i]) continue;
+            n += counts[i];
+            double p = (double)n / total;
+            if (p < 1.0)
+                snprintf(buf, sizeof(buf), "%12.3f %14.12f %10llu %14.2f\n", min(highest(i), maxv) / 1000.0, p,
+                         (unsigned long long)n, 1.0 / (1.0 - p));
+            else
+                snprintf(buf, sizeof(buf), "%12.3f %14.12f %10llu\n", maxv / 1000.0, p, (unsigned long long)n);
+            out << buf;
+        }
+
+        double sd = 0;
+        for (int i = 0; i < nbuckets; i++) {
+            if (!counts[i]) continue;
+            double d = (lowest(i) + highest(i)) / 2.0 - mean();
+            sd += d * d * counts[i];
+        }
+        sd = total ? sqrt(sd / total) : 0;
+
+        snprintf(buf, sizeof(buf), "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n"
+                 "#[Max     = %12.3f, Total count    = %12llu]\n"
+                 "#[Buckets = %12d, SubBuckets     = %12d]\n",
+                 mean() / 1000.0, sd / 1000.0, maxv / 1000.0, (unsigned long long)total, maxbits - subbits + 1, subcount);
+        out << buf;
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total, sum, maxv;
+
+    static int index(uint64_t v) {
+        if (v < subcount) return v;
+        int o = 63 - __builtin_clzll(v);
+        if (o >= maxbits) return nbuckets - 1;
+        int shift = o - (subbits - 1);
+        return subcount + (o - subbits) * halfcount + (int)((v >> shift) - halfcount);
+    }
+
+    static uint64_t lowest(int i) {
+        if (i < subcount) return i;
+        int o = (i - subcount) / halfcount + subbits;
+        int shift = o - (subbits - 1);
+        return (uint64_t)((i - subcount) % halfcount + halfcount) << shift;
+    }
+
+    static uint64_t highest(int i) {
+        if (i < subcount) return i;
+        int o = (i - subcount) / halfcount + subbits;
+        return lowest(i) + (1ULL << (o - (subbits - 1))) - 1;
+    }
+};
+
+
+// ------------------------------------------------------------------------------------
+// Zipf distribution over 1..n, by rejection-inversion (W. Hormann, G. Derflinger,
+// "Rejection-inversion to generate variates from monotone discrete distributions").
+// It needs no table, the namespace can be huge
+// ------------------------------------------------------------------------------------
+
+class ZipfGen {
+public:
+    ZipfGen(uint64_t n, double s): n(n), s(s) {
+        hx1 = hIntegral(1.5) - 1.0;
+        hn = hIntegral(n + 0.5);
+        threshold = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+    }
+
+    /// A rank, 1 is the most popular
+    uint64_t operator()(std::mt19937_64 &rng) {
+        std::uniform_real_distribution<double> u01(0.0, 1.0);
+        for (;;) {
+            double u = hn + u01(rng) * (hx1 - hn);
+            double x = hIntegralInverse(u);
+            uint64_t k = (uint64_t)(x + 0.5);
+            if (k < 1) k = 1;
+            else if (k > n) k = n;
+            if ((k - x <= threshold) || (u >= hIntegral(k + 0.5) - h(k))) return k;
+        }
+    }
+
+private:
+    uint64_t n;
+    double s, hx1, hn, threshold;
+
+    double h(double x) const { return exp(-s * log(x)); }
+
+    double hIntegral(double x) const {
+        double lx = log(x);
+        return helper2((1.0 - s) * lx) * lx;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = x * (1.0 - s);
+        if (t < -1.0) t = -1.0;
+        return exp(helper1(t) * x);
+    }
+
+    // log1p(x)/x and expm1(x)/x, that stay accurate around 0
+    static double helper1(double x) {
+        if (fabs(x) > 1e-8) return log1p(x) / x;
+        return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+    static double helper2(double x) {
+        if (fabs(x) > 1e-8) return expm1(x) / x;
+        return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+    }
+};
+
+
+// ------------------------------------------------------------------------------------
+// The load
+// ------------------------------------------------------------------------------------
+
+enum OpType { OpStat = 0, OpLocate, OpList, OpNewLocation, OpLast };
+static const char *opnames[OpLast] = { "stat", "locate", "list", "newlocation" };
+
+static struct {
+    int threads;
+    int seconds;
+    int warmup;
+    double rate;
+    double mix[OpLast];
+    int dirs;
+    int files;
+    string prefix;
+    string namesfile;
+    double zipf;
+    string client;
+    string hgrm;
+} cfg;
+
+/// The names from the file, if any
+static vector<string> names;
+/// Their parent dirs, without duplicates
+static vector<string> dirnames;
+
+/// Spreads the ranks over the namespace, so that the popular files are not all in the first dirs
+static uint64_t scramble(uint64_t rank, uint64_t n) {
+    // An odd multiplier is a permutation of the integers modulo 2^64, hence
+    // cycling on the values above n is a permutation of 0..n-1
+    uint64_t x = rank - 1;
+    uint64_t mask = 1;
+    while (mask < n) mask <<= 1;
+    mask--;
+    do {
+        x = (x * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL) & mask;
+    } while (x >= n);
+    return x;
+}
+
+struct ThreadStats {
+    LatHistogram service[OpLast];
+    LatHistogram corrected[OpLast];
+    uint64_t failed[OpLast];
+    uint64_t late;
+
+    ThreadStats(): late(0) {
+        for (int i = 0; i < OpLast; i++) failed[i] = 0;
+    }
+};
+
+static void loader(UgrConnector *ugr, ThreadStats *st, int idx, uint64_t tstart, uint64_t tmeasure, uint64_t tend) {
+    std::mt19937_64 rng(nowns() ^ (idx * 0x9e3779b97f4a7c15ULL));
+    std::uniform_real_distribution<double> u01(0.0, 1.0);
+    std::exponential_distribution<double> interarrival(cfg.rate > 0 ? cfg.rate / cfg.threads : 1.0);
+
+    uint64_t nfiles = names.empty() ? (uint64_t)cfg.dirs * cfg.files : names.size();
+    uint64_t ndirs = names.empty() ? cfg.dirs : dirnames.size();
+    ZipfGen zfiles(nfiles, cfg.zipf), zdirs(ndirs, cfg.zipf);
+
+    UgrClientInfo cli(cfg.client);
+    uint64_t seq = 0;
+    char buf[1024];
+
+    // Open loop: the threads don't start all together
+    uint64_t intended = tstart;
+    if (cfg.rate > 0) intended += (uint64_t)(interarrival(rng) * 1e9);
+
+    for (;;) {
+        if (cfg.rate > 0) {
+            if (intended >= tend) break;
+            sleepUntil(intended);
+        }
+
+        // In open loop the requests that are late are sent anyway, they are the interesting ones
+        uint64_t t0 = nowns();
+        if (cfg.rate <= 0) {
+            if (t0 >= tend) break;
+            intended = t0;
+        }
+
+        // Which op
+        double r = u01(rng);
+        int op = 0;
+        while ((op < OpLast - 1) && (r >= cfg.mix[op])) {
+            r -= cfg.mix[op];
+            op++;
+        }
+
+        // On which name
+        string lfn;
+        if (op == OpList) {
+            uint64_t d = scramble(zdirs(rng), ndirs);
+            if (names.empty()) {
+                snprintf(buf, sizeof(buf), "%s/dir%05d", cfg.prefix.c_str(), (int)d);
+                lfn = buf;
+            }
+            else lfn = dirnames[d];
+        }
+        else if (op == OpNewLocation) {
+            snprintf(buf, sizeof(buf), "%s/dir%05d/new.%d.%llu", cfg.prefix.c_str(), (int)(rng() % cfg.dirs), idx,
+                     (unsigned long long)seq++);
+            lfn = buf;
+        }
+        else {
+            uint64_t f = scramble(zfiles(rng), nfiles);
+            if (names.empty()) {
+                snprintf(buf, sizeof(buf), "%s/dir%05d/file%07d", cfg.prefix.c_str(), (int)(f / cfg.files), (int)(f % cfg.files));
+                lfn = buf;
+            }
+            else lfn = names[f];
+        }
+
+        bool ok = true;
+        UgrFileInfo *fi = 0;
+        switch (op) {
+            case OpStat:
+                ugr->stat(lfn, cli, &fi);
+                break;
+            case OpLocate:
+                ugr->locate(lfn, cli, &fi);
+                break;
+            case OpList:
+                ugr->list(lfn, cli, &fi);
+                break;
+            case OpNewLocation: {
+                UgrReplicaVec repls;
+                ok = ugr->findNewLocation(lfn, 1024, cli, repls).isOK();
+                break;
+            }
+        }
+
+        // A name that does not exist is an answer, what did not get one is a failure
+        if (fi) {
+            boost::lock_guard<UgrFileInfo> l(*fi);
+            UgrFileInfo::InfoStatus s = (op == OpStat) ? fi->getStatStatus() :
+                ((op == OpLocate) ? fi->getLocationStatus() : fi->getItemsStatus());
+            ok = (s == UgrFileInfo::Ok) || (s == UgrFileInfo::NotFound);
+        }
+
+        uint64_t t1 = nowns();
+        if (t0 >= tmeasure) {
+            st->service[op].record((t1 - t0) / 1000);
+            st->corrected[op].record((t1 - intended) / 1000);
+            if (!ok) st->failed[op]++;
+            if (t0 - intended > 1000000) st->late++;
+        }
+
+        if (cfg.rate > 0) intended += (uint64_t)(interarrival(rng) * 1e9);
+    }
+}
+
+
+static void printRow(const char *op, const char *kind, const LatHistogram &h, double secs) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-12s %-10s %10llu %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f", op, kind,
+             (unsigned long long)h.count(), h.count() / secs, h.percentile(50) / 1000.0, h.percentile(90) / 1000.0,
+             h.percentile(99) / 1000.0, h.percentile(99.9) / 1000.0, h.percentile(99.99) / 1000.0, h.maxValue() / 1000.0);
+    cout << buf << endl;
+}
+
+
+static int parseMix(const string &s) {
+    for (int i = 0; i < OpLast; i++) cfg.mix[i] = 0;
+
+    stringstream ss(s);
+    string item;
+    double tot = 0;
+    while (getline(ss, item, ',')) {
+        size_t c = item.find(':');
+        string name = item.substr(0, c);
+        double w = (c == string::npos) ? 1.0 : atof(item.substr(c + 1).c_str());
+
+        int i = 0;
+        while ((i < OpLast) && (name != opnames[i])) i++;
+        if ((i == OpLast) || (w < 0)) return -1;
+
+        cfg.mix[i] += w;
+        tot += w;
+    }
+
+    if (tot <= 0) return -1;
+    for (int i = 0; i < OpLast; i++) cfg.mix[i] /= tot;
+    return 0;
+}
+
+
+static void usage(const char *me) {
+    cout << "Usage: " << me << " <cfgfile> [options]" << endl <<
+        "  --threads <n>      the threads that send the requests (16)" << endl <<
+        "  --seconds <n>      how long to measure (30)" << endl <<
+        "  --warmup <n>       seconds of load before measuring (5)" << endl <<
+        "  --rate <ops/s>     open loop, Poisson arrivals at this total rate. 0 is closed loop (0)" << endl <<
+        "  --mix <op:w,...>   the weights of stat, locate, list, newlocation (stat:80,locate:15,list:5)" << endl <<
+        "  --dirs <n>         the dirs of the namespace (100)" << endl <<
+        "  --files <n>        the files in each dir (1000)" << endl <<
+        "  --prefix <path>    where the namespace is in the federation ()" << endl <<
+        "  --names <file>     take the names from a file, one per line, instead" << endl <<
+        "  --zipf <s>         the exponent of the popularity of the names, 0 is uniform (0.99)" << endl <<
+        "  --client <ip>      the address of the client (127.0.0.1)" << endl <<
+        "  --hgrm <pfx>       write the distributions to <pfx>.<op>.<service|corrected>.hgrm" << endl;
+}
+
+int main(int argc, char **argv) {
+
+    if ((argc < 2) || (argv[1][0] == '-')) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    cfg.threads = 16;
+    cfg.seconds = 30;
+    cfg.warmup = 5;
+    cfg.rate = 0;
+    cfg.dirs = 100;
+    cfg.files = 1000;
+    cfg.zipf = 0.99;
+    cfg.client = "127.0.0.1";
+    parseMix("stat:80,locate:15,list:5");
+
+    for (int i = 2; i < argc; i++) {
+        string a = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            exit(1);
+        }
+        string v = argv[++i];
+
+        if (a == "--threads") cfg.threads = atoi(v.c_str());
+        else if (a == "--seconds") cfg.seconds = atoi(v.c_str());
+        else if (a == "--warmup") cfg.warmup = atoi(v.c_str());
+        else if (a == "--rate") cfg.rate = atof(v.c_str());
+        else if (a == "--dirs") cfg.dirs = atoi(v.c_str());
+        else if (a == "--files") cfg.files = atoi(v.c_str());
+        else if (a == "--prefix") cfg.prefix = v;
+        else if (a == "--names") cfg.namesfile = v;
+        else if (a == "--zipf") cfg.zipf = atof(v.c_str());
+        else if (a == "--client") cfg.client = v;
+        else if (a == "--hgrm") cfg.hgrm = v;
+        else if (a == "--mix") {
+            if (parseMix(v)) {
+                cout << "Bad mix '" << v << "'" << endl;
+                exit(1);
+            }
+        }
+        else {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    while (!cfg.prefix.empty() && (cfg.prefix[cfg.prefix.size() - 1] == '/')) cfg.prefix.erase(cfg.prefix.size() - 1);
+    if ((cfg.threads < 1) || (cfg.seconds < 1) || (cfg.warmup < 0) || (cfg.rate < 0) || (cfg.dirs < 1) || (cfg.files < 1) ||
+        (cfg.zipf < 0)) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if (!cfg.namesfile.empty()) {
+        ifstream f(cfg.namesfile.c_str());
+        string l;
+        while (getline(f, l)) {
+            if (l.empty()) continue;
+            names.push_back(l);
+            size_t p = l.rfind('/');
+            dirnames.push_back((p == string::npos) || (p == 0) ? "/" : l.substr(0, p));
+        }
+        sort(dirnames.begin(), dirnames.end());
+        dirnames.erase(unique(dirnames.begin(), dirnames.end()), dirnames.end());
+
+        if (names.empty()) {
+            cout << "No names in " << cfg.namesfile << endl;
+            exit(1);
+        }
+        cout << "Loaded " << names.size() << " names in " << dirnames.size() << " dirs" << endl;
+    }
+
+    UgrConnector ugr;
+
+    cout << "Initializing" << endl;
+    if (ugr.init(argv[1]))
+        return 1;
+
+    cout << "Loading with " << cfg.threads << " threads, " <<
+        ((cfg.rate > 0) ? "open loop at " + to_string((long)cfg.rate) + " ops/s" : string("closed loop")) <<
+        ", warmup " << cfg.warmup << "s, measuring " << cfg.seconds << "s" << endl;
+
+    vector<ThreadStats> stats(cfg.threads);
+    boost::thread_group tg;
+    uint64_t tstart = nowns();
+    uint64_t tmeasure = tstart + cfg.warmup * 1000000000ULL;
+    uint64_t tend = tmeasure + cfg.seconds * 1000000000ULL;
+
+    for (int i = 0; i < cfg.threads; i++)
+        tg.create_thread(boost::bind(loader, &ugr, &stats[i], i, tstart, tmeasure, tend));
+    tg.join_all();
+
+    // The last requests may have finished a bit later
+    double secs = max((double)cfg.seconds, (nowns() - tmeasure) / 1e9);
+
+    ThreadStats tot;
+    for (int i = 0; i < cfg.threads; i++) {
+        for (int op = 0; op < OpLast; op++) {
+            tot.service[op].add(stats[i].service[op]);
+            tot.corrected[op].add(stats[i].corrected[op]);
+            tot.failed[op] += stats[i].failed[op];
+        }
+        tot.late += stats[i].late;
+    }
+
+    cout << endl << "Latencies in ms" << endl;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-12s %-10s %10s %10s %9s %9s %9s %9s %9s %9s", "op", "", "count", "ops/s",
+             "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    cout << buf << endl;
+
+    LatHistogram all;
+    uint64_t failed = 0;
+    for (int op = 0; op < OpLast; op++) {
+        if (!tot.service[op].count()) continue;
+
+        printRow(opnames[op], "service", tot.service[op], secs);
+        if (cfg.rate > 0) printRow("", "corrected", tot.corrected[op], secs);
+        all.add(tot.corrected[op]);
+        failed += tot.failed[op];
+
+        if (!cfg.hgrm.empty()) {
+            ofstream fs((cfg.hgrm + "." + opnames[op] + ".service.hgrm").c_str());
+            tot.service[op].writeHgrm(fs);
+            if (cfg.rate > 0) {
+                ofstream fc((cfg.hgrm + "." + opnames[op] + ".corrected.hgrm").c_str());
+                tot.corrected[op].writeHgrm(fc);
+            }
+        }
+    }
+    printRow("all", (cfg.rate > 0) ? "corrected" : "service", all, secs);
+
+    cout << endl << "Achieved " << all.count() / secs << " ops/s";
+    if (cfg.rate > 0) cout << " of " << cfg.rate << ", " << tot.late << " requests started more than 1ms late";
+    cout << endl << "Failed: " << failed << endl;
+
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/* ugrreplay
+ * Replay the requests captured by a production instance (glb.capture.file)
+ * against the federation described by the given cfgfile, e.g. one made of
+ * ugr_mockstorage endpoints, at the original speed or faster.
+ * The replayed requests are captured again, hence two builds can be compared
+ * on the same load, in latency and in cache hits.
+ *
+ *   ugrreplay replay <cfgfile> <capture> [options]
+ *   ugrreplay stats <capture>
+ *   ugrreplay compare <capture A> <capture B>
+ *
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <boost/thread.hpp>
+#include "../UgrConnector.hh"
+#include "../UgrCapture.hh"
+
+using namespace std;
+
+
+static uint64_t nowns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t t) {
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+}
+
+
+static bool earlier(const UgrCapture::Record &a, const UgrCapture::Record &b) {
+    return a.tns < b.tns;
+}
+
+static int load(const string &fn, vector<UgrCapture::Record> &recs) {
+    FILE *f;
+    if (UgrCapture::openFile(fn, f)) {
+        cout << "Cannot open capture '" << fn << "'" << endl;
+        return -1;
+    }
+
+    UgrCapture::Record r;
+    int rc;
+    while ((rc = UgrCapture::read(f, r)) == 0) recs.push_back(r);
+    fclose(f);
+
+    if (rc < 0) cout << "Capture '" << fn << "' is truncated after " << recs.size() << " records" << endl;
+
+    // The threads write their records in batches, not in order of time
+    stable_sort(recs.begin(), recs.end(), earlier);
+    return 0;
+}
+
+
+// ------------------------------------------------------------------------------------
+// Statistics of a capture
+// ------------------------------------------------------------------------------------
+
+struct OpStats {
+    unsigned long long count, hits, notfound, errors;
+    vector<uint32_t> durs;
+
+    OpStats(): count(0), hits(0), notfound(0), errors(0) {}
+
+    uint32_t pct(double p) {
+        if (durs.empty()) return 0;
+        size_t i = (size_t)(p / 100.0 * (durs.size() - 1) + 0.5);
+        return durs[i];
+    }
+};
+
+static void summarize(const vector<UgrCapture::Record> &recs, OpStats st[UgrCapture::OpLast], double &secs) {
+    for (size_t i = 0; i < recs.size(); i++) {
+        const UgrCapture::Record &r = recs[i];
+        OpStats &s = st[r.op];
+        s.count++;
+        if (r.hit) s.hits++;
+        if (r.result == UgrCapture::ResNotFound) s.notfound++;
+        else if (r.result == UgrCapture::ResError) s.errors++;
+        s.durs.push_back(r.durus);
+    }
+    for (int op = 0; op < UgrCapture::OpLast; op++) sort(st[op].durs.begin(), st[op].durs.end());
+
+    secs = (recs.size() > 1) ? (recs.back().tns - recs.front().tns) / 1e9 : 0;
+}
+
+static int doStats(const string &fn) {
+    vector<UgrCapture::Record> recs;
+    if (load(fn, recs)) return 1;
+
+    OpStats st[UgrCapture::OpLast];
+    double secs;
+    summarize(recs, st, secs);
+
+    cout << recs.size() << " requests in " << secs << "s" << endl;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-12s %10s %9s %7s %9s %9s %10s %10s %10s %10s", "op", "count", "rate/s", "hit%",
+             "notfound", "errors", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    cout << buf << endl;
+
+    for (int op = 0; op < UgrCapture::OpLast; op++) {
+        OpStats &s = st[op];
+        if (!s.count) continue;
+        snprintf(buf, sizeof(buf), "%-12s %10llu %9.1f %7.1f %9llu %9llu %10u %10u %10u %10u", UgrCapture::opName(op), s.count,
+                 secs > 0 ? s.count / secs : 0.0, 100.0 * s.hits / s.count, s.notfound, s.errors,
+                 s.pct(50), s.pct(90), s.pct(99), s.durs.back());
+        cout << buf << endl;
+    }
+    return 0;
+}
+
+
+/// Change the prefix of a name, if it has it
+static string mapName(const string &lfn, const string &mapfrom, const string &mapto) {
+    if (!mapfrom.empty() && !lfn.compare(0, mapfrom.size(), mapfrom))
+        return mapto + lfn.substr(mapfrom.size());
+    return lfn;
+}
+
+
+/// B may have been replayed with the names mapped, A's are mapped the same way to pair them
+static int doCompare(const string &fa, const string &fb, const string &mapfrom, const string &mapto) {
+    vector<UgrCapture::Record> ra, rb;
+    if (load(fa, ra) || load(fb, rb)) return 1;
+
+    OpStats sa[UgrCapture::OpLast], sb[UgrCapture::OpLast];
+    double secsa, secsb;
+    summarize(ra, sa, secsa);
+    summarize(rb, sb, secsb);
+
+    // Pair the requests for the same op and name, in the order they came,
+    // to count the ones whose outcome changed
+    map<pair<int, string>, deque<const UgrCapture::Record *> > pending;
+    for (size_t i = 0; i < ra.size(); i++)
+        pending[make_pair((int)ra[i].op, mapName(ra[i].lfn, mapfrom, mapto))].push_back(&ra[i]);
+
+    unsigned long long paired[UgrCapture::OpLast] = {0}, hitdiff[UgrCapture::OpLast] = {0}, resdiff[UgrCapture::OpLast] = {0};
+    for (size_t i = 0; i < rb.size(); i++) {
+        deque<const UgrCapture::Record *> &q = pending[make_pair((int)rb[i].op, rb[i].lfn)];
+        if (q.empty()) continue;
+        const UgrCapture::Record *a = q.front();
+        q.pop_front();
+
+        paired[a->op]++;
+        if (a->hit != rb[i].hit) hitdiff[a->op]++;
+        if (a->result != rb[i].result) resdiff[a->op]++;
+    }
+
+    unsigned long long npaired = 0;
+    for (int op = 0; op < UgrCapture::OpLast; op++) npaired += paired[op];
+
+    cout << "A: " << fa << ", " << ra.size() << " requests in " << secsa << "s" << endl;
+    cout << "B: " << fb << ", " << rb.size() << " requests in " << secsb << "s" << endl;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-12s %-7s %10s %11s %11s %11s %11s", "op", "", "count", "hit%", "p50(us)", "p90(us)", "p99(us)");
+    cout << buf << endl;
+
+    for (int op = 0; op < UgrCapture::OpLast; op++) {
+        OpStats &a = sa[op], &b = sb[op];
+        if (!a.count && !b.count) continue;
+
+        double ha = a.count ? 100.0 * a.hits / a.count : 0, hb = b.count ? 100.0 * b.hits / b.count : 0;
+        snprintf(buf, sizeof(buf), "%-12s %-7s %10llu %11.1f %11u %11u %11u", UgrCapture::opName(op), "A",
+                 a.count, ha, a.pct(50), a.pct(90), a.pct(99));
+        cout << buf << endl;
+        snprintf(buf, sizeof(buf), "%-12s %-7s %10llu %11.1f %11u %11u %11u", "", "B",
+                 b.count, hb, b.pct(50), b.pct(90), b.pct(99));
+        cout << buf << endl;
+
+        double d50 = a.pct(50) ? 100.0 * ((double)b.pct(50) - a.pct(50)) / a.pct(50) : 0;
+        double d90 = a.pct(90) ? 100.0 * ((double)b.pct(90) - a.pct(90)) / a.pct(90) : 0;
+        double d99 = a.pct(99) ? 100.0 * ((double)b.pct(99) - a.pct(99)) / a.pct(99) : 0;
+        snprintf(buf, sizeof(buf), "%-12s %-7s %10s %+11.1f %+10.1f%% %+10.1f%% %+10.1f%%", "", "B-A", "", hb - ha, d50, d90, d99);
+        cout << buf << endl;
+
+        if (paired[op])
+            cout << "             " << paired[op] << " paired, " << hitdiff[op] << " changed hit/miss, " <<
+                resdiff[op] << " changed result" << endl;
+    }
+
+    if (!npaired && ra.size() && rb.size())
+        cout << "No request of B has the name of one of A, hit/miss and results cannot be compared. " <<
+            "If B was replayed with --map, give the same --map" << endl;
+    return 0;
+}
+
+
+// ------------------------------------------------------------------------------------
+// Replay
+// ------------------------------------------------------------------------------------
+
+static struct {
+    double speed;
+    int threads;
+    string out;
+    string mapfrom, mapto;
+    string client;
+    size_t limit;
+} cfg;
+
+static void replayer(UgrConnector *ugr, const vector<UgrCapture::Record> *recs, std::atomic<size_t> *next,
+                     uint64_t tstart, std::atomic<unsigned long long> *late, std::atomic<unsigned long long> *maxlateus) {
+    uint64_t t0rec = (*recs)[0].tns;
+
+    for (;;) {
+        size_t i = next->fetch_add(1);
+        if (i >= recs->size()) break;
+        const UgrCapture::Record &r = (*recs)[i];
+
+        if (cfg.speed > 0) {
+            uint64_t when = tstart + (uint64_t)((r.tns - t0rec) / cfg.speed);
+            sleepUntil(when);
+
+            uint64_t lateus = (nowns() - when) / 1000;
+            if (lateus > 1000) (*late)++;
+            unsigned long long m = maxlateus->load();
+            while ((lateus > m) && !maxlateus->compare_exchange_weak(m, lateus));
+        }
+
+        string lfn = mapName(r.lfn, cfg.mapfrom, cfg.mapto);
+
+        UgrClientInfo cli(cfg.client.empty() ? r.client : cfg.client);
+        UgrFileInfo *fi = 0;
+
+        switch (r.op) {
+            case UgrCapture::OpStat:
+                ugr->stat(lfn, cli, &fi);
+                break;
+            case UgrCapture::OpLocate:
+                ugr->locate(lfn, cli, &fi);
+                break;
+            case UgrCapture::OpList:
+                ugr->list(lfn, cli, &fi);
+                break;
+            case UgrCapture::OpNewLocation: {
+                UgrReplicaVec repls;
+                ugr->findNewLocation(lfn, 1024, cli, repls);
+                break;
+            }
+        }
+    }
+}
+
+static int doReplay(char *cfgfile, const string &fn) {
+    vector<UgrCapture::Record> recs;
+    if (load(fn, recs)) return 1;
+    if (recs.empty()) {
+        cout << "Nothing to replay" << endl;
+        return 1;
+    }
+    if (cfg.limit && (recs.size() > cfg.limit)) recs.resize(cfg.limit);
+
+    UgrConnector ugr;
+
+    cout << "Initializing" << endl;
+    if (ugr.init(cfgfile))
+        return 1;
+
+    if (!cfg.out.empty()) {
+        if (UgrCapture::get()->isOn())
+            cout << "The config already captures the requests, --out is ignored" << endl;
+        else if (UgrCapture::get()->start(cfg.out, 1024*1024)) {
+            cout << "Cannot capture into '" << cfg.out << "'" << endl;
+            return 1;
+        }
+    }
+
+    double span = (recs.back().tns - recs.front().tns) / 1e9;
+    cout << "Replaying " << recs.size() << " requests, captured in " << span << "s, " <<
+        ((cfg.speed > 0) ? "at " + to_string(cfg.speed) + "x" : string("as fast as possible")) <<
+        " with " << cfg.threads << " threads" << endl;
+
+    std::atomic<size_t> next(0);
+    std::atomic<unsigned long long> late(0), maxlateus(0);
+    boost::thread_group tg;
+    uint64_t tstart = nowns();
+
+    for (int i = 0; i < cfg.threads; i++)
+        tg.create_thread(boost::bind(replayer, &ugr, &recs, &next, tstart, &late, &maxlateus));
+    tg.join_all();
+
+    double secs = (nowns() - tstart) / 1e9;
+    cout << "Replayed in " << secs << "s, " << recs.size() / secs << " requests/s" << endl;
+    if (cfg.speed > 0) {
+        cout << late << " requests started more than 1ms late, the latest by " << maxlateus / 1000 << "ms" << endl;
+        if (late > recs.size() / 100)
+            cout << "Too many late requests, the replay is not faithful. Use more threads or a lower speed" << endl;
+    }
+
+    if (!cfg.out.empty() && UgrCapture::get()->isOn()) {
+        UgrCapture::get()->stop();
+        cout << endl;
+        return doCompare(fn, cfg.out, cfg.mapfrom, cfg.mapto);
+    }
+    return 0;
+}
+
+
+static void usage(const char *me) {
+    cout << "Usage: " << me << " replay <cfgfile> <capture> [options]" << endl <<
+        "         --speed <x>         the speed, relative to the capture. 0 is as fast as possible (1)" << endl <<
+        "         --threads <n>       the threads that send the requests (64)" << endl <<
+        "         --out <capture>     capture the replayed requests, then compare them with the original" << endl <<
+        "         --map <from>:<to>   change the prefix of the names, e.g. to the ones of a test federation" << endl <<
+        "         --client <ip>       the client address, instead of the captured ones" << endl <<
+        "         --limit <n>         replay only the first n requests" << endl <<
+        "       " << me << " stats <capture>" << endl <<
+        "       " << me << " compare <capture A> <capture B> [--map <from>:<to>]" << endl;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 3) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    string cmd = argv[1];
+    if ((cmd == "stats") && (argc == 3)) return doStats(argv[2]);
+    if ((cmd == "compare") && (argc == 4)) return doCompare(argv[2], argv[3], "", "");
+    if ((cmd == "compare") && (argc == 6) && (string(argv[4]) == "--map")) {
+        string v = argv[5];
+        size_t c = v.find(':');
+        if (c != string::npos) return doCompare(argv[2], argv[3], v.substr(0, c), v.substr(c + 1));
+    }
+    if ((cmd != "replay") || (argc < 4)) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    cfg.speed = 1.0;
+    cfg.threads = 64;
+    cfg.limit = 0;
+
+    for (int i = 4; i < argc; i++) {
+        string a = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            exit(1);
+        }
+        string v = argv[++i];
+
+        if (a == "--speed") cfg.speed = atof(v.c_str());
+        else if (a == "--threads") cfg.threads = atoi(v.c_str());
+        else if (a == "--out") cfg.out = v;
+        else if (a == "--client") cfg.client = v;
+        else if (a == "--limit") cfg.limit = atol(v.c_str());
+        else if (a == "--map") {
+            size_t c = v.find(':');
+            if (c == string::npos) {
+                usage(argv[0]);
+                exit(1);
+            }
+            cfg.mapfrom = v.substr(0, c);
+            cfg.mapto = v.substr(c + 1);
+        }
+        else {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if ((cfg.speed < 0) || (cfg.threads < 1)) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    return doReplay(argv[2], argv[3]);
+}
@@ -0,0 +1,187 @@
+#include <string>
+#include <sstream>
+#include <set>
+#include <benchmark/benchmark.h>
+#include <UgrConnector.hh>
+#include <UgrMemcached.pb.h>
+
+
+// Decoding of the lists of subitems that come from the external cache.
+// This dominates the CPU when browsing directories that are in the cache
+
+static std::string make_subdirs(int n){
+    ugrmemcached::SerialUgrSubdirs dirlist;
+    std::set<std::string> names;
+
+    for(int i = 0; i < n; i++){
+        std::ostringstream ss;
+        ss << "some_reasonably_long_file_name_" << i << ".root";
+        names.insert(ss.str());
+    }
+    for(std::set<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+        dirlist.add_subdirs()->set_name(*it);
+
+    return dirlist.SerializeAsString();
+}
+
+static std::string make_replicas(int n){
+    ugrmemcached::SerialUgrReplicas replist;
+
+    for(int i = 0; i < n; i++){
+        std::ostringstream ss;
+        ss << "https://storage" << i << ".example.org:443/some/path/to/the/file.root";
+        ugrmemcached::SerialUgrReplica *r = replist.add_replicas();
+        r->set_name(ss.str());
+        r->set_location("Somewhere");
+        r->set_latitude(0.8);
+        r->set_longitude(0.1);
+        r->set_pluginid(i % 16);
+    }
+
+    return replist.SerializeAsString();
+}
+
+
+static void BM_decodeSubdirs(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/dir";
+    std::string buf = make_subdirs(state.range(0));
+
+    for (auto _ : state){
+        UgrFileInfo fi(c, lfn);
+        fi.unixflags = S_IFDIR;
+        fi.decodeSubitems((void *)buf.c_str(), buf.length());
+        benchmark::DoNotOptimize(fi.subdirs.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * buf.length());
+}
+BENCHMARK(BM_decodeSubdirs)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+
+/// How the subdirs were decoded before: a full message, then a copy of every item,
+/// inserted with a comparator that takes its arguments by value
+class LegacyItemComp {
+public:
+    bool operator()(UgrFileItem s1, UgrFileItem s2) const {
+        return (s1.name < s2.name);
+    }
+};
+
+static void BM_decodeSubdirsLegacy(benchmark::State& state){
+    std::string buf = make_subdirs(state.range(0));
+
+    for (auto _ : state){
+        std::set<UgrFileItem, LegacyItemComp> subdirs;
+        ugrmemcached::SerialUgrSubdirs dirlist;
+        ugrmemcached::SerialUgrSubdir dir;
+
+        dirlist.ParseFromArray(buf.c_str(), buf.length());
+        for (int i = 0; i < dirlist.subdirs_size(); i++) {
+            UgrFileItem itr;
+
+            dir = dirlist.subdirs(i);
+            itr.name = dir.name();
+            subdirs.insert(itr);
+        }
+        benchmark::DoNotOptimize(subdirs.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * buf.length());
+}
+BENCHMARK(BM_decodeSubdirsLegacy)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_decodeReplicas(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/file";
+    std::string buf = make_replicas(state.range(0));
+
+    for (auto _ : state){
+        UgrFileInfo fi(c, lfn);
+        fi.unixflags = 0;
+        fi.decodeSubitems((void *)buf.c_str(), buf.length());
+        benchmark::DoNotOptimize(fi.replicas.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_decodeReplicas)->RangeMultiplier(4)->Range(4, 1024);
+
+
+// Encoding, done for every item that is sent to the external cache
+
+static void BM_encodeFileInfo(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/file";
+    UgrFileInfo fi(c, lfn);
+    fi.size = 123456789;
+    fi.atime = fi.mtime = fi.ctime = 1500000000;
+    fi.unixflags = S_IFREG | 0644;
+    fi.owner = fi.group = "atlas";
+
+    std::string buf;
+    for (auto _ : state){
+        fi.encodeToString(buf);
+        benchmark::DoNotOptimize(buf.data());
+    }
+}
+BENCHMARK(BM_encodeFileInfo);
+
+
+static void BM_decodeFileInfo(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/file";
+    std::string buf;
+    {
+        UgrFileInfo fi(c, lfn);
+        fi.size = 123456789;
+        fi.atime = fi.mtime = fi.ctime = 1500000000;
+        fi.unixflags = S_IFREG | 0644;
+        fi.owner = fi.group = "atlas";
+        fi.encodeToString(buf);
+    }
+
+    UgrFileInfo fi(c, lfn);
+    for (auto _ : state){
+        fi.decode((void *)buf.c_str(), buf.length());
+        benchmark::DoNotOptimize(fi.size);
+    }
+}
+BENCHMARK(BM_decodeFileInfo);
+
+
+static void BM_encodeSubdirs(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/dir";
+    std::string buf = make_subdirs(state.range(0));
+
+    UgrFileInfo fi(c, lfn);
+    fi.unixflags = S_IFDIR;
+    fi.decodeSubitems((void *)buf.c_str(), buf.length());
+
+    for (auto _ : state){
+        fi.encodeSubitemsToString(buf);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * buf.length());
+}
+BENCHMARK(BM_encodeSubdirs)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_encodeReplicas(benchmark::State& state){
+    UgrConnector c;
+    std::string lfn = "/some/file";
+    std::string buf = make_replicas(state.range(0));
+
+    UgrFileInfo fi(c, lfn);
+    fi.unixflags = 0;
+    fi.decodeSubitems((void *)buf.c_str(), buf.length());
+
+    for (auto _ : state){
+        fi.encodeSubitemsToString(buf);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_encodeReplicas)->RangeMultiplier(4)->Range(4, 1024);
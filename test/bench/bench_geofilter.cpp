@@ -0,0 +1,79 @@
+#include <string>
+#include <sstream>
+#include <benchmark/benchmark.h>
+#include <UgrConnector.hh>
+#include <UgrMockFn.hh>
+#include <plugins/geo_maxmindDB/UgrGeoPlugin_mmdb.hh>
+
+
+// The whole filtering and sorting of the replicas of a locate, with the geo plugin.
+// Built only if libmaxminddb is there. The plugin gets no db, the locations of the
+// replicas and of the client are given as if they had been looked up already
+
+static const std::string bench_client = "188.184.9.234";
+
+/// The geo plugin, with the location of the client already in its cache
+class BenchGeoPlugin : public UgrGeoPlugin_mmdb {
+public:
+    BenchGeoPlugin(UgrConnector &c, std::vector<std::string> &parms): UgrGeoPlugin_mmdb(c, parms) {
+        UgrGeoClientLoc loc;
+        loc.latitude = 0.8;
+        loc.longitude = 0.1;
+        clientcache.put(clientSubnet(bench_client), loc);
+        mmdb_ok = true;
+    }
+};
+
+/// A connector with no location plugins, that takes the filters it's given
+class BenchFilterConnector : public UgrConnector {
+public:
+    void addFilter(FilterPlugin *f) { filterPlugins.push_back(f); }
+};
+
+static bool bench_online(UgrConnector *, const UgrFileItem_replica &) { return false; }
+
+
+static UgrReplicaVec make_replicas(int n){
+    UgrReplicaVec reps;
+
+    for(int i = 0; i < n; i++){
+        std::ostringstream ss;
+        ss << "https://storage" << i << ".example.org:443/some/path/to/the/file.root";
+        UgrFileItem_replica r;
+        r.name = ss.str();
+        r.latitude = (float)((i % 37) - 18) / 20.0;
+        r.longitude = (float)((i % 53) - 26) / 10.0;
+        r.pluginID = i % 16;
+        reps.push_back(r);
+    }
+
+    return reps;
+}
+
+
+/// range(0) replicas, sorting the closest range(1) of them (0 means all)
+static void BM_filterAndSortGeo(benchmark::State& state){
+    std::function<bool (UgrConnector*, const UgrFileItem_replica&)> prevstatus = replicasStatusObj;
+    replicasStatusObj = bench_online;
+    UgrCFG->SetLong("glb.filterplugin.mmdb.sorttopk", state.range(1));
+
+    BenchFilterConnector c;
+    std::vector<std::string> parms;
+    parms.push_back("libugrgeoplugin_mmdb.so");
+    parms.push_back("geo");
+    parms.push_back("/nonexistent/GeoLite2-City.mmdb");
+    c.addFilter(new BenchGeoPlugin(c, parms));
+
+    UgrReplicaVec reps = make_replicas(state.range(0));
+    UgrClientInfo cli(bench_client);
+
+    for (auto _ : state){
+        UgrReplicaVec r(reps);
+        c.filterAndSortReplicaList(r, cli);
+        benchmark::DoNotOptimize(r.front().tempDistance);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+
+    replicasStatusObj = prevstatus;
+}
+BENCHMARK(BM_filterAndSortGeo)->ArgsProduct({benchmark::CreateRange(2, 512, 4), {0, 3}});
@@ -0,0 +1,100 @@
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <math.h>
+#include <benchmark/benchmark.h>
+#include <LocationInfo.hh>
+#include <UgrLRUCache.hh>
+
+
+// Sorting of the replicas by distance from the client, done by the geo plugin at every locate.
+// Both versions include the copy of the list, that the sort works on
+
+static UgrReplicaVec make_replicas(int n){
+    UgrReplicaVec reps;
+
+    // Some replicas are in the same places
+    for(int i = 0; i < n; i++){
+        std::ostringstream ss;
+        ss << "https://storage" << i << ".example.org:443/some/path/to/the/file.root";
+        UgrFileItem_replica r;
+        r.name = ss.str();
+        r.latitude = (float)((i % 37) - 18) / 20.0;
+        r.longitude = (float)((i % 53) - 26) / 10.0;
+        r.pluginID = i % 16;
+        reps.push_back(r);
+    }
+
+    return reps;
+}
+
+static bool bench_lessthan(const UgrFileItem_replica &i, const UgrFileItem_replica &j) { return (i.tempDistance < j.tempDistance); }
+
+
+static void bench_distances(UgrReplicaVec &r, float cli_latitude, float cli_longitude){
+    for (UgrReplicaVec::iterator i = r.begin(); i != r.end(); i++) {
+        float x, y;
+        x = (i->longitude-cli_longitude) * cos( (cli_latitude+i->latitude)/2 );
+        y = (i->latitude-cli_latitude);
+        i->tempDistance = x*x + y*y;
+    }
+}
+
+
+/// How the replicas were sorted before: all of them
+static void BM_geoSortLegacy(benchmark::State& state){
+    UgrReplicaVec reps = make_replicas(state.range(0));
+    float cli_latitude = 0.8, cli_longitude = 0.1;
+
+    for (auto _ : state){
+        UgrReplicaVec r(reps);
+        bench_distances(r, cli_latitude, cli_longitude);
+        std::sort(r.begin(), r.end(), bench_lessthan);
+        benchmark::DoNotOptimize(r.front().tempDistance);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_geoSortLegacy)->RangeMultiplier(4)->Range(2, 512);
+
+
+/// Only the closest k replicas are sorted (0 means all), as glb.filterplugin.mmdb.sorttopk
+static void BM_geoSortTopK(benchmark::State& state){
+    UgrReplicaVec reps = make_replicas(state.range(0));
+    size_t k = state.range(1);
+    float cli_latitude = 0.8, cli_longitude = 0.1;
+
+    for (auto _ : state){
+        UgrReplicaVec r(reps);
+        bench_distances(r, cli_latitude, cli_longitude);
+        if ((k > 0) && (k < r.size()))
+            std::partial_sort(r.begin(), r.begin() + k, r.end(), bench_lessthan);
+        else
+            std::sort(r.begin(), r.end(), bench_lessthan);
+        benchmark::DoNotOptimize(r.front().tempDistance);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_geoSortTopK)->ArgsProduct({benchmark::CreateRange(2, 512, 4), {0, 3}});
+
+
+/// The lookup of the location of a client in the cache of the subnets
+static void BM_geoClientCache(benchmark::State& state){
+    UgrLRUCache<std::string, std::pair<float, float> > cache(state.range(0), 3600);
+    std::vector<std::string> keys;
+
+    for (int i = 0; i < state.range(0); i++) {
+        std::string k = "4";
+        k += (char)(i & 0xff);
+        k += (char)((i >> 8) & 0xff);
+        k += (char)((i >> 16) & 0xff);
+        keys.push_back(k);
+        cache.put(k, std::make_pair(0.8f, 0.1f));
+    }
+
+    size_t i = 0;
+    for (auto _ : state){
+        std::pair<float, float> loc;
+        benchmark::DoNotOptimize(cache.get(keys[i++ % keys.size()], loc));
+    }
+}
+BENCHMARK(BM_geoClientCache)->Range(16, 65536);
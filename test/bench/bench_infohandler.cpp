@@ -0,0 +1,158 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+#include <benchmark/benchmark.h>
+#include <UgrConnector.hh>
+
+
+// The 1st level cache of the items, that every request goes through.
+// The items are not looked up in the external cache, the handler has none
+
+static std::string make_lfn(int i){
+    char buf[128];
+    snprintf(buf, sizeof(buf), "/myfed/atlas/mc16_13TeV/dir%04d/AOD.12345678._%06d.pool.root.1", i % 1000, i);
+    return buf;
+}
+
+static void fill_handler(LocationInfoHandler &h, UgrConnector &c, int n){
+    for (int i = 0; i < n; i++) {
+        std::string lfn = make_lfn(i);
+        h.getFileInfoOrCreateNewOne(c, lfn, false);
+    }
+}
+
+static void init_handler(LocationInfoHandler &h, long maxitems){
+    UgrCFG->SetLong("infohandler.maxitems", maxitems);
+    UgrCFG->SetLong("infohandler.itemttl", 3600);
+    UgrCFG->SetLong("infohandler.itemmaxttl", 86400);
+    h.Init(0);
+}
+
+
+static const int bench_hititems = 100000;
+
+static LocationInfoHandler *hit_handler(UgrConnector &c){
+    static LocationInfoHandler *h = 0;
+    if (!h) {
+        h = new LocationInfoHandler();
+        init_handler(*h, 1000000);
+        fill_handler(*h, c, bench_hititems);
+    }
+    return h;
+}
+
+/// Lookups of items that are in memory, from many threads
+static void BM_infoHandlerHit(benchmark::State& state){
+    static UgrConnector c;
+    static LocationInfoHandler *h;
+    static std::vector<std::string> lfns;
+
+    if (state.thread_index() == 0) {
+        h = hit_handler(c);
+        if (lfns.empty())
+            for (int i = 0; i < 4096; i++) lfns.push_back(make_lfn((i * 7919) % bench_hititems));
+    }
+
+    size_t n = state.thread_index() * 1024;
+    for (auto _ : state){
+        std::string lfn = lfns[n++ % lfns.size()];
+        benchmark::DoNotOptimize(h->getFileInfoOrCreateNewOne(c, lfn, false));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_infoHandlerHit)->ThreadRange(1, 64)->UseRealTime();
+
+
+/// Lookups of new items, from many threads. The handler is full, every new item
+/// makes the least recently used one go away
+static void BM_infoHandlerMiss(benchmark::State& state){
+    static UgrConnector c;
+    static LocationInfoHandler *h = 0;
+
+    if ((state.thread_index() == 0) && !h) {
+        h = new LocationInfoHandler();
+        init_handler(*h, bench_hititems);
+        fill_handler(*h, c, bench_hititems);
+    }
+
+    char buf[128];
+    unsigned long n = 0;
+    for (auto _ : state){
+        snprintf(buf, sizeof(buf), "/myfed/cms/store/mc/thread%d/%lu.root", state.thread_index(), n++);
+        std::string lfn = buf;
+        benchmark::DoNotOptimize(h->getFileInfoOrCreateNewOne(c, lfn, false));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_infoHandlerMiss)->ThreadRange(1, 64)->UseRealTime();
+
+
+/// A new item in a full handler of range(0) items, that has to purge the least recently used one
+static void BM_infoHandlerPurgeLRU(benchmark::State& state){
+    UgrConnector c;
+    LocationInfoHandler h;
+    init_handler(h, state.range(0));
+    fill_handler(h, c, state.range(0) + 1);
+
+    char buf[128];
+    unsigned long n = 0;
+    for (auto _ : state){
+        snprintf(buf, sizeof(buf), "/myfed/cms/store/mc/%lu.root", n++);
+        std::string lfn = buf;
+        benchmark::DoNotOptimize(h.getFileInfoOrCreateNewOne(c, lfn, false));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_infoHandlerPurgeLRU)->RangeMultiplier(10)->Range(10000, 1000000);
+
+
+/// The periodic garbage collection of range(0) items. With range(1) nothing expired,
+/// which is what happens at most of the ticks, otherwise they all expired
+static void BM_infoHandlerPurgeExpired(benchmark::State& state){
+    UgrConnector c;
+    LocationInfoHandler h;
+    init_handler(h, 2 * state.range(0));
+    bool expired = (state.range(1) == 0);
+    std::vector<UgrFileInfo *> items;
+
+    for (auto _ : state){
+        state.PauseTiming();
+        if (items.empty()) {
+            for (int i = 0; i < state.range(0); i++) {
+                std::string lfn = make_lfn(i);
+                items.push_back(h.getFileInfoOrCreateNewOne(c, lfn, false));
+            }
+        }
+        if (expired) {
+            for (size_t i = 0; i < items.size(); i++)
+                items[i]->lastreftime = 0;
+        }
+        state.ResumeTiming();
+
+        h.tick();
+
+        if (expired) items.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_infoHandlerPurgeExpired)->ArgsProduct({{10000, 100000, 1000000}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+
+/// The normalization of the names, done for every lookup
+static void BM_trimpath(benchmark::State& state){
+    std::vector<std::string> paths;
+    paths.push_back("/myfed/atlas/mc16_13TeV/AOD.12345678._000123.pool.root.1");
+    paths.push_back("/myfed/atlas/mc16_13TeV/");
+    paths.push_back("/myfed/atlas/mc16_13TeV///");
+    paths.push_back("");
+
+    std::string s;
+    size_t n = 0;
+    for (auto _ : state){
+        s = paths[n++ % paths.size()];
+        UgrFileInfo::trimpath(s);
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+BENCHMARK(BM_trimpath);
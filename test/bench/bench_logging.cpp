@@ -0,0 +1,53 @@
+#include <string>
+#include <sstream>
+#include <benchmark/benchmark.h>
+#include <SimpleDebug.hh>
+
+
+// Formatting of a log message like the ones of the Info macros, without writing it.
+// This is what a thread pays for every message when the log level is high
+
+static const std::string bench_lfn = "/myfed/atlas/mc16_13TeV/AOD.12345678._000123.pool.root.1";
+
+
+/// How the messages were formatted before: a new ostringstream and a copy of its string
+static void BM_logFormatStream(benchmark::State& state){
+    size_t n = 0;
+    for (auto _ : state){
+        std::ostringstream outs;
+        outs << ugrlogname << " " << "UgrConnector::do_Stat" << " " << __func__ << " : " <<
+          "Stat of '" << bench_lfn << "' done. pluginID: " << n++ % 16 << " size: " << 123456789L;
+        std::string s = outs.str();
+        benchmark::DoNotOptimize(s.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_logFormatStream)->ThreadRange(1, 8);
+
+
+/// The buffers of the thread, reused
+static void BM_logFormatLine(benchmark::State& state){
+    size_t n = 0;
+    for (auto _ : state){
+        UgrLogLine ugrlogline;
+        std::ostream &outs = ugrlogline.stream();
+        outs << ugrlogname << " " << "UgrConnector::do_Stat" << " " << __func__ << " : " <<
+          "Stat of '" << bench_lfn << "' done. pluginID: " << n++ % 16 << " size: " << 123456789L;
+        benchmark::DoNotOptimize(ugrlogline.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_logFormatLine)->ThreadRange(1, 8);
+
+
+/// A message whose level is not being logged
+static void BM_logInfoDisabled(benchmark::State& state){
+    DebugSetLevel(1);
+    size_t n = 0;
+    for (auto _ : state){
+        Info(UgrLogger::Lvl3, "UgrConnector::do_Stat", "Stat of '" << bench_lfn << "' done. pluginID: " << n % 16);
+        benchmark::DoNotOptimize(n++);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_logInfoDisabled);
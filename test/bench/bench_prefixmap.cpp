@@ -0,0 +1,162 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <UgrPrefixMap.hh>
+#include <UgrConnector.hh>
+
+
+// Translation of the names with the prefixes of the config, done for every request
+// by the n2n and by every plugin that gets it. The tables look like the ones of a
+// federation of many sites, many of them sharing the first part of the prefix
+
+static std::vector<std::string> make_prefixes(int n){
+    static const char *vos[] = {"atlas", "cms", "lhcb", "alice", "dteam", "belle"};
+    std::vector<std::string> pfxs;
+
+    for(int i = 0; i < n; i++){
+        std::ostringstream ss;
+        ss << "/myfed/" << vos[i % 6] << "/site" << i / 6 << "/data";
+        pfxs.push_back(ss.str());
+    }
+
+    return pfxs;
+}
+
+static std::vector<std::string> make_paths(const std::vector<std::string> &pfxs){
+    std::vector<std::string> paths;
+
+    // Mostly hits, some misses that share the beginning
+    for(size_t i = 0; i < 64; i++){
+        if (i % 8 == 7)
+            paths.push_back("/myfed/atlas/elsewhere/mc16_13TeV/AOD.12345678._000123.pool.root.1");
+        else
+            paths.push_back(pfxs[(i * 7) % pfxs.size()] + "/mc16_13TeV/AOD.12345678._000123.pool.root.1");
+    }
+
+    return paths;
+}
+
+static bool bench_desclen(const std::string &a, const std::string &b) { return (a.size() > b.size()); }
+
+
+/// How the names were translated before: the prefixes sorted by length, compared one by one
+static void BM_xlateLegacy(benchmark::State& state){
+    std::vector<std::string> pfxs = make_prefixes(state.range(0));
+    std::vector<std::string> paths = make_paths(pfxs);
+    std::sort(pfxs.begin(), pfxs.end(), bench_desclen);
+    std::string xlateto = "/dpm/cern.ch/home";
+
+    size_t n = 0;
+    for (auto _ : state){
+        const std::string &from = paths[n++ % paths.size()];
+        std::string to;
+
+        for (size_t i = 0; i < pfxs.size(); i++) {
+            if (from.compare(0, pfxs[i].length(), pfxs[i]) == 0) {
+                to = xlateto + from.substr(pfxs[i].length());
+                break;
+            }
+        }
+        if (to.empty()) to = from;
+        benchmark::DoNotOptimize(to.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_xlateLegacy)->RangeMultiplier(4)->Range(4, 1024);
+
+
+/// The trie, translating into a string that is reused
+static void BM_xlateMap(benchmark::State& state){
+    std::vector<std::string> pfxs = make_prefixes(state.range(0));
+    std::vector<std::string> paths = make_paths(pfxs);
+    UgrPrefixMap map;
+    for (size_t i = 0; i < pfxs.size(); i++) map.add(pfxs[i], "/dpm/cern.ch/home");
+
+    size_t n = 0;
+    std::string to;
+    for (auto _ : state){
+        const std::string &from = paths[n++ % paths.size()];
+        int r = map.match(from);
+
+        if (r >= 0) map.apply(r, from, to);
+        else to = from;
+        benchmark::DoNotOptimize(to.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_xlateMap)->RangeMultiplier(4)->Range(4, 1024);
+
+
+/// The trie, translating into a fixed buffer
+static void BM_xlateMapBuffer(benchmark::State& state){
+    std::vector<std::string> pfxs = make_prefixes(state.range(0));
+    std::vector<std::string> paths = make_paths(pfxs);
+    UgrPrefixMap map;
+    for (size_t i = 0; i < pfxs.size(); i++) map.add(pfxs[i], "/dpm/cern.ch/home");
+
+    size_t n = 0;
+    char buf[4096];
+    for (auto _ : state){
+        const std::string &from = paths[n++ % paths.size()];
+        int r = map.match(from);
+
+        if (r >= 0) map.apply(r, from.c_str(), from.size(), buf, sizeof(buf));
+        benchmark::DoNotOptimize(buf);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_xlateMapBuffer)->RangeMultiplier(4)->Range(4, 1024);
+
+
+/// The prefixes that are below a dir, as when listing the parents of the prefixes
+static void BM_xlateBelow(benchmark::State& state){
+    std::vector<std::string> pfxs = make_prefixes(state.range(0));
+    UgrPrefixMap map;
+    for (size_t i = 0; i < pfxs.size(); i++) map.add(pfxs[i], "/");
+
+    std::vector<int> below;
+    for (auto _ : state){
+        map.below("/myfed/cms", below);
+        benchmark::DoNotOptimize(below.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_xlateBelow)->RangeMultiplier(4)->Range(4, 1024);
+
+
+/// A plugin that lets the benchmark call its translation
+class BenchXlatePlugin : public LocationPlugin {
+public:
+    BenchXlatePlugin(UgrConnector &c, std::vector<std::string> &parms): LocationPlugin(c, parms) {}
+    using LocationPlugin::doNameXlation;
+};
+
+/// The whole translation of a plugin, as done for every op that it gets
+static void BM_doNameXlation(benchmark::State& state){
+    std::vector<std::string> pfxs = make_prefixes(state.range(0));
+    std::vector<std::string> paths = make_paths(pfxs);
+
+    std::string v;
+    for (size_t i = 0; i < pfxs.size(); i++) v += pfxs[i] + " ";
+    v += "/dpm/cern.ch/home";
+    UgrCFG->SetString("locplugin.benchxlate.xlatepfx", (char *)v.c_str());
+
+    UgrConnector c;
+    std::vector<std::string> parms;
+    parms.push_back("libbench.so");
+    parms.push_back("benchxlate");
+    parms.push_back("0");
+    BenchXlatePlugin p(c, parms);
+
+    size_t n = 0;
+    std::string to, altpfx;
+    for (auto _ : state){
+        std::string from = paths[n++ % paths.size()];
+        p.doNameXlation(from, to, LocationPlugin::wop_Stat, altpfx);
+        benchmark::DoNotOptimize(to.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_doNameXlation)->RangeMultiplier(4)->Range(4, 1024);
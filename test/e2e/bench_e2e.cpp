@@ -0,0 +1,393 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/* ugr_bench_e2e
+ * Start ugr_mockstorage with a number of endpoints, load a location plugin
+ * for each one of them, then hammer the connector with stat, locate and list
+ * from many threads and report the throughput and the latencies.
+ *
+ * The names are random in the namespace of the mock, hence the cache of the
+ * connector helps only as much as it would with a real, big namespace.
+ *
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <boost/thread.hpp>
+#include "UgrConnector.hh"
+#include "UgrMetrics.hh"
+#include "UgrTrace.hh"
+
+using namespace std;
+
+
+static struct {
+    string mock;
+    string plugin;
+    string type;
+    int endpoints;
+    int conc;
+    int threads;
+    int seconds;
+    vector<string> ops;
+    int dirs;
+    int files;
+    string coverage;
+    string replicas;
+    string latency;
+    string errorrate;
+    string hanguprate;
+    long cacheitems;
+    double minok;
+    bool keep;
+    int debug;
+} cfg;
+
+
+struct OpResult {
+    string op;
+    unsigned long long ok, failed;
+    double secs;
+    UgrMetricHistogram hist;
+};
+
+
+static unsigned long long percentile(const UgrMetricHistogram &h, double frac) {
+    vector<unsigned long long> counts;
+    unsigned long long sumus;
+    h.snapshot(counts, sumus);
+
+    unsigned long long tot = 0, n = 0;
+    for (size_t i = 0; i < counts.size(); i++) tot += counts[i];
+    for (size_t i = 0; i < counts.size(); i++) {
+        n += counts[i];
+        if (tot && (n >= tot * frac)) return UgrMetricHistogram::bucketEnd(i);
+    }
+    return 0;
+}
+
+
+static pid_t startMock(const string &portfile) {
+    vector<string> args;
+    args.push_back(cfg.mock);
+    args.push_back("--endpoints"); args.push_back(to_string(cfg.endpoints));
+    args.push_back("--portfile"); args.push_back(portfile);
+    args.push_back("--dirs"); args.push_back(to_string(cfg.dirs));
+    args.push_back("--files"); args.push_back(to_string(cfg.files));
+    args.push_back("--coverage"); args.push_back(cfg.coverage);
+    args.push_back("--replicas"); args.push_back(cfg.replicas);
+    args.push_back("--latency"); args.push_back(cfg.latency);
+    args.push_back("--error-rate"); args.push_back(cfg.errorrate);
+    args.push_back("--hangup-rate"); args.push_back(cfg.hanguprate);
+
+    vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++) argv.push_back((char *)args[i].c_str());
+    argv.push_back(0);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The connector may exit() on a bad config, the mock goes with it
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execv(argv[0], &argv[0]);
+        perror("Cannot start the mock storage");
+        _exit(127);
+    }
+    return pid;
+}
+
+
+/// Wait for the mock to write its ports
+static int readPorts(const string &portfile, pid_t mock, vector<int> &ports) {
+    for (int i = 0; i < 1000; i++) {
+        ifstream f(portfile.c_str());
+        int p;
+        ports.clear();
+        while (f >> p) ports.push_back(p);
+        if ((int)ports.size() == cfg.endpoints) return 0;
+
+        int st;
+        if (waitpid(mock, &st, WNOHANG) == mock) return -1;
+        usleep(10000);
+    }
+    return -1;
+}
+
+
+static int writeConfig(const string &fn, const vector<int> &ports) {
+    ofstream f(fn.c_str());
+
+    f << "glb.debug: " << cfg.debug << endl <<
+         "glb.log_stderr: true" << endl <<
+         "glb.maxlistitems: " << max(cfg.dirs, cfg.files) + 10 << endl <<
+         "glb.waittimeout: 30" << endl <<
+         "infohandler.useextcache: false" << endl <<
+         "infohandler.maxitems: " << cfg.cacheitems << endl <<
+         "infohandler.itemttl: 2" << endl <<
+         "infohandler.itemmaxttl: 10" << endl <<
+         "infohandler.itemttl_negative: 1" << endl;
+
+    string scheme = (cfg.type == "s3") ? "s3" : ((cfg.type == "dav") ? "dav" : "http");
+    for (size_t i = 0; i < ports.size(); i++) {
+        string id = "mock" + to_string(i);
+        f << "glb.locplugin[]: " << cfg.plugin << " " << id << " " << cfg.conc << " " <<
+             scheme << "://127.0.0.1:" << ports[i] << "/ugrbench" << endl <<
+             "locplugin." << id << ".status_checking: false" << endl <<
+             "locplugin." << id << ".ssl_check: false" << endl;
+
+        if (cfg.type == "s3")
+            f << "locplugin." << id << ".s3.alternate: true" << endl <<
+                 "locplugin." << id << ".s3.pub_key: ugrbench" << endl <<
+                 "locplugin." << id << ".s3.priv_key: ugrbench" << endl <<
+                 "locplugin." << id << ".s3.region: mock" << endl <<
+                 "locplugin." << id << ".s3.signaturevalidity: 5" << endl;
+        else
+            f << "locplugin." << id << ".metalink_support: true" << endl;
+    }
+
+    f.close();
+    return f.fail() ? -1 : 0;
+}
+
+
+static void worker(UgrConnector *ugr, OpResult *res, int idx, std::atomic<bool> *stop,
+                   std::atomic<unsigned long long> *ok, std::atomic<unsigned long long> *failed) {
+    std::mt19937_64 rng(idx * 7919 + time(0));
+    UgrClientInfo cli("127.0.0.1");
+    char buf[64];
+
+    while (!stop->load()) {
+        int d = rng() % cfg.dirs;
+        string lfn;
+        if (res->op == "list")
+            sprintf(buf, "/dir%05d", d);
+        else
+            sprintf(buf, "/dir%05d/file%07d", d, (int)(rng() % cfg.files));
+        lfn = buf;
+
+        UgrFileInfo *fi = 0;
+        uint64_t t0 = UgrTrace::now();
+
+        if (res->op == "stat") ugr->stat(lfn, cli, &fi);
+        else if (res->op == "locate") ugr->locate(lfn, cli, &fi);
+        else ugr->list(lfn, cli, &fi);
+
+        res->hist.observe((UgrTrace::now() - t0) / 1000);
+
+        bool good = false;
+        if (fi) {
+            boost::lock_guard<UgrFileInfo> l(*fi);
+            if (res->op == "stat") good = (fi->getStatStatus() == UgrFileInfo::Ok);
+            else if (res->op == "locate") good = (fi->getLocationStatus() == UgrFileInfo::Ok) && fi->replicas.size();
+            else good = (fi->getItemsStatus() == UgrFileInfo::Ok);
+        }
+
+        if (good) (*ok)++;
+        else (*failed)++;
+    }
+}
+
+
+static void runOp(UgrConnector &ugr, OpResult &res) {
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long long> ok(0), failed(0);
+
+    boost::thread_group tg;
+    uint64_t t0 = UgrTrace::now();
+    for (int i = 0; i < cfg.threads; i++)
+        tg.create_thread(boost::bind(worker, &ugr, &res, i, &stop, &ok, &failed));
+
+    sleep(cfg.seconds);
+    stop = true;
+    tg.join_all();
+
+    res.secs = (UgrTrace::now() - t0) / 1e9;
+    res.ok = ok;
+    res.failed = failed;
+}
+
+
+static void usage(const char *me) {
+    cerr << "Usage: " << me << " --mock <ugr_mockstorage> --plugin <location plugin .so> [options]" << endl <<
+        "  --type <http|dav|s3>  the protocol of the plugin (dav)" << endl <<
+        "  --endpoints <n>       the endpoints, one plugin each (4)" << endl <<
+        "  --conc <n>            the worker threads of each plugin (10)" << endl <<
+        "  --threads <n>         the client threads (16)" << endl <<
+        "  --seconds <n>         the duration of each op (5)" << endl <<
+        "  --ops <list>          comma separated, among stat,locate,list (stat,locate,list)" << endl <<
+        "  --dirs <n>            the directories of the mock (100)" << endl <<
+        "  --files <n>           the files in each directory (1000)" << endl <<
+        "  --coverage <f>        the fraction of the files in each endpoint (1.0)" << endl <<
+        "  --replicas <n>        max replicas in a metalink (1)" << endl <<
+        "  --latency <dist>      the latency of the mock, see ugr_mockstorage (none)" << endl <<
+        "  --error-rate <f>      the requests that the mock fails (0)" << endl <<
+        "  --hangup-rate <f>     the connections that the mock drops (0)" << endl <<
+        "  --cacheitems <n>      the items of the cache of the connector (10000)" << endl <<
+        "  --min-ok <f>          fail if less than this fraction of the ops succeed (0.5)" << endl <<
+        "  --debug <n>           the log level of the connector (0)" << endl <<
+        "  --keep                keep the config in the temp dir" << endl;
+}
+
+int main(int argc, char **argv) {
+    cfg.type = "dav";
+    cfg.endpoints = 4;
+    cfg.conc = 10;
+    cfg.threads = 16;
+    cfg.seconds = 5;
+    cfg.dirs = 100;
+    cfg.files = 1000;
+    cfg.coverage = "1.0";
+    cfg.replicas = "1";
+    cfg.latency = "none";
+    cfg.errorrate = "0";
+    cfg.hanguprate = "0";
+    cfg.cacheitems = 10000;
+    cfg.minok = 0.5;
+    cfg.keep = false;
+    cfg.debug = 0;
+    string ops = "stat,locate,list";
+
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "--keep") {
+            cfg.keep = true;
+            continue;
+        }
+        if ((a == "-h") || (a == "--help") || (i + 1 >= argc)) {
+            usage(argv[0]);
+            return (a == "-h") || (a == "--help") ? 0 : 1;
+        }
+        string v = argv[++i];
+
+        if (a == "--mock") cfg.mock = v;
+        else if (a == "--plugin") cfg.plugin = v;
+        else if (a == "--type") cfg.type = v;
+        else if (a == "--endpoints") cfg.endpoints = atoi(v.c_str());
+        else if (a == "--conc") cfg.conc = atoi(v.c_str());
+        else if (a == "--threads") cfg.threads = atoi(v.c_str());
+        else if (a == "--seconds") cfg.seconds = atoi(v.c_str());
+        else if (a == "--ops") ops = v;
+        else if (a == "--dirs") cfg.dirs = atoi(v.c_str());
+        else if (a == "--files") cfg.files = atoi(v.c_str());
+        else if (a == "--coverage") cfg.coverage = v;
+        else if (a == "--replicas") cfg.replicas = v;
+        else if (a == "--latency") cfg.latency = v;
+        else if (a == "--error-rate") cfg.errorrate = v;
+        else if (a == "--hangup-rate") cfg.hanguprate = v;
+        else if (a == "--cacheitems") cfg.cacheitems = atol(v.c_str());
+        else if (a == "--min-ok") cfg.minok = atof(v.c_str());
+        else if (a == "--debug") cfg.debug = atoi(v.c_str());
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    stringstream ss(ops);
+    string op;
+    while (getline(ss, op, ',')) {
+        if ((op != "stat") && (op != "locate") && (op != "list")) {
+            cerr << "Unknown op '" << op << "'" << endl;
+            return 1;
+        }
+        cfg.ops.push_back(op);
+    }
+
+    if (cfg.mock.empty() || cfg.plugin.empty() || cfg.ops.empty() || (cfg.endpoints < 1) || (cfg.threads < 1) ||
+        (cfg.dirs < 1) || (cfg.files < 1) || ((cfg.type != "http") && (cfg.type != "dav") && (cfg.type != "s3"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char tmpl[] = "/tmp/ugr_bench_e2e.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("Cannot create the temp dir");
+        return 1;
+    }
+    string dir = tmpl;
+    string portfile = dir + "/ports";
+    string cfgfile = dir + "/ugr.conf";
+
+    pid_t mock = startMock(portfile);
+    vector<int> ports;
+    if ((mock < 0) || readPorts(portfile, mock, ports)) {
+        cerr << "The mock storage did not start" << endl;
+        if (mock > 0) kill(mock, SIGTERM);
+        return 1;
+    }
+
+    if (writeConfig(cfgfile, ports)) {
+        cerr << "Cannot write " << cfgfile << endl;
+        kill(mock, SIGTERM);
+        return 1;
+    }
+
+    vector<OpResult *> results;
+    int rc = 0;
+    {
+        UgrConnector ugr;
+        if (ugr.init((char *)cfgfile.c_str())) {
+            cerr << "Cannot initialize the connector with " << cfgfile << endl;
+            kill(mock, SIGTERM);
+            return 1;
+        }
+
+        for (size_t i = 0; i < cfg.ops.size(); i++) {
+            OpResult *r = new OpResult();
+            r->op = cfg.ops[i];
+            runOp(ugr, *r);
+            results.push_back(r);
+        }
+    }
+
+    kill(mock, SIGTERM);
+    waitpid(mock, 0, 0);
+
+    cout << endl << "type:" << cfg.type << " endpoints:" << cfg.endpoints << " threads:" << cfg.threads <<
+        " latency:" << cfg.latency << " error-rate:" << cfg.errorrate << endl;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-8s %12s %10s %10s %12s %12s", "op", "ops/s", "ok", "failed", "p50(us)", "p99(us)");
+    cout << buf << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        OpResult *r = results[i];
+        snprintf(buf, sizeof(buf), "%-8s %12.1f %10llu %10llu %12llu %12llu", r->op.c_str(), (r->ok + r->failed) / r->secs,
+                 r->ok, r->failed, percentile(r->hist, 0.5), percentile(r->hist, 0.99));
+        cout << buf << endl;
+
+        if ((r->ok + r->failed == 0) || (r->ok < cfg.minok * (r->ok + r->failed))) {
+            cerr << "Too few " << r->op << " succeeded" << endl;
+            rc = 1;
+        }
+        delete r;
+    }
+
+    if (!cfg.keep) {
+        unlink(cfgfile.c_str());
+        unlink(portfile.c_str());
+        rmdir(dir.c_str());
+    }
+    else cout << "Config in " << cfgfile << endl;
+
+    return rc;
+}
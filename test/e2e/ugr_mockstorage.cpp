@@ -0,0 +1,722 @@
+/*
+ *  Copyright (c) CERN 2026
+ *
+ *  Licensed under the Apache License, Version 2.0
+ *  See the LICENSE file for further information
+ *
+ */
+
+
+/* ugr_mockstorage
+ * A fake storage endpoint, to run the http, dav and s3 location plugins
+ * against something that answers reproducibly.
+ *
+ * It speaks just enough HTTP: HEAD and GET of the files, PROPFIND (depth 0 and 1),
+ * the ListObjects of S3 (a GET of the bucket with prefix/delimiter) and Metalink
+ * (a GET with Accept: application/metalink4+xml).
+ *
+ * The namespace is synthetic: <root>/dirNNNNN/fileNNNNNNN, nothing is stored.
+ * One process can listen on several ports, each one is an endpoint that holds
+ * a fraction of the files. The answers can be delayed following a distribution
+ * and some can fail on purpose.
+ *
+ * @author agent
+ * @date   Oct 2026
+ */
+
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+
+/// How long to wait before answering
+struct Latency {
+    enum Dist { None, Fixed, Uniform, Exp, LogNormal } dist;
+    double a, b;
+
+    Latency(): dist(None), a(0), b(0) {}
+
+    /// none | fixed:<ms> | uniform:<minms>:<maxms> | exp:<meanms> | lognormal:<medianms>:<sigma>
+    int parse(const string &s) {
+        double x = 0, y = 0;
+        char name[32];
+        int n = sscanf(s.c_str(), "%31[a-z]:%lf:%lf", name, &x, &y);
+        if (n < 1) return -1;
+
+        string d = name;
+        a = x; b = y;
+        if (d == "none") dist = None;
+        else if ((d == "fixed") && (n == 2)) dist = Fixed;
+        else if ((d == "uniform") && (n == 3) && (y >= x)) dist = Uniform;
+        else if ((d == "exp") && (n == 2)) dist = Exp;
+        else if ((d == "lognormal") && (n == 3)) dist = LogNormal;
+        else return -1;
+
+        return 0;
+    }
+
+    /// A sample, in us
+    long sample(std::mt19937_64 &rng) const {
+        double ms = 0;
+        switch (dist) {
+            case Fixed:
+                ms = a;
+                break;
+            case Uniform:
+                ms = std::uniform_real_distribution<double>(a, b)(rng);
+                break;
+            case Exp:
+                ms = std::exponential_distribution<double>(1.0 / a)(rng);
+                break;
+            case LogNormal:
+                ms = std::lognormal_distribution<double>(log(a), b)(rng);
+                break;
+            default:
+                break;
+        }
+        return (long)(ms * 1000);
+    }
+};
+
+
+/// The settings, from the command line
+static struct {
+    string root;
+    int ndirs;
+    int nfiles;
+    double coverage;
+    int replicas;
+    Latency latency;
+    double errorrate;
+    int errorcode;
+    double hanguprate;
+    int nendpoints;
+    int baseport;
+    string portfile;
+} cfg;
+
+/// The ports of the endpoints, in order
+static vector<int> ports;
+
+static std::atomic<unsigned long long> nrequests(0), nerrors(0), nhangups(0);
+
+
+// ------------------------------------------------------------------------------------
+// The namespace
+// ------------------------------------------------------------------------------------
+
+static uint64_t fnv1a(const string &s, uint64_t h = 14695981039346656037ULL) {
+    for (size_t i = 0; i < s.size(); i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static string dirName(int i) {
+    char buf[32];
+    sprintf(buf, "dir%05d", i);
+    return buf;
+}
+
+static string fileName(int j) {
+    char buf[32];
+    sprintf(buf, "file%07d", j);
+    return buf;
+}
+
+/// If an endpoint holds a file. The directories are everywhere
+static bool holds(int ep, const string &key) {
+    if (cfg.coverage >= 1.0) return true;
+    uint64_t h = fnv1a(key, 14695981039346656037ULL + ep * 0x9e3779b97f4a7c15ULL);
+    return (h % 1000000) < cfg.coverage * 1000000;
+}
+
+struct Entry {
+    enum Type { NotFound, Root, Dir, File } type;
+    int dir, file;
+    /// The path below the root, without leading slash, e.g. dir00001/file0000002
+    string key;
+    long long size;
+    time_t mtime;
+};
+
+/// Parse a number of exactly ndigits digits after a prefix
+static int parseIdx(const string &s, const char *pfx, size_t ndigits, int max) {
+    size_t l = strlen(pfx);
+    if ((s.size() != l + ndigits) || s.compare(0, l, pfx)) return -1;
+    int v = 0;
+    for (size_t i = l; i < s.size(); i++) {
+        if ((s[i] < '0') || (s[i] > '9')) return -1;
+        v = v * 10 + (s[i] - '0');
+    }
+    return (v < max) ? v : -1;
+}
+
+static void fillEntry(int ep, Entry &e) {
+    uint64_t h = fnv1a(e.key);
+    e.size = (e.type == Entry::File) ? (long long)(h % (16 * 1024 * 1024)) : 0;
+    e.mtime = 1500000000 + (h >> 20) % 10000000;
+    if ((e.type == Entry::File) && !holds(ep, e.key)) e.type = Entry::NotFound;
+}
+
+/// Find what a path is, for a given endpoint
+static void lookup(int ep, string path, Entry &e) {
+    e.type = Entry::NotFound;
+    e.dir = e.file = -1;
+    e.key.clear();
+
+    while ((path.size() > 1) && (path[path.size() - 1] == '/')) path.erase(path.size() - 1);
+    if (path.compare(0, cfg.root.size(), cfg.root)) return;
+
+    string rest = path.substr(cfg.root.size());
+    if (rest.empty() || (rest == "/")) {
+        e.type = Entry::Root;
+        fillEntry(ep, e);
+        return;
+    }
+    if (rest[0] != '/') return;
+    rest.erase(0, 1);
+
+    size_t p = rest.find('/');
+    e.dir = parseIdx(rest.substr(0, p), "dir", 5, cfg.ndirs);
+    if (e.dir < 0) return;
+
+    if (p == string::npos) {
+        e.type = Entry::Dir;
+        e.key = rest;
+        fillEntry(ep, e);
+        return;
+    }
+
+    e.file = parseIdx(rest.substr(p + 1), "file", 7, cfg.nfiles);
+    if (e.file < 0) return;
+
+    e.type = Entry::File;
+    e.key = rest;
+    fillEntry(ep, e);
+}
+
+
+// ------------------------------------------------------------------------------------
+// The answers
+// ------------------------------------------------------------------------------------
+
+static string httpDate(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+static string isoDate(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.000Z", &tm);
+    return buf;
+}
+
+/// In the queries a + is a space, not in the paths
+static string urlDecode(const string &s, bool query = false) {
+    string r;
+    for (size_t i = 0; i < s.size(); i++) {
+        if ((s[i] == '%') && (i + 2 < s.size())) {
+            r += (char)strtol(s.substr(i + 1, 2).c_str(), 0, 16);
+            i += 2;
+        }
+        else if (query && (s[i] == '+')) r += ' ';
+        else r += s[i];
+    }
+    return r;
+}
+
+static void parseQuery(const string &q, map<string, string> &args) {
+    size_t p = 0;
+    while (p < q.size()) {
+        size_t amp = q.find('&', p);
+        if (amp == string::npos) amp = q.size();
+        string kv = q.substr(p, amp - p);
+        size_t eq = kv.find('=');
+        if (eq == string::npos) args[urlDecode(kv, true)] = "";
+        else args[urlDecode(kv.substr(0, eq), true)] = urlDecode(kv.substr(eq + 1), true);
+        p = amp + 1;
+    }
+}
+
+static void propEntry(ostringstream &out, const string &href, const Entry &e) {
+    bool isdir = (e.type != Entry::File);
+    out << "<D:response><D:href>" << href << (isdir ? "/" : "") << "</D:href>"
+        "<D:propstat><D:prop>"
+        "<D:resourcetype>" << (isdir ? "<D:collection/>" : "") << "</D:resourcetype>"
+        "<D:getcontentlength>" << e.size << "</D:getcontentlength>"
+        "<D:getlastmodified>" << httpDate(e.mtime) << "</D:getlastmodified>"
+        "<D:creationdate>" << isoDate(e.mtime) << "</D:creationdate>"
+        "</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n";
+}
+
+/// The multistatus of a PROPFIND
+static void propfind(int ep, const string &path, const Entry &e, bool depth1, string &body) {
+    ostringstream out;
+    string href = path;
+    while ((href.size() > 1) && (href[href.size() - 1] == '/')) href.erase(href.size() - 1);
+
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<D:multistatus xmlns:D=\"DAV:\">\n";
+    propEntry(out, href, e);
+
+    if (depth1 && (e.type == Entry::Root)) {
+        for (int i = 0; i < cfg.ndirs; i++) {
+            Entry c;
+            lookup(ep, href + "/" + dirName(i), c);
+            propEntry(out, href + "/" + dirName(i), c);
+        }
+    }
+    else if (depth1 && (e.type == Entry::Dir)) {
+        for (int j = 0; j < cfg.nfiles; j++) {
+            Entry c;
+            lookup(ep, href + "/" + fileName(j), c);
+            if (c.type == Entry::File) propEntry(out, href + "/" + fileName(j), c);
+        }
+    }
+
+    out << "</D:multistatus>\n";
+    body = out.str();
+}
+
+/// The ListBucketResult of S3. The root is the bucket, the keys are the paths below it
+static void s3list(int ep, map<string, string> &args, string &body) {
+    const string &prefix = args["prefix"];
+    bool delim = (args["delimiter"] == "/");
+    size_t maxkeys = 1000;
+    if (!args["max-keys"].empty()) maxkeys = atol(args["max-keys"].c_str());
+    string marker = args.count("marker") ? args["marker"] : args["start-after"];
+
+    // The keys come out sorted, the names are zero padded
+    vector<pair<string, Entry> > contents;
+    vector<string> prefixes;
+    bool truncated = false;
+    string last;
+
+    for (int i = 0; (i < cfg.ndirs) && !truncated; i++) {
+        string d = dirName(i) + "/";
+        bool dinp = !d.compare(0, min(d.size(), prefix.size()), prefix, 0, min(d.size(), prefix.size()));
+        if (!dinp) continue;
+
+        if (delim && (prefix.size() < d.size())) {
+            if (d <= marker) continue;
+            if (contents.size() + prefixes.size() >= maxkeys) { truncated = true; break; }
+            prefixes.push_back(d);
+            last = d;
+            continue;
+        }
+
+        for (int j = 0; j < cfg.nfiles; j++) {
+            string k = d + fileName(j);
+            if (k.compare(0, prefix.size(), prefix) || (k <= marker)) continue;
+
+            Entry c;
+            lookup(ep, cfg.root + "/" + k, c);
+            if (c.type != Entry::File) continue;
+
+            if (contents.size() + prefixes.size() >= maxkeys) { truncated = true; break; }
+            contents.push_back(make_pair(k, c));
+            last = k;
+        }
+    }
+
+    ostringstream out;
+    string bucket = cfg.root.substr(cfg.root.rfind('/') + 1);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">"
+        "<Name>" << bucket << "</Name><Prefix>" << prefix << "</Prefix><Marker>" << marker << "</Marker>"
+        "<MaxKeys>" << maxkeys << "</MaxKeys>" << (delim ? "<Delimiter>/</Delimiter>" : "") <<
+        "<IsTruncated>" << (truncated ? "true" : "false") << "</IsTruncated>";
+    if (truncated) out << "<NextMarker>" << last << "</NextMarker>";
+    out << "\n";
+
+    for (size_t i = 0; i < contents.size(); i++)
+        out << "<Contents><Key>" << contents[i].first << "</Key>"
+            "<LastModified>" << isoDate(contents[i].second.mtime) << "</LastModified>"
+            "<ETag>\"" << hex << fnv1a(contents[i].first) << dec << "\"</ETag>"
+            "<Size>" << contents[i].second.size << "</Size><StorageClass>STANDARD</StorageClass></Contents>\n";
+    for (size_t i = 0; i < prefixes.size(); i++)
+        out << "<CommonPrefixes><Prefix>" << prefixes[i] << "</Prefix></CommonPrefixes>\n";
+
+    out << "</ListBucketResult>\n";
+    body = out.str();
+}
+
+/// The Metalink of a file, with the endpoints that hold it
+static void metalink(int ep, const string &path, const Entry &e, string &body) {
+    ostringstream out;
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">\n"
+        "<file name=\"" << e.key.substr(e.key.rfind('/') + 1) << "\">\n"
+        "<size>" << e.size << "</size>\n";
+
+    // This endpoint first, then the others that have the file
+    int n = 0;
+    for (int i = 0; (i < cfg.nendpoints) && (n < cfg.replicas); i++) {
+        int other = (ep + i) % cfg.nendpoints;
+        if (!holds(other, e.key)) continue;
+        out << "<url priority=\"" << ++n << "\">http://127.0.0.1:" << ports[other] << path << "</url>\n";
+    }
+
+    out << "</file>\n</metalink>\n";
+    body = out.str();
+}
+
+
+// ------------------------------------------------------------------------------------
+// The connections
+// ------------------------------------------------------------------------------------
+
+struct Request {
+    string method, path, query, version;
+    map<string, string> headers;
+};
+
+static int writeAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t r = send(fd, buf, len, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/// Read a request from the connection. The data beyond it stays in pending
+/// @return 0 if ok, -1 if the connection is over
+static int readRequest(int fd, string &pending, Request &req) {
+    size_t hend;
+    char buf[16384];
+
+    while ((hend = pending.find("\r\n\r\n")) == string::npos) {
+        if (pending.size() > 65536) return -1;
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        pending.append(buf, r);
+    }
+
+    string head = pending.substr(0, hend);
+    pending.erase(0, hend + 4);
+
+    istringstream in(head);
+    string line, target;
+    getline(in, line);
+    istringstream rl(line);
+    rl >> req.method >> target >> req.version;
+    if (req.method.empty() || target.empty()) return -1;
+
+    size_t q = target.find('?');
+    req.path = urlDecode(target.substr(0, q));
+    req.query = (q == string::npos) ? "" : target.substr(q + 1);
+
+    // Davix may send the absolute form
+    if (!req.path.compare(0, 7, "http://")) {
+        size_t s = req.path.find('/', 7);
+        req.path = (s == string::npos) ? "/" : req.path.substr(s);
+    }
+
+    req.headers.clear();
+    while (getline(in, line)) {
+        if (!line.empty() && (line[line.size() - 1] == '\r')) line.erase(line.size() - 1);
+        size_t c = line.find(':');
+        if (c == string::npos) continue;
+        string k = line.substr(0, c);
+        for (size_t i = 0; i < k.size(); i++) k[i] = tolower(k[i]);
+        size_t v = line.find_first_not_of(" \t", c + 1);
+        req.headers[k] = (v == string::npos) ? "" : line.substr(v);
+    }
+
+    // The bodies of the requests (e.g. the props of a PROPFIND) are not interesting
+    size_t clen = req.headers.count("content-length") ? atol(req.headers["content-length"].c_str()) : 0;
+    while (pending.size() < clen) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        pending.append(buf, r);
+    }
+    pending.erase(0, clen);
+
+    return 0;
+}
+
+static int reply(int fd, int code, const char *reason, const string &hdrs, const string &body, bool head, bool keepalive,
+                 long long clen = -1) {
+    ostringstream out;
+    out << "HTTP/1.1 " << code << " " << reason << "\r\n"
+        "Server: ugr_mockstorage\r\n"
+        "Date: " << httpDate(time(0)) << "\r\n"
+        "Content-Length: " << ((clen >= 0) ? clen : (long long)body.size()) << "\r\n" <<
+        (keepalive ? "" : "Connection: close\r\n") << hdrs << "\r\n";
+    if (!head) out << body;
+
+    string s = out.str();
+    return writeAll(fd, s.data(), s.size());
+}
+
+/// Serve one request
+/// @return 0 to keep the connection, -1 to close it
+static int serve(int ep, int fd, Request &req, std::mt19937_64 &rng) {
+    nrequests++;
+
+    string conn = req.headers["connection"];
+    bool keepalive = (req.version == "HTTP/1.1") ? (conn != "close") : (conn == "keep-alive");
+
+    long us = cfg.latency.sample(rng);
+    if (us > 0) usleep(us);
+
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    if ((cfg.hanguprate > 0) && (u(rng) < cfg.hanguprate)) {
+        nhangups++;
+        return -1;
+    }
+    if ((cfg.errorrate > 0) && (u(rng) < cfg.errorrate)) {
+        nerrors++;
+        reply(fd, cfg.errorcode, "Injected Error", "", "", req.method == "HEAD", false);
+        return -1;
+    }
+
+    Entry e;
+    lookup(ep, req.path, e);
+
+    map<string, string> args;
+    parseQuery(req.query, args);
+
+    bool head = (req.method == "HEAD");
+    string body, hdrs;
+
+    if (req.method == "PROPFIND") {
+        if (e.type == Entry::NotFound)
+            return reply(fd, 404, "Not Found", "", "", false, keepalive) ? -1 : 0;
+
+        string depth = req.headers["depth"];
+        propfind(ep, req.path, e, (depth != "0"), body);
+        return reply(fd, 207, "Multi-Status", "Content-Type: application/xml; charset=utf-8\r\n", body, false, keepalive) ? -1 : 0;
+    }
+
+    if ((req.method != "GET") && !head)
+        return reply(fd, 405, "Method Not Allowed", "Allow: GET, HEAD, PROPFIND\r\n", "", false, keepalive) ? -1 : 0;
+
+    // A GET of the bucket with the arguments of a listing
+    if ((e.type == Entry::Root) && (args.count("prefix") || args.count("delimiter") || args.count("list-type"))) {
+        s3list(ep, args, body);
+        return reply(fd, 200, "OK", "Content-Type: application/xml\r\n", body, head, keepalive) ? -1 : 0;
+    }
+
+    if (e.type == Entry::NotFound)
+        return reply(fd, 404, "Not Found", "", "", head, keepalive) ? -1 : 0;
+
+    if ((e.type == Entry::File) && (args.count("metalink") || (req.headers["accept"].find("metalink") != string::npos))) {
+        metalink(ep, req.path, e, body);
+        return reply(fd, 200, "OK", "Content-Type: application/metalink4+xml\r\n", body, head, keepalive) ? -1 : 0;
+    }
+
+    ostringstream h;
+    h << "Last-Modified: " << httpDate(e.mtime) << "\r\n";
+    if (e.type == Entry::File) {
+        h << "ETag: \"" << hex << fnv1a(e.key) << dec << "\"\r\nAccept-Ranges: bytes\r\n"
+            "Content-Type: application/octet-stream\r\n";
+        // Some clients find the replicas here
+        if (cfg.replicas > 1)
+            h << "Link: <" << req.path << "?metalink>; rel=describedby; type=\"application/metalink4+xml\"\r\n";
+    }
+
+    if (head || (e.type != Entry::File))
+        return reply(fd, 200, "OK", h.str(), "", true, keepalive, e.size) ? -1 : 0;
+
+    // The content of the files is zeroes
+    if (reply(fd, 200, "OK", h.str(), "", true, keepalive, e.size)) return -1;
+    static const char zeroes[65536] = {0};
+    for (long long left = e.size; left > 0; left -= sizeof(zeroes))
+        if (writeAll(fd, zeroes, min<long long>(left, sizeof(zeroes)))) return -1;
+
+    return keepalive ? 0 : -1;
+}
+
+static void connection(int ep, int fd) {
+    std::mt19937_64 rng(fnv1a(to_string(fd)) ^ (uint64_t)time(0) ^ ((uint64_t)ep << 32));
+    string pending;
+    Request req;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    while (!readRequest(fd, pending, req))
+        if (serve(ep, fd, req, rng)) break;
+
+    close(fd);
+}
+
+static void acceptor(int ep, int lfd) {
+    for (;;) {
+        int fd = accept(lfd, 0, 0);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            usleep(10000);
+            continue;
+        }
+        boost::thread(connection, ep, fd).detach();
+    }
+}
+
+
+// ------------------------------------------------------------------------------------
+// Main
+// ------------------------------------------------------------------------------------
+
+static void usage(const char *me) {
+    cerr << "Usage: " << me << " [options]" << endl <<
+        "  --endpoints <n>       endpoints, on consecutive ports (1)" << endl <<
+        "  --port <p>            the first port, 0 for any free ones (0)" << endl <<
+        "  --portfile <file>     where to write the ports, one per line, once listening" << endl <<
+        "  --root <path>         the root of the namespace, also the S3 bucket (/ugrbench)" << endl <<
+        "  --dirs <n>            directories below the root (100)" << endl <<
+        "  --files <n>           files in each directory (1000)" << endl <<
+        "  --coverage <f>        the fraction of the files that each endpoint holds (1.0)" << endl <<
+        "  --replicas <n>        max replicas in a metalink (1)" << endl <<
+        "  --latency <dist>      none | fixed:<ms> | uniform:<min>:<max> | exp:<mean> | lognormal:<median>:<sigma> (none)" << endl <<
+        "  --error-rate <f>      the fraction of the requests that fail (0)" << endl <<
+        "  --error-code <n>      the status of the failures (503)" << endl <<
+        "  --hangup-rate <f>     the fraction of the requests whose connection is dropped (0)" << endl;
+}
+
+int main(int argc, char **argv) {
+    cfg.root = "/ugrbench";
+    cfg.ndirs = 100;
+    cfg.nfiles = 1000;
+    cfg.coverage = 1.0;
+    cfg.replicas = 1;
+    cfg.errorrate = 0;
+    cfg.errorcode = 503;
+    cfg.hanguprate = 0;
+    cfg.nendpoints = 1;
+    cfg.baseport = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if ((a == "-h") || (a == "--help")) {
+            usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        string v = argv[++i];
+
+        if (a == "--endpoints") cfg.nendpoints = atoi(v.c_str());
+        else if (a == "--port") cfg.baseport = atoi(v.c_str());
+        else if (a == "--portfile") cfg.portfile = v;
+        else if (a == "--root") cfg.root = v;
+        else if (a == "--dirs") cfg.ndirs = atoi(v.c_str());
+        else if (a == "--files") cfg.nfiles = atoi(v.c_str());
+        else if (a == "--coverage") cfg.coverage = atof(v.c_str());
+        else if (a == "--replicas") cfg.replicas = atoi(v.c_str());
+        else if (a == "--error-rate") cfg.errorrate = atof(v.c_str());
+        else if (a == "--error-code") cfg.errorcode = atoi(v.c_str());
+        else if (a == "--hangup-rate") cfg.hanguprate = atof(v.c_str());
+        else if (a == "--latency") {
+            if (cfg.latency.parse(v)) {
+                cerr << "Bad latency distribution '" << v << "'" << endl;
+                return 1;
+            }
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    while ((cfg.root.size() > 1) && (cfg.root[cfg.root.size() - 1] == '/')) cfg.root.erase(cfg.root.size() - 1);
+    if ((cfg.nendpoints < 1) || (cfg.ndirs < 0) || (cfg.ndirs > 99999) || (cfg.nfiles < 0) || (cfg.nfiles > 9999999) ||
+        (cfg.root.empty()) || (cfg.root[0] != '/')) {
+        cerr << "Bad parameters" << endl;
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // Block the signals that stop us, we wait for them below
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, 0);
+
+    vector<int> lfds;
+    for (int ep = 0; ep < cfg.nendpoints; ep++) {
+        int lfd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sa.sin_port = htons(cfg.baseport ? cfg.baseport + ep : 0);
+        socklen_t sl = sizeof(sa);
+
+        if ((lfd < 0) || bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) || listen(lfd, 1024) ||
+            getsockname(lfd, (struct sockaddr *)&sa, &sl)) {
+            perror("Cannot listen");
+            return 1;
+        }
+
+        ports.push_back(ntohs(sa.sin_port));
+        lfds.push_back(lfd);
+    }
+
+    for (int ep = 0; ep < cfg.nendpoints; ep++)
+        boost::thread(acceptor, ep, lfds[ep]).detach();
+
+    // Written at the end, whoever waits for it can connect at once
+    if (!cfg.portfile.empty()) {
+        string tmp = cfg.portfile + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if (!f) {
+            perror("Cannot write the port file");
+            return 1;
+        }
+        for (size_t i = 0; i < ports.size(); i++) fprintf(f, "%d\n", ports[i]);
+        fclose(f);
+        rename(tmp.c_str(), cfg.portfile.c_str());
+    }
+
+    for (size_t i = 0; i < ports.size(); i++)
+        cout << "Endpoint " << i << " listening on http://127.0.0.1:" << ports[i] << cfg.root << endl;
+
+    int sig = 0;
+    sigwait(&sigs, &sig);
+
+    cout << "Served " << nrequests << " requests, injected " << nerrors << " errors and " << nhangups << " hangups" << endl;
+    return 0;
+}
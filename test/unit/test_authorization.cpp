@@ -0,0 +1,106 @@
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <UgrConnector.hh>
+#include <UgrAuthorization.hh>
+
+
+static std::vector<std::string> no_groups;
+
+static std::vector<std::string> groups(const char *g1, const char *g2 = 0){
+    std::vector<std::string> v;
+    v.push_back(g1);
+    if (g2) v.push_back(g2);
+    return v;
+}
+
+
+TEST(authorizationTests, users){
+    std::vector<std::string> users, grps;
+    users.push_back("alice /fed/data rl");
+    users.push_back("\"/DC=ch/CN=Bob Smith\" /fed/ rwld");
+
+    UgrAuthzIndex idx;
+    idx.build(users, grps);
+    ASSERT_TRUE(idx.hasDirectives());
+
+    ASSERT_TRUE(idx.isallowed("t", "alice", no_groups, "/fed/data/f1", 'r'));
+    ASSERT_TRUE(idx.isallowed("t", "alice", no_groups, "/fed/data", 'l'));
+    ASSERT_FALSE(idx.isallowed("t", "alice", no_groups, "/fed/data/f1", 'w'));
+    ASSERT_FALSE(idx.isallowed("t", "alice", no_groups, "/fed/other", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "alice", no_groups, "/fed", 'r'));
+    // The resources are plain string prefixes
+    ASSERT_TRUE(idx.isallowed("t", "alice", no_groups, "/fed/database", 'r'));
+
+    ASSERT_TRUE(idx.isallowed("t", "/DC=ch/CN=Bob Smith", no_groups, "/fed/x", 'd'));
+    ASSERT_FALSE(idx.isallowed("t", "/DC=ch/CN=Bob", no_groups, "/fed/x", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "bob", no_groups, "/fed/data/f1", 'r'));
+}
+
+
+TEST(authorizationTests, modesAddUp){
+    std::vector<std::string> users, grps;
+    users.push_back("alice /fed/ r");
+    users.push_back("alice /fed/data/ w");
+
+    UgrAuthzIndex idx;
+    idx.build(users, grps);
+
+    ASSERT_TRUE(idx.isallowed("t", "alice", no_groups, "/fed/data/f1", 'r'));
+    ASSERT_TRUE(idx.isallowed("t", "alice", no_groups, "/fed/data/f1", 'w'));
+    ASSERT_FALSE(idx.isallowed("t", "alice", no_groups, "/fed/f1", 'w'));
+}
+
+
+TEST(authorizationTests, groups){
+    std::vector<std::string> users, grps;
+    grps.push_back("atlas /fed/atlas rl");
+    grps.push_back("/cms/* /fed/cms rwl");
+    grps.push_back("\"\" /fed/public r");
+
+    UgrAuthzIndex idx;
+    idx.build(users, grps);
+
+    ASSERT_TRUE(idx.isallowed("t", "u", groups("atlas"), "/fed/atlas/f", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "u", groups("atlas"), "/fed/atlas/f", 'w'));
+    ASSERT_FALSE(idx.isallowed("t", "u", groups("atlasprod"), "/fed/atlas/f", 'r'));
+    ASSERT_TRUE(idx.isallowed("t", "u", groups("x", "atlas"), "/fed/atlas/f", 'l'));
+
+    ASSERT_TRUE(idx.isallowed("t", "u", groups("/cms/Role=prod"), "/fed/cms/f", 'w'));
+    ASSERT_FALSE(idx.isallowed("t", "u", groups("/cmsx"), "/fed/cms/f", 'w'));
+    ASSERT_FALSE(idx.isallowed("t", "u", groups("/cms/Role=prod"), "/fed/atlas/f", 'r'));
+
+    // The empty group is for the clients that have none
+    ASSERT_TRUE(idx.isallowed("t", "u", no_groups, "/fed/public/f", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "u", groups("atlas"), "/fed/public/f", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "u", no_groups, "/fed/atlas/f", 'r'));
+}
+
+
+TEST(authorizationTests, badDirectives){
+    std::vector<std::string> users, grps;
+
+    UgrAuthzIndex empty;
+    empty.build(users, grps);
+    ASSERT_FALSE(empty.hasDirectives());
+
+    // A rule without modes grants nothing, a too short one stops the parsing
+    users.push_back("alice /fed/");
+    users.push_back("bob /fed/ r");
+    users.push_back("x");
+    users.push_back("carol /fed/ r");
+
+    UgrAuthzIndex idx;
+    idx.build(users, grps);
+    ASSERT_TRUE(idx.hasDirectives());
+
+    ASSERT_FALSE(idx.isallowed("t", "alice", no_groups, "/fed/f", 'r'));
+    ASSERT_TRUE(idx.isallowed("t", "bob", no_groups, "/fed/f", 'r'));
+    ASSERT_FALSE(idx.isallowed("t", "carol", no_groups, "/fed/f", 'r'));
+
+    users.clear();
+    users.push_back("\"unterminated /fed/ r");
+    UgrAuthzIndex idx2;
+    idx2.build(users, grps);
+    ASSERT_FALSE(idx2.isallowed("t", "\"unterminated", no_groups, "/fed/f", 'r'));
+}
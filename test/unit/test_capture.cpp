@@ -0,0 +1,97 @@
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <UgrCapture.hh>
+#include <LocationInfo.hh>
+
+
+static void captureSome(int n, const char *ip) {
+    UgrClientInfo cli(ip);
+    std::string lfn = "/fed/dir/file";
+    for (int i = 0; i < n; i++) {
+        UgrCaptureScope cap(UgrCapture::OpLocate, lfn, cli);
+        cap.result(UgrCapture::ResNotFound);
+    }
+}
+
+
+TEST(captureTests, writeRead){
+    std::string fn = "/tmp/ugr_test_capture.cap";
+    unlink(fn.c_str());
+
+    UgrCapture *c = UgrCapture::get();
+    unsigned long long w0 = c->getWritten();
+
+    // Not captured, it's off
+    captureSome(3, "10.0.0.1");
+
+    ASSERT_EQ(0, c->start(fn, 65536));
+    ASSERT_TRUE(c->isOn());
+
+    UgrClientInfo cli("2001:db8::1");
+    std::string lfn = "/fed/a/b/c";
+    {
+        UgrCaptureScope cap(UgrCapture::OpStat, lfn, cli);
+        cap.miss();
+        cap.result(UgrFileInfo::Ok);
+
+        // What is done on behalf of a request is not a request
+        UgrCaptureScope inner(UgrCapture::OpList, lfn, cli);
+        usleep(2000);
+    }
+
+    boost::thread t1(captureSome, 100, "10.0.0.2"), t2(captureSome, 100, "10.0.0.3");
+    t1.join();
+    t2.join();
+
+    c->stop();
+    ASSERT_FALSE(c->isOn());
+    ASSERT_EQ(201ULL, c->getWritten() - w0);
+
+    FILE *f;
+    ASSERT_EQ(0, UgrCapture::openFile(fn, f));
+
+    std::vector<UgrCapture::Record> recs;
+    UgrCapture::Record r;
+    int rc;
+    while ((rc = UgrCapture::read(f, r)) == 0) recs.push_back(r);
+    fclose(f);
+
+    ASSERT_EQ(1, rc);
+    ASSERT_EQ(201U, recs.size());
+
+    // The first thread's ring was drained first
+    ASSERT_EQ(UgrCapture::OpStat, recs[0].op);
+    ASSERT_EQ(UgrCapture::ResOk, recs[0].result);
+    ASSERT_FALSE(recs[0].hit);
+    ASSERT_EQ("2001:db8::1", recs[0].client);
+    ASSERT_EQ(lfn, recs[0].lfn);
+    ASSERT_LE(2000U, recs[0].durus);
+
+    int n2 = 0, n3 = 0;
+    for (size_t i = 1; i < recs.size(); i++) {
+        ASSERT_EQ(UgrCapture::OpLocate, recs[i].op);
+        ASSERT_EQ(UgrCapture::ResNotFound, recs[i].result);
+        ASSERT_TRUE(recs[i].hit);
+        ASSERT_EQ("/fed/dir/file", recs[i].lfn);
+        ASSERT_GE(recs[i].tns, recs[0].tns);
+        if (recs[i].client == "10.0.0.2") n2++;
+        if (recs[i].client == "10.0.0.3") n3++;
+    }
+    ASSERT_EQ(100, n2);
+    ASSERT_EQ(100, n3);
+}
+
+
+TEST(captureTests, badFile){
+    std::string fn = "/tmp/ugr_test_capture_bad.cap";
+    FILE *f = fopen(fn.c_str(), "w");
+    fputs("not a capture", f);
+    fclose(f);
+
+    ASSERT_NE(0, UgrCapture::openFile(fn, f));
+    unlink(fn.c_str());
+}
@@ -0,0 +1,69 @@
+#include <string>
+#include <stdio.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <UgrConfig.hh>
+
+
+static void writeconf(const char *fn, const char *content){
+    FILE *f = fopen(fn, "w");
+    ASSERT_TRUE(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+
+TEST(configTests, snapshot){
+    char fn[] = "/tmp/ugrtestconfXXXXXX";
+    int fd = mkstemp(fn);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    writeconf(fn,
+        "cfgtest.num: 42\n"
+        "cfgtest.flag: Yes\n"
+        "cfgtest.str: hello world\n"
+        "locplugin.*.cfgtest_timeout: 7\n"
+        "locplugin.ep1.cfgtest_timeout: 3\n");
+    ASSERT_EQ(0, UgrCFG->ProcessFile(fn));
+    unlink(fn);
+
+    ASSERT_EQ(42, UgrCFG->GetLong("cfgtest.num", 0));
+    ASSERT_EQ(5, UgrCFG->GetLong("cfgtest.missing", 5));
+    ASSERT_TRUE(UgrCFG->GetBool("cfgtest.flag", false));
+    ASSERT_EQ("hello world", UgrCFG->GetString("cfgtest.str", std::string("")));
+
+    // The locplugin parameters fall back to the wildcard
+    ASSERT_EQ(3, UgrCFG->GetLong("locplugin.ep1.cfgtest_timeout", 0));
+    ASSERT_EQ(7, UgrCFG->GetLong("locplugin.ep2.cfgtest_timeout", 0));
+
+    // ... but not with the char buffer version
+    char buf[64];
+    UgrCFG->GetString("locplugin.ep2.cfgtest_timeout", buf, (char *)"none");
+    ASSERT_STREQ("none", buf);
+
+    // A snapshot does not change while it's held
+    std::shared_ptr<const UgrConfigSnapshot> s = UgrCFG->GetSnapshot();
+    UgrCFG->SetLong("cfgtest.num", 43);
+    ASSERT_EQ(42, s->GetLong("cfgtest.num", 0));
+    ASSERT_EQ(43, UgrCFG->GetLong("cfgtest.num", 0));
+}
+
+
+TEST(configTests, keys){
+    UgrConfigKey<long> num("cfgtest.keynum", 10);
+    UgrConfigKey<bool> flag("cfgtest.keyflag", false);
+
+    ASSERT_EQ(10, num.get());
+    ASSERT_FALSE(flag.get());
+
+    // The handles follow the changes
+    UgrCFG->SetLong("cfgtest.keynum", 20);
+    UgrCFG->SetString("cfgtest.keyflag", (char *)"true");
+    ASSERT_EQ(20, num.get());
+    ASSERT_TRUE(flag.get());
+
+    // A handle created later gets the current value
+    UgrConfigKey<long> num2("cfgtest.keynum", 0);
+    ASSERT_EQ(20, num2.get());
+}
@@ -0,0 +1,209 @@
+#include <string>
+#include <sstream>
+#include <gtest/gtest.h>
+#include <UgrConnector.hh>
+#include <ExtCacheHandler.hh>
+#include <ExtCacheBackend_shm.hh>
+#include <UgrMemcached.pb.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// The lists of subitems too big for one value, written as a manifest plus chunks.
+// The cache is a shared memory segment, that the tests also open on their own to
+// tamper with what the handler wrote
+
+static UgrConnector &chunks_connector(){
+    static UgrConnector c;
+    return c;
+}
+
+static std::string chunks_shm_setup(){
+    std::ostringstream ss;
+    ss << "/ugrtest_chunks_" << getpid() << "_" << rand();
+    std::string name = ss.str();
+
+    UgrCFG->SetString("extcache.backend", (char *)"shm");
+    UgrCFG->SetString("extcache.shm.name", (char *)name.c_str());
+    UgrCFG->SetLong("extcache.shm.nslots", 4096);
+    return name;
+}
+
+static void chunks_fill(UgrFileInfo &fi, int n){
+    fi.unixflags = S_IFREG;
+    for (int i = 0; i < n; i++) {
+        std::ostringstream ss;
+        ss << "https://storage" << i << ".example.org/some/path/to/the/file.root";
+        UgrFileItem_replica r;
+        r.name = ss.str();
+        r.location = "Somewhere";
+        r.pluginID = i % 4;
+        fi.replicas.insert(r);
+    }
+    fi.status_locations = UgrFileInfo::Ok;
+    fi.dirtyitems = true;
+}
+
+/// An item that a plugin is filling, with one replica already there
+static void chunks_partial(UgrFileInfo &fi){
+    UgrFileItem_replica r;
+    r.name = "https://plugin.example.org/the/file.root";
+    r.pluginID = 1;
+    fi.replicas.insert(r);
+}
+
+static int chunks_manifest(ExtCacheBackend &b, const std::string &lfn, ugrmemcached::SerialUgrChunkManifest &mf){
+    char *val = 0;
+    size_t len = 0;
+    if (b.get("itemsmf_" + lfn, &val, len)) return 1;
+    bool ok = mf.ParseFromArray(val, len - 1);
+    free(val);
+    return ok ? 0 : 1;
+}
+
+static std::string chunks_key(const ugrmemcached::SerialUgrChunkManifest &mf, int idx, const std::string &lfn){
+    char buf[64];
+    sprintf(buf, "itemsck_%llx_%d_", (long long)mf.generation(), idx);
+    return buf + lfn;
+}
+
+
+TEST(extCacheChunksTests, roundTrip){
+    std::string name = chunks_shm_setup();
+    ExtCacheHandler h;
+    h.Init();
+
+    std::string lfn = "/fed/big/file";
+    UgrFileInfo fi(chunks_connector(), lfn);
+    chunks_fill(fi, 2000);
+    ASSERT_EQ(0, h.putSubitems(&fi));
+
+    // It was written in chunks
+    ExtCacheBackendShm b;
+    ASSERT_EQ(0, b.Init());
+    ugrmemcached::SerialUgrChunkManifest mf;
+    ASSERT_EQ(0, chunks_manifest(b, lfn, mf));
+    ASSERT_GT(mf.nchunks(), 10);
+    ASSERT_EQ(2000, mf.nitems());
+
+    UgrFileInfo fi2(chunks_connector(), lfn);
+    ASSERT_EQ(0, h.getSubitems(&fi2));
+    ASSERT_EQ(UgrFileInfo::Ok, fi2.getLocationStatus());
+    ASSERT_EQ(fi.replicas.size(), fi2.replicas.size());
+    std::set<UgrFileItem_replica, UgrFileItemComp>::iterator i, j;
+    for (i = fi.replicas.begin(), j = fi2.replicas.begin(); i != fi.replicas.end(); ++i, ++j) {
+        ASSERT_EQ(i->name, j->name);
+        ASSERT_EQ(i->pluginID, j->pluginID);
+    }
+
+    shm_unlink(name.c_str());
+}
+
+
+TEST(extCacheChunksTests, incomplete){
+    std::string name = chunks_shm_setup();
+    ExtCacheHandler h;
+    h.Init();
+
+    std::string lfn = "/fed/big/file";
+    UgrFileInfo fi(chunks_connector(), lfn);
+    chunks_fill(fi, 2000);
+    ASSERT_EQ(0, h.putSubitems(&fi));
+
+    ExtCacheBackendShm b;
+    ASSERT_EQ(0, b.Init());
+    ugrmemcached::SerialUgrChunkManifest mf;
+    ASSERT_EQ(0, chunks_manifest(b, lfn, mf));
+
+    // A manifest of another generation, whose chunks are not there
+    ugrmemcached::SerialUgrChunkManifest mf2 = mf;
+    mf2.set_generation(mf.generation() + 1);
+    std::string smf = mf2.SerializeAsString();
+    ASSERT_EQ(0, b.set("itemsmf_" + lfn, smf.c_str(), smf.length() + 1, time(0) + 60));
+
+    UgrFileInfo fi2(chunks_connector(), lfn);
+    chunks_partial(fi2);
+    ASSERT_NE(0, h.getSubitems(&fi2));
+    ASSERT_EQ(1U, fi2.replicas.size());
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi2.getLocationStatus());
+
+    // Back to the right generation, but one chunk was evicted
+    smf = mf.SerializeAsString();
+    ASSERT_EQ(0, b.set("itemsmf_" + lfn, smf.c_str(), smf.length() + 1, time(0) + 60));
+    std::string ck = chunks_key(mf, mf.nchunks() / 2, lfn);
+    char *val = 0;
+    size_t len = 0;
+    ASSERT_EQ(0, b.get(ck, &val, len));
+    std::string saved(val, len);
+    free(val);
+    ASSERT_EQ(0, b.del(ck));
+
+    ASSERT_NE(0, h.getSubitems(&fi2));
+    ASSERT_EQ(1U, fi2.replicas.size());
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi2.getLocationStatus());
+
+    // A chunk that does not decode
+    std::string bad(64, '\xff');
+    ASSERT_EQ(0, b.set(ck, bad.c_str(), bad.length() + 1, time(0) + 60));
+
+    ASSERT_NE(0, h.getSubitems(&fi2));
+    ASSERT_EQ(1U, fi2.replicas.size());
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi2.getLocationStatus());
+
+    // All there again
+    ASSERT_EQ(0, b.set(ck, saved.c_str(), saved.length(), time(0) + 60));
+    ASSERT_EQ(0, h.getSubitems(&fi2));
+    ASSERT_EQ(2001U, fi2.replicas.size());
+    ASSERT_EQ(UgrFileInfo::Ok, fi2.getLocationStatus());
+
+    shm_unlink(name.c_str());
+}
+
+
+TEST(extCacheChunksTests, streaming){
+    std::string name = chunks_shm_setup();
+    ExtCacheHandler h;
+    h.Init();
+
+    std::string lfn = "/fed/big/file";
+    UgrFileInfo fi(chunks_connector(), lfn);
+    chunks_fill(fi, 2000);
+    ASSERT_EQ(0, h.putSubitems(&fi));
+
+    ExtCacheBackendShm b;
+    ASSERT_EQ(0, b.Init());
+    ugrmemcached::SerialUgrChunkManifest mf;
+    ASSERT_EQ(0, chunks_manifest(b, lfn, mf));
+
+    // All the chunks are there, the listing is complete
+    UgrFileInfo fi2(chunks_connector(), lfn);
+    ASSERT_EQ(0, h.getSubitems(&fi2, true));
+    ASSERT_EQ(2000U, fi2.replicas.size());
+    ASSERT_EQ(UgrFileInfo::Ok, fi2.getLocationStatus());
+
+    // One chunk was evicted: what arrived is merged, but the listing is not complete
+    std::string ck = chunks_key(mf, mf.nchunks() / 2, lfn);
+    ASSERT_EQ(0, b.del(ck));
+
+    UgrFileInfo fi3(chunks_connector(), lfn);
+    chunks_partial(fi3);
+    ASSERT_NE(0, h.getSubitems(&fi3, true));
+    ASSERT_GT(fi3.replicas.size(), 1U);
+    ASSERT_LT(fi3.replicas.size(), 2001U);
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi3.getLocationStatus());
+
+    // A chunk that does not decode merges nothing of its own
+    size_t npartial = fi3.replicas.size();
+    std::string bad(64, '\xff');
+    ASSERT_EQ(0, b.set(ck, bad.c_str(), bad.length() + 1, time(0) + 60));
+
+    UgrFileInfo fi4(chunks_connector(), lfn);
+    chunks_partial(fi4);
+    ASSERT_NE(0, h.getSubitems(&fi4, true));
+    ASSERT_EQ(npartial, fi4.replicas.size());
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi4.getLocationStatus());
+
+    shm_unlink(name.c_str());
+}
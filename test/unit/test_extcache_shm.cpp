@@ -0,0 +1,188 @@
+#include <string>
+#include <sstream>
+#include <gtest/gtest.h>
+#include <UgrConnector.hh>
+#include <ExtCacheBackend_shm.hh>
+#include <boost/thread.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static std::string shm_test_name(){
+    std::ostringstream ss;
+    ss << "/ugrtest_" << getpid() << "_" << rand();
+    return ss.str();
+}
+
+struct count_found {
+    int *n;
+    void operator()(int, const char *, size_t){ (*n)++; }
+};
+
+
+TEST(extCacheShmTests, setGetDel){
+    std::string name = shm_test_name();
+    UgrCFG->SetString("extcache.shm.name", (char *)name.c_str());
+
+    ExtCacheBackendShm b;
+    ASSERT_EQ(b.Init(), 0);
+
+    char *val = 0;
+    size_t len = 0;
+    ASSERT_NE(b.get("/some/file", &val, len), 0);
+
+    std::string v = "some value";
+    ASSERT_EQ(b.set("/some/file", v.c_str(), v.length(), time(0) + 60), 0);
+    ASSERT_EQ(b.get("/some/file", &val, len), 0);
+    ASSERT_EQ(std::string(val, len), v);
+    free(val);
+
+    // Overwriting does not duplicate the key
+    v = "another value";
+    ASSERT_EQ(b.set("/some/file", v.c_str(), v.length(), time(0) + 60), 0);
+    ASSERT_EQ(b.get("/some/file", &val, len), 0);
+    ASSERT_EQ(std::string(val, len), v);
+    free(val);
+
+    ASSERT_EQ(b.del("/some/file"), 0);
+    ASSERT_NE(b.get("/some/file", &val, len), 0);
+
+    // Expired values are not returned
+    ASSERT_EQ(b.set("/old/file", v.c_str(), v.length(), time(0) - 10 - 2592000), 0);
+    ASSERT_NE(b.get("/old/file", &val, len), 0);
+
+    // Too big for a slot
+    std::string big(b.maxValueSize() + 1024, 'x');
+    ASSERT_NE(b.set("/big", big.c_str(), big.length(), time(0) + 60), 0);
+
+    shm_unlink(name.c_str());
+}
+
+
+TEST(extCacheShmTests, sharedAndIncr){
+    std::string name = shm_test_name();
+    UgrCFG->SetString("extcache.shm.name", (char *)name.c_str());
+
+    ExtCacheBackendShm b1, b2;
+    ASSERT_EQ(b1.Init(), 0);
+    ASSERT_EQ(b2.Init(), 0);
+
+    // Two mappings of the same segment see the same data
+    std::string v = "shared";
+    ASSERT_EQ(b1.set("k", v.c_str(), v.length(), time(0) + 60), 0);
+
+    char *val = 0;
+    size_t len = 0;
+    ASSERT_EQ(b2.get("k", &val, len), 0);
+    ASSERT_EQ(std::string(val, len), v);
+    free(val);
+
+    uint64_t n = 0;
+    ASSERT_EQ(b1.incr("ctr", 5, 0, n), 0);
+    ASSERT_EQ(n, 5ULL);
+    ASSERT_EQ(b2.incr("ctr", 5, 0, n), 0);
+    ASSERT_EQ(n, 6ULL);
+
+    std::vector<std::string> keys;
+    keys.push_back("k");
+    keys.push_back("missing");
+    keys.push_back("ctr");
+    int found = 0;
+    count_found cb;
+    cb.n = &found;
+    ASSERT_EQ(b2.mget(keys, cb), 0);
+    ASSERT_EQ(found, 2);
+
+    shm_unlink(name.c_str());
+}
+
+
+static void shm_stalled_writer(char *dst, const std::string &v1, const std::string &v2){
+    for (int i = 0; i < 20000; i++)
+        memcpy(dst, (i & 1) ? v2.c_str() : v1.c_str(), v1.length());
+}
+
+// A writer that stalled past the claim timeout, while another one took over its slot,
+// wrote and released it. The stalled one then goes on copying into the slot, that the
+// readers see as stable. Its steps are replayed here on the raw segment, whose layout is
+// the one of ExtCacheBackend_shm.cc: a header of 64 bytes, then slots of slotsize bytes
+// each one starting with seq, csum, keyhash, expiry, keylen, vallen in 64 bytes
+TEST(extCacheShmTests, stolenSlot){
+    std::string name = shm_test_name();
+    UgrCFG->SetString("extcache.shm.name", (char *)name.c_str());
+
+    ExtCacheBackendShm b;
+    ASSERT_EQ(b.Init(), 0);
+
+    std::string key = "/stolen/file";
+    std::string v1(1000, 'a');
+    ASSERT_EQ(b.set(key, v1.c_str(), v1.length(), time(0) + 60), 0);
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    ASSERT_GE(fd, 0);
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0);
+    char *seg = (char *)mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(seg, (char *)MAP_FAILED);
+
+    uint64_t slotsize = *(uint64_t *)(seg + 24);
+    char *slot = 0;
+    for (char *p = seg + 64; p + slotsize <= seg + st.st_size; p += slotsize)
+        if ((*(uint32_t *)(p + 32) == key.length()) && !memcmp(p + 64, key.c_str(), key.length())) {
+            slot = p;
+            break;
+        }
+    ASSERT_TRUE(slot != 0);
+    volatile uint64_t *seq = (volatile uint64_t *)slot;
+
+    // The stalled writer claimed the slot a long time ago
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t nowms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    *seq = (((nowms - 60000) & ((1ULL << 40) - 1)) << 24) | 1;
+
+    // Another writer takes it over, writes its value and releases it
+    std::string v2(1000, 'b');
+    ASSERT_EQ(b.set(key, v2.c_str(), v2.length(), time(0) + 60), 0);
+    ASSERT_EQ(*seq & 1, 0U);
+
+    char *val = 0;
+    size_t len = 0;
+    ASSERT_EQ(b.get(key, &val, len), 0);
+    ASSERT_EQ(std::string(val, len), v2);
+    free(val);
+
+    // The stalled writer wakes up and copies half of its value over the one of the thief
+    std::string v3(1000, 'c');
+    memcpy(slot + 64 + key.length(), v3.c_str(), v3.length() / 2);
+
+    // The seq is even and stable, yet the mix must not be returned
+    ASSERT_NE(b.get(key, &val, len), 0);
+
+    // The same from a thread that reads while another one keeps replaying the stalled writer
+    boost::thread t(boost::bind(shm_stalled_writer, slot + 64 + key.length(), v2, v3));
+    for (int i = 0; i < 20000; i++) {
+        val = 0;
+        if (!b.get(key, &val, len)) {
+            std::string got(val, len);
+            free(val);
+            ASSERT_TRUE(got == v2);
+        }
+    }
+    t.join();
+
+    // The next write makes it good again
+    ASSERT_EQ(b.set(key, v1.c_str(), v1.length(), time(0) + 60), 0);
+    ASSERT_EQ(b.get(key, &val, len), 0);
+    ASSERT_EQ(std::string(val, len), v1);
+    free(val);
+
+    munmap(seg, st.st_size);
+    shm_unlink(name.c_str());
+}
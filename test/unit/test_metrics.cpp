@@ -0,0 +1,86 @@
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <UgrMetrics.hh>
+
+
+TEST(metricsTests, buckets){
+    // Every value falls in one bucket, whose end is above it and within 25%
+    int prev = 0;
+    for (unsigned long long v = 0; v < 100000000ULL; v = v * 5 / 4 + 1) {
+        int b = UgrMetricHistogram::bucket(v);
+        ASSERT_GE(b, prev);
+        ASSERT_LT(v, UgrMetricHistogram::bucketEnd(b));
+        if (b > 0) {
+            ASSERT_GE(v, UgrMetricHistogram::bucketEnd(b - 1));
+            ASSERT_LE(UgrMetricHistogram::bucketEnd(b) - UgrMetricHistogram::bucketEnd(b - 1), v / 4 + 1);
+        }
+        prev = b;
+    }
+
+    ASSERT_EQ(UgrMetricHistogram::nbuckets - 1, UgrMetricHistogram::bucket(~0ULL));
+}
+
+
+static void metrics_incr(UgrMetricCounter *c, UgrMetricHistogram *h){
+    for (int i = 0; i < 10000; i++) {
+        c->inc();
+        h->observe(i % 100);
+    }
+}
+
+TEST(metricsTests, threads){
+    UgrMetricCounter *c = UgrMetrics::get()->counter("test_metrics_threads", "test", "t=\"1\"");
+    UgrMetricHistogram *h = UgrMetrics::get()->histogram("test_metrics_lat_seconds", "test");
+
+    // Same name and labels, same metric
+    ASSERT_EQ(c, UgrMetrics::get()->counter("test_metrics_threads", "test", "t=\"1\""));
+
+    boost::thread_group g;
+    for (int i = 0; i < 8; i++) g.create_thread(boost::bind(metrics_incr, c, h));
+    g.join_all();
+
+    ASSERT_EQ(80000ULL, c->value());
+
+    std::vector<unsigned long long> counts;
+    unsigned long long sum;
+    h->snapshot(counts, sum);
+    unsigned long long n = 0;
+    for (size_t i = 0; i < counts.size(); i++) n += counts[i];
+    ASSERT_EQ(80000ULL, n);
+    ASSERT_EQ(8ULL * 100 * 4950, sum);
+}
+
+
+static double metrics_gauge(){
+    return 42;
+}
+
+TEST(metricsTests, render){
+    UgrMetrics *m = UgrMetrics::get();
+    m->counter("test_metrics_render", "A test", "x=\"" + UgrMetrics::escapeLabel("a\"b") + "\"")->inc(3);
+    int g = m->gauge("test_metrics_gauge", "A gauge", "", metrics_gauge);
+
+    std::string out;
+    m->render(out);
+    ASSERT_NE(std::string::npos, out.find("# TYPE test_metrics_render counter\n"));
+    ASSERT_NE(std::string::npos, out.find("test_metrics_render_total{x=\"a\\\"b\"} 3\n"));
+    ASSERT_NE(std::string::npos, out.find("test_metrics_gauge 42\n"));
+    ASSERT_NE(std::string::npos, out.find("ugr_stage_duration_seconds_bucket{stage=\"request\",le=\"+Inf\"}"));
+    ASSERT_EQ(out.size() - 6, out.rfind("# EOF\n"));
+
+    // le is less or equal, a value right on a power of two goes above it
+    UgrMetricHistogram *h = m->histogram("test_metrics_le_seconds", "test");
+    h->observe(15);
+    h->observe(16);
+    out.clear();
+    m->render(out);
+    ASSERT_NE(std::string::npos, out.find("test_metrics_le_seconds_bucket{le=\"0.000015\"} 1\n"));
+    ASSERT_NE(std::string::npos, out.find("test_metrics_le_seconds_bucket{le=\"0.000031\"} 2\n"));
+
+    m->removeGauge(g);
+    out.clear();
+    m->render(out);
+    ASSERT_EQ(std::string::npos, out.find("test_metrics_gauge 42"));
+}
@@ -0,0 +1,71 @@
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <UgrPrefixMap.hh>
+
+
+TEST(prefixMapTests, translate){
+    UgrPrefixMap m;
+    m.add("/myfed/atlas", "/dpm/cern.ch/home/atlas");
+    m.add("/myfed/atlas/disk", "/disk");
+    m.add("/myfed/cms", "");
+
+    std::string out;
+
+    // The longest prefix wins
+    int r = m.match("/myfed/atlas/disk/f1");
+    ASSERT_GE(r, 0);
+    m.apply(r, "/myfed/atlas/disk/f1", out);
+    ASSERT_EQ("/disk/f1", out);
+
+    r = m.match("/myfed/atlas/tape/f1");
+    ASSERT_GE(r, 0);
+    m.apply(r, "/myfed/atlas/tape/f1", out);
+    ASSERT_EQ("/dpm/cern.ch/home/atlas/tape/f1", out);
+
+    std::string p = "/myfed/cms/f1";
+    m.applyInPlace(m.match(p), p);
+    ASSERT_EQ("/f1", p);
+
+    ASSERT_EQ(-1, m.match("/myfed/alice/f1"));
+    ASSERT_EQ(-1, m.match("/myfed/atl"));
+
+    // Into a buffer that is too small, like snprintf
+    char buf[16];
+    const char *path = "/myfed/atlas/f1";
+    size_t n = m.apply(m.match(path), path, strlen(path), buf, sizeof(buf), "/st1");
+    ASSERT_EQ(strlen("/st1/dpm/cern.ch/home/atlas/f1"), n);
+    ASSERT_STREQ("/st1/dpm/cern.c", buf);
+
+    // An empty prefix matches anything, after the others
+    m.add("", "/other");
+    r = m.match("/x");
+    ASSERT_GE(r, 0);
+    m.apply(r, "/x", out);
+    ASSERT_EQ("/other/x", out);
+}
+
+
+TEST(prefixMapTests, below){
+    UgrPrefixMap m;
+    m.add("/myfed/atlas/disk", "/");
+    m.add("/myfed/atlas/tape", "/");
+    m.add("/myfed/cms", "/");
+
+    std::vector<int> b;
+    m.below("/myfed/atlas", b);
+    ASSERT_EQ(2u, b.size());
+
+    m.below("/myfed/at", b);
+    ASSERT_EQ(2u, b.size());
+
+    m.below("/myfed/cms", b);
+    ASSERT_EQ(1u, b.size());
+    ASSERT_EQ("/myfed/cms", m.from(b[0]));
+
+    m.below("/myfed/cms/f1", b);
+    ASSERT_EQ(0u, b.size());
+
+    m.below("/", b);
+    ASSERT_EQ(3u, b.size());
+}
@@ -0,0 +1,48 @@
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <UgrPrefixRouter.hh>
+
+
+static std::string route(const UgrPrefixRouter &r, const char *lfn){
+    std::vector<int> v;
+    r.route(lfn, v);
+
+    std::string s;
+    for (unsigned int i = 0; i < v.size(); i++) {
+        if (i) s += ",";
+        s += std::to_string(v[i]);
+    }
+    return s;
+}
+
+
+TEST(prefixRouterTests, route){
+    std::vector< std::vector<std::string> > pfxs(4);
+    pfxs[0].push_back("/atlas/disk");
+    pfxs[0].push_back("/atlasalias");
+    pfxs[1].push_back("/cms");
+    // pfxs[2] serves everything
+    pfxs[3].push_back("/lhcb/a/b");
+
+    UgrPrefixRouter r;
+    r.build(pfxs);
+    ASSERT_EQ(4, r.size());
+
+    // The prefix of the lfn
+    ASSERT_EQ("0,2", route(r, "/atlas/disk/f1"));
+    ASSERT_EQ("0,2", route(r, "/atlasalias/f1"));
+    ASSERT_EQ("1,2", route(r, "/cms/f1"));
+    // The plugins match plain string prefixes, like doNameXlation
+    ASSERT_EQ("1,2", route(r, "/cmsx"));
+
+    // The parent dirs of a prefix
+    ASSERT_EQ("0,1,2,3", route(r, "/"));
+    ASSERT_EQ("0,2", route(r, "/atlas"));
+    ASSERT_EQ("2,3", route(r, "/lhcb/a"));
+    ASSERT_EQ("2", route(r, "/lhc"));
+    ASSERT_EQ("2", route(r, "/atlas/di"));
+
+    ASSERT_EQ("2", route(r, "/alice/f1"));
+    ASSERT_EQ("0,1,2,3", route(r, ""));
+}
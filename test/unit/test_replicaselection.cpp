@@ -0,0 +1,116 @@
+#include <string>
+#include <map>
+#include <set>
+#include <gtest/gtest.h>
+#include <UgrConnector.hh>
+
+
+/// Reaches the replica selection without loading a config
+class SelConnector: public UgrConnector {
+public:
+    using UgrConnector::SelSorted;
+    using UgrConnector::SelP2C;
+    using UgrConnector::SelLfnHash;
+
+    void setSelection(ReplicaSelection sel, unsigned int ncand) {
+        replicaselection = sel;
+        selcandidates = ncand;
+        // No decay while the test runs
+        hostHandler.setHalflife(1000000);
+    }
+
+    void select(UgrReplicaVec &replicas, const std::string &lfn) {
+        selectReplica(replicas, lfn);
+    }
+
+    float load(int pluginID) {
+        return hostHandler.getLoad(pluginID);
+    }
+};
+
+
+static UgrReplicaVec make_replicas(int n){
+    UgrReplicaVec v;
+    for (int i = 0; i < n; i++) {
+        UgrFileItem_replica item;
+        item.name = "http://ep" + std::to_string(i) + "/f";
+        item.pluginID = i;
+        v.push_back(item);
+    }
+    return v;
+}
+
+
+TEST(replicaSelectionTests, p2cSpreads){
+    SelConnector c;
+    c.setSelection(SelConnector::SelP2C, 2);
+
+    // The filters keep giving the same order, the least loaded of the first two is taken
+    std::map<int, int> picks;
+    for (int i = 0; i < 100; i++) {
+        UgrReplicaVec v = make_replicas(4);
+        c.select(v, "/f");
+        ASSERT_EQ(4, v.size());
+        picks[v[0].pluginID]++;
+    }
+
+    // Only the candidates, about half each
+    ASSERT_EQ(2, picks.size());
+    ASSERT_NEAR(50, picks[0], 1);
+    ASSERT_NEAR(50, picks[1], 1);
+    ASSERT_NEAR(50, c.load(0), 2);
+    ASSERT_NEAR(50, c.load(1), 2);
+    ASSERT_EQ(0, c.load(2));
+
+    // The one that is not picked stays behind as a fallback, the others keep their order
+    UgrReplicaVec v = make_replicas(4);
+    c.select(v, "/f");
+    ASSERT_EQ(2, v[2].pluginID);
+    ASSERT_EQ(3, v[3].pluginID);
+}
+
+
+TEST(replicaSelectionTests, lfnhashAffinity){
+    SelConnector c;
+    c.setSelection(SelConnector::SelLfnHash, 3);
+
+    std::map<int, int> picks;
+    for (int i = 0; i < 300; i++) {
+        std::string lfn = "/dir/file" + std::to_string(i);
+
+        UgrReplicaVec v = make_replicas(5);
+        c.select(v, lfn);
+        int first = v[0].pluginID;
+        ASSERT_LT(first, 3);
+        picks[first]++;
+
+        // The same file goes to the same endpoint, whatever the load
+        for (int j = 0; j < 3; j++) {
+            UgrReplicaVec w = make_replicas(5);
+            c.select(w, lfn);
+            ASSERT_EQ(first, w[0].pluginID);
+        }
+
+        // ... and if it is among the candidates, whatever their order
+        UgrReplicaVec r = make_replicas(5);
+        std::swap(r[0], r[2]);
+        c.select(r, lfn);
+        ASSERT_EQ(first, r[0].pluginID);
+    }
+
+    // Different files go to all the candidates
+    ASSERT_EQ(3, picks.size());
+    for (std::map<int, int>::iterator it = picks.begin(); it != picks.end(); ++it)
+        ASSERT_GT(it->second, 50);
+}
+
+
+TEST(replicaSelectionTests, sortedKeepsOrder){
+    SelConnector c;
+    c.setSelection(SelConnector::SelSorted, 2);
+
+    UgrReplicaVec v = make_replicas(3);
+    c.select(v, "/f");
+    ASSERT_EQ(0, v[0].pluginID);
+    ASSERT_EQ(0, c.load(0));
+}
@@ -0,0 +1,229 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include <gtest/gtest.h>
+#include <UgrConnector.hh>
+
+
+// The lists of subitems as they go to the external cache and come back.
+// Values in the cache carry a trailing zero, the decoders are given the same
+
+static UgrConnector &subitems_connector(){
+    static UgrConnector c;
+    return c;
+}
+
+static void fill_subdirs(UgrFileInfo &fi, int n){
+    fi.unixflags = S_IFDIR;
+    for (int i = 0; i < n; i++) {
+        std::ostringstream ss;
+        // Some of them with multibyte UTF-8 chars
+        if (i % 3 == 0) ss << "r\xc3\xa9sum\xc3\xa9_\xe6\x97\xa5\xe6\x9c\xac_" << i;
+        else ss << "file_" << i << ".root";
+        UgrFileItem it;
+        it.name = ss.str();
+        fi.subdirs.insert(it);
+    }
+}
+
+static void fill_replicas(UgrFileInfo &fi, int n){
+    fi.unixflags = S_IFREG;
+    for (int i = 0; i < n; i++) {
+        std::ostringstream ss;
+        ss << "https://storage" << i << ".example.org/\xce\xb1\xce\xb2/file.root";
+        UgrFileItem_replica r;
+        r.name = ss.str();
+        // Some with an empty location
+        if (i % 2) r.location = "Gen\xc3\xa8ve";
+        r.latitude = (float)i / 7.0 - 3.0;
+        r.longitude = -(float)i / 3.0;
+        // Negative means that no plugin owns the replica
+        r.pluginID = (i % 5) - 2;
+        fi.replicas.insert(r);
+    }
+}
+
+/// A copy of the data in a buffer of exactly that size, so that reading past it is an error
+static char *exact_copy(const std::string &s, size_t len){
+    char *p = (char *)malloc(len ? len : 1);
+    memcpy(p, s.data(), len);
+    return p;
+}
+
+static void expect_same_replicas(UgrFileInfo &a, UgrFileInfo &b){
+    ASSERT_EQ(a.replicas.size(), b.replicas.size());
+    std::set<UgrFileItem_replica, UgrFileItemComp>::iterator i, j;
+    for (i = a.replicas.begin(), j = b.replicas.begin(); i != a.replicas.end(); ++i, ++j) {
+        ASSERT_EQ(i->name, j->name);
+        ASSERT_EQ(i->location, j->location);
+        ASSERT_EQ(i->latitude, j->latitude);
+        ASSERT_EQ(i->longitude, j->longitude);
+        ASSERT_EQ(i->pluginID, j->pluginID);
+    }
+}
+
+
+TEST(subitemsTests, subdirs){
+    std::string lfn = "/fed/dir";
+    UgrFileInfo fi(subitems_connector(), lfn);
+    fill_subdirs(fi, 5000);
+
+    std::string s;
+    ASSERT_TRUE(fi.encodeSubitemsToString(s));
+
+    UgrFileInfo fi2(subitems_connector(), lfn);
+    fi2.unixflags = S_IFDIR;
+    ASSERT_EQ(0, fi2.decodeSubitems((void *)s.c_str(), s.length() + 1));
+    ASSERT_EQ(UgrFileInfo::Ok, fi2.getItemsStatus());
+    ASSERT_EQ(fi.subdirs.size(), fi2.subdirs.size());
+    std::set<UgrFileItem, UgrFileItemComp>::iterator i, j;
+    for (i = fi.subdirs.begin(), j = fi2.subdirs.begin(); i != fi.subdirs.end(); ++i, ++j)
+        ASSERT_EQ(i->name, j->name);
+
+    // The same in chunks, each one decoded on its own
+    std::vector<std::string> chunks;
+    ASSERT_TRUE(fi.encodeSubitemsToChunks(chunks, 4096));
+    ASSERT_GT(chunks.size(), 10U);
+
+    UgrFileInfo fi3(subitems_connector(), lfn);
+    fi3.unixflags = S_IFDIR;
+    for (size_t k = 0; k < chunks.size(); k++) {
+        ASSERT_LE(chunks[k].length(), 4096U);
+        ASSERT_EQ(0, fi3.decodeSubitemsChunk(chunks[k].c_str(), chunks[k].length() + 1));
+    }
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi3.getItemsStatus());
+    ASSERT_EQ(fi.subdirs.size(), fi3.subdirs.size());
+    for (i = fi.subdirs.begin(), j = fi3.subdirs.begin(); i != fi.subdirs.end(); ++i, ++j)
+        ASSERT_EQ(i->name, j->name);
+}
+
+
+TEST(subitemsTests, replicas){
+    std::string lfn = "/fed/dir/file";
+    UgrFileInfo fi(subitems_connector(), lfn);
+    fill_replicas(fi, 3000);
+
+    std::string s;
+    ASSERT_TRUE(fi.encodeSubitemsToString(s));
+
+    UgrFileInfo fi2(subitems_connector(), lfn);
+    ASSERT_EQ(0, fi2.decodeSubitems((void *)s.c_str(), s.length() + 1));
+    ASSERT_EQ(UgrFileInfo::Ok, fi2.getLocationStatus());
+    expect_same_replicas(fi, fi2);
+
+    // Only the valid plugin ids become owners
+    ASSERT_EQ(3U, fi2.ownerpluginIDs.size());
+    ASSERT_EQ(0U, fi2.ownerpluginIDs.count(-1));
+
+    std::vector<std::string> chunks;
+    ASSERT_TRUE(fi.encodeSubitemsToChunks(chunks, 8192));
+    ASSERT_GT(chunks.size(), 10U);
+
+    // Without the trailing zero too
+    UgrFileInfo fi3(subitems_connector(), lfn);
+    for (size_t k = 0; k < chunks.size(); k++)
+        ASSERT_EQ(0, fi3.decodeSubitemsChunk(chunks[k].c_str(), chunks[k].length()));
+    expect_same_replicas(fi, fi3);
+}
+
+
+TEST(subitemsTests, truncated){
+    std::string lfn = "/fed/dir/file";
+    UgrFileInfo fi(subitems_connector(), lfn);
+    fill_replicas(fi, 20);
+
+    std::string s;
+    fi.encodeSubitemsToString(s);
+
+    std::map<std::string, UgrFileItem_replica> orig;
+    for (std::set<UgrFileItem_replica, UgrFileItemComp>::iterator i = fi.replicas.begin(); i != fi.replicas.end(); ++i)
+        orig[i->name] = *i;
+
+    // Cut anywhere. The wire format cannot tell a cut between two items, then we get
+    // the items before it, unchanged. Anywhere else nothing is taken
+    int accepted = 0;
+    for (size_t len = 1; len < s.length(); len++) {
+        char *p = exact_copy(s, len);
+        UgrFileInfo fi2(subitems_connector(), lfn);
+        int r = fi2.decodeSubitems(p, len);
+        free(p);
+
+        if (r) {
+            ASSERT_EQ(0U, fi2.replicas.size());
+            ASSERT_NE(UgrFileInfo::Ok, fi2.getLocationStatus());
+            continue;
+        }
+
+        accepted++;
+        ASSERT_LT(fi2.replicas.size(), fi.replicas.size());
+        for (std::set<UgrFileItem_replica, UgrFileItemComp>::iterator i = fi2.replicas.begin(); i != fi2.replicas.end(); ++i) {
+            ASSERT_EQ(1U, orig.count(i->name));
+            ASSERT_EQ(orig[i->name].location, i->location);
+            ASSERT_EQ(orig[i->name].pluginID, i->pluginID);
+        }
+    }
+    ASSERT_EQ(19, accepted);
+
+    // The last item is always cut
+    char *p = exact_copy(s, s.length() - 1);
+    UgrFileInfo fi3(subitems_connector(), lfn);
+    ASSERT_NE(0, fi3.decodeSubitemsChunk(p, s.length() - 1));
+    free(p);
+}
+
+
+TEST(subitemsTests, corrupt){
+    std::string lfn = "/fed/dir";
+    UgrFileInfo fi(subitems_connector(), lfn);
+    fill_subdirs(fi, 10);
+
+    std::string s;
+    fi.encodeSubitemsToString(s);
+
+    // What was there before stays as it is
+    UgrFileInfo fi2(subitems_connector(), lfn);
+    fi2.unixflags = S_IFDIR;
+    UgrFileItem it;
+    it.name = "already_there";
+    fi2.subdirs.insert(it);
+
+    // The length of the first item, way beyond the end of the buffer
+    std::string bad = s;
+    ASSERT_EQ(0x0a, bad[0]);
+    bad[1] = 0x7f;
+    char *p = exact_copy(bad, bad.length());
+    ASSERT_NE(0, fi2.decodeSubitems(p, bad.length()));
+    free(p);
+
+    // A varint that never ends
+    bad = s + std::string(12, '\xff');
+    p = exact_copy(bad, bad.length());
+    ASSERT_NE(0, fi2.decodeSubitems(p, bad.length()));
+    free(p);
+
+    // A zero in the middle is not the end
+    bad = s;
+    bad.insert(bad.begin() + s.length() / 2, 3, '\0');
+    p = exact_copy(bad, bad.length());
+    ASSERT_NE(0, fi2.decodeSubitems(p, bad.length()));
+    free(p);
+
+    // Garbage
+    bad.assign(256, '\0');
+    for (size_t i = 0; i < bad.length(); i++) bad[i] = (char)(i * 37 + 11);
+    p = exact_copy(bad, bad.length());
+    ASSERT_NE(0, fi2.decodeSubitems(p, bad.length()));
+    free(p);
+
+    ASSERT_NE(0, fi2.decodeSubitems((void *)s.c_str(), 0));
+
+    ASSERT_EQ(1U, fi2.subdirs.size());
+    ASSERT_EQ(UgrFileInfo::NoInfo, fi2.getItemsStatus());
+
+    // And the good one still works
+    ASSERT_EQ(0, fi2.decodeSubitems((void *)s.c_str(), s.length() + 1));
+    ASSERT_EQ(11U, fi2.subdirs.size());
+}
@@ -0,0 +1,92 @@
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <boost/thread.hpp>
+#include <UgrTrace.hh>
+
+
+TEST(traceTests, histogram){
+    UgrTrace *t = UgrTrace::get();
+    UgrTrace::Histogram before, after;
+    t->getHistogram(UgrTrace::StgFilter, before);
+
+    // 0us, 3us, 1000us
+    t->record(UgrTrace::StgFilter, 0, 1000, 1000, -1);
+    t->record(UgrTrace::StgFilter, 0, 1000, 4000, -1);
+    t->record(UgrTrace::StgFilter, 0, 1000, 1001000, -1);
+
+    t->getHistogram(UgrTrace::StgFilter, after);
+    ASSERT_EQ(3ULL, after.count - before.count);
+    ASSERT_EQ(1003ULL, after.sumus - before.sumus);
+    ASSERT_EQ(1ULL, after.buckets[0] - before.buckets[0]);
+    ASSERT_EQ(1ULL, after.buckets[2] - before.buckets[2]);
+    ASSERT_EQ(1ULL, after.buckets[10] - before.buckets[10]);
+}
+
+
+static void recordMany(int n) {
+    for (int i = 0; i < n; i++)
+        UgrTrace::get()->record(UgrTrace::StgWait, 0, 1000, 3000, -1);
+}
+
+TEST(traceTests, histogramThreads){
+    UgrTrace *t = UgrTrace::get();
+    UgrTrace::Histogram before, after;
+    t->getHistogram(UgrTrace::StgWait, before);
+
+    // The threads record into different shards, that are summed when read
+    boost::thread_group g;
+    for (int i = 0; i < 16; i++)
+        g.create_thread(boost::bind(recordMany, 1000));
+    g.join_all();
+
+    t->getHistogram(UgrTrace::StgWait, after);
+    ASSERT_EQ(16000ULL, after.count - before.count);
+    ASSERT_EQ(32000ULL, after.sumus - before.sumus);
+    ASSERT_EQ(16000ULL, after.buckets[2] - before.buckets[2]);
+}
+
+
+TEST(traceTests, sampling){
+    UgrTrace *t = UgrTrace::get();
+    std::string fn = "/tmp/ugr_test_trace.json";
+    unlink(fn.c_str());
+
+    // Without a file nothing is traced
+    t->configure(1, "", 100);
+    ASSERT_EQ(0ULL, t->begin());
+
+    t->configure(2, fn, 100);
+    int traced = 0;
+    for (int i = 0; i < 10; i++) {
+        uint64_t id = t->begin();
+        ASSERT_EQ(id, UgrTrace::current());
+        if (id) {
+            traced++;
+            UgrTraceScope s(UgrTrace::StgRequest, 3);
+        }
+    }
+    ASSERT_EQ(5, traced);
+
+    // A worker takes over the request of an op
+    UgrTrace::setCurrent(0);
+    t->record(UgrTrace::StgQueue, UgrTrace::now());
+
+    t->flush();
+    t->configure(0, "", 100);
+
+    std::ifstream f(fn.c_str());
+    std::string line;
+    int n = 0;
+    std::getline(f, line);
+    ASSERT_EQ("[", line);
+    while (std::getline(f, line)) {
+        ASSERT_NE(std::string::npos, line.find("\"name\":\"request\""));
+        ASSERT_NE(std::string::npos, line.find("\"plugin\":3"));
+        n++;
+    }
+    ASSERT_EQ(5, n);
+    unlink(fn.c_str());
+}